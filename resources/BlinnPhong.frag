@@ -1,10 +1,10 @@
 #version 330
+#include "Material.glsl"
 
 // Fragment shader
 
-// Textures
-uniform sampler2D diffuseRamp;
-uniform sampler2D specularRamp;
+// Diffuse plus specular lighting, indexed by (N.L, N.H). Baked from the ramps by LightingLUT.
+uniform sampler2D lightingLUT;
 
 uniform vec3 eye_world;
 
@@ -12,24 +12,30 @@ uniform vec3 eye_world;
 // change for each pixel across the triangle:
 in vec4 interpSurfPosition;
 in vec3 interpSurfNormal;
+in vec2 interpTexCoord;
 
 // This is an out variable for the final color we want to render this fragment.
 out vec4 fragColor;
 
 uniform vec4 lightPosition;
-uniform float specularExponent;
 
+// The diffuse and specular coefficients, intensities and the specular exponent are baked into lightingLUT
 uniform vec3 ambientReflectionCoeff;
-uniform vec3 diffuseReflectionCoeff;
-uniform vec3 specularReflectionCoeff;
-
 uniform vec3 ambientLightIntensity;
-uniform vec3 diffuseLightIntensity;
-uniform vec3 specularLightIntensity;
+
+// The mesh's texture or color, and alphaCutoff, come from Material.glsl
 
 
 void main() {
     
+    // From the model's MaterialBuffer, or the mesh's own texture or color
+    vec4 color = getMaterialColor(interpTexCoord);
+    
+    // Alpha tested (cutout) meshes leave holes where the texture is transparent, and keep writing depth everywhere else
+    if (color.a < alphaCutoff) {
+        discard;
+    }
+    
     // Start with black and then add lighting to the final color as we calculate it
     vec3 finalColor = vec3(0.0, 0.0, 0.0);
     
@@ -46,20 +52,15 @@ void main() {
     // Ambient
     vec3 ambient = ambientReflectionCoeff * ambientLightIntensity;
     
-    // Diffuse
-    vec4 diffuseTex = texture(diffuseRamp, vec2(dotLN, 0.5));
-    vec3 diffuse = diffuseReflectionCoeff * diffuseLightIntensity * diffuseTex.rgb;
-    
-    // Specular
-    vec4 specularTex = texture(specularRamp, vec2(pow(dotHN, specularExponent), 0.5));
-    vec3 specular = specularReflectionCoeff * specularLightIntensity * specularTex.rgb;
+    // Diffuse + Specular
+    vec3 diffuseSpecular = texture(lightingLUT, vec2(dotLN, dotHN)).rgb;
     
-    // TODO: Tell OpenGL to use the r,g,b compenents of materialColor mixed with the reflected color for the color of this fragment (pixel).
-    finalColor = ambient + diffuse + specular;
+    // The r,g,b components of the mesh's color mixed with the reflected color
+    finalColor = (ambient + diffuseSpecular) * color.rgb;
                      
     // Tell OpenGL to use the r,g,b compenents of finalColor for the color of this fragment (pixel).
     fragColor.rgb = finalColor.rgb;
                      
-    // And, set the alpha component to 1.0 (completely opaque, no transparency).
-    fragColor.a = 1.0;
+    // And, keep the mesh's alpha, it only matters for the blended meshes Model::draw draws last
+    fragColor.a = color.a;
 }
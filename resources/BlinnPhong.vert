@@ -23,6 +23,9 @@ out vec4 interpSurfPosition;
 // Normal of the current point on the surface, interpolated across the surface.
 out vec3 interpSurfNormal;
 
+// Texture coordinate of the current point, for the mesh's texture
+out vec2 interpTexCoord;
+
 void main(void)
 {
     // vertex_position is a variable that holds the 3D position of the current vertex.  We want to
@@ -36,6 +39,8 @@ void main(void)
     // bit differently than points.
     interpSurfNormal = normal_mat * vertex_normal;
 
+    interpTexCoord = vertex_texcoord;
+
     // This is the last line of almost every vertex shader program.  We don't need this for our lighting
     // calculations, but it is required by OpenGl.  Whereas a fragment program must output a color
     // as its final result, a vertex program must output a vertex position that has been projected into the
@@ -0,0 +1,67 @@
+// Material lookup for meshes drawn with a MaterialBuffer, and for meshes that bind their own texture or color.
+// Include right after #version (through ShaderManager) so the extension directive comes before any code:
+//
+//   #version 330
+//   #include "Material.glsl"
+//   ...
+//   vec4 color = getMaterialColor(interpTexCoord);
+//   if (color.a < alphaCutoff) discard;
+//   fragColor = color * lighting;
+
+#extension GL_ARB_bindless_texture : enable
+
+// Must match MaterialBuffer::GPUMaterial
+struct MaterialData {
+	vec4 color;
+	uvec2 handle;    // bindless texture handle, low and high 32 bits
+	int arrayIndex;  // which materialArray, -1 if the material has no texture
+	int layer;
+};
+
+// Must match MaterialBuffer::MAX_MATERIALS
+layout(std140) uniform Materials {
+	MaterialData materials[256];
+};
+
+// Set by Mesh::draw, -1 for meshes that are not in a MaterialBuffer
+uniform int materialIndex;
+uniform int useBindless;
+
+// Set by Mesh::draw for meshes that are not in a MaterialBuffer: their texture, or their color when they have none
+uniform int hasTexture;
+uniform sampler2D textureSampler;
+uniform vec4 materialColor;
+
+// Set by Mesh::draw, 0.5 for cutout materials and 0 otherwise: if (color.a < alphaCutoff) discard;
+uniform float alphaCutoff;
+
+// GLSL 330 can only index sampler arrays with constants, so the arrays get a name each (MaterialBuffer::MAX_ARRAYS).
+// MaterialBuffer::setTextureUnits points them at their own units even when nothing is bound there, samplers of
+// different types on one unit fail the draw.
+uniform sampler2DArray materialArray0;
+uniform sampler2DArray materialArray1;
+uniform sampler2DArray materialArray2;
+uniform sampler2DArray materialArray3;
+
+vec4 sampleMaterialArray(int arrayIndex, vec3 coord) {
+	if (arrayIndex == 0) return texture(materialArray0, coord);
+	if (arrayIndex == 1) return texture(materialArray1, coord);
+	if (arrayIndex == 2) return texture(materialArray2, coord);
+	return texture(materialArray3, coord);
+}
+
+vec4 getMaterialColor(vec2 uv) {
+	if (materialIndex < 0) {
+		return (hasTexture != 0) ? texture(textureSampler, uv) : materialColor;
+	}
+	MaterialData m = materials[materialIndex];
+	if (m.arrayIndex < 0 && m.handle == uvec2(0)) {
+		return m.color;
+	}
+#ifdef GL_ARB_bindless_texture
+	if (useBindless != 0) {
+		return m.color * texture(sampler2D(m.handle), uv);
+	}
+#endif
+	return m.color * sampleMaterialArray(m.arrayIndex, vec3(uv, float(m.layer)));
+}
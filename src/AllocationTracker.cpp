@@ -0,0 +1,447 @@
+//
+//  AllocationTracker.cpp
+//
+//
+
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <string>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <cxxabi.h>
+#include <execinfo.h>
+#define ALLOCATION_TRACKER_STACKS
+#endif
+
+// Checked by every operator new, set while the tracker is enabled
+static std::atomic<bool> allocationHook(false);
+
+// Set while the tracker itself runs on this thread, what it and backtrace allocate is not counted
+static thread_local bool insideTracker = false;
+
+namespace basicgraphics {
+
+	// Frames of steady state frames that allocated printed by printReport, the rest are summed up
+	static const int MAX_REPORTED_FRAMES = 20;
+
+	// The entry points the wrappers forward to, saved when they are installed
+	static PFNGLGENBUFFERSPROC realGenBuffers;
+	static PFNGLGENVERTEXARRAYSPROC realGenVertexArrays;
+	static PFNGLGENTEXTURESPROC realGenTextures;
+	static PFNGLGENFRAMEBUFFERSPROC realGenFramebuffers;
+	static PFNGLGENRENDERBUFFERSPROC realGenRenderbuffers;
+	static PFNGLGENQUERIESPROC realGenQueries;
+	static PFNGLCREATEPROGRAMPROC realCreateProgram;
+	static PFNGLCREATESHADERPROC realCreateShader;
+	static PFNGLFENCESYNCPROC realFenceSync;
+
+	struct AllocationTracker::Wrappers {
+
+		static void APIENTRY genBuffers(GLsizei n, GLuint* buffers)
+		{
+			getInstance().recordGLObjects("glGenBuffers", n);
+			realGenBuffers(n, buffers);
+		}
+
+		static void APIENTRY genVertexArrays(GLsizei n, GLuint* arrays)
+		{
+			getInstance().recordGLObjects("glGenVertexArrays", n);
+			realGenVertexArrays(n, arrays);
+		}
+
+		static void APIENTRY genTextures(GLsizei n, GLuint* textures)
+		{
+			getInstance().recordGLObjects("glGenTextures", n);
+			realGenTextures(n, textures);
+		}
+
+		static void APIENTRY genFramebuffers(GLsizei n, GLuint* framebuffers)
+		{
+			getInstance().recordGLObjects("glGenFramebuffers", n);
+			realGenFramebuffers(n, framebuffers);
+		}
+
+		static void APIENTRY genRenderbuffers(GLsizei n, GLuint* renderbuffers)
+		{
+			getInstance().recordGLObjects("glGenRenderbuffers", n);
+			realGenRenderbuffers(n, renderbuffers);
+		}
+
+		static void APIENTRY genQueries(GLsizei n, GLuint* ids)
+		{
+			getInstance().recordGLObjects("glGenQueries", n);
+			realGenQueries(n, ids);
+		}
+
+		static GLuint APIENTRY createProgram()
+		{
+			getInstance().recordGLObjects("glCreateProgram", 1);
+			return realCreateProgram();
+		}
+
+		static GLuint APIENTRY createShader(GLenum type)
+		{
+			getInstance().recordGLObjects("glCreateShader", 1);
+			return realCreateShader(type);
+		}
+
+		static GLsync APIENTRY fenceSync(GLenum condition, GLbitfield flags)
+		{
+			getInstance().recordGLObjects("glFenceSync", 1);
+			return realFenceSync(condition, flags);
+		}
+	};
+
+	void AllocationTracker::Frame::clear(int frameNumber)
+	{
+		number = frameNumber;
+		allocations = 0;
+		bytes = 0;
+		glObjects = 0;
+		numStacks = 0;
+		numUnrecorded = 0;
+	}
+
+	AllocationTracker& AllocationTracker::getInstance()
+	{
+		static AllocationTracker tracker;
+		return tracker;
+	}
+
+	AllocationTracker::AllocationTracker() : _enabled(false), _numWarmupFrames(DEFAULT_WARMUP_FRAMES), _frameNumber(0),
+		_hasAllocatingFrame(false), _numAllocatingFrames(0)
+	{
+		_frame.clear(0);
+		_lastFrame.clear(0);
+		_firstAllocatingFrame.clear(0);
+	}
+
+	void AllocationTracker::setEnabled(bool enabled, int numWarmupFrames /*=DEFAULT_WARMUP_FRAMES*/)
+	{
+		if (enabled == isEnabled()) {
+			return;
+		}
+		if (enabled) {
+			insideTracker = true;
+#ifdef ALLOCATION_TRACKER_STACKS
+			// The first backtrace loads the unwinder, better now than inside a counted frame
+			void* frames[1];
+			backtrace(frames, 1);
+#endif
+			_thread = std::this_thread::get_id();
+			_numWarmupFrames = std::max(numWarmupFrames, 0);
+			_frameNumber = 0;
+			_frame.clear(0);
+			_lastFrame.clear(0);
+			_hasAllocatingFrame = false;
+			_numAllocatingFrames = 0;
+			_history.clear();
+			insideTracker = false;
+		}
+		install(enabled);
+		_enabled.store(enabled, std::memory_order_release);
+		allocationHook.store(enabled, std::memory_order_release);
+	}
+
+	void AllocationTracker::install(bool enabled)
+	{
+		if (enabled) {
+			realGenBuffers = glad_glGenBuffers;
+			realGenVertexArrays = glad_glGenVertexArrays;
+			realGenTextures = glad_glGenTextures;
+			realGenFramebuffers = glad_glGenFramebuffers;
+			realGenRenderbuffers = glad_glGenRenderbuffers;
+			realGenQueries = glad_glGenQueries;
+			realCreateProgram = glad_glCreateProgram;
+			realCreateShader = glad_glCreateShader;
+			realFenceSync = glad_glFenceSync;
+
+			glad_glGenBuffers = Wrappers::genBuffers;
+			glad_glGenVertexArrays = Wrappers::genVertexArrays;
+			glad_glGenTextures = Wrappers::genTextures;
+			glad_glGenFramebuffers = Wrappers::genFramebuffers;
+			glad_glGenRenderbuffers = Wrappers::genRenderbuffers;
+			glad_glGenQueries = Wrappers::genQueries;
+			glad_glCreateProgram = Wrappers::createProgram;
+			glad_glCreateShader = Wrappers::createShader;
+			glad_glFenceSync = Wrappers::fenceSync;
+		}
+		else {
+			glad_glGenBuffers = realGenBuffers;
+			glad_glGenVertexArrays = realGenVertexArrays;
+			glad_glGenTextures = realGenTextures;
+			glad_glGenFramebuffers = realGenFramebuffers;
+			glad_glGenRenderbuffers = realGenRenderbuffers;
+			glad_glGenQueries = realGenQueries;
+			glad_glCreateProgram = realCreateProgram;
+			glad_glCreateShader = realCreateShader;
+			glad_glFenceSync = realFenceSync;
+		}
+	}
+
+	bool AllocationTracker::isCounting() const
+	{
+		return !insideTracker && _enabled.load(std::memory_order_acquire) && std::this_thread::get_id() == _thread;
+	}
+
+	void AllocationTracker::recordAllocation(size_t bytes)
+	{
+		if (!isCounting()) {
+			return;
+		}
+		insideTracker = true;
+		_frame.allocations++;
+		_frame.bytes += bytes;
+		record(nullptr, 1, bytes);
+		insideTracker = false;
+	}
+
+	void AllocationTracker::recordGLObjects(const char* function, int count)
+	{
+		if (!isCounting() || count <= 0) {
+			return;
+		}
+		insideTracker = true;
+		_frame.glObjects += count;
+		record(function, count, 0);
+		insideTracker = false;
+	}
+
+	void AllocationTracker::record(const char* glFunction, unsigned long long count, unsigned long long bytes)
+	{
+		// Loading is expected to allocate, only the steady state frames pay for the stacks
+		if (!isSteady()) {
+			return;
+		}
+
+		Stack stack;
+		stack.depth = 0;
+#ifdef ALLOCATION_TRACKER_STACKS
+		stack.depth = backtrace(stack.frames, MAX_STACK_DEPTH);
+#endif
+		for (int i = 0; i < _frame.numStacks; i++) {
+			Stack &other = _frame.stacks[i];
+			if (other.glFunction == glFunction && other.depth == stack.depth && memcmp(other.frames, stack.frames, stack.depth * sizeof(void*)) == 0) {
+				other.count += count;
+				other.bytes += bytes;
+				return;
+			}
+		}
+		if (_frame.numStacks == MAX_STACKS) {
+			_frame.numUnrecorded += count;
+			return;
+		}
+		stack.glFunction = glFunction;
+		stack.count = count;
+		stack.bytes = bytes;
+		_frame.stacks[_frame.numStacks++] = stack;
+	}
+
+	void AllocationTracker::endFrame()
+	{
+		if (!isEnabled()) {
+			return;
+		}
+		insideTracker = true;
+		if (!_frame.isEmpty()) {
+			FrameCounts counts = { _frame.number, _frame.allocations, _frame.bytes, _frame.glObjects };
+			_history.push_back(counts);
+			if (isSteady()) {
+				_numAllocatingFrames++;
+				if (!_hasAllocatingFrame) {
+					_firstAllocatingFrame = _frame;
+					_hasAllocatingFrame = true;
+				}
+			}
+		}
+		_lastFrame = _frame;
+		_frameNumber++;
+		_frame.clear(_frameNumber);
+		insideTracker = false;
+	}
+
+	int AllocationTracker::getNumFrames() const
+	{
+		return _frameNumber;
+	}
+
+	int AllocationTracker::getNumSteadyFrames() const
+	{
+		return std::max(_frameNumber - _numWarmupFrames, 0);
+	}
+
+	int AllocationTracker::getNumAllocatingFrames() const
+	{
+		return _numAllocatingFrames;
+	}
+
+	void AllocationTracker::printReport(std::ostream &out) const
+	{
+		FrameCounts warmup = { 0, 0, 0, 0 };
+		for (int i = 0; i < _history.size() && _history[i].number < _numWarmupFrames; i++) {
+			warmup.allocations += _history[i].allocations;
+			warmup.bytes += _history[i].bytes;
+			warmup.glObjects += _history[i].glObjects;
+		}
+
+		out << "Allocations on the render thread over " << _frameNumber << " frames" << std::endl;
+		out << "  warmup (" << std::min(_numWarmupFrames, _frameNumber) << " frames): " << warmup.allocations << " allocations, "
+			<< warmup.bytes << " bytes, " << warmup.glObjects << " GL objects" << std::endl;
+		out << "  steady state: " << _numAllocatingFrames << " of " << getNumSteadyFrames() << " frames allocated" << std::endl;
+		if (_numAllocatingFrames == 0) {
+			return;
+		}
+
+		out << "  " << std::setw(8) << "frame" << std::setw(14) << "allocations" << std::setw(12) << "bytes" << std::setw(12) << "GL objects" << std::endl;
+		int numPrinted = 0;
+		for (int i = 0; i < _history.size(); i++) {
+			const FrameCounts &frame = _history[i];
+			if (frame.number < _numWarmupFrames) {
+				continue;
+			}
+			if (numPrinted++ == MAX_REPORTED_FRAMES) {
+				out << "  ... and " << _numAllocatingFrames - MAX_REPORTED_FRAMES << " more" << std::endl;
+				break;
+			}
+			out << "  " << std::setw(8) << frame.number << std::setw(14) << frame.allocations << std::setw(12) << frame.bytes
+				<< std::setw(12) << frame.glObjects << std::endl;
+		}
+
+		out << "First steady state frame that allocated:" << std::endl;
+		printFrame(_firstAllocatingFrame, out);
+	}
+
+#ifdef ALLOCATION_TRACKER_STACKS
+	// The readable name of one backtrace_symbols line, demangled if it has a C++ name
+	static std::string getSymbolName(const char* symbol)
+	{
+		const char* mangled = strstr(symbol, "_Z");
+		if (mangled == nullptr) {
+			return symbol;
+		}
+		const size_t length = strcspn(mangled, "+) ");
+		const std::string name(mangled, length);
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+		if (demangled == nullptr) {
+			return symbol;
+		}
+		const std::string result = demangled;
+		free(demangled);
+		return result;
+	}
+#endif
+
+	void AllocationTracker::printFrame(const Frame &frame, std::ostream &out)
+	{
+		out << "Frame " << frame.number << ": " << frame.allocations << " allocations (" << frame.bytes << " bytes), "
+			<< frame.glObjects << " GL objects" << std::endl;
+		for (int i = 0; i < frame.numStacks; i++) {
+			const Stack &stack = frame.stacks[i];
+			out << "  " << stack.count;
+			if (stack.glFunction != nullptr) {
+				out << " x " << stack.glFunction << std::endl;
+			}
+			else {
+				out << " x new, " << stack.bytes << " bytes" << std::endl;
+			}
+#ifdef ALLOCATION_TRACKER_STACKS
+			char** symbols = backtrace_symbols(stack.frames, stack.depth);
+			if (symbols == nullptr) {
+				continue;
+			}
+			// The innermost frames are the tracker and operator new
+			bool caller = false;
+			for (int f = 0; f < stack.depth; f++) {
+				const std::string name = getSymbolName(symbols[f]);
+				if (!caller && (name.find("AllocationTracker") != std::string::npos || name.find("operator new") != std::string::npos)) {
+					continue;
+				}
+				caller = true;
+				out << "      " << name << std::endl;
+			}
+			free(symbols);
+#endif
+		}
+		if (frame.numUnrecorded > 0) {
+			out << "  " << frame.numUnrecorded << " more from other call stacks" << std::endl;
+		}
+	}
+
+}
+
+// The replaceable global allocation functions, the tracker sees everything allocated with new
+void* operator new(std::size_t size)
+{
+	if (allocationHook.load(std::memory_order_relaxed)) {
+		basicgraphics::AllocationTracker::getInstance().recordAllocation(size);
+	}
+	for (;;) {
+		void* pointer = std::malloc(size == 0 ? 1 : size);
+		if (pointer != nullptr) {
+			return pointer;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void* operator new[](std::size_t size)
+{
+	return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	try {
+		return ::operator new(size);
+	}
+	catch (std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	std::free(pointer);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+#endif
@@ -0,0 +1,130 @@
+/*!
+ *  AllocationTracker.h
+ *
+ * Counts the heap allocations and GL object creations of each frame, with their call stacks, to keep steady state frames allocation free.
+ */
+
+#ifndef AllocationTracker_h
+#define AllocationTracker_h
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** AllocationTracker replaces the global operator new, so every allocation through new, make_shared or a
+	standard container is seen, and glad's glGen* and glCreate* entry points, like GLStats does for its calls.
+	While it is disabled the hook is one relaxed atomic load and the GL pointers are the original ones.
+	Only the thread that enabled it is counted, so the ThreadPool's loaders and the ShaderManager's context
+	are left alone; allocations made by C code such as the GL driver don't go through operator new and aren't seen.
+	The first numWarmupFrames frames load, compile and fill caches, every frame after them is steady state and
+	should neither allocate nor create GL objects. For those frames the call stack of every allocation is kept
+	(on Linux and macOS), the first one that allocated is printed with its stacks by printReport.
+	BaseApp turns it on with --track-allocations, calls endFrame after every frame and prints the report on exit.
+	------------------------------------------------------------------------
+	AllocationTracker &tracker = AllocationTracker::getInstance();
+	tracker.setEnabled(true, 30);
+	... render frames, calling tracker.endFrame() after each ...
+	tracker.printReport(std::cout);
+	if (tracker.getNumAllocatingFrames() > 0) {
+		return 1; // a steady state frame allocated
+	}
+	------------------------------------------------------------------------
+	*/
+	class AllocationTracker
+	{
+	public:
+
+		static const int DEFAULT_WARMUP_FRAMES = 30;
+		static const int MAX_STACK_DEPTH = 16;
+		static const int MAX_STACKS = 64; // distinct call stacks kept per frame, further ones are only counted
+
+		// Where allocations of one call stack came from, innermost frame first
+		struct Stack {
+			void* frames[MAX_STACK_DEPTH];
+			int depth;
+			const char* glFunction; // the GL entry point for GL object creations, otherwise null
+			unsigned long long count;
+			unsigned long long bytes;
+		};
+
+		struct Frame {
+			int number;
+			unsigned long long allocations;
+			unsigned long long bytes;
+			unsigned long long glObjects;
+			Stack stacks[MAX_STACKS];
+			int numStacks;
+			unsigned long long numUnrecorded; // allocations and GL objects whose stack did not fit
+
+			void clear(int frameNumber);
+			bool isEmpty() const { return allocations == 0 && glObjects == 0; }
+		};
+
+		static AllocationTracker& getInstance();
+
+		/*!
+		 * Starts counting the calling thread, which must have the GL context current, or stops. Enabling starts a new report.
+		 */
+		void setEnabled(bool enabled, int numWarmupFrames = DEFAULT_WARMUP_FRAMES);
+		bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+		// Makes the current frame the last one
+		void endFrame();
+
+		const Frame& getLastFrame() const { return _lastFrame; }
+		int getNumFrames() const;
+		int getNumSteadyFrames() const;
+		int getNumAllocatingFrames() const; // steady state frames that allocated or created GL objects
+
+		// Allocations, bytes and GL objects of every frame that had any, and the stacks of the first steady state one
+		void printReport(std::ostream &out) const;
+
+		// Prints one frame with its symbolized call stacks
+		static void printFrame(const Frame &frame, std::ostream &out);
+
+		// Called by operator new and the GL wrappers
+		void recordAllocation(size_t bytes);
+		void recordGLObjects(const char* function, int count);
+
+	private:
+		AllocationTracker();
+		AllocationTracker(const AllocationTracker&) {}; // prevent copying
+
+		struct Wrappers; // the replacement GL entry points, in AllocationTracker.cpp
+
+		struct FrameCounts {
+			int number;
+			unsigned long long allocations;
+			unsigned long long bytes;
+			unsigned long long glObjects;
+		};
+
+		std::atomic<bool> _enabled;
+		std::thread::id _thread;
+		int _numWarmupFrames;
+		int _frameNumber;
+
+		// Fixed size, recording into them never allocates
+		Frame _frame;
+		Frame _lastFrame;
+		Frame _firstAllocatingFrame;
+		bool _hasAllocatingFrame;
+
+		std::vector<FrameCounts> _history; // of the frames that allocated
+		int _numAllocatingFrames;
+
+		bool isCounting() const;
+		bool isSteady() const { return _frameNumber >= _numWarmupFrames; }
+		void record(const char* glFunction, unsigned long long count, unsigned long long bytes);
+		void install(bool enabled);
+	};
+
+}
+
+#endif /* AllocationTracker_h */
@@ -1,4 +1,7 @@
 #include "App.h"
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include <chrono>
 #include <iostream>
 
 namespace basicgraphics{
@@ -6,32 +9,50 @@ namespace basicgraphics{
 using namespace std;
 using namespace glm;
 
-App::App(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight) : BaseApp(argc, argv, windowName, windowWidth, windowHeight) {
+// Where the camera and the light vector point at
+static const vec3 BUNNY_CENTER(-0.3, 0.8, 0);
+
+// Above the units Mesh::draw binds the mesh textures to, and below MaterialBuffer's texture arrays
+static const int LIGHTING_LUT_TEXTURE_UNIT = MaterialBuffer::FIRST_TEXTURE_UNIT - 1;
+
+App::App(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight, bool headless /*=false*/) : BaseApp(argc, argv, windowName, windowWidth, windowHeight, headless) {
 
     glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
 
     // This load shaders from disk, we do it once when the program starts
-    // up, but since you don't need to recompile to reload shaders, you can
-    // even do this inteactively as you debug your shaders!  Press the R
-    // key to reload them while your program is running!
-    reloadShaders();
+    // up. After that the shader manager watches the files and rebuilds the
+    // program in the background whenever you save one of them, so you can
+    // edit your shaders while the program is running! Pressing the R key
+    // forces a reload.
+    {
+        TRACE_SCOPE("startup", "Load shaders");
+        shaderManager.reset(new ShaderManager(_window));
+        shaderManager->addProgram(shader, {"BlinnPhong.vert", "BlinnPhong.frag"});
+        shader.use();
+    }
     
     // This loads the model from a file and initializes an instance of the model class to store it
-    modelMesh.reset(new Model("bunny.obj", 1.0, vec4(1.0)));
-    
-    //Loading textures
-    diffuseRamp = Texture::create2DTextureFromFile("lightingNormal.jpg");
-    diffuseRamp->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    diffuseRamp->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    {
+        TRACE_SCOPE_DETAIL("startup", "Load model", "bunny.obj");
+        modelMesh.reset(new Model("bunny.obj", 1.0, vec4(1.0)));
+        // All of its materials in one buffer, bound once per draw; texture arrays where bindless textures are not supported
+        modelMesh->useMaterialBuffer();
+    }
     
-    specularRamp = Texture::create2DTextureFromFile("lightingNormal.jpg");
-    specularRamp->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    specularRamp->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // Loading the lighting ramps, each pair of diffuse and specular ramps is baked into one lookup table
+    {
+        TRACE_SCOPE("startup", "Load lighting ramps");
+        lightingLUTs.emplace_back(new LightingLUT("lightingNormal.jpg", "lightingNormal.jpg"));
+        lightingLUTs.emplace_back(new LightingLUT("lightingToon.jpg", "lightingToon.jpg"));
+        lightingLUTs.emplace_back(new LightingLUT("lightingFunky.jpg", "lightingFunky.jpg"));
+    }
+    currentLUT = 0;
     
     turntable.reset(new TurntableManipulator(3, 0.3, 0.5));
-    turntable->setCenterPosition(vec3(-0.3,0.8,0));
+    turntable->setCenterPosition(BUNNY_CENTER);
     
     drawLightVector = false;
+    lightVector.reset(new Line(vec3(0.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0), 0.01, vec4(1.0, 1.0, 0.0, 1.0)));
     ambientOnOff = 1.0;
     diffuseOnOff = 1.0;
     specularOnOff = 1.0;
@@ -41,21 +62,33 @@ App::App(int argc, char** argv, std::string windowName, int windowWidth, int win
     
 void App::reloadShaders()
 {
-    shader.compileShader("BlinnPhong.vert", GLSLShader::VERTEX);
-    shader.compileShader("BlinnPhong.frag", GLSLShader::FRAGMENT);
-    shader.link();
-    shader.use();
+    // Rebuilt in the background, the current program stays in use until the new one links
+    TRACE_SCOPE("shaders", "reloadShaders");
+    shaderManager->reloadAll();
 }
     
 
 void App::onEvent(shared_ptr<Event> event)
 {
-    string name = event->getName();
+    const string &name = event->getName();
     
     // Dolly the camera closer or farther away from the earth
     if (name == "kbd_R_down") {
         reloadShaders();
     }
+    // Press C to start/stop writing every frame to the capture directory
+    else if (name == "kbd_C_down") {
+        if (isCapturingFrames()) {
+            stopFrameCapture();
+        }
+        else {
+            startFrameCapture("capture", FrameCapture::FORMAT_QOI);
+        }
+    }
+    // Press 1, 2 or 3 to switch between the normal, toon and funky lighting ramps
+    else if (name == "kbd_1_down" || name == "kbd_2_down" || name == "kbd_3_down") {
+        currentLUT = name[4] - '1';
+    }
     else if (name == "kbd_L_down") {
         drawLightVector = !drawLightVector; // Toggle drawing the vector to the light on or off
     }
@@ -77,6 +110,23 @@ void App::onEvent(shared_ptr<Event> event)
             diffuseOnOff = 1.0;
         }
     }
+    // Press P to show/hide the profiler overlay, showing it also prints the scope times
+    if (name == "kbd_P_down") {
+        Profiler &profiler = Profiler::getInstance();
+        profiler.setOverlayVisible(!profiler.isOverlayVisible());
+        if (profiler.isOverlayVisible()) {
+            profiler.printStats(std::cout);
+        }
+    }
+    // Press G to start counting GL calls, pressing it again prints the counts and stops
+    if (name == "kbd_G_down") {
+        GLStats &glStats = GLStats::getInstance();
+        if (glStats.isEnabled()) {
+            glStats.printFrame(std::cout);
+            glStats.printTotals(std::cout);
+        }
+        glStats.setEnabled(!glStats.isEnabled());
+    }
     // Press A to toggle ambient lighting on/off
     if (name == "kbd_A_down") {
         if (ambientOnOff == 1.0) {
@@ -92,59 +142,302 @@ void App::onEvent(shared_ptr<Event> event)
 }
 
 void App::onRenderGraphics() {
+    // Swap in any shaders that finished rebuilding since the last frame
+    {
+        ProfileScope scope("Shader reload");
+        shaderManager->update();
+    }
+
     double currentT = glfwGetTime();
     totalTime += 0.25*(currentT - lastTime);
     lastTime = currentT;
-    
-    // Make the light orbit around the bunny so we can see the lighting change in response to the light position
-    float radius = 5.0;
-    lightPosition = vec4(cos(totalTime*0.6)*sin(totalTime*0.5)*radius,
-                            cos(totalTime*0.3)*sin(totalTime*0.2)*radius,
-                            cos(totalTime*0.1)*sin(totalTime*0.4)*radius,
-                            1.0);
-    
+    updateLightPosition(totalTime);
     
     // Setup the camera with a good initial position and view direction to see the table
     glm::mat4 view = turntable->frame();
-    glm:mat4 model(1.0);
     // Setup the projection matrix so that things are rendered in perspective
     glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)_windowWidth / (GLfloat)_windowHeight, 0.1f, 100.0f);
-    shader.use(); // Tell opengl we want to use this specific shader.
-    shader.setUniform("view_mat", view);
-    shader.setUniform("projection_mat", projection);
-    shader.setUniform("model_mat", model);
-    shader.setUniform("normal_mat", mat3(transpose(inverse(model))));
-    vec3 eyePosition = turntable->getPos();
-    shader.setUniform("eye_world", eyePosition);
-    diffuseRamp->bind(0);
-    shader.setUniform("diffuseRamp", 0);
-    specularRamp->bind(1);
-    shader.setUniform("specularRamp", 1);
+    drawScene(*modelMesh, view, projection, turntable->getPos(), _windowHeight);
+}
+
+void App::setupTurntable(TurntableRenderer::Settings &settings)
+{
+    // The light stays put so the only thing that changes between frames is the camera
+    updateLightPosition(2.0);
+    
+    settings.width = _windowWidth;
+    settings.height = _windowHeight;
+    settings.center = turntable->getCenterPosition();
+}
+
+TurntableRenderer::Report App::renderTurntable(TurntableRenderer::Settings settings)
+{
+    setupTurntable(settings);
+    TurntableRenderer renderer(settings);
+    return renderer.render([this, &settings](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eyePosition) {
+        drawScene(*modelMesh, view, projection, eyePosition, settings.height);
+    });
+}
+
+int App::serveFarmWorker(int commandFd, int resultFd, TurntableRenderer::Settings settings)
+{
+    // Every worker computes the same camera path, the coordinator only says which frames to render
+    setupTurntable(settings);
+    TurntableRenderer renderer(settings);
+    TurntableRenderer::DrawFunction draw = [this, &settings](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eyePosition) {
+        drawScene(*modelMesh, view, projection, eyePosition, settings.height);
+    };
+    return RenderFarm::serveWorker(commandFd, resultFd, [&](int firstFrame, int count) {
+        return renderer.render(draw, firstFrame, count);
+    });
+}
+
+bool App::renderPoster(const std::string &fileName, const PosterRenderer::Settings &settings)
+{
+    updateLightPosition(2.0);
+    
+    glm::mat4 view = turntable->frame();
+    glm::vec3 eyePosition = turntable->getPos();
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)settings.width / (GLfloat)settings.height, 0.1f, 100.0f);
+    PosterRenderer poster(settings);
+    return poster.render(fileName, projection, [&](const glm::mat4 &tileProjection, int tileHeight) {
+        drawScene(*modelMesh, view, tileProjection, eyePosition, tileHeight);
+    });
+}
+
+bool App::serve(const std::string &address)
+{
+    RenderService service(address, "bunny.obj");
+    std::string error;
+    if (!service.start(error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::cout << "Serving renders on " << address << std::endl;
+    
+    // Each request brings its own camera, light and lighting style (style=normal, toon or funky)
+    RenderService::DrawFunction draw = [this](const RenderService::Request &request, Model &requestModel, const glm::mat4 &view, const glm::mat4 &projection) {
+        if (request.program != "default" && request.program != "blinnphong") {
+            return false;
+        }
+        std::map<std::string, std::string>::const_iterator style = request.parameters.find("style");
+        currentLUT = 0;
+        if (style != request.parameters.end()) {
+            currentLUT = (style->second == "toon") ? 1 : (style->second == "funky") ? 2 : 0;
+        }
+        lightPosition = vec4(request.light, 1.0);
+        drawScene(requestModel, view, projection, request.eye, request.height);
+        return true;
+    };
+    
+    while (!_exitRequested && (_window == nullptr || !glfwWindowShouldClose(_window))) {
+        shaderManager->update();
+        TextureLoader::getInstance().update();
+        TextureStreamer::getInstance().update();
+        service.update(draw);
+        if (_window != nullptr) {
+            glfwPollEvents();
+        }
+    }
+    return true;
+}
+
+int App::renderSoftware(const std::string &fileName, int width, int height, int numFrames, bool compareGL /*=false*/)
+{
+    std::vector<Mesh::Vertex> vertices;
+    std::vector<int> indices;
+    if (!Model::loadGeometry("bunny.obj", 1.0, vertices, indices)) {
+        return 1;
+    }
+    
+    // The same scene the GL path draws with the normal lighting style, seen from the starting camera
+    Lighting lighting = getDefaultLighting();
+    LightingLUT lut("lightingNormal.jpg", "lightingNormal.jpg");
+    lut.setSpecularExponent(lighting.specularExponent);
+    lut.setScales(lighting.diffuseReflectionCoeff * lighting.diffuseLightIntensity, lighting.specularReflectionCoeff * lighting.specularLightIntensity);
+    
+    TurntableManipulator camera(3, 0.3, 0.5);
+    camera.setCenterPosition(BUNNY_CENTER);
+    glm::mat4 view = camera.frame();
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)width / (GLfloat)height, 0.1f, 100.0f);
+    
+    SoftwareRasterizer::Lighting rasterizerLighting;
+    rasterizerLighting.lightPosition = vec3(getLightPosition(2.0));
+    rasterizerLighting.eyePosition = camera.getPos();
+    rasterizerLighting.ambient = lighting.ambientReflectionCoeff * lighting.ambientLightIntensity;
+    rasterizerLighting.table = &lut.getTable()[0];
+    rasterizerLighting.tableSize = lut.getSize();
+    rasterizerLighting.tableRows = lut.getNumRows();
+    
+    SoftwareRasterizer rasterizer(width, height);
+    double totalSeconds = 0.0;
+    for (int frame = 0; frame < numFrames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        rasterizer.clear(vec4(0.2f, 0.2f, 0.2f, 1.0f));
+        rasterizer.draw(vertices, indices, mat4(1.0), view, projection, rasterizerLighting);
+        totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    cout << "Software rasterizer: " << indices.size() / 3 << " triangles at " << width << "x" << height << " on " << ThreadPool::getShared().getNumThreads() << " threads, "
+        << 1000.0 * totalSeconds / numFrames << " ms per frame (" << numFrames / totalSeconds << " fps)" << endl;
+    
+    std::vector<unsigned char> pixels;
+    rasterizer.readPixels(3, pixels);
+    std::string error;
+    if (!ImageWriter::write(fileName, width, height, 3, &pixels[0], error)) {
+        cerr << error << endl;
+        return 1;
+    }
     
+    if (compareGL) {
+        char name[] = "software";
+        char* arguments[] = { name };
+        App app(1, arguments, "Software rasterizer comparison", width, height, true);
+        const double milliseconds = app.timeSoftwareView(numFrames);
+        cout << "GL (" << (const char*)glGetString(GL_RENDERER) << "): " << indices.size() / 3 << " triangles at " << width << "x" << height << ", "
+            << milliseconds << " ms per frame (" << 1000.0 / milliseconds << " fps)" << endl;
+    }
+    return 0;
+}
+
+double App::timeSoftwareView(int numFrames)
+{
+    // The starting camera, the light where renderSoftware puts it and the normal lighting style
+    TurntableManipulator camera(3, 0.3, 0.5);
+    camera.setCenterPosition(BUNNY_CENTER);
+    const glm::mat4 view = camera.frame();
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)_windowWidth / (GLfloat)_windowHeight, 0.1f, 100.0f);
+    updateLightPosition(2.0);
+    currentLUT = 0;
+    
+    // The first frame compiles shader variants and uploads the mesh, like the software path's untimed loadGeometry
+    double totalSeconds = 0.0;
+    for (int frame = -1; frame < numFrames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        _framebuffer->bind();
+        glViewport(0, 0, _windowWidth, _windowHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawScene(*modelMesh, view, projection, camera.getPos(), _windowHeight);
+        _framebuffer->resolve();
+        // llvmpipe draws when the commands are flushed, finishing each frame times the rendering and not just the submission
+        glFinish();
+        if (frame >= 0) {
+            totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    return 1000.0 * totalSeconds / numFrames;
+}
+
+int App::renderPathTraced(const std::string &directory, int width, int height, int numSamples)
+{
+    std::vector<Mesh::Vertex> vertices;
+    std::vector<int> indices;
+    if (!Model::loadGeometry("bunny.obj", 1.0, vertices, indices)) {
+        return 1;
+    }
+    
+    PathTracer::Settings settings;
+    settings.width = width;
+    settings.height = height;
+    PathTracer tracer(settings, vertices, indices);
+    
+    TurntableManipulator camera(3, 0.3, 0.5);
+    camera.setCenterPosition(BUNNY_CENTER);
+    tracer.setCamera(camera.frame(), glm::perspective(glm::radians(45.0f), (GLfloat)width / (GLfloat)height, 0.1f, 100.0f));
+    
+    Lighting lighting = getDefaultLighting();
+    PathTracer::Material material;
+    material.ambient = lighting.ambientReflectionCoeff;
+    material.diffuse = lighting.diffuseReflectionCoeff;
+    material.specular = lighting.specularReflectionCoeff;
+    material.specularExponent = lighting.specularExponent;
+    tracer.setMaterial(material);
+    
+    // A bit larger than the debug sphere the raster path draws, for visibly soft shadows
+    PathTracer::Light light;
+    light.position = vec3(getLightPosition(2.0));
+    light.radius = 0.25f;
+    light.ambientIntensity = lighting.ambientLightIntensity;
+    light.diffuseIntensity = lighting.diffuseLightIntensity;
+    light.specularIntensity = lighting.specularLightIntensity;
+    tracer.setLight(light);
+    
+    FrameCapture capture(directory, "pathtrace");
+    for (int sample = 1; sample <= numSamples; sample++) {
+        tracer.renderPass();
+        if ((sample & (sample - 1)) == 0 || sample == numSamples) {
+            capture.captureImage(tracer.getImage());
+            const PathTracer::Stats stats = tracer.getStats();
+            cout << sample << " samples per pixel, " << stats.raysPerSecond / 1e6 << " Mrays/s" << endl;
+        }
+    }
+    capture.finish();
+    tracer.getStats().print(cout);
+    return capture.getNumWritten() == capture.getNumCaptured() ? 0 : 1;
+}
+
+void App::updateLightPosition(double time)
+{
+    lightPosition = getLightPosition(time);
+}
+
+glm::vec4 App::getLightPosition(double time)
+{
+    // Make the light orbit around the bunny so we can see the lighting change in response to the light position
+    float radius = 5.0;
+    return vec4(cos(time*0.6)*sin(time*0.5)*radius,
+                cos(time*0.3)*sin(time*0.2)*radius,
+                cos(time*0.1)*sin(time*0.4)*radius,
+                1.0);
+}
+
+App::Lighting App::getDefaultLighting()
+{
+    Lighting lighting;
     
     // Properties of the material the model is made out of (the "K" terms in the equations discussed in class)
     // These values should make the model look like it is made out of a metal, like brass
     
-    vec3 ambientReflectionCoeff = vec3(0.4125, 0.275, 0.0375);
-    vec3 diffuseReflectionCoeff = vec3(0.78, 0.57, 0.11);
-    vec3 specularReflectionCoeff = vec3(0.99, 0.94, 0.80);
-    float specularExponent = 27.9;
+    lighting.ambientReflectionCoeff = vec3(0.4125, 0.275, 0.0375);
+    lighting.diffuseReflectionCoeff = vec3(0.78, 0.57, 0.11);
+    lighting.specularReflectionCoeff = vec3(0.99, 0.94, 0.80);
+    lighting.specularExponent = 27.9;
     
     
     // For toon shading, you want all the color to come from the texture, so you can just use a white bunny like this:
     
-//     vec3 ambientReflectionCoeff = vec3(1,1,1);
-//     vec3 diffuseReflectionCoeff = vec3(1,1,1);
-//     vec3 specularReflectionCoeff = vec3(1,1,1);
-//     float specularExponent = 50.0;
+//     lighting.ambientReflectionCoeff = vec3(1,1,1);
+//     lighting.diffuseReflectionCoeff = vec3(1,1,1);
+//     lighting.specularReflectionCoeff = vec3(1,1,1);
+//     lighting.specularExponent = 50.0;
     
     
     // Properties of the light source (the "I" terms in the equations discussed in class)
     // These values are for a white light so the r,g,b intensities are all the same
-    // Note: lightPosition is another important property of the light; it is set at the top of the method
-    vec3 ambientLightIntensity = vec3(0.4, 0.4, 0.4);
-    vec3 diffuseLightIntensity = vec3(0.6, 0.6, 0.6);
-    vec3 specularLightIntensity = vec3(1.0, 1.0, 1.0);
+    // Note: lightPosition is another important property of the light; it is set in updateLightPosition
+    lighting.ambientLightIntensity = vec3(0.4, 0.4, 0.4);
+    lighting.diffuseLightIntensity = vec3(0.6, 0.6, 0.6);
+    lighting.specularLightIntensity = vec3(1.0, 1.0, 1.0);
+    return lighting;
+}
+
+void App::drawScene(Model &mesh, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eyePosition, int viewportHeight) {
+    glm:mat4 model(1.0);
+    shader.use(); // Tell opengl we want to use this specific shader.
+    shader.setUniform("view_mat", view);
+    shader.setUniform("projection_mat", projection);
+    shader.setUniform("model_mat", model);
+    shader.setUniform("normal_mat", mat3(transpose(inverse(model))));
+    shader.setUniform("eye_world", eyePosition);
+    
+    
+    Lighting lighting = getDefaultLighting();
+    vec3 ambientReflectionCoeff = lighting.ambientReflectionCoeff;
+    vec3 diffuseReflectionCoeff = lighting.diffuseReflectionCoeff;
+    vec3 specularReflectionCoeff = lighting.specularReflectionCoeff;
+    float specularExponent = lighting.specularExponent;
+    vec3 ambientLightIntensity = lighting.ambientLightIntensity;
+    vec3 diffuseLightIntensity = lighting.diffuseLightIntensity;
+    vec3 specularLightIntensity = lighting.specularLightIntensity;
     
     // Multiply these light intensities by the OnOff terms below to turn each commonent on the lighting on/off based on keystrokes
     ambientLightIntensity *= ambientOnOff;
@@ -155,19 +448,26 @@ void App::onRenderGraphics() {
     // TODO: Pass these parameters into your shader programs... in shader programs these are called "uniform variables"
     
     shader.setUniform("lightPosition", lightPosition);
-    shader.setUniform("specularExponent", specularExponent);
     
     shader.setUniform("ambientReflectionCoeff", ambientReflectionCoeff);
-    shader.setUniform("diffuseReflectionCoeff", diffuseReflectionCoeff);
-    shader.setUniform("specularReflectionCoeff",specularReflectionCoeff);
-    
     shader.setUniform("ambientLightIntensity", ambientLightIntensity);
-    shader.setUniform("diffuseLightIntensity", diffuseLightIntensity);
-    shader.setUniform("specularLightIntensity",specularLightIntensity);
+    
+    // The diffuse and specular terms are baked into the lookup table, it is only rebaked when these change
+    LightingLUT &lut = *lightingLUTs[currentLUT];
+    lut.setSpecularExponent(specularExponent);
+    lut.setScales(diffuseReflectionCoeff * diffuseLightIntensity, specularReflectionCoeff * specularLightIntensity);
+    lut.bind(shader, "lightingLUT", LIGHTING_LUT_TEXTURE_UNIT);
+    
+    // BlinnPhong.frag includes Material.glsl, its texture arrays need their own units even for models without a MaterialBuffer
+    MaterialBuffer::setTextureUnits(shader);
     
 
-    // Draw the model
-    modelMesh->draw(shader);
+    // Draw the model, streaming in as much texture detail as its size on screen needs
+    {
+        ProfileScope scope("Bunny");
+        mesh.requestTextureResolution(projection * view * model, viewportHeight);
+        mesh.draw(shader, vec3(inverse(model) * vec4(eyePosition, 1.0)));
+    }
     
     // For debugging purposes, let's draw a sphere to reprsent each "light bulb" in the scene, that way
     // we can make sure the lighting on the bunny makes sense given the position of each light source.
@@ -176,10 +476,11 @@ void App::onRenderGraphics() {
     
     // Another useful aid for debugging: draw vectors to the light sources
     if (drawLightVector) {
-        vec3 toLight = vec3(lightPosition) - vec3(-0.3,0.8,0);
+        vec3 toLight = vec3(lightPosition) - BUNNY_CENTER;
         vec3 normal = normalize(cross(toLight, cross(toLight, vec3(0,1,0))));
-        Line l(vec3(-0.3,0.8,0), vec3(lightPosition), normal, 0.01, vec4(1.0, 1.0, 0.0, 1.0));
-        l.draw(shader, model);
+        // Maps the unit ribbon onto the one from the bunny to the light instead of making a new Line every frame
+        mat4 lineFrame(vec4(toLight, 0.0), vec4(normalize(cross(normal, toLight)), 0.0), vec4(normal, 0.0), vec4(BUNNY_CENTER, 1.0));
+        lightVector->draw(shader, model * lineFrame);
     }
 
 
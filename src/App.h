@@ -5,35 +5,85 @@
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
 #include "TurntableManipulator.h"
+#include "ShaderManager.h"
+#include "LightingLUT.h"
+#include "TurntableRenderer.h"
+#include "PosterRenderer.h"
+#include "RenderService.h"
+#include "RenderFarm.h"
+#include "SoftwareRasterizer.h"
+#include "PathTracer.h"
 
 namespace basicgraphics {
 class App : public BaseApp {
 public:
   
-    App(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight);
+    App(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight, bool headless = false);
     ~App(){};
   
     void onRenderGraphics() override;
     void onEvent(std::shared_ptr<Event> event) override;
+    
+    // Renders a full orbit around the bunny to an image sequence at the --size resolution, as fast as possible
+    TurntableRenderer::Report renderTurntable(TurntableRenderer::Settings settings);
+    
+    // Renders the current view as one image of any size, in tiles, straight to a .png or .raw file
+    bool renderPoster(const std::string &fileName, const PosterRenderer::Settings &settings);
+    
+    // Renders the turntable chunks a RenderFarm coordinator sends over the pipes, returns the exit code
+    int serveFarmWorker(int commandFd, int resultFd, TurntableRenderer::Settings settings);
+    
+    // Answers render requests on address until requestExit() or the window is closed, see RenderService
+    bool serve(const std::string &address);
+    
+    // Renders the bunny numFrames times with the SoftwareRasterizer, without a window or GL, and writes the last frame to fileName.
+    // With compareGL the same view is then timed through the GL path on a headless context (llvmpipe with LIBGL_ALWAYS_SOFTWARE=1).
+    static int renderSoftware(const std::string &fileName, int width, int height, int numFrames, bool compareGL = false);
+    
+    // Path traces the same view with numSamples samples per pixel, writing the image to directory each time the count doubles
+    static int renderPathTraced(const std::string &directory, int width, int height, int numSamples);
 
   
 protected:
     
+    // Material ("K") and light ("I") terms of the lighting model, before the on/off keys are applied
+    struct Lighting {
+        glm::vec3 ambientReflectionCoeff;
+        glm::vec3 diffuseReflectionCoeff;
+        glm::vec3 specularReflectionCoeff;
+        float specularExponent;
+        glm::vec3 ambientLightIntensity;
+        glm::vec3 diffuseLightIntensity;
+        glm::vec3 specularLightIntensity;
+    };
+    static Lighting getDefaultLighting();
+    static glm::vec4 getLightPosition(double time);
+    
     double lastTime;
     double totalTime;
     
     virtual void reloadShaders();
     
-    std::shared_ptr<Texture> diffuseRamp;
-    std::shared_ptr<Texture> specularRamp;
+    void updateLightPosition(double time);
+    void setupTurntable(TurntableRenderer::Settings &settings);
+    void drawScene(Model &mesh, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eyePosition, int viewportHeight);
+    
+    // Milliseconds per frame for drawing the view renderSoftware draws into the headless framebuffer, after one warmup frame
+    double timeSoftwareView(int numFrames);
+    
+    // One baked table per lighting style (normal, toon, funky), switched with the 1, 2 and 3 keys
+    std::vector<std::unique_ptr<LightingLUT>> lightingLUTs;
+    int currentLUT;
     
     GLSLProgram shader;
+    std::unique_ptr<ShaderManager> shaderManager;
     
     std::unique_ptr<Model> modelMesh;
     std::shared_ptr<TurntableManipulator> turntable;
     
     glm::vec4 lightPosition;
     bool drawLightVector;
+    std::unique_ptr<Line> lightVector; // a unit ribbon along x facing z, drawScene stretches it to the light
     float diffuseOnOff;  // 1.0 when on, 0.0 when off
     float specularOnOff; // 1.0 when on, 0.0 when off
     float ambientOnOff;  // 1.0 when on, 0.0 when off
@@ -0,0 +1,550 @@
+//
+//  BVH.cpp
+//
+//
+
+#include "BVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_USE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BVH_USE_NEON
+#endif
+
+namespace basicgraphics {
+
+	// Nodes with more triangles than this are binned on several threads and build their children in parallel
+	static const int PARALLEL_BINNING_SIZE = 65536;
+	static const int PARALLEL_BUILD_SIZE = 4096;
+	static const int STACK_SIZE = 128;
+
+	// Relative cost of a ray-box test against a ray-triangle test in the surface area heuristic
+	static const float TRAVERSAL_COST = 1.0f;
+	static const float INTERSECTION_COST = 1.0f;
+
+	/** Four floats processed together, just what testing four boxes needs. */
+	struct Float4
+	{
+#if defined(BVH_USE_SSE)
+		__m128 v;
+
+		Float4() {}
+		Float4(__m128 value) : v(value) {}
+		Float4(float value) : v(_mm_set1_ps(value)) {}
+		static Float4 load(const float* p) { return _mm_loadu_ps(p); }
+		void store(float* p) const { _mm_storeu_ps(p, v); }
+
+		friend Float4 operator-(const Float4 &a, const Float4 &b) { return _mm_sub_ps(a.v, b.v); }
+		friend Float4 operator*(const Float4 &a, const Float4 &b) { return _mm_mul_ps(a.v, b.v); }
+		friend Float4 min(const Float4 &a, const Float4 &b) { return _mm_min_ps(a.v, b.v); }
+		friend Float4 max(const Float4 &a, const Float4 &b) { return _mm_max_ps(a.v, b.v); }
+		// One bit per lane that is set where a <= b
+		friend int lessEqualMask(const Float4 &a, const Float4 &b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+#elif defined(BVH_USE_NEON)
+		float32x4_t v;
+
+		Float4() {}
+		Float4(float32x4_t value) : v(value) {}
+		Float4(float value) : v(vdupq_n_f32(value)) {}
+		static Float4 load(const float* p) { return vld1q_f32(p); }
+		void store(float* p) const { vst1q_f32(p, v); }
+
+		friend Float4 operator-(const Float4 &a, const Float4 &b) { return vsubq_f32(a.v, b.v); }
+		friend Float4 operator*(const Float4 &a, const Float4 &b) { return vmulq_f32(a.v, b.v); }
+		friend Float4 min(const Float4 &a, const Float4 &b) { return vminq_f32(a.v, b.v); }
+		friend Float4 max(const Float4 &a, const Float4 &b) { return vmaxq_f32(a.v, b.v); }
+		friend int lessEqualMask(const Float4 &a, const Float4 &b)
+		{
+			uint32_t lanes[4];
+			vst1q_u32(lanes, vcleq_f32(a.v, b.v));
+			return (lanes[0] & 1) | ((lanes[1] & 1) << 1) | ((lanes[2] & 1) << 2) | ((lanes[3] & 1) << 3);
+		}
+#else
+		float v[4];
+
+		Float4() {}
+		Float4(float value) { v[0] = v[1] = v[2] = v[3] = value; }
+		static Float4 load(const float* p) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+		void store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+
+		friend Float4 operator-(const Float4 &a, const Float4 &b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+		friend Float4 operator*(const Float4 &a, const Float4 &b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+		friend Float4 min(const Float4 &a, const Float4 &b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = std::min(a.v[i], b.v[i]); return r; }
+		friend Float4 max(const Float4 &a, const Float4 &b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = std::max(a.v[i], b.v[i]); return r; }
+		friend int lessEqualMask(const Float4 &a, const Float4 &b) { int r = 0; for (int i = 0; i < 4; i++) r |= (a.v[i] <= b.v[i]) << i; return r; }
+#endif
+	};
+
+	static float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+	{
+		const glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	// Bounds of the triangles and of their centroids
+	struct Bin {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 centroidMin;
+		glm::vec3 centroidMax;
+		int count;
+
+		Bin() : boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max()),
+			centroidMin(std::numeric_limits<float>::max()), centroidMax(-std::numeric_limits<float>::max()), count(0) {}
+		void add(const glm::vec3 &primitiveMin, const glm::vec3 &primitiveMax, const glm::vec3 &centroid)
+		{
+			boundsMin = glm::min(boundsMin, primitiveMin);
+			boundsMax = glm::max(boundsMax, primitiveMax);
+			centroidMin = glm::min(centroidMin, centroid);
+			centroidMax = glm::max(centroidMax, centroid);
+			count++;
+		}
+		void merge(const Bin &other)
+		{
+			if (other.count > 0) {
+				boundsMin = glm::min(boundsMin, other.boundsMin);
+				boundsMax = glm::max(boundsMax, other.boundsMax);
+				centroidMin = glm::min(centroidMin, other.centroidMin);
+				centroidMax = glm::max(centroidMax, other.centroidMax);
+				count += other.count;
+			}
+		}
+	};
+
+	struct BVH::BuildContext {
+		std::vector<glm::vec3> primitiveMin;
+		std::vector<glm::vec3> primitiveMax;
+		std::vector<glm::vec3> centroids;
+		std::vector<int> primitives; /// triangle indices, partitioned in place
+		std::vector<BuildNode> nodes;
+		std::atomic<int> numNodes;
+	};
+
+	BVH::Ray::Ray(const glm::vec3 &origin, const glm::vec3 &direction, float tMin /*=0.0f*/, float tMax /*=1e30f*/) :
+		origin(origin), direction(direction), tMin(tMin), tMax(tMax)
+	{
+	}
+
+	BVH::BVH() : _boundsMin(0.0f), _boundsMax(0.0f)
+	{
+	}
+
+	BVH::~BVH()
+	{
+	}
+
+	void BVH::build(const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices)
+	{
+		_nodes.clear();
+		_triangles.clear();
+		const int numTriangles = indices.size() / 3;
+		if (numTriangles == 0) {
+			return;
+		}
+
+		BuildContext context;
+		context.primitiveMin.resize(numTriangles);
+		context.primitiveMax.resize(numTriangles);
+		context.centroids.resize(numTriangles);
+		context.primitives.resize(numTriangles);
+		// A binary tree over n leaves has at most 2n - 1 nodes
+		context.nodes.resize(2 * numTriangles);
+		context.numNodes = 0;
+
+		const int trianglesPerTask = 16384;
+		ThreadPool::getShared().parallelFor(0, (numTriangles + trianglesPerTask - 1) / trianglesPerTask, [&](int task) {
+			const int end = std::min(numTriangles, (task + 1) * trianglesPerTask);
+			for (int i = task * trianglesPerTask; i < end; i++) {
+				const glm::vec3 &a = vertices[indices[i * 3]].position;
+				const glm::vec3 &b = vertices[indices[i * 3 + 1]].position;
+				const glm::vec3 &c = vertices[indices[i * 3 + 2]].position;
+				context.primitiveMin[i] = glm::min(glm::min(a, b), c);
+				context.primitiveMax[i] = glm::max(glm::max(a, b), c);
+				context.centroids[i] = (context.primitiveMin[i] + context.primitiveMax[i]) * 0.5f;
+				context.primitives[i] = i;
+			}
+		});
+
+		Bin all;
+		for (int i = 0; i < numTriangles; i++) {
+			all.add(context.primitiveMin[i], context.primitiveMax[i], context.centroids[i]);
+		}
+		_boundsMin = all.boundsMin;
+		_boundsMax = all.boundsMax;
+
+		const int root = buildNode(context, 0, numTriangles, all.boundsMin, all.boundsMax, all.centroidMin, all.centroidMax);
+
+		// Triangles in leaf order, so a leaf is a contiguous range
+		_triangles.resize(numTriangles);
+		ThreadPool::getShared().parallelFor(0, (numTriangles + trianglesPerTask - 1) / trianglesPerTask, [&](int task) {
+			const int end = std::min(numTriangles, (task + 1) * trianglesPerTask);
+			for (int i = task * trianglesPerTask; i < end; i++) {
+				const int index = context.primitives[i];
+				const glm::vec3 &a = vertices[indices[index * 3]].position;
+				_triangles[i].v0 = a;
+				_triangles[i].edge1 = vertices[indices[index * 3 + 1]].position - a;
+				_triangles[i].edge2 = vertices[indices[index * 3 + 2]].position - a;
+				_triangles[i].index = index;
+			}
+		});
+
+		_nodes.reserve(context.numNodes / 2 + 1);
+		collapse(context, root);
+	}
+
+	int BVH::buildNode(BuildContext &context, int first, int count, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+		const glm::vec3 &centroidMin, const glm::vec3 &centroidMax)
+	{
+		const int index = context.numNodes++;
+		BuildNode &node = context.nodes[index];
+		node.boundsMin = boundsMin;
+		node.boundsMax = boundsMax;
+		node.children[0] = node.children[1] = -1;
+		node.first = first;
+		node.count = count;
+		if (count <= 2) {
+			return index;
+		}
+
+		// Bin the centroids along all three axes, in slices on several threads for large nodes
+		const glm::vec3 extent = centroidMax - centroidMin;
+		const glm::vec3 binScale(extent.x > 0.0f ? NUM_BINS * 0.9999f / extent.x : 0.0f,
+			extent.y > 0.0f ? NUM_BINS * 0.9999f / extent.y : 0.0f,
+			extent.z > 0.0f ? NUM_BINS * 0.9999f / extent.z : 0.0f);
+		const int numSlices = count > PARALLEL_BINNING_SIZE ? std::min(count / (PARALLEL_BINNING_SIZE / 4), 64) : 1;
+		Bin bins[3][NUM_BINS];
+		std::vector<Bin> sliceBins(numSlices > 1 ? (size_t)numSlices * 3 * NUM_BINS : 0);
+		auto binSlice = [&](int slice) {
+			const int begin = first + (int)((long long)count * slice / numSlices);
+			const int end = first + (int)((long long)count * (slice + 1) / numSlices);
+			Bin* sliceBin = numSlices > 1 ? &sliceBins[(size_t)slice * 3 * NUM_BINS] : &bins[0][0];
+			for (int i = begin; i < end; i++) {
+				const int primitive = context.primitives[i];
+				const glm::vec3 &centroid = context.centroids[primitive];
+				const glm::vec3 position = (centroid - centroidMin) * binScale;
+				for (int axis = 0; axis < 3; axis++) {
+					sliceBin[axis * NUM_BINS + (int)position[axis]].add(context.primitiveMin[primitive], context.primitiveMax[primitive], centroid);
+				}
+			}
+		};
+		if (numSlices > 1) {
+			ThreadPool::getShared().parallelFor(0, numSlices, binSlice);
+			for (int slice = 0; slice < numSlices; slice++) {
+				for (int axis = 0; axis < 3; axis++) {
+					for (int b = 0; b < NUM_BINS; b++) {
+						bins[axis][b].merge(sliceBins[((size_t)slice * 3 + axis) * NUM_BINS + b]);
+					}
+				}
+			}
+		}
+		else {
+			binSlice(0);
+		}
+
+		// Sweep from both sides for the cost of splitting after each bin
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		int bestSplit = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			if (extent[axis] <= 0.0f) {
+				continue;
+			}
+			float rightArea[NUM_BINS];
+			int rightCount[NUM_BINS];
+			Bin right;
+			for (int b = NUM_BINS - 1; b > 0; b--) {
+				right.merge(bins[axis][b]);
+				rightArea[b] = surfaceArea(right.boundsMin, right.boundsMax);
+				rightCount[b] = right.count;
+			}
+			Bin left;
+			for (int b = 0; b < NUM_BINS - 1; b++) {
+				left.merge(bins[axis][b]);
+				if (left.count == 0 || rightCount[b + 1] == 0) {
+					continue;
+				}
+				const float cost = surfaceArea(left.boundsMin, left.boundsMax) * left.count + rightArea[b + 1] * rightCount[b + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		const float area = surfaceArea(boundsMin, boundsMax);
+		const float leafCost = INTERSECTION_COST * count;
+		const float splitCost = TRAVERSAL_COST + INTERSECTION_COST * bestCost / std::max(area, 1e-20f);
+		if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || leafCost <= splitCost)) {
+			return index;
+		}
+
+		// The children's bounds come straight from the bins, no need for another pass over the triangles
+		Bin children[2];
+		int middle;
+		if (bestAxis >= 0) {
+			for (int b = 0; b < NUM_BINS; b++) {
+				children[b <= bestSplit ? 0 : 1].merge(bins[bestAxis][b]);
+			}
+			int* begin = &context.primitives[first];
+			middle = first + (int)(std::partition(begin, begin + count, [&](int primitive) {
+				return (int)((context.centroids[primitive][bestAxis] - centroidMin[bestAxis]) * binScale[bestAxis]) <= bestSplit;
+			}) - begin);
+		}
+		else {
+			// All centroids in one spot, any split is as good as another
+			middle = first + count / 2;
+			for (int i = first; i < first + count; i++) {
+				const int primitive = context.primitives[i];
+				children[i < middle ? 0 : 1].add(context.primitiveMin[primitive], context.primitiveMax[primitive], context.centroids[primitive]);
+			}
+		}
+
+		const int childFirst[2] = { first, middle };
+		int childIndex[2];
+		auto buildChild = [&](int c) {
+			childIndex[c] = buildNode(context, childFirst[c], children[c].count, children[c].boundsMin, children[c].boundsMax,
+				children[c].centroidMin, children[c].centroidMax);
+		};
+		if (count > PARALLEL_BUILD_SIZE) {
+			ThreadPool::getShared().parallelFor(0, 2, buildChild);
+		}
+		else {
+			buildChild(0);
+			buildChild(1);
+		}
+		// nodes was sized up front, so node is still valid after the children were added
+		node.children[0] = childIndex[0];
+		node.children[1] = childIndex[1];
+		return index;
+	}
+
+	int BVH::collapse(const BuildContext &context, int buildNode)
+	{
+		const BuildNode &root = context.nodes[buildNode];
+
+		// Open the child with the largest surface area until there are four
+		std::vector<int> candidates;
+		if (root.children[0] < 0) {
+			candidates.push_back(buildNode);
+		}
+		else {
+			candidates.push_back(root.children[0]);
+			candidates.push_back(root.children[1]);
+		}
+		while (candidates.size() < 4) {
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (int i = 0; i < candidates.size(); i++) {
+				const BuildNode &candidate = context.nodes[candidates[i]];
+				const float area = surfaceArea(candidate.boundsMin, candidate.boundsMax);
+				if (candidate.children[0] >= 0 && area > largestArea) {
+					largest = i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0) {
+				break;
+			}
+			const BuildNode &opened = context.nodes[candidates[largest]];
+			candidates[largest] = opened.children[0];
+			candidates.push_back(opened.children[1]);
+		}
+
+		const int index = _nodes.size();
+		_nodes.push_back(Node());
+		int children[4];
+		for (int i = 0; i < 4; i++) {
+			if (i >= candidates.size()) {
+				// Unused slot, masked out by numChildren
+				for (int axis = 0; axis < 6; axis++) {
+					_nodes[index].bounds[axis][i] = 0.0f;
+				}
+				children[i] = encodeLeaf(0, 0);
+				continue;
+			}
+			const BuildNode &child = context.nodes[candidates[i]];
+			for (int axis = 0; axis < 3; axis++) {
+				_nodes[index].bounds[axis][i] = child.boundsMin[axis];
+				_nodes[index].bounds[axis + 3][i] = child.boundsMax[axis];
+			}
+			children[i] = child.children[0] < 0 ? encodeLeaf(child.first, child.count) : collapse(context, candidates[i]);
+		}
+		// _nodes may have grown during the recursion
+		_nodes[index].numChildren = candidates.size();
+		for (int i = 0; i < 4; i++) {
+			_nodes[index].children[i] = children[i];
+		}
+		return index;
+	}
+
+	bool BVH::intersectTriangle(const Triangle &triangle, const Ray &ray, float &t, float &u, float &v) const
+	{
+		// Moller-Trumbore
+		const glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+		const float determinant = glm::dot(triangle.edge1, p);
+		if (std::fabs(determinant) < 1e-12f) {
+			return false;
+		}
+		const float inverse = 1.0f / determinant;
+		const glm::vec3 s = ray.origin - triangle.v0;
+		u = glm::dot(s, p) * inverse;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		const glm::vec3 q = glm::cross(s, triangle.edge1);
+		v = glm::dot(ray.direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		t = glm::dot(triangle.edge2, q) * inverse;
+		return t > ray.tMin && t < ray.tMax;
+	}
+
+	bool BVH::intersect(const Ray &ray, Hit &hit) const
+	{
+		if (_nodes.empty()) {
+			return false;
+		}
+		Ray current = ray;
+		bool found = false;
+
+		const glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+		const Float4 originX(ray.origin.x), originY(ray.origin.y), originZ(ray.origin.z);
+		const Float4 inverseX(inverseDirection.x), inverseY(inverseDirection.y), inverseZ(inverseDirection.z);
+		const Float4 tMin(ray.tMin);
+
+		int stack[STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const int child = stack[--stackSize];
+			if (child < 0) {
+				int first, count;
+				decodeLeaf(child, first, count);
+				for (int i = first; i < first + count; i++) {
+					float t, u, v;
+					if (intersectTriangle(_triangles[i], current, t, u, v)) {
+						current.tMax = t;
+						hit.t = t;
+						hit.u = u;
+						hit.v = v;
+						hit.triangle = _triangles[i].index;
+						found = true;
+					}
+				}
+				continue;
+			}
+
+			// Slab test against all four boxes at once
+			const Node &node = _nodes[child];
+			const Float4 t0x = (Float4::load(node.bounds[0]) - originX) * inverseX;
+			const Float4 t1x = (Float4::load(node.bounds[3]) - originX) * inverseX;
+			const Float4 t0y = (Float4::load(node.bounds[1]) - originY) * inverseY;
+			const Float4 t1y = (Float4::load(node.bounds[4]) - originY) * inverseY;
+			const Float4 t0z = (Float4::load(node.bounds[2]) - originZ) * inverseZ;
+			const Float4 t1z = (Float4::load(node.bounds[5]) - originZ) * inverseZ;
+			const Float4 tNear = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), tMin));
+			const Float4 tFar = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), Float4(current.tMax)));
+			const int mask = lessEqualMask(tNear, tFar) & ((1 << node.numChildren) - 1);
+			if (mask == 0) {
+				continue;
+			}
+
+			// Push the hit children farthest first so the nearest is visited next
+			float distances[4];
+			tNear.store(distances);
+			int order[4];
+			int numHit = 0;
+			for (int i = 0; i < 4; i++) {
+				if (mask & (1 << i)) {
+					int j = numHit++;
+					while (j > 0 && distances[order[j - 1]] < distances[i]) {
+						order[j] = order[j - 1];
+						j--;
+					}
+					order[j] = i;
+				}
+			}
+			for (int i = 0; i < numHit && stackSize < STACK_SIZE; i++) {
+				stack[stackSize++] = node.children[order[i]];
+			}
+		}
+		return found;
+	}
+
+	bool BVH::occluded(const Ray &ray) const
+	{
+		if (_nodes.empty()) {
+			return false;
+		}
+		const glm::vec3 inverseDirection = glm::vec3(1.0f) / ray.direction;
+		const Float4 originX(ray.origin.x), originY(ray.origin.y), originZ(ray.origin.z);
+		const Float4 inverseX(inverseDirection.x), inverseY(inverseDirection.y), inverseZ(inverseDirection.z);
+		const Float4 tMin(ray.tMin), tMax(ray.tMax);
+
+		int stack[STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const int child = stack[--stackSize];
+			if (child < 0) {
+				int first, count;
+				decodeLeaf(child, first, count);
+				for (int i = first; i < first + count; i++) {
+					float t, u, v;
+					if (intersectTriangle(_triangles[i], ray, t, u, v)) {
+						return true;
+					}
+				}
+				continue;
+			}
+
+			const Node &node = _nodes[child];
+			const Float4 t0x = (Float4::load(node.bounds[0]) - originX) * inverseX;
+			const Float4 t1x = (Float4::load(node.bounds[3]) - originX) * inverseX;
+			const Float4 t0y = (Float4::load(node.bounds[1]) - originY) * inverseY;
+			const Float4 t1y = (Float4::load(node.bounds[4]) - originY) * inverseY;
+			const Float4 t0z = (Float4::load(node.bounds[2]) - originZ) * inverseZ;
+			const Float4 t1z = (Float4::load(node.bounds[5]) - originZ) * inverseZ;
+			const Float4 tNear = max(max(min(t0x, t1x), min(t0y, t1y)), max(min(t0z, t1z), tMin));
+			const Float4 tFar = min(min(max(t0x, t1x), max(t0y, t1y)), min(max(t0z, t1z), tMax));
+			const int mask = lessEqualMask(tNear, tFar) & ((1 << node.numChildren) - 1);
+			for (int i = 0; i < 4 && stackSize < STACK_SIZE; i++) {
+				if (mask & (1 << i)) {
+					stack[stackSize++] = node.children[i];
+				}
+			}
+		}
+		return false;
+	}
+
+	int BVH::getNumNodes() const
+	{
+		return _nodes.size();
+	}
+
+	int BVH::getNumTriangles() const
+	{
+		return _triangles.size();
+	}
+
+	glm::vec3 BVH::getBoundsMin() const
+	{
+		return _boundsMin;
+	}
+
+	glm::vec3 BVH::getBoundsMax() const
+	{
+		return _boundsMax;
+	}
+
+}
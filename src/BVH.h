@@ -0,0 +1,120 @@
+/*!
+ *  BVH.h
+ *
+ * Bounding volume hierarchy over Mesh::Vertex triangles for casting rays on the CPU.
+ */
+
+#ifndef BVH_h
+#define BVH_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace basicgraphics {
+
+	/** BVH is built top down with the surface area heuristic, evaluated at NUM_BINS split positions per
+	axis instead of at every triangle. Large nodes are binned in parallel and the two halves of a node are
+	built on the ThreadPool at the same time. The binary tree is then collapsed into a tree with four
+	children per node, stored so that one SIMD instruction tests a ray against all four child boxes (SSE or
+	NEON, plain floats elsewhere). Leaves hold up to MAX_LEAF_SIZE triangles.
+	------------------------------------------------------------------------
+	BVH bvh;
+	bvh.build(vertices, indices);
+	BVH::Ray ray(origin, direction);
+	BVH::Hit hit;
+	if (bvh.intersect(ray, hit)) {
+		// triangle hit.triangle, at origin + hit.t * direction
+	}
+	------------------------------------------------------------------------
+	*/
+	class BVH
+	{
+	public:
+
+		static const int NUM_BINS = 16;
+		static const int MAX_LEAF_SIZE = 8;
+
+		struct Ray {
+			glm::vec3 origin;
+			glm::vec3 direction; /// doesn't need to be normalized, t is in units of its length
+			float tMin;
+			float tMax;
+
+			Ray() {}
+			Ray(const glm::vec3 &origin, const glm::vec3 &direction, float tMin = 0.0f, float tMax = 1e30f);
+		};
+
+		struct Hit {
+			float t;
+			float u;      /// barycentric coordinate of the triangle's second vertex
+			float v;      /// and of its third
+			int triangle; /// index into the index buffer divided by three
+		};
+
+		BVH();
+		virtual ~BVH();
+
+		// Builds the hierarchy over indexed triangles (three indices each), replacing the previous one
+		void build(const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices);
+
+		// Finds the closest hit between tMin and tMax
+		bool intersect(const Ray &ray, Hit &hit) const;
+
+		// True if anything is hit between tMin and tMax, faster than intersect, e.g. for shadow rays
+		bool occluded(const Ray &ray) const;
+
+		int getNumNodes() const;
+		int getNumTriangles() const;
+		glm::vec3 getBoundsMin() const;
+		glm::vec3 getBoundsMax() const;
+
+	private:
+		BVH(const BVH&) {}; // prevent copying
+
+		// Binary tree node during the build
+		struct BuildNode {
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			int children[2]; /// -1 for leaves
+			int first;       /// range in _primitives for leaves
+			int count;
+		};
+
+		// Four children, the boxes stored one axis at a time for SIMD: minX[4], minY[4], ... maxZ[4]
+		struct Node {
+			float bounds[6][4];
+			int children[4]; /// node index, or a leaf if negative, see encodeLeaf
+			int numChildren; /// the used slots come first
+		};
+
+		// Precomputed for the intersection test, in leaf order
+		struct Triangle {
+			glm::vec3 v0;
+			glm::vec3 edge1;
+			glm::vec3 edge2;
+			int index;
+		};
+
+		struct BuildContext;
+
+		std::vector<Node> _nodes;
+		std::vector<Triangle> _triangles;
+		glm::vec3 _boundsMin;
+		glm::vec3 _boundsMax;
+
+		int buildNode(BuildContext &context, int first, int count, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+			const glm::vec3 &centroidMin, const glm::vec3 &centroidMax);
+		int collapse(const BuildContext &context, int buildNode);
+		bool intersectTriangle(const Triangle &triangle, const Ray &ray, float &t, float &u, float &v) const;
+
+		static int encodeLeaf(int first, int count) { return -1 - (first * 16 + count); }
+		static void decodeLeaf(int child, int &first, int &count) { const int code = -1 - child; first = code >> 4; count = code & 15; }
+	};
+
+}
+
+#endif /* BVH_h */
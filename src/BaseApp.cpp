@@ -7,16 +7,116 @@
 //
 
 #include "BaseApp.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 
 namespace basicgraphics {
 
 	glm::vec2 BaseApp::cursorPos(0);
 
-	BaseApp::BaseApp(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight) {
+	BaseApp::BaseApp(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight, bool headless /*=false*/) :
+		_window(nullptr), _windowXPos(0), _windowYPos(0), _exitRequested(false), _maxFrames(0), _frameNumber(0), _profiling(false), _glStats(false), _trackAllocations(false), _memoryReport(false) {
+		_windowWidth = windowWidth;
+		_windowHeight = windowHeight;
+		parseArguments(argc, argv, headless);
+
 		glfwSetErrorCallback(BaseApp::error_callback);
 
-		if (!glfwInit()) {
-			exit(EXIT_FAILURE);
+		if (headless) {
+			createHeadless(_windowWidth, _windowHeight);
+		}
+		else {
+			createWindow(windowName, _windowWidth, _windowHeight);
+		}
+
+		//Turn on depth testing. This is an optimization so that triangle fragments that are further in depth than something already rendered are not processed
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_MULTISAMPLE);
+
+		// Specify the background color
+		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+		// Check for opengl errors
+		GLenum err;
+		while ((err = glGetError()) != GL_NO_ERROR) {
+			std::cerr << "OpenGL error: " << err << std::endl;
+		}
+
+		// Made now so that the first input after warmup doesn't count as an allocating frame
+		nextInputEvent();
+
+		if (_glStats) {
+			GLStats::getInstance().setEnabled(true);
+		}
+		if (_trackAllocations) {
+			AllocationTracker::getInstance().setEnabled(true);
+		}
+		if (_metricsServer.get() != nullptr) {
+			std::string error;
+			if (!_metricsServer->start(error)) {
+				std::cerr << "Unable to serve metrics: " << error << std::endl;
+				_metricsServer.reset();
+			}
+		}
+	}
+
+	void BaseApp::parseArguments(int argc, char** argv, bool &headless)
+	{
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--headless") {
+				headless = true;
+			}
+			else if (arg == "--size" && i + 1 < argc) {
+				int width, height;
+				if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+					_windowWidth = width;
+					_windowHeight = height;
+				}
+				else {
+					std::cerr << "Ignoring --size " << argv[i] << ", expected WIDTHxHEIGHT" << std::endl;
+				}
+			}
+			else if (arg == "--frames" && i + 1 < argc) {
+				_maxFrames = std::max(atoi(argv[++i]), 0);
+			}
+			else if (arg == "--gl-stats") {
+				_glStats = true;
+			}
+			else if (arg == "--track-allocations") {
+				_trackAllocations = true;
+			}
+			else if (arg == "--memory-report" && i + 1 < argc) {
+				MemoryAccounting::getInstance().setReportInterval(atof(argv[++i]));
+				_memoryReport = true;
+			}
+			else if (arg == "--metrics" && i + 1 < argc) {
+				_metricsServer.reset(new MetricsServer(argv[++i]));
+			}
+			else if (arg == "--memory-dump" && i + 1 < argc) {
+				_memoryDumpFile = argv[++i];
+				_memoryReport = true;
+			}
+			else if (arg == "--trace" && i + 1 < argc) {
+				Tracer::getInstance().start(argv[++i]);
+			}
+			else if (arg == "--profile" && i + 1 < argc) {
+				_profiling = Profiler::getInstance().setCSVFile(argv[++i]);
+			}
+		}
+	}
+
+	void BaseApp::createWindow(const std::string &windowName, int windowWidth, int windowHeight)
+	{
+		{
+			TRACE_SCOPE("startup", "glfwInit");
+			if (!glfwInit()) {
+				exit(EXIT_FAILURE);
+			}
 		}
 
 		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -26,10 +126,13 @@ namespace basicgraphics {
 		glfwWindowHint(GLFW_SAMPLES, 4);
 
 		// Create the window
-		_window = glfwCreateWindow(windowWidth, windowHeight, windowName.c_str(), NULL, NULL);
-		if (!_window) {
-			glfwTerminate();
-			exit(EXIT_FAILURE);
+		{
+			TRACE_SCOPE("startup", "glfwCreateWindow");
+			_window = glfwCreateWindow(windowWidth, windowHeight, windowName.c_str(), NULL, NULL);
+			if (!_window) {
+				glfwTerminate();
+				exit(EXIT_FAILURE);
+			}
 		}
 
 		// Setup event callbacks
@@ -48,40 +151,173 @@ namespace basicgraphics {
 		glfwGetFramebufferSize(_window, &_windowWidth, &_windowHeight);
 		glfwGetWindowPos(_window, &_windowXPos, &_windowYPos);
 
-		gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+		{
+			TRACE_SCOPE("startup", "gladLoadGLLoader");
+			gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+		}
 
 		glfwSwapInterval(1);
+	}
 
-		//Turn on depth testing. This is an optimization so that triangle fragments that are further in depth than something already rendered are not processed
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_MULTISAMPLE);
-
-		// Specify the background color
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	void BaseApp::createHeadless(int width, int height)
+	{
+		TRACE_SCOPE("startup", "createHeadless");
+		// GLFW is still used for its timer. Its null platform needs no display, older versions may fail to initialize without one.
+#ifdef GLFW_PLATFORM_NULL
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+		if (!glfwInit()) {
+			std::cerr << "GLFW could not be initialized, glfwGetTime will not advance" << std::endl;
+		}
 
-		// Check for opengl errors
-		GLenum err;
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error: " << err << std::endl;
+		_headlessContext.reset(new HeadlessContext());
+		if (!_headlessContext->isValid()) {
+			std::cerr << _headlessContext->getError() << std::endl;
+			exit(EXIT_FAILURE);
 		}
+		gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress);
+
+		// Same sample count as the window's default framebuffer
+		_framebuffer.reset(new Framebuffer(width, height, 4));
+		_windowWidth = _framebuffer->getWidth();
+		_windowHeight = _framebuffer->getHeight();
 	}
 
 	BaseApp::~BaseApp() {
-		glfwDestroyWindow(_window);
+		// Captured frames still need the context to be read back
+		stopFrameCapture();
+		_framebuffer.reset();
+		_headlessContext.reset();
+		if (_window != nullptr) {
+			glfwDestroyWindow(_window);
+		}
 		glfwTerminate();
 	}
 
 	void BaseApp::run() {
-		while (!glfwWindowShouldClose(_window))
+		Profiler &profiler = Profiler::getInstance();
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (!_exitRequested && (_maxFrames == 0 || _frameNumber < _maxFrames) && (_window == nullptr || !glfwWindowShouldClose(_window)))
 		{
+			const std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+			profiler.beginFrame();
+			if (_framebuffer.get() != nullptr) {
+				_framebuffer->bind();
+			}
 			glViewport(0, 0, _windowWidth, _windowHeight);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-			onRenderGraphics();
+			// Make textures that finished loading in the background resident and stream in mip levels
+			{
+				ProfileScope scope("Streaming");
+				TextureLoader::getInstance().update();
+				TextureStreamer::getInstance().update();
+				Metrics::setGauge(Metrics::TEXTURE_LOADS_PENDING, TextureLoader::getInstance().getNumPending());
+				Metrics::setGauge(Metrics::TEXTURES_STREAMING, TextureStreamer::getInstance().getNumStreaming());
+			}
+
+			{
+				ProfileScope scope("onRenderGraphics");
+				onRenderGraphics();
+			}
+
+			if (profiler.isOverlayVisible()) {
+				ProfileScope scope("Profiler overlay");
+				profiler.drawOverlay(_windowWidth, _windowHeight);
+			}
+
+			{
+				ProfileScope scope("Capture");
+				if (_framebuffer.get() != nullptr) {
+					_framebuffer->resolve();
+					_framebuffer->bindForReading();
+				}
+				if (_frameCapture.get() != nullptr) {
+					_frameCapture->capture(_windowWidth, _windowHeight);
+				}
+				// Hand finished readbacks (captured frames, saved textures) to the workers
+				PixelReadback::getInstance().update();
+			}
+
+			if (_window != nullptr) {
+				// Mostly waiting for vsync, so not timed on the GPU
+				ProfileScope scope("Swap", false);
+				glfwSwapBuffers(_window);
+				glfwPollEvents();
+			}
+			_frameNumber++;
+			profiler.endFrame();
+			GLStats::getInstance().endFrame();
+			AllocationTracker::getInstance().endFrame();
+			MemoryAccounting::getInstance().update();
+			Metrics::getInstance().observeFrameTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+			TRACE_END_FRAME();
+		}
 
-			glfwSwapBuffers(_window);
-			glfwPollEvents();
+		// With --frames the run is a benchmark, e.g. against the software rasterizer or with LIBGL_ALWAYS_SOFTWARE=1 on llvmpipe
+		if (_maxFrames > 0 && _frameNumber > 0) {
+			glFinish();
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "Rendered " << _frameNumber << " frames at " << _windowWidth << "x" << _windowHeight << ", "
+				<< 1000.0 * seconds / _frameNumber << " ms per frame (" << _frameNumber / seconds << " fps)" << std::endl;
+		}
+
+		profiler.finish();
+		if (_profiling) {
+			profiler.printStats(std::cout);
+		}
+		GLStats &glStats = GLStats::getInstance();
+		if (glStats.isEnabled()) {
+			glStats.printFrame(std::cout);
+			glStats.printTotals(std::cout);
 		}
+		AllocationTracker &allocations = AllocationTracker::getInstance();
+		if (allocations.isEnabled()) {
+			allocations.setEnabled(false);
+			allocations.printReport(std::cout);
+		}
+		if (_memoryReport) {
+			MemoryAccounting::getInstance().printReport(std::cout);
+		}
+		if (!_memoryDumpFile.empty()) {
+			std::ofstream dump(_memoryDumpFile.c_str());
+			if (dump) {
+				MemoryAccounting::getInstance().writeCSV(dump);
+			}
+			else {
+				std::cerr << "Unable to write the memory dump to " << _memoryDumpFile << std::endl;
+			}
+		}
+	}
+
+	void BaseApp::startFrameCapture(const std::string &directory, FrameCapture::Format format /*=FrameCapture::FORMAT_PNG*/)
+	{
+		stopFrameCapture();
+		_frameCapture.reset(new FrameCapture(directory, "frame", format));
+	}
+
+	void BaseApp::stopFrameCapture()
+	{
+		if (_frameCapture.get() != nullptr) {
+			_frameCapture->finish();
+			std::cout << "Captured " << _frameCapture->getNumWritten() << " frames" << std::endl;
+			_frameCapture.reset();
+		}
+	}
+
+	bool BaseApp::isCapturingFrames() const
+	{
+		return _frameCapture.get() != nullptr;
+	}
+
+	void BaseApp::requestExit()
+	{
+		_exitRequested = true;
+	}
+
+	bool BaseApp::isHeadless() const
+	{
+		return _headlessContext.get() != nullptr;
 	}
 
 	void BaseApp::onRenderGraphics()
@@ -116,19 +352,26 @@ namespace basicgraphics {
 
 	void BaseApp::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 	{
-		string name = "kbd_" + getKeyName(key);
-
-		if (mods) {
-			name = name + "_" + getModsName(mods);
-		}
+		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
+		app->onKey(key, scancode, action, mods);
+	}
 
-		string value = getKeyValue(key, mods);
+	void BaseApp::onKey(int key, int scancode, int action, int mods)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "kbd_%s%s%s_%s", getKeyName(key), mods ? "_" : "", getModsName(mods), getActionName(action));
 
-		name = name + "_" + getActionName(action);
+		nextInputEvent().reset(name, getKeyValue(key, mods), _window);
+		onEvent(_inputEvent);
+	}
 
-		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
-		std::shared_ptr<Event> newEvent(new Event(name, value, window));
-		app->onEvent(newEvent);
+	Event& BaseApp::nextInputEvent()
+	{
+		if (_inputEvent.use_count() != 1) {
+			// Room for the longest name, reset assigns into it
+			_inputEvent = std::make_shared<Event>(std::string(63, ' '), _window);
+		}
+		return *_inputEvent;
 	}
 
 	void BaseApp::updateWindowSize()
@@ -156,47 +399,39 @@ namespace basicgraphics {
 
 	void BaseApp::mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	{
-		string name = getButtonName(button);
-
-		if (mods) {
-			name = name + "_" + getModsName(mods);
-		}
-
-		name = name + "_" + getActionName(action);
+		char name[64];
+		snprintf(name, sizeof(name), "%s%s%s_%s", getButtonName(button), mods ? "_" : "", getModsName(mods), getActionName(action));
 
 		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
-		std::shared_ptr<Event> newEvent(new Event(name, cursorPos, window));
-		app->onEvent(newEvent);
+		app->nextInputEvent().reset(name, cursorPos, window);
+		app->onEvent(app->_inputEvent);
 	}
 
 	void BaseApp::cursor_position_callback(GLFWwindow* window, double x, double y)
 	{
 		// Note: x and y can be outside the bounds of the window!
-		string name = "mouse_pointer";
 		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
 		BaseApp::cursorPos.x = x;
 		BaseApp::cursorPos.y = y;
-		std::shared_ptr<Event> newEvent(new Event(name, cursorPos, window));
-		app->onEvent(newEvent);
+		app->nextInputEvent().reset("mouse_pointer", cursorPos, window);
+		app->onEvent(app->_inputEvent);
 	}
 
 	void BaseApp::cursor_enter_callback(GLFWwindow* window, int entered)
 	{
-		string name = "mouse_pointer_" + entered ? "entered" : "left";
 		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
-		std::shared_ptr<Event> newEvent(new Event(name, window));
-		app->onEvent(newEvent);
+		app->nextInputEvent().reset(entered ? "mouse_pointer_entered" : "mouse_pointer_left", window);
+		app->onEvent(app->_inputEvent);
 	}
 
 	void BaseApp::scroll_callback(GLFWwindow* window, double x, double y)
 	{
-		string name = "mouse_scroll";
 		BaseApp* app = static_cast<BaseApp*>(glfwGetWindowUserPointer(window));
-		std::shared_ptr<Event> newEvent(new Event(name, glm::dvec2(x, y), window));
-		app->onEvent(newEvent);
+		app->nextInputEvent().reset("mouse_scroll", glm::dvec2(x, y), window);
+		app->onEvent(app->_inputEvent);
 	}
 
-	string BaseApp::getKeyName(int key)
+	const char* BaseApp::getKeyName(int key)
 	{
 		switch (key)
 		{
@@ -329,102 +564,67 @@ namespace basicgraphics {
 		}
 	}
 
-	string BaseApp::getKeyValue(int key, int mods)
+	const char* BaseApp::getKeyValue(int key, int mods)
 	{
-		string value = "";
-		switch (key)
-		{
-			// Printable keys
-		case GLFW_KEY_A:            value = "a"; break;
-		case GLFW_KEY_B:            value = "b"; break;
-		case GLFW_KEY_C:            value = "c"; break;
-		case GLFW_KEY_D:            value = "d"; break;
-		case GLFW_KEY_E:            value = "e"; break;
-		case GLFW_KEY_F:            value = "f"; break;
-		case GLFW_KEY_G:            value = "g"; break;
-		case GLFW_KEY_H:            value = "h"; break;
-		case GLFW_KEY_I:            value = "i"; break;
-		case GLFW_KEY_J:            value = "j"; break;
-		case GLFW_KEY_K:            value = "k"; break;
-		case GLFW_KEY_L:            value = "l"; break;
-		case GLFW_KEY_M:            value = "m"; break;
-		case GLFW_KEY_N:            value = "n"; break;
-		case GLFW_KEY_O:            value = "o"; break;
-		case GLFW_KEY_P:            value = "p"; break;
-		case GLFW_KEY_Q:            value = "q"; break;
-		case GLFW_KEY_R:            value = "r"; break;
-		case GLFW_KEY_S:            value = "s"; break;
-		case GLFW_KEY_T:            value = "t"; break;
-		case GLFW_KEY_U:            value = "u"; break;
-		case GLFW_KEY_V:            value = "v"; break;
-		case GLFW_KEY_W:            value = "w"; break;
-		case GLFW_KEY_X:            value = "x"; break;
-		case GLFW_KEY_Y:            value = "y"; break;
-		case GLFW_KEY_Z:            value = "z"; break;
-
-		default:					value = ""; break;
+		static const char* LOWERCASE[26] = { "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m",
+			"n", "o", "p", "q", "r", "s", "t", "u", "v", "w", "x", "y", "z" };
+		static const char* UPPERCASE[26] = { "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",
+			"N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z" };
+
+		// The GLFW letter keys are contiguous
+		if (key >= GLFW_KEY_A && key <= GLFW_KEY_Z) {
+			return (mods & GLFW_MOD_SHIFT) ? UPPERCASE[key - GLFW_KEY_A] : LOWERCASE[key - GLFW_KEY_A];
 		}
 
-		if (value != "") {
-			if (mods & GLFW_MOD_SHIFT)
-			{
-				value = std::toupper(value[0]);
-			}
-		}
-		else {
+		switch (key)
+		{
+		case GLFW_KEY_1:            return "1";
+		case GLFW_KEY_2:            return "2";
+		case GLFW_KEY_3:            return "3";
+		case GLFW_KEY_4:            return "4";
+		case GLFW_KEY_5:            return "5";
+		case GLFW_KEY_6:            return "6";
+		case GLFW_KEY_7:            return "7";
+		case GLFW_KEY_8:            return "8";
+		case GLFW_KEY_9:            return "9";
+		case GLFW_KEY_0:            return "0";
+		case GLFW_KEY_SPACE:        return " ";
+		case GLFW_KEY_MINUS:        return "-";
+		case GLFW_KEY_EQUAL:        return "=";
+		case GLFW_KEY_LEFT_BRACKET: return "]";
+		case GLFW_KEY_RIGHT_BRACKET: return "[";
+		case GLFW_KEY_BACKSLASH:    return "\\";
+		case GLFW_KEY_SEMICOLON:    return ";";
+		case GLFW_KEY_APOSTROPHE:   return "'";
+		case GLFW_KEY_GRAVE_ACCENT: return "`";
+		case GLFW_KEY_COMMA:        return ",";
+		case GLFW_KEY_PERIOD:       return ".";
+		case GLFW_KEY_SLASH:        return "/";
+		case GLFW_KEY_TAB:          return "\t";
+		case GLFW_KEY_ENTER:        return "\n";
+		case GLFW_KEY_KP_0:         return "0";
+		case GLFW_KEY_KP_1:         return "1";
+		case GLFW_KEY_KP_2:         return "2";
+		case GLFW_KEY_KP_3:         return "3";
+		case GLFW_KEY_KP_4:         return "4";
+		case GLFW_KEY_KP_5:         return "5";
+		case GLFW_KEY_KP_6:         return "6";
+		case GLFW_KEY_KP_7:         return "7";
+		case GLFW_KEY_KP_8:         return "8";
+		case GLFW_KEY_KP_9:         return "9";
+		case GLFW_KEY_KP_DIVIDE:    return "/";
+		case GLFW_KEY_KP_MULTIPLY:  return "*";
+		case GLFW_KEY_KP_SUBTRACT:  return "-";
+		case GLFW_KEY_KP_ADD:       return "+";
+		case GLFW_KEY_KP_DECIMAL:   return ".";
+		case GLFW_KEY_KP_EQUAL:     return "=";
+		case GLFW_KEY_KP_ENTER:     return "\n";
 
-			switch (key)
-			{
-			case GLFW_KEY_1:            value = "1"; break;
-			case GLFW_KEY_2:            value = "2"; break;
-			case GLFW_KEY_3:            value = "3"; break;
-			case GLFW_KEY_4:            value = "4"; break;
-			case GLFW_KEY_5:            value = "5"; break;
-			case GLFW_KEY_6:            value = "6"; break;
-			case GLFW_KEY_7:            value = "7"; break;
-			case GLFW_KEY_8:            value = "8"; break;
-			case GLFW_KEY_9:            value = "9"; break;
-			case GLFW_KEY_0:            value = "0"; break;
-			case GLFW_KEY_SPACE:        value = " "; break;
-			case GLFW_KEY_MINUS:        value = "-"; break;
-			case GLFW_KEY_EQUAL:        value = "="; break;
-			case GLFW_KEY_LEFT_BRACKET: value = "]"; break;
-			case GLFW_KEY_RIGHT_BRACKET: value = "["; break;
-			case GLFW_KEY_BACKSLASH:    value = "\\"; break;
-			case GLFW_KEY_SEMICOLON:    value = ";"; break;
-			case GLFW_KEY_APOSTROPHE:   value = "'"; break;
-			case GLFW_KEY_GRAVE_ACCENT: value = "`"; break;
-			case GLFW_KEY_COMMA:        value = ","; break;
-			case GLFW_KEY_PERIOD:       value = "."; break;
-			case GLFW_KEY_SLASH:        value = "/"; break;
-			case GLFW_KEY_TAB:          value = "\t"; break;
-			case GLFW_KEY_ENTER:        value = "\n"; break;
-			case GLFW_KEY_KP_0:         value = "0"; break;
-			case GLFW_KEY_KP_1:         value = "1"; break;
-			case GLFW_KEY_KP_2:         value = "2"; break;
-			case GLFW_KEY_KP_3:         value = "3"; break;
-			case GLFW_KEY_KP_4:         value = "4"; break;
-			case GLFW_KEY_KP_5:         value = "5"; break;
-			case GLFW_KEY_KP_6:         value = "6"; break;
-			case GLFW_KEY_KP_7:         value = "7"; break;
-			case GLFW_KEY_KP_8:         value = "8"; break;
-			case GLFW_KEY_KP_9:         value = "9"; break;
-			case GLFW_KEY_KP_DIVIDE:    value = "/"; break;
-			case GLFW_KEY_KP_MULTIPLY:  value = "*"; break;
-			case GLFW_KEY_KP_SUBTRACT:  value = "-"; break;
-			case GLFW_KEY_KP_ADD:       value = "+"; break;
-			case GLFW_KEY_KP_DECIMAL:   value = "."; break;
-			case GLFW_KEY_KP_EQUAL:     value = "="; break;
-			case GLFW_KEY_KP_ENTER:     value = "\n"; break;
-
-			default:                    break;
-			}
+		default:                    return "";
 		}
-
-		return value;
 	}
 
-	string BaseApp::getActionName(int action)
+	const char* BaseApp::getActionName(int action)
 	{
 		switch (action)
 		{
@@ -439,7 +639,7 @@ namespace basicgraphics {
 		return "caused unknown action";
 	}
 
-	string BaseApp::getButtonName(int button)
+	const char* BaseApp::getButtonName(int button)
 	{
 		switch (button)
 		{
@@ -449,28 +649,31 @@ namespace basicgraphics {
 			return "mouse_btn_right";
 		case GLFW_MOUSE_BUTTON_MIDDLE:
 			return "mouse_btn_middle";
-		default:
-			std::stringstream ss;
-			ss << "mouse_btn_" << button;
-			return ss.str();
+		case GLFW_MOUSE_BUTTON_4:
+			return "mouse_btn_3";
+		case GLFW_MOUSE_BUTTON_5:
+			return "mouse_btn_4";
+		case GLFW_MOUSE_BUTTON_6:
+			return "mouse_btn_5";
+		case GLFW_MOUSE_BUTTON_7:
+			return "mouse_btn_6";
+		case GLFW_MOUSE_BUTTON_8:
+			return "mouse_btn_7";
 		}
 
-		return "";
+		return "mouse_btn_unknown";
 	}
 
-	string BaseApp::getModsName(int mods)
+	const char* BaseApp::getModsName(int mods)
 	{
-		string modName = "";
-		if (mods & GLFW_MOD_SHIFT)
-			modName += "SHIFT";
-		if (mods & GLFW_MOD_CONTROL)
-			modName += "CTRL";
-		if (mods & GLFW_MOD_ALT)
-			modName += "ALT";
-		if (mods & GLFW_MOD_SUPER)
-			modName += "SUPER";
-
-		return modName;
+		// Indexed by the SHIFT, CONTROL, ALT and SUPER bits
+		static const char* MOD_NAMES[16] = {
+			"", "SHIFT", "CTRL", "SHIFTCTRL",
+			"ALT", "SHIFTALT", "CTRLALT", "SHIFTCTRLALT",
+			"SUPER", "SHIFTSUPER", "CTRLSUPER", "SHIFTCTRLSUPER",
+			"ALTSUPER", "SHIFTALTSUPER", "CTRLALTSUPER", "SHIFTCTRLALTSUPER" };
+
+		return MOD_NAMES[mods & (GLFW_MOD_SHIFT | GLFW_MOD_CONTROL | GLFW_MOD_ALT | GLFW_MOD_SUPER)];
 	}
 
 }
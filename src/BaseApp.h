@@ -26,6 +26,18 @@
 #include "Event.h"
 #include "Sphere.h"
 #include "Line.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "PixelReadback.h"
+#include "FrameCapture.h"
+#include "HeadlessContext.h"
+#include "Framebuffer.h"
+#include "Profiler.h"
+#include "Tracer.h"
+#include "GLStats.h"
+#include "AllocationTracker.h"
+#include "MemoryAccounting.h"
+#include "MetricsServer.h"
 
 namespace basicgraphics {
 
@@ -49,12 +61,29 @@ namespace basicgraphics {
 	   return 0;
 	}
 	------------------------------------------------------------------------
+	Headless mode renders without a window through a HeadlessContext (surfaceless EGL or OSMesa, so it runs
+	on Mesa's llvmpipe) into a Framebuffer of windowWidth x windowHeight. There is no swap and no vsync,
+	run() calls onRenderGraphics as fast as it can until requestExit() or the frame limit. It is turned on
+	by passing headless = true or with these command line arguments:
+		--headless          render without a window
+		--size WxH          size of the headless framebuffer, e.g. --size 3840x2160
+		--frames N          stop after N frames (also with a window)
+	Every frame is timed by the Profiler, with scopes for streaming, onRenderGraphics, capture and the swap:
+		--profile FILE      write the time of every scope in every frame to FILE as CSV and print percentiles on exit
+		--trace FILE        record startup, loading and every frame as a Chrome trace, see Tracer
+		--gl-stats          count the GL calls of every frame and print them on exit, see GLStats
+		--track-allocations count the allocations and GL objects of every frame and print the ones after the warmup, see AllocationTracker
+	Memory held by meshes, textures, shaders and render targets is counted by MemoryAccounting:
+		--memory-report S   print the CPU and GPU totals every S seconds, and the categories, peaks and largest assets on exit
+		--memory-dump FILE  write every counted resource to FILE as CSV on exit
+	Frame times, draw calls, uploads, cache hits and the load queues always go into Metrics:
+		--metrics ADDRESS   serve them in the Prometheus text format at http://ADDRESS/metrics, e.g. --metrics 127.0.0.1:9100
 	*/
 	class BaseApp
 	{
 	public:
 
-		BaseApp(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight);
+		BaseApp(int argc, char** argv, std::string windowName, int windowWidth, int windowHeight, bool headless = false);
 		virtual ~BaseApp();
 
 		/*!
@@ -62,6 +91,21 @@ namespace basicgraphics {
 		 */
 		void run();
 
+		/*!
+		 * Writes every frame rendered from now on to directory as an image sequence, see FrameCapture.
+		 */
+		void startFrameCapture(const std::string &directory, FrameCapture::Format format = FrameCapture::FORMAT_PNG);
+
+		// Stops capturing and waits until the captured frames are written
+		void stopFrameCapture();
+
+		bool isCapturingFrames() const;
+
+		// Makes run() return after the current frame
+		void requestExit();
+
+		bool isHeadless() const;
+
 		// Callbacks for user input
 		static void error_callback(int error, const char* description);
 		static void window_size_callback(GLFWwindow* window, int width, int height);
@@ -71,6 +115,10 @@ namespace basicgraphics {
 		static void cursor_enter_callback(GLFWwindow* window, int entered);
 		static void scroll_callback(GLFWwindow* window, double x, double y);
 		static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
+		// Turns a key action into a kbd_ event for onEvent, key_callback calls it for the window
+		void onKey(int key, int scancode, int action, int mods);
+
 		static glm::vec2 cursorPos;
 
 	protected:
@@ -80,6 +128,25 @@ namespace basicgraphics {
 		int _windowXPos;
 		int _windowYPos;
 
+		std::unique_ptr<FrameCapture> _frameCapture;
+
+		// Only in headless mode, then _window is null
+		std::unique_ptr<HeadlessContext> _headlessContext;
+		std::unique_ptr<Framebuffer> _framebuffer;
+
+		bool _exitRequested;
+		int _maxFrames; // 0 for no limit
+		int _frameNumber;
+		bool _profiling; // --profile was given
+		bool _glStats;   // --gl-stats was given
+		bool _trackAllocations; // --track-allocations was given
+		bool _memoryReport; // --memory-report or --memory-dump was given
+		std::string _memoryDumpFile;
+		std::unique_ptr<MetricsServer> _metricsServer; // with --metrics
+
+		// The Event the input callbacks fill in and pass to onEvent, see nextInputEvent
+		std::shared_ptr<Event> _inputEvent;
+
 
 		/*!
 		 * Called from the run loop. You should put any of your drawing code in this member function.
@@ -104,12 +171,23 @@ namespace basicgraphics {
 		void updateWindowSize();
 		void updateWindowPosition(int x, int y);
 
-		// Keypress helper methods
-		static std::string getKeyName(int key);
-		static std::string getKeyValue(int key, int mods);
-		static std::string getActionName(int action);
-		static std::string getButtonName(int button);
-		static std::string getModsName(int mods);
+		void parseArguments(int argc, char** argv, bool &headless);
+		void createWindow(const std::string &windowName, int windowWidth, int windowHeight);
+		void createHeadless(int width, int height);
+
+		/*!
+		 * Returns _inputEvent to be reset for the next input. Input arrives every frame the mouse moves, so the
+		 * callbacks don't allocate: they reuse the one Event, and build its name from the string literals below in
+		 * a buffer on the stack. Only when a handler kept the last event is a new one made.
+		 */
+		Event& nextInputEvent();
+
+		// Keypress helper methods, they return string literals
+		static const char* getKeyName(int key);
+		static const char* getKeyValue(int key, int mods);
+		static const char* getActionName(int action);
+		static const char* getButtonName(int button);
+		static const char* getModsName(int mods);
 
 	};
 
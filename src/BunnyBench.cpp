@@ -0,0 +1,387 @@
+//
+//  BunnyBench.cpp
+//
+//  bunny_bench renders a set of models along a scripted camera and light path for a fixed number of
+//  frames, with vsync off, and reports the frame, CPU, GPU and load times as JSON. Given a baseline
+//  report it exits with 1 if any time got worse by more than the threshold, so it can gate changes:
+//
+//      ./bunny_bench --headless --size 1920x1080 --output baseline.json
+//      ... change something ...
+//      ./bunny_bench --headless --size 1920x1080 --baseline baseline.json --threshold 10
+//
+//  With --scaling it instead sweeps grids of objects, materials and lights and writes the scaling curves
+//  as CSV, see ScalingBenchmark:
+//
+//      ./bunny_bench --scaling --objects 1,10,100,1000 --materials 1,10 --lights 1,8 --output scaling.csv
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "App.h"
+#include "ScalingBenchmark.h"
+
+using namespace basicgraphics;
+
+typedef std::chrono::steady_clock Clock;
+typedef std::vector<std::pair<std::string, double> > Metrics; // in the order they are reported
+
+// The camera goes around once every ORBIT_FRAMES frames, the light moves as it does in App at 60 fps
+static const int ORBIT_FRAMES = 600;
+static const double LIGHT_STEP = 0.25 / 60.0;
+static const double TWO_PI = 6.283185307179586;
+
+// Differences below this are noise on any machine, they never count as regressions
+static const double MIN_REGRESSION_MILLISECONDS = 0.05;
+
+// App with the camera and the light driven by the frame number instead of the clock and the mouse, so every
+// run renders the same frames. The frames before numWarmupFrames (shader compiles, first uploads) are not kept.
+class BenchApp : public App {
+public:
+
+	BenchApp(int argc, char** argv, const std::vector<std::string> &modelFiles, int numFrames, int numWarmupFrames) :
+		App(argc, argv, "bunny_bench", 1024, 768), _numWarmupFrames(numWarmupFrames)
+	{
+		// Measure the rendering, not the display's refresh rate
+		if (_window != nullptr) {
+			glfwSwapInterval(0);
+		}
+		_maxFrames = numWarmupFrames + numFrames;
+
+		const Clock::time_point start = Clock::now();
+		for (int i = 0; i < modelFiles.size(); i++) {
+			TRACE_SCOPE_DETAIL("startup", "Load model", modelFiles[i].c_str());
+			_models.emplace_back(new Model(modelFiles[i], 1.0, glm::vec4(1.0)));
+		}
+		_loadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		Profiler::getInstance().setListener([this](int frame, const std::string &path, int depth, float cpuMilliseconds, float gpuMilliseconds) {
+			if (frame < _numWarmupFrames) {
+				return;
+			}
+			if (path == "Frame") {
+				frameTimes.push_back(cpuMilliseconds);
+				if (gpuMilliseconds >= 0.0f) {
+					gpuTimes.push_back(gpuMilliseconds);
+				}
+			}
+			else if (path == "Frame/onRenderGraphics") {
+				cpuTimes.push_back(cpuMilliseconds);
+			}
+		});
+	}
+
+	~BenchApp()
+	{
+		Profiler::getInstance().setListener(nullptr);
+	}
+
+	void onRenderGraphics() override
+	{
+		// Around once, bobbing up and down twice and moving in and out so the models cover more and less of the screen
+		const double t = (double)_frameNumber / ORBIT_FRAMES;
+		turntable->setAround(TWO_PI * t);
+		turntable->setUp(0.3 + 0.25 * sin(2.0 * TWO_PI * t));
+		turntable->setDistance(3.0 + sin(TWO_PI * t));
+		updateLightPosition(_frameNumber * LIGHT_STEP);
+
+		glm::mat4 view = turntable->frame();
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)_windowWidth / (GLfloat)_windowHeight, 0.1f, 100.0f);
+		for (int i = 0; i < _models.size(); i++) {
+			drawScene(*_models[i], view, projection, turntable->getPos(), _windowHeight);
+		}
+	}
+
+	// Keys and the mouse would change what is rendered
+	void onEvent(std::shared_ptr<Event> event) override {}
+
+	double getLoadMilliseconds() const { return _loadMilliseconds; }
+	int getWidth() const { return _windowWidth; }
+	int getHeight() const { return _windowHeight; }
+
+	// In milliseconds, one per frame after the warmup. Frames whose GPU times were dropped have none.
+	std::vector<float> frameTimes; // the whole frame on the CPU, from the Profiler's "Frame" scope
+	std::vector<float> cpuTimes;   // onRenderGraphics on the CPU
+	std::vector<float> gpuTimes;   // the whole frame on the GPU
+
+private:
+	std::vector<std::unique_ptr<Model>> _models;
+	int _numWarmupFrames;
+	double _loadMilliseconds;
+};
+
+static double getPercentile(const std::vector<float> &sorted, int percent)
+{
+	return sorted[(sorted.size() - 1) * percent / 100];
+}
+
+// Adds name_avg, name_p50, name_p95 and name_p99, nothing if there are no times
+static void addTimes(Metrics &metrics, const std::string &name, std::vector<float> times)
+{
+	if (times.empty()) {
+		return;
+	}
+	std::sort(times.begin(), times.end());
+	double sum = 0.0;
+	for (int i = 0; i < times.size(); i++) {
+		sum += times[i];
+	}
+	metrics.push_back(std::make_pair(name + "_avg", sum / times.size()));
+	metrics.push_back(std::make_pair(name + "_p50", getPercentile(times, 50)));
+	metrics.push_back(std::make_pair(name + "_p95", getPercentile(times, 95)));
+	metrics.push_back(std::make_pair(name + "_p99", getPercentile(times, 99)));
+}
+
+static std::string writeReport(const BenchApp &app, const std::vector<std::string> &modelFiles, int numWarmupFrames, const Metrics &metrics)
+{
+	std::ostringstream json;
+	json << "{\n";
+	json << "\t\"benchmark\": \"bunny_bench\",\n";
+	json << "\t\"width\": " << app.getWidth() << ",\n";
+	json << "\t\"height\": " << app.getHeight() << ",\n";
+	json << "\t\"frames\": " << app.frameTimes.size() << ",\n";
+	json << "\t\"warmup_frames\": " << numWarmupFrames << ",\n";
+	json << "\t\"gpu_frames\": " << app.gpuTimes.size() << ",\n";
+	json << "\t\"models\": [";
+	for (int i = 0; i < modelFiles.size(); i++) {
+		json << (i > 0 ? ", " : "") << "\"" << modelFiles[i] << "\"";
+	}
+	json << "],\n";
+	json << "\t\"metrics\": {\n";
+	for (int i = 0; i < metrics.size(); i++) {
+		char value[32];
+		snprintf(value, sizeof(value), "%.4f", metrics[i].second);
+		json << "\t\t\"" << metrics[i].first << "\": " << value << (i + 1 < metrics.size() ? ",\n" : "\n");
+	}
+	json << "\t}\n";
+	json << "}\n";
+	return json.str();
+}
+
+// Reads the "metrics" object of a report written by writeReport
+static bool readBaseline(const std::string &fileName, Metrics &metrics)
+{
+	std::ifstream file(fileName.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Could not open the baseline " << fileName << std::endl;
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	const std::string json = contents.str();
+
+	size_t position = json.find("\"metrics\"");
+	position = position == std::string::npos ? position : json.find('{', position);
+	if (position == std::string::npos) {
+		std::cerr << "No metrics in the baseline " << fileName << std::endl;
+		return false;
+	}
+	const size_t end = json.find('}', position);
+	while (true) {
+		const size_t keyStart = json.find('"', position + 1);
+		if (keyStart == std::string::npos || keyStart > end) {
+			break;
+		}
+		const size_t keyEnd = json.find('"', keyStart + 1);
+		const size_t colon = json.find(':', keyEnd);
+		if (keyEnd == std::string::npos || colon == std::string::npos || colon > end) {
+			break;
+		}
+		const char* number = json.c_str() + colon + 1;
+		char* numberEnd = nullptr;
+		const double value = strtod(number, &numberEnd);
+		if (numberEnd == number) {
+			std::cerr << "Bad value for " << json.substr(keyStart + 1, keyEnd - keyStart - 1) << " in the baseline " << fileName << std::endl;
+			return false;
+		}
+		metrics.push_back(std::make_pair(json.substr(keyStart + 1, keyEnd - keyStart - 1), value));
+		position = numberEnd - json.c_str();
+	}
+	return !metrics.empty();
+}
+
+// Prints every time that is in both, returns the number of times that are more than threshold percent slower
+static int compare(const Metrics &baseline, const Metrics &metrics, double threshold)
+{
+	int numRegressions = 0;
+	printf("%-16s %10s %10s %9s\n", "metric", "baseline", "current", "change");
+	for (int i = 0; i < metrics.size(); i++) {
+		for (int j = 0; j < baseline.size(); j++) {
+			if (baseline[j].first != metrics[i].first) {
+				continue;
+			}
+			const double before = baseline[j].second;
+			const double now = metrics[i].second;
+			const double change = before > 0.0 ? 100.0 * (now - before) / before : 0.0;
+			const bool regression = change > threshold && now - before > MIN_REGRESSION_MILLISECONDS;
+			printf("%-16s %10.3f %10.3f %+8.1f%%%s\n", metrics[i].first.c_str(), before, now, change, regression ? "  REGRESSION" : "");
+			if (regression) {
+				numRegressions++;
+			}
+		}
+	}
+	return numRegressions;
+}
+
+static std::vector<std::string> splitList(const std::string &list)
+{
+	std::vector<std::string> items;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (!item.empty()) {
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static std::vector<int> splitNumbers(const std::string &list)
+{
+	const std::vector<std::string> items = splitList(list);
+	std::vector<int> numbers;
+	for (int i = 0; i < items.size(); i++) {
+		numbers.push_back(atoi(items[i].c_str()));
+	}
+	return numbers;
+}
+
+static int runScaling(int argc, char** argv, const ScalingBenchmark::Settings &settings, const std::string &outputFile)
+{
+	std::ofstream file(outputFile.c_str());
+	if (!file.is_open()) {
+		std::cerr << "Could not open " << outputFile << std::endl;
+		return 2;
+	}
+	ScalingBenchmark benchmark(argc, argv, settings);
+	benchmark.run();
+	benchmark.writeCSV(file);
+	if (!file.good()) {
+		std::cerr << "Could not write " << outputFile << std::endl;
+		return 2;
+	}
+	std::cout << "Wrote " << benchmark.getResults().size() << " configurations to " << outputFile << std::endl;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	// BaseApp also reads --headless and --size, --frames here is the number of frames measured after the warmup
+	std::vector<std::string> modelFiles;
+	int numFrames = 600;
+	int numWarmupFrames = 60;
+	std::string outputFile;
+	std::string baselineFile;
+	double threshold = 10.0; // percent
+	bool scaling = false;
+	bool framesGiven = false;
+	bool warmupGiven = false;
+	ScalingBenchmark::Settings scalingSettings;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--scaling") {
+			scaling = true;
+		}
+		else if (i + 1 >= argc) {
+			break;
+		}
+		else if (arg == "--objects") {
+			scalingSettings.numObjects = splitNumbers(argv[++i]);
+		}
+		else if (arg == "--materials") {
+			scalingSettings.numMaterials = splitNumbers(argv[++i]);
+		}
+		else if (arg == "--lights") {
+			scalingSettings.numLights = splitNumbers(argv[++i]);
+		}
+		else if (arg == "--models") {
+			modelFiles = splitList(argv[++i]);
+		}
+		else if (arg == "--frames") {
+			numFrames = std::max(atoi(argv[++i]), 1);
+			framesGiven = true;
+		}
+		else if (arg == "--warmup") {
+			numWarmupFrames = std::max(atoi(argv[++i]), 0);
+			warmupGiven = true;
+		}
+		else if (arg == "--output") {
+			outputFile = argv[++i];
+		}
+		else if (arg == "--baseline") {
+			baselineFile = argv[++i];
+		}
+		else if (arg == "--threshold") {
+			threshold = std::max(atof(argv[++i]), 0.0);
+		}
+	}
+
+	// Each configuration gets fewer frames than a single run by default, there are dozens of them
+	if (scaling) {
+		if (framesGiven) {
+			scalingSettings.numFrames = numFrames;
+		}
+		if (warmupGiven) {
+			scalingSettings.numWarmupFrames = numWarmupFrames;
+		}
+		return runScaling(argc, argv, scalingSettings, outputFile.empty() ? "scaling.csv" : outputFile);
+	}
+
+	if (modelFiles.empty()) {
+		modelFiles.push_back("bunny.obj");
+	}
+
+	const Clock::time_point start = Clock::now();
+	std::unique_ptr<BenchApp> app(new BenchApp(argc, argv, modelFiles, numFrames, numWarmupFrames));
+	const double startupMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	app->run();
+
+	if (app->frameTimes.empty()) {
+		std::cerr << "No frames were measured" << std::endl;
+		return 2;
+	}
+	if (app->gpuTimes.empty()) {
+		std::cerr << "No GPU times, timer queries are not supported or never finished in time" << std::endl;
+	}
+
+	Metrics metrics;
+	metrics.push_back(std::make_pair(std::string("startup_ms"), startupMilliseconds));
+	metrics.push_back(std::make_pair(std::string("load_ms"), app->getLoadMilliseconds()));
+	addTimes(metrics, "frame_ms", app->frameTimes);
+	addTimes(metrics, "cpu_ms", app->cpuTimes);
+	addTimes(metrics, "gpu_ms", app->gpuTimes);
+
+	const std::string report = writeReport(*app, modelFiles, numWarmupFrames, metrics);
+	std::cout << report;
+	if (!outputFile.empty()) {
+		std::ofstream file(outputFile.c_str());
+		file << report;
+		if (!file.good()) {
+			std::cerr << "Could not write " << outputFile << std::endl;
+			return 2;
+		}
+	}
+
+	if (!baselineFile.empty()) {
+		Metrics baseline;
+		if (!readBaseline(baselineFile, baseline)) {
+			return 2;
+		}
+		const int numRegressions = compare(baseline, metrics, threshold);
+		if (numRegressions > 0) {
+			std::cout << numRegressions << " times are more than " << threshold << "% slower than " << baselineFile << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
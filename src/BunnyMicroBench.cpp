@@ -0,0 +1,330 @@
+//
+//  BunnyMicroBench.cpp
+//
+//  bunny_microbench times the hot paths of loading and drawing one at a time: OBJ import, vertex
+//  packing, uniform uploads, key events, texture decode and upload and the normal matrix. The GL
+//  benchmarks run in a window, or with --headless in an offscreen context. With --output the results
+//  are written as Google Benchmark style JSON to track them over time:
+//
+//      ./bunny_microbench --headless --output micro.json
+//      ./bunny_microbench --headless --filter Uniform --min-time 2
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BaseApp.h"
+#include "MicroBenchmark.h"
+
+using namespace basicgraphics;
+
+// Provides the GL context and the GL objects the benchmarks share, and counts the events it gets
+class MicroBenchApp : public BaseApp {
+public:
+
+	MicroBenchApp(int argc, char** argv) : BaseApp(argc, argv, "bunny_microbench", 256, 256), numEvents(0), _shaderLoaded(false) {}
+
+	void onEvent(std::shared_ptr<Event> event) override
+	{
+		numEvents++;
+	}
+
+	// The shader App draws with, null if it does not compile
+	GLSLProgram* getShader()
+	{
+		if (!_shaderLoaded) {
+			_shaderLoaded = true;
+			try {
+				_shader.compileShader("BlinnPhong.vert");
+				_shader.compileShader("BlinnPhong.frag");
+				_shader.link();
+			}
+			catch (GLSLProgramException &e) {
+				std::cerr << e.what() << std::endl;
+				return nullptr;
+			}
+		}
+		return _shader.isLinked() ? &_shader : nullptr;
+	}
+
+	int numEvents;
+
+private:
+	GLSLProgram _shader;
+	bool _shaderLoaded;
+};
+
+static MicroBenchApp* app = nullptr;
+static std::string modelFile = "bunny-simplified.obj";
+
+static bool readFile(const std::string &fileName, std::vector<unsigned char> &bytes)
+{
+	std::ifstream file(fileName.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !bytes.empty();
+}
+
+// Import ---------------------------------------------------------------
+
+// Assimp's parse plus packing into Mesh::Vertex, without GL
+static void parseOBJ(BenchmarkState &state)
+{
+	std::vector<unsigned char> file;
+	if (!readFile(modelFile, file)) {
+		state.skip("could not read " + modelFile);
+	}
+	std::vector<Mesh::Vertex> vertices;
+	std::vector<int> indices;
+	while (state.keepRunning()) {
+		Model::loadGeometry(modelFile, 1.0, vertices, indices);
+	}
+	state.setBytesProcessed(state.getIterations() * (long long)file.size());
+}
+MICRO_BENCHMARK("Import/parse OBJ (Model::loadGeometry)", parseOBJ);
+
+// All of the Model constructor: the parse, Model::processMesh and the buffer uploads
+static void importModel(BenchmarkState &state)
+{
+	std::vector<unsigned char> file;
+	if (!readFile(modelFile, file)) {
+		state.skip("could not read " + modelFile);
+	}
+	// Model prints its import progress, which is not what is being measured here
+	std::ostringstream discard;
+	std::streambuf* output = std::cout.rdbuf(discard.rdbuf());
+	while (state.keepRunning()) {
+		Model model(modelFile, 1.0);
+		state.pauseTiming();
+		discard.str("");
+		state.resumeTiming();
+	}
+	glFinish();
+	std::cout.rdbuf(output);
+	state.setBytesProcessed(state.getIterations() * (long long)file.size());
+}
+MICRO_BENCHMARK("Import/import model (Model::Model)", importModel);
+
+// Model::appendGeometry, the loop processMesh spends its CPU time in
+static void packVertices(BenchmarkState &state)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(modelFile, aiProcess_Triangulate);
+	if (scene == nullptr || scene->mNumMeshes == 0) {
+		state.skip("could not import " + modelFile);
+	}
+	const glm::mat4 scaleMat(1.0);
+	std::vector<Mesh::Vertex> vertices;
+	std::vector<int> indices;
+	long long numVertices = 0;
+	while (state.keepRunning()) {
+		vertices.clear();
+		indices.clear();
+		for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+			Model::appendGeometry(scene->mMeshes[i], scaleMat, vertices, indices);
+		}
+		numVertices += vertices.size();
+		doNotOptimize(vertices[0]);
+	}
+	state.setItemsProcessed(numVertices);
+	state.setBytesProcessed(numVertices * (long long)sizeof(Mesh::Vertex));
+}
+MICRO_BENCHMARK("Import/pack vertices (Model::appendGeometry)", packVertices);
+
+// Uniforms -------------------------------------------------------------
+
+// setUniform looks the location up by name every call, then uploads
+static void setUniform(BenchmarkState &state, const char* name, bool matrix)
+{
+	GLSLProgram* shader = app->getShader();
+	if (shader == nullptr) {
+		state.skip("BlinnPhong did not compile");
+		return;
+	}
+	shader->use();
+	glm::mat4 model(1.0);
+	glm::vec3 eye(0.0, 1.0, 3.0);
+	while (state.keepRunning()) {
+		doNotOptimize(model);
+		doNotOptimize(eye);
+		if (matrix) {
+			shader->setUniform(name, model);
+		}
+		else {
+			shader->setUniform(name, eye);
+		}
+	}
+	glFinish();
+	state.setItemsProcessed(state.getIterations());
+}
+
+static void setUniformMat4(BenchmarkState &state)
+{
+	setUniform(state, "model_mat", true);
+}
+MICRO_BENCHMARK("Uniform/setUniform mat4", setUniformMat4);
+
+static void setUniformVec3(BenchmarkState &state)
+{
+	setUniform(state, "eye_world", false);
+}
+MICRO_BENCHMARK("Uniform/setUniform vec3", setUniformVec3);
+
+// A name the program does not have, which App sets when a shader leaves a uniform out
+static void setUniformMissing(BenchmarkState &state)
+{
+	setUniform(state, "not_in_the_shader", false);
+}
+MICRO_BENCHMARK("Uniform/setUniform missing name", setUniformMissing);
+
+// Events ---------------------------------------------------------------
+
+static void constructEvent(BenchmarkState &state)
+{
+	while (state.keepRunning()) {
+		std::shared_ptr<Event> event(new Event("kbd_A_down", std::string("a"), nullptr));
+		doNotOptimize(event);
+	}
+	state.setItemsProcessed(state.getIterations());
+}
+MICRO_BENCHMARK("Event/construct", constructEvent);
+
+// What BaseApp::key_callback does per key: build the event name, reset the reused Event with it and call onEvent
+static void dispatchKey(BenchmarkState &state)
+{
+	while (state.keepRunning()) {
+		app->onKey(GLFW_KEY_A, 0, GLFW_PRESS, GLFW_MOD_SHIFT);
+	}
+	doNotOptimize(app->numEvents);
+	state.setItemsProcessed(state.getIterations());
+}
+MICRO_BENCHMARK("Event/key dispatch (BaseApp::onKey)", dispatchKey);
+
+// Textures -------------------------------------------------------------
+
+static void decodeTexture(BenchmarkState &state)
+{
+	std::vector<unsigned char> file;
+	if (!readFile("lightingToon.jpg", file)) {
+		state.skip("could not read lightingToon.jpg");
+	}
+	while (state.keepRunning()) {
+		int width = 0, height = 0, channels = 0;
+		unsigned char* pixels = SOIL_load_image_from_memory(&file[0], (int)file.size(), &width, &height, &channels, SOIL_LOAD_AUTO);
+		doNotOptimize(pixels);
+		SOIL_free_image_data(pixels);
+	}
+	state.setBytesProcessed(state.getIterations() * (long long)file.size());
+}
+MICRO_BENCHMARK("Texture/decode JPEG", decodeTexture);
+
+// Creating the texture and uploading the pixels, until the GL is done with them
+static void uploadTexture(BenchmarkState &state)
+{
+	const int size = 1024;
+	std::vector<unsigned char> pixels(size * size * 4);
+	for (size_t i = 0; i < pixels.size(); i++) {
+		pixels[i] = (unsigned char)(i * 7);
+	}
+	while (state.keepRunning()) {
+		std::shared_ptr<Texture> texture = Texture::createFromMemory("upload", &pixels[0], GL_UNSIGNED_BYTE, GL_RGBA, GL_RGBA8, GL_TEXTURE_2D, size, size, 1);
+		glFinish();
+	}
+	state.setBytesProcessed(state.getIterations() * (long long)pixels.size());
+}
+MICRO_BENCHMARK("Texture/upload 1024x1024 RGBA8", uploadTexture);
+
+// Matrices -------------------------------------------------------------
+
+static void inverseMatrix(BenchmarkState &state)
+{
+	glm::mat4 model = glm::translate(glm::mat4(1.0), glm::vec3(1.0, 2.0, 3.0)) * glm::scale(glm::mat4(1.0), glm::vec3(0.5));
+	while (state.keepRunning()) {
+		doNotOptimize(model);
+		glm::mat4 inverse = glm::inverse(model);
+		doNotOptimize(inverse);
+	}
+	state.setItemsProcessed(state.getIterations());
+}
+MICRO_BENCHMARK("Matrix/inverse", inverseMatrix);
+
+// The normal matrix as Sphere::draw and App::drawScene compute it
+static void normalMatrix(BenchmarkState &state)
+{
+	glm::mat4 model = glm::translate(glm::mat4(1.0), glm::vec3(1.0, 2.0, 3.0)) * glm::scale(glm::mat4(1.0), glm::vec3(0.5));
+	while (state.keepRunning()) {
+		doNotOptimize(model);
+		glm::mat3 normal = glm::mat3(glm::transpose(glm::inverse(model)));
+		doNotOptimize(normal);
+	}
+	state.setItemsProcessed(state.getIterations());
+}
+MICRO_BENCHMARK("Matrix/normal matrix (Sphere::draw)", normalMatrix);
+
+// All of Sphere::draw on the CPU: the matrices, four uniform uploads and the draw call
+static void drawSphere(BenchmarkState &state)
+{
+	GLSLProgram* shader = app->getShader();
+	if (shader == nullptr) {
+		state.skip("BlinnPhong did not compile");
+		return;
+	}
+	shader->use();
+	Sphere sphere(glm::vec3(0.0, 1.0, 0.0), 0.1f, glm::vec4(1.0, 1.0, 0.0, 1.0));
+	const glm::mat4 model(1.0);
+	while (state.keepRunning()) {
+		sphere.draw(*shader, model);
+	}
+	glFinish();
+	state.setItemsProcessed(state.getIterations());
+}
+MICRO_BENCHMARK("Matrix/Sphere::draw", drawSphere);
+
+int main(int argc, char** argv)
+{
+	// BaseApp also reads --headless
+	MicroBenchmarks::Settings settings;
+	std::string outputFile;
+	for (int i = 1; i < argc - 1; i++) {
+		std::string arg = argv[i];
+		if (arg == "--filter") {
+			settings.filter = argv[++i];
+		}
+		else if (arg == "--min-time") {
+			settings.minSeconds = std::max(atof(argv[++i]), 0.001);
+		}
+		else if (arg == "--repetitions") {
+			settings.repetitions = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--model") {
+			modelFile = argv[++i];
+		}
+		else if (arg == "--output") {
+			outputFile = argv[++i];
+		}
+	}
+
+	std::unique_ptr<MicroBenchApp> benchApp(new MicroBenchApp(argc, argv));
+	app = benchApp.get();
+	const std::vector<MicroBenchmarks::Result> results = MicroBenchmarks::getInstance().run(settings, std::cout);
+	app = nullptr;
+
+	if (!outputFile.empty()) {
+		std::ofstream file(outputFile.c_str());
+		MicroBenchmarks::writeJSON(results, argv[0], file);
+		if (!file.good()) {
+			std::cerr << "Could not write " << outputFile << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,439 @@
+//
+//  CompressedImage.cpp
+//
+//
+
+#include "CompressedImage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+namespace basicgraphics {
+
+	static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	struct KTXHeader {
+		unsigned char identifier[12];
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	struct DDSPixelFormat {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DDSHeader {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DDSHeaderDX10 {
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static uint32_t makeFourCC(char a, char b, char c, char d)
+	{
+		return (uint32_t)(unsigned char)a | ((uint32_t)(unsigned char)b << 8) | ((uint32_t)(unsigned char)c << 16) | ((uint32_t)(unsigned char)d << 24);
+	}
+
+	static const uint32_t DDPF_ALPHAPIXELS = 0x1;
+	static const uint32_t DDPF_FOURCC = 0x4;
+	static const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	static const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+	// Larger than any GL_MAX_TEXTURE_SIZE, anything bigger in a header is a corrupt file
+	static const uint32_t MAX_DIMENSION = 32768;
+
+	// floor(log2(max(width, height))) + 1, a longer chain in a header is corrupt and would shift by 32 or more
+	static int getFullMipMapLevels(int width, int height)
+	{
+		int levels = 1;
+		for (int size = std::max(width, height); size > 1; size >>= 1) {
+			levels++;
+		}
+		return levels;
+	}
+
+	// Bytes from the read position to the end of the file
+	static std::streamoff getRemainingBytes(std::ifstream &in)
+	{
+		const std::streamoff position = in.tellg();
+		in.seekg(0, std::ios::end);
+		const std::streamoff end = in.tellg();
+		in.seekg(position, std::ios::beg);
+		return end - position;
+	}
+
+	CompressedImage::CompressedImage() : target(GL_TEXTURE_2D), internalFormat(0), width(0), height(0), numMipMapLevels(0), numFaces(1)
+	{
+	}
+
+	std::vector<unsigned char>& CompressedImage::getLevel(int level, int face /*=0*/)
+	{
+		return data[level * numFaces + face];
+	}
+
+	const std::vector<unsigned char>& CompressedImage::getLevel(int level, int face /*=0*/) const
+	{
+		return data[level * numFaces + face];
+	}
+
+	size_t CompressedImage::getByteSize() const
+	{
+		size_t total = 0;
+		for (int i = 0; i < data.size(); i++) {
+			total += data[i].size();
+		}
+		return total;
+	}
+
+	bool CompressedImage::load(const std::string &fileName, std::string &error)
+	{
+		size_t loc = fileName.find_last_of('.');
+		std::string ext = (loc != std::string::npos) ? fileName.substr(loc) : "";
+		if (ext == ".ktx" || ext == ".KTX") {
+			return loadKTX(fileName, error);
+		}
+		if (ext == ".dds" || ext == ".DDS") {
+			return loadDDS(fileName, error);
+		}
+		error = "Unrecognized compressed texture container: " + fileName;
+		return false;
+	}
+
+	bool CompressedImage::loadKTX(const std::string &fileName, std::string &error)
+	{
+		std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+		if (!in) {
+			error = "Unable to open: " + fileName;
+			return false;
+		}
+
+		KTXHeader header;
+		in.read((char*)&header, sizeof(KTXHeader));
+		if (!in || memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0) {
+			error = "Not a KTX 1.1 file: " + fileName;
+			return false;
+		}
+		if (header.endianness != 0x04030201) {
+			error = "Big endian KTX files are not supported: " + fileName;
+			return false;
+		}
+		if (header.glType != 0 || !isCompressedFormat(header.glInternalFormat)) {
+			error = "KTX file does not hold a supported block compressed format: " + fileName;
+			return false;
+		}
+		if (header.pixelDepth > 1 || header.numberOfArrayElements > 1 || (header.numberOfFaces != 1 && header.numberOfFaces != 6)) {
+			error = "Only 2D textures and cube maps are supported: " + fileName;
+			return false;
+		}
+		if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > MAX_DIMENSION || header.pixelHeight > MAX_DIMENSION) {
+			error = "Invalid image size in: " + fileName;
+			return false;
+		}
+
+		internalFormat = header.glInternalFormat;
+		width = header.pixelWidth;
+		height = header.pixelHeight;
+		numFaces = header.numberOfFaces;
+		target = (numFaces == 6) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+		numMipMapLevels = std::min(std::max(header.numberOfMipmapLevels, (uint32_t)1), (uint32_t)getFullMipMapLevels(width, height));
+
+		std::streamoff remaining = getRemainingBytes(in);
+		if ((std::streamoff)header.bytesOfKeyValueData > remaining) {
+			error = "Truncated KTX file: " + fileName;
+			return false;
+		}
+		in.seekg(header.bytesOfKeyValueData, std::ios::cur);
+		remaining -= header.bytesOfKeyValueData;
+		data.assign(numMipMapLevels * numFaces, std::vector<unsigned char>());
+
+		for (int level = 0; level < numMipMapLevels; level++) {
+			uint32_t imageSize = 0;
+			in.read((char*)&imageSize, sizeof(uint32_t));
+			if (!in) {
+				error = "Truncated KTX file: " + fileName;
+				return false;
+			}
+
+			int levelWidth = std::max(1, width >> level);
+			int levelHeight = std::max(1, height >> level);
+			if (imageSize != getLevelByteSize(internalFormat, levelWidth, levelHeight)) {
+				error = "Unexpected mip level size in: " + fileName;
+				return false;
+			}
+			// Checked before resizing, so a corrupt size can't allocate more than the file holds
+			remaining -= sizeof(uint32_t);
+			if ((std::streamoff)imageSize * numFaces > remaining) {
+				error = "Truncated KTX file: " + fileName;
+				return false;
+			}
+			remaining -= (std::streamoff)imageSize * numFaces;
+
+			for (int face = 0; face < numFaces; face++) {
+				std::vector<unsigned char> &bytes = getLevel(level, face);
+				bytes.resize(imageSize);
+				in.read((char*)&bytes[0], imageSize);
+				// Block sizes are multiples of 4, so there is no cube or mip padding to skip
+			}
+			if (!in) {
+				error = "Truncated KTX file: " + fileName;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool CompressedImage::loadDDS(const std::string &fileName, std::string &error)
+	{
+		std::ifstream in(fileName.c_str(), std::ios::in | std::ios::binary);
+		if (!in) {
+			error = "Unable to open: " + fileName;
+			return false;
+		}
+
+		uint32_t magic = 0;
+		DDSHeader header;
+		in.read((char*)&magic, sizeof(uint32_t));
+		in.read((char*)&header, sizeof(DDSHeader));
+		if (!in || magic != makeFourCC('D', 'D', 'S', ' ') || header.size != sizeof(DDSHeader)) {
+			error = "Not a DDS file: " + fileName;
+			return false;
+		}
+		if (!(header.pixelFormat.flags & DDPF_FOURCC)) {
+			error = "DDS file is not block compressed: " + fileName;
+			return false;
+		}
+
+		bool cube = (header.caps2 & DDSCAPS2_CUBEMAP) != 0;
+		const uint32_t fourCC = header.pixelFormat.fourCC;
+		internalFormat = 0;
+		if (fourCC == makeFourCC('D', 'X', '1', '0')) {
+			DDSHeaderDX10 dx10;
+			in.read((char*)&dx10, sizeof(DDSHeaderDX10));
+			if (!in) {
+				error = "Truncated DDS file: " + fileName;
+				return false;
+			}
+			cube = cube || (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+			switch (dx10.dxgiFormat) {
+			case 71: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break; // BC1_UNORM
+			case 72: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; break; // BC1_UNORM_SRGB
+			case 74: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break; // BC2_UNORM
+			case 77: internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break; // BC3_UNORM
+			case 78: internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; break; // BC3_UNORM_SRGB
+			case 80: internalFormat = GL_COMPRESSED_RED_RGTC1; break; // BC4_UNORM
+			case 81: internalFormat = GL_COMPRESSED_SIGNED_RED_RGTC1; break; // BC4_SNORM
+			case 83: internalFormat = GL_COMPRESSED_RG_RGTC2; break; // BC5_UNORM
+			case 84: internalFormat = GL_COMPRESSED_SIGNED_RG_RGTC2; break; // BC5_SNORM
+			case 98: internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break; // BC7_UNORM
+			case 99: internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break; // BC7_UNORM_SRGB
+			default: break;
+			}
+		}
+		else if (fourCC == makeFourCC('D', 'X', 'T', '1')) {
+			internalFormat = (header.pixelFormat.flags & DDPF_ALPHAPIXELS) ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		}
+		else if (fourCC == makeFourCC('D', 'X', 'T', '3')) {
+			internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		}
+		else if (fourCC == makeFourCC('D', 'X', 'T', '5')) {
+			internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		}
+		else if (fourCC == makeFourCC('A', 'T', 'I', '1') || fourCC == makeFourCC('B', 'C', '4', 'U')) {
+			internalFormat = GL_COMPRESSED_RED_RGTC1;
+		}
+		else if (fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U')) {
+			internalFormat = GL_COMPRESSED_RG_RGTC2;
+		}
+
+		if (internalFormat == 0) {
+			error = "Unsupported DDS pixel format in: " + fileName;
+			return false;
+		}
+
+		if (header.width == 0 || header.height == 0 || header.width > MAX_DIMENSION || header.height > MAX_DIMENSION) {
+			error = "Invalid image size in: " + fileName;
+			return false;
+		}
+
+		width = header.width;
+		height = header.height;
+		numFaces = cube ? 6 : 1;
+		target = cube ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+		numMipMapLevels = std::min(std::max(header.mipMapCount, (uint32_t)1), (uint32_t)getFullMipMapLevels(width, height));
+
+		// Checked before anything is allocated, so a corrupt header can't ask for more than the file holds
+		std::streamoff needed = 0;
+		for (int level = 0; level < numMipMapLevels; level++) {
+			needed += getLevelByteSize(internalFormat, std::max(1, width >> level), std::max(1, height >> level));
+		}
+		if (needed * numFaces > getRemainingBytes(in)) {
+			error = "Truncated DDS file: " + fileName;
+			return false;
+		}
+		data.assign(numMipMapLevels * numFaces, std::vector<unsigned char>());
+
+		// Unlike KTX, DDS stores each face with all of its mip levels before the next face
+		for (int face = 0; face < numFaces; face++) {
+			for (int level = 0; level < numMipMapLevels; level++) {
+				size_t size = getLevelByteSize(internalFormat, std::max(1, width >> level), std::max(1, height >> level));
+				std::vector<unsigned char> &bytes = getLevel(level, face);
+				bytes.resize(size);
+				in.read((char*)&bytes[0], size);
+				if (!in) {
+					error = "Truncated DDS file: " + fileName;
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool CompressedImage::saveKTX(const std::string &fileName, std::string &error) const
+	{
+		std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out) {
+			error = "Unable to write: " + fileName;
+			return false;
+		}
+
+		KTXHeader header;
+		memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+		header.endianness = 0x04030201;
+		header.glType = 0;
+		header.glTypeSize = 1;
+		header.glFormat = 0;
+		header.glInternalFormat = internalFormat;
+		header.glBaseInternalFormat = hasAlpha(internalFormat) ? GL_RGBA : (internalFormat == GL_COMPRESSED_RED_RGTC1 ? GL_RED : (internalFormat == GL_COMPRESSED_RG_RGTC2 ? GL_RG : GL_RGB));
+		header.pixelWidth = width;
+		header.pixelHeight = height;
+		header.pixelDepth = 0;
+		header.numberOfArrayElements = 0;
+		header.numberOfFaces = numFaces;
+		header.numberOfMipmapLevels = numMipMapLevels;
+		header.bytesOfKeyValueData = 0;
+		out.write((const char*)&header, sizeof(KTXHeader));
+
+		for (int level = 0; level < numMipMapLevels; level++) {
+			uint32_t imageSize = getLevel(level, 0).size();
+			out.write((const char*)&imageSize, sizeof(uint32_t));
+			for (int face = 0; face < numFaces; face++) {
+				const std::vector<unsigned char> &bytes = getLevel(level, face);
+				out.write((const char*)&bytes[0], bytes.size());
+			}
+		}
+
+		if (!out) {
+			error = "Unable to write: " + fileName;
+			return false;
+		}
+		return true;
+	}
+
+	bool CompressedImage::isCompressedFormat(GLenum internalFormat)
+	{
+		return getBlockBytes(internalFormat) != 0;
+	}
+
+	int CompressedImage::getBlockBytes(GLenum internalFormat)
+	{
+		switch (internalFormat) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RED_RGTC1:
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		case GL_COMPRESSED_RGB8_ETC2:
+		case GL_COMPRESSED_SRGB8_ETC2:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_R11_EAC:
+		case GL_COMPRESSED_SIGNED_R11_EAC:
+			return 8;
+
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RG_RGTC2:
+		case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+		case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+		case GL_COMPRESSED_RG11_EAC:
+		case GL_COMPRESSED_SIGNED_RG11_EAC:
+			return 16;
+
+		default:
+			return 0;
+		}
+	}
+
+	size_t CompressedImage::getLevelByteSize(GLenum internalFormat, int width, int height)
+	{
+		size_t blocksWide = (std::max(1, width) + 3) / 4;
+		size_t blocksHigh = (std::max(1, height) + 3) / 4;
+		return blocksWide * blocksHigh * getBlockBytes(internalFormat);
+	}
+
+	bool CompressedImage::hasAlpha(GLenum internalFormat)
+	{
+		switch (internalFormat) {
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+		case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+		case GL_COMPRESSED_RGBA8_ETC2_EAC:
+		case GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+}
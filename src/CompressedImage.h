@@ -0,0 +1,78 @@
+/*!
+ *  CompressedImage.h
+ *
+ * Block compressed image data (BC1-BC5, BC7, ETC2/EAC) with its full mip chain, read from or written to KTX and DDS containers.
+ */
+
+#ifndef CompressedImage_h
+#define CompressedImage_h
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+// Only present in the loader if it was generated with GL_EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace basicgraphics {
+
+	class CompressedImage
+	{
+	public:
+		CompressedImage();
+
+		GLenum target; // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+		GLenum internalFormat; // e.g. GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		int width; // of the base level, in pixels
+		int height;
+		int numMipMapLevels;
+		int numFaces; // 6 for cube maps
+
+		// Compressed blocks, indexed by level * numFaces + face
+		std::vector<std::vector<unsigned char>> data;
+
+		std::vector<unsigned char>& getLevel(int level, int face = 0);
+		const std::vector<unsigned char>& getLevel(int level, int face = 0) const;
+
+		// Total size of all levels and faces, i.e. how much video memory the texture takes
+		size_t getByteSize() const;
+
+		/*!
+		 * Loads a .ktx or .dds file (picked by extension). Returns false and sets error if the file
+		 * cannot be read or holds a format that is not block compressed.
+		 */
+		bool load(const std::string &fileName, std::string &error);
+		bool loadKTX(const std::string &fileName, std::string &error);
+		bool loadDDS(const std::string &fileName, std::string &error);
+
+		// Writes a KTX 1.1 file
+		bool saveKTX(const std::string &fileName, std::string &error) const;
+
+		// True for the block compressed formats this class knows how to size
+		static bool isCompressedFormat(GLenum internalFormat);
+
+		// 8 or 16 bytes per 4x4 block, 0 if the format is unknown
+		static int getBlockBytes(GLenum internalFormat);
+
+		// Bytes taken by one face of a level
+		static size_t getLevelByteSize(GLenum internalFormat, int width, int height);
+
+		// True if the format can store non-opaque alpha
+		static bool hasAlpha(GLenum internalFormat);
+	};
+
+}
+
+#endif /* CompressedImage_h */
@@ -67,7 +67,30 @@ void Event::rename(const std::string &newname)
 	_name = newname;
 }
 
-std::string Event::getName() const
+void Event::reset(const char* name, const GLFWwindow* window)
+{
+	_name.assign(name);
+	_type = EVENTTYPE_STANDARD;
+	_window = window;
+}
+
+void Event::reset(const char* name, const glm::dvec2 &data, const GLFWwindow* window)
+{
+	_name.assign(name);
+	_data2D = data;
+	_type = EVENTTYPE_2D;
+	_window = window;
+}
+
+void Event::reset(const char* name, const char* data, const GLFWwindow* window)
+{
+	_name.assign(name);
+	_dataMsg.assign(data);
+	_type = EVENTTYPE_MSG;
+	_window = window;
+}
+
+const std::string& Event::getName() const
 {
 	return _name;
 }
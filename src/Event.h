@@ -42,7 +42,7 @@ namespace basicgraphics {
 
 		virtual ~Event();
 
-		std::string getName() const;
+		const std::string& getName() const;
 		EventType getType() const;
 		const GLFWwindow* getWindow() const;
 
@@ -55,6 +55,12 @@ namespace basicgraphics {
 
 		void rename(const std::string &newname);
 
+		// Turn this event into another one of the same kind. The name and message are assigned in place, so
+		// once their capacity is big enough this doesn't allocate (BaseApp reuses one Event for input this way).
+		void reset(const char* name, const GLFWwindow* window);
+		void reset(const char* name, const glm::dvec2 &data, const GLFWwindow* window);
+		void reset(const char* name, const char* data, const GLFWwindow* window);
+
 	protected:
 		std::string _name;
 		int	_id;
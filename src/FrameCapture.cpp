@@ -0,0 +1,150 @@
+//
+//  FrameCapture.cpp
+//
+//
+
+#include "FrameCapture.h"
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+#include <cstdio>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace basicgraphics {
+
+	FrameCapture::FrameCapture(const std::string &directory, const std::string &prefix /*="frame"*/, Format format /*=FORMAT_PNG*/, int maxFramesInFlight /*=8*/) :
+		_directory(directory), _prefix(prefix), _format(format), _maxFramesInFlight(maxFramesInFlight), _firstFrame(0), _numCaptured(0), _numWritten(0), _numInFlight(0)
+	{
+		_stats.readbackSeconds = 0.0;
+		_stats.encodeSeconds = 0.0;
+		_stats.stallSeconds = 0.0;
+#ifdef _WIN32
+		_mkdir(_directory.c_str());
+#else
+		mkdir(_directory.c_str(), 0755);
+#endif
+	}
+
+	FrameCapture::~FrameCapture()
+	{
+		finish();
+	}
+
+	void FrameCapture::capture(int width, int height)
+	{
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point waitStart = Clock::now();
+		waitForFramesInFlight(_maxFramesInFlight - 1);
+		const Clock::time_point captured = Clock::now();
+
+		std::string fileName = getFileName(_firstFrame + _numCaptured);
+		_numCaptured++;
+		_numInFlight++;
+
+		// The window alpha isn't meaningful, RGB keeps the files smaller
+		const int channels = 3;
+		PixelReadback::getInstance().readFramebuffer(0, 0, width, height, channels, [this, fileName, captured](std::shared_ptr<PixelReadback::Image> image) {
+			write(image, fileName, captured);
+		});
+
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		_stats.stallSeconds += std::chrono::duration<double>(captured - waitStart).count();
+	}
+
+	void FrameCapture::captureImage(std::shared_ptr<PixelReadback::Image> image)
+	{
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point waitStart = Clock::now();
+		waitForFramesInFlight(_maxFramesInFlight - 1);
+		const Clock::time_point captured = Clock::now();
+
+		std::string fileName = getFileName(_firstFrame + _numCaptured);
+		_numCaptured++;
+		_numInFlight++;
+		ThreadPool::getShared().enqueue([this, image, fileName, captured]() {
+			write(image, fileName, captured);
+		});
+
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		_stats.stallSeconds += std::chrono::duration<double>(captured - waitStart).count();
+	}
+
+	void FrameCapture::write(std::shared_ptr<PixelReadback::Image> image, const std::string &fileName, std::chrono::steady_clock::time_point captured)
+	{
+		TRACE_SCOPE_DETAIL("capture", "Write frame", fileName.c_str());
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point encodeStart = Clock::now();
+		if (!image) {
+			std::cerr << "FrameCapture: unable to read back " << fileName << std::endl;
+			_numInFlight--;
+			return;
+		}
+		std::string error;
+		if (ImageWriter::write(fileName, image->width, image->height, image->channels, &image->pixels[0], error)) {
+			_numWritten++;
+		}
+		else {
+			std::cerr << "FrameCapture: " << error << std::endl;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			_stats.readbackSeconds += std::chrono::duration<double>(encodeStart - captured).count();
+			_stats.encodeSeconds += std::chrono::duration<double>(Clock::now() - encodeStart).count();
+		}
+		_numInFlight--;
+	}
+
+	void FrameCapture::finish()
+	{
+		waitForFramesInFlight(0);
+	}
+
+	void FrameCapture::waitForFramesInFlight(int maxFrames)
+	{
+		// Readback only advances through update(), so keep calling it while waiting on the GL thread
+		while (_numInFlight > maxFrames) {
+			PixelReadback::getInstance().update();
+			std::this_thread::yield();
+		}
+	}
+
+	int FrameCapture::getNumCaptured() const
+	{
+		return _numCaptured;
+	}
+
+	int FrameCapture::getNumWritten() const
+	{
+		return _numWritten;
+	}
+
+	FrameCapture::Stats FrameCapture::getStats() const
+	{
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		return _stats;
+	}
+
+	void FrameCapture::setFirstFrame(int frame)
+	{
+		_firstFrame = frame;
+	}
+
+	std::string FrameCapture::getFileName(int frame) const
+	{
+		return getFileName(_directory, _prefix, _format, frame);
+	}
+
+	std::string FrameCapture::getFileName(const std::string &directory, const std::string &prefix, Format format, int frame)
+	{
+		static const char* extensions[3] = { "png", "qoi", "raw" };
+		char number[16];
+		snprintf(number, sizeof(number), "%05d", frame);
+		return directory + "/" + prefix + "_" + number + "." + extensions[format];
+	}
+
+}
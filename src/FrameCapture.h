@@ -0,0 +1,101 @@
+/*!
+ *  FrameCapture.h
+ *
+ * Writes the window contents to a numbered image sequence without slowing down rendering.
+ */
+
+#ifndef FrameCapture_h
+#define FrameCapture_h
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "PixelReadback.h"
+
+namespace basicgraphics {
+
+	/** FrameCapture reads the back buffer through PixelReadback after each frame and encodes the images
+	on the ThreadPool, so several frames are compressed in parallel while rendering continues. Files are
+	named <directory>/<prefix>_00000.<ext> in capture order. If encoding falls more than maxFramesInFlight
+	frames behind, capture() waits for it so memory use stays bounded and no frame is dropped.
+	------------------------------------------------------------------------
+	FrameCapture capture("capture", "turntable", FrameCapture::FORMAT_QOI);
+	while (rendering) {
+		drawScene();
+		capture.capture(width, height); // before swapping buffers
+		glfwSwapBuffers(window);
+		PixelReadback::getInstance().update();
+	}
+	capture.finish();
+	------------------------------------------------------------------------
+	*/
+	class FrameCapture
+	{
+	public:
+
+		enum Format {
+			FORMAT_PNG = 0,
+			FORMAT_QOI = 1, /// much faster to encode than PNG at a similar size
+			FORMAT_RAW = 2  /// RGB bytes only, fastest but largest
+		};
+
+		FrameCapture(const std::string &directory, const std::string &prefix = "frame", Format format = FORMAT_PNG, int maxFramesInFlight = 8);
+
+		// Waits until every captured frame has been written
+		virtual ~FrameCapture();
+
+		/*!
+		 * Queues the current contents of the back buffer. Call after drawing and before swapping buffers.
+		 */
+		void capture(int width, int height);
+
+		/*!
+		 * Queues an image that was rendered on the CPU (e.g. by the PathTracer) as the next frame. It is
+		 * encoded on the ThreadPool like a captured frame, so no GL context is needed.
+		 */
+		void captureImage(std::shared_ptr<PixelReadback::Image> image);
+
+		// Waits until every captured frame has been written
+		void finish();
+
+		int getNumCaptured() const;
+		int getNumWritten() const;
+		std::string getFileName(int frame) const;
+
+		// Number in the file name of the first captured frame, 0 by default. Lets several processes share one sequence.
+		void setFirstFrame(int frame);
+
+		static std::string getFileName(const std::string &directory, const std::string &prefix, Format format, int frame);
+
+		// Time spent in each stage, summed over all frames. Stages overlap, so the sums can add up to more than the wall time.
+		struct Stats {
+			double readbackSeconds; /// from capture() until encoding starts: the GPU finishing the frame, the copy out of the pixel buffer and waiting for a worker
+			double encodeSeconds;   /// encoding and writing the files, on the worker threads
+			double stallSeconds;    /// capture() waiting because maxFramesInFlight frames were still being written
+		};
+		Stats getStats() const;
+
+	private:
+		FrameCapture(const FrameCapture&) {}; // prevent copying
+
+		std::string _directory;
+		std::string _prefix;
+		Format _format;
+		int _maxFramesInFlight;
+		int _firstFrame;
+		int _numCaptured;
+		std::atomic<int> _numWritten;
+		std::atomic<int> _numInFlight;
+
+		mutable std::mutex _statsMutex;
+		Stats _stats;
+
+		void waitForFramesInFlight(int maxFrames);
+		void write(std::shared_ptr<PixelReadback::Image> image, const std::string &fileName, std::chrono::steady_clock::time_point captured);
+	};
+
+}
+
+#endif /* FrameCapture_h */
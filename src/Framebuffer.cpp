@@ -0,0 +1,144 @@
+//
+//  Framebuffer.cpp
+//
+//
+
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace basicgraphics {
+
+	Framebuffer::Framebuffer(int width, int height, int samples /*=0*/) : _width(width), _height(height), _samples(samples),
+		_fbo(0), _colorBuffer(0), _depthBuffer(0), _resolveFbo(0), _resolveColorBuffer(0), _memory(MemoryAccounting::RENDER_TARGETS, "framebuffer")
+	{
+		create();
+	}
+
+	Framebuffer::~Framebuffer()
+	{
+		destroy();
+	}
+
+	void Framebuffer::bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+		glViewport(0, 0, _width, _height);
+	}
+
+	void Framebuffer::unbind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void Framebuffer::resolve()
+	{
+		if (_resolveFbo == 0) {
+			return;
+		}
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _resolveFbo);
+		glBlitFramebuffer(0, 0, _width, _height, 0, 0, _width, _height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+	}
+
+	void Framebuffer::bindForReading()
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, (_resolveFbo != 0) ? _resolveFbo : _fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+	}
+
+	void Framebuffer::resize(int width, int height)
+	{
+		if (width == _width && height == _height) {
+			return;
+		}
+		destroy();
+		_width = width;
+		_height = height;
+		create();
+	}
+
+	int Framebuffer::getWidth() const
+	{
+		return _width;
+	}
+
+	int Framebuffer::getHeight() const
+	{
+		return _height;
+	}
+
+	int Framebuffer::getSamples() const
+	{
+		return _samples;
+	}
+
+	int Framebuffer::getMaxSize()
+	{
+		GLint maxSize = 0;
+		glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+		return maxSize;
+	}
+
+	void Framebuffer::create()
+	{
+		const int maxSize = getMaxSize();
+		assert(_width <= maxSize && _height <= maxSize && "Framebuffer is larger than GL_MAX_RENDERBUFFER_SIZE");
+
+		if (_samples > 0) {
+			GLint maxSamples = 0;
+			glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+			_samples = std::min(_samples, (int)maxSamples);
+		}
+
+		glGenRenderbuffers(1, &_colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, _colorBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples, GL_RGBA8, _width, _height);
+
+		glGenRenderbuffers(1, &_depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, _samples, GL_DEPTH_COMPONENT24, _width, _height);
+
+		glGenFramebuffers(1, &_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "Framebuffer: " << _width << "x" << _height << " with " << _samples << " samples is incomplete" << std::endl;
+		}
+
+		if (_samples > 0) {
+			glGenRenderbuffers(1, &_resolveColorBuffer);
+			glBindRenderbuffer(GL_RENDERBUFFER, _resolveColorBuffer);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+
+			glGenFramebuffers(1, &_resolveFbo);
+			glBindFramebuffer(GL_FRAMEBUFFER, _resolveFbo);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _resolveColorBuffer);
+		}
+
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		// RGBA8 color and a depth buffer padded to 32 bits, per sample, plus the single sampled copy
+		const size_t pixels = (size_t)_width * _height;
+		_memory.setBytes(pixels * (4 + 4) * std::max(_samples, 1) + (_samples > 0 ? pixels * 4 : 0));
+	}
+
+	void Framebuffer::destroy()
+	{
+		glDeleteFramebuffers(1, &_fbo);
+		glDeleteRenderbuffers(1, &_colorBuffer);
+		glDeleteRenderbuffers(1, &_depthBuffer);
+		if (_resolveFbo != 0) {
+			glDeleteFramebuffers(1, &_resolveFbo);
+			glDeleteRenderbuffers(1, &_resolveColorBuffer);
+		}
+		_fbo = _colorBuffer = _depthBuffer = _resolveFbo = _resolveColorBuffer = 0;
+		_memory.setBytes(0);
+	}
+
+}
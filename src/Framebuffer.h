@@ -0,0 +1,81 @@
+/*!
+ *  Framebuffer.h
+ *
+ * An offscreen render target with a color and a depth buffer.
+ */
+
+#ifndef Framebuffer_h
+#define Framebuffer_h
+
+#include <glad/glad.h>
+
+#include "MemoryAccounting.h"
+
+namespace basicgraphics {
+
+	/** Framebuffer wraps a framebuffer object with RGBA8 color and 24 bit depth renderbuffers of any size, up to
+	GL_MAX_RENDERBUFFER_SIZE. With samples > 0 the buffers are multisampled and resolve() blits them into a
+	single sampled copy, which is what reads (glReadPixels, PixelReadback) see after bindForReading().
+	------------------------------------------------------------------------
+	Framebuffer target(3840, 2160, 4);
+	target.bind();
+	drawScene();
+	target.resolve();
+	target.bindForReading();
+	PixelReadback::getInstance().readFramebuffer(0, 0, target.getWidth(), target.getHeight(), 4, callback);
+	Framebuffer::unbind();
+	------------------------------------------------------------------------
+	*/
+	class Framebuffer
+	{
+	public:
+
+		Framebuffer(int width, int height, int samples = 0);
+		virtual ~Framebuffer();
+
+		// Binds for drawing and sets the viewport to the whole buffer
+		void bind();
+
+		// Back to the window's framebuffer (or no framebuffer with a headless context)
+		static void unbind();
+
+		// Copies the multisampled buffer into the single sampled one, does nothing without multisampling
+		void resolve();
+
+		// Binds the single sampled buffer as GL_READ_FRAMEBUFFER
+		void bindForReading();
+
+		// Reallocates the buffers, the contents are lost
+		void resize(int width, int height);
+
+		int getWidth() const;
+		int getHeight() const;
+		int getSamples() const;
+
+		// Largest width or height the driver allows
+		static int getMaxSize();
+
+	private:
+		Framebuffer(const Framebuffer&) : _memory(MemoryAccounting::RENDER_TARGETS) {}; // prevent copying
+
+		int _width;
+		int _height;
+		int _samples;
+
+		GLuint _fbo;
+		GLuint _colorBuffer;
+		GLuint _depthBuffer;
+
+		// Only with multisampling
+		GLuint _resolveFbo;
+		GLuint _resolveColorBuffer;
+
+		MemoryRecord _memory; // all renderbuffers, samples included
+
+		void create();
+		void destroy();
+	};
+
+}
+
+#endif /* Framebuffer_h */
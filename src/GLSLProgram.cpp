@@ -1,12 +1,26 @@
 #include "GLSLProgram.h"
+#include "Tracer.h"
+#include "Metrics.h"
 
+#include <cstring>
 #include <fstream>
 using std::ifstream;
 using std::ios;
 
 #include <sstream>
+#include <utility>
 #include <sys/stat.h>
 
+// From GL_KHR_parallel_shader_compile, in case the glad loader was generated without it
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// From GL_ARB_get_program_binary, core since 4.1
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
 namespace basicgraphics {
 
 	namespace GLSLShaderInfo {
@@ -28,49 +42,63 @@ namespace basicgraphics {
 		};
 	}
 
-	GLSLProgram::GLSLProgram() : handle(0), linked(false) {
+	// Only then can the size of a linked program be queried, other drivers would raise GL_INVALID_ENUM
+	static bool hasProgramBinaryLength()
+	{
+		static const bool supported = []() {
+			GLint numExtensions = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+			for (int i = 0; i < numExtensions; i++) {
+				const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+				if (ext != nullptr && strcmp(ext, "GL_ARB_get_program_binary") == 0) {
+					return true;
+				}
+			}
+			return false;
+		}();
+		return supported;
+	}
+
+	GLSLProgram::GLSLProgram() : handle(0), linked(false), memory(MemoryAccounting::SHADERS) {
 	}
 
 	GLSLProgram::~GLSLProgram() {
 		if (handle == 0) return;
 
+		deleteShaders();
+
+		// Delete the program
+		glDeleteProgram(handle);
+	}
+
+	void GLSLProgram::deleteShaders() {
 		// Query the number of attached shaders
 		GLint numShaders = 0;
 		glGetProgramiv(handle, GL_ATTACHED_SHADERS, &numShaders);
 
 		// Get the shader names
-		GLuint * shaderNames = new GLuint[numShaders];
-		glGetAttachedShaders(handle, numShaders, NULL, shaderNames);
+		std::vector<GLuint> shaderNames(numShaders);
+		if (numShaders > 0) {
+			glGetAttachedShaders(handle, numShaders, NULL, &shaderNames[0]);
+		}
 
-		// Delete the shaders
-		for (int i = 0; i < numShaders; i++)
+		// The linked program doesn't need them anymore, detached they are freed right away
+		for (int i = 0; i < numShaders; i++) {
+			glDetachShader(handle, shaderNames[i]);
 			glDeleteShader(shaderNames[i]);
-
-		// Delete the program
-		glDeleteProgram(handle);
-
-		delete[] shaderNames;
+		}
+		pendingShaders.clear();
 	}
 
 	void GLSLProgram::compileShader(const char * fileName)
 		throw(GLSLProgramException) {
-		int numExts = sizeof(GLSLShaderInfo::extensions) / sizeof(GLSLShaderInfo::shader_file_extension);
-
 		// Check the file name's extension to determine the shader type
-		string ext = getExtension(fileName);
 		GLSLShader::GLSLShaderType type = GLSLShader::VERTEX;
-		bool matchFound = false;
-		for (int i = 0; i < numExts; i++) {
-			if (ext == GLSLShaderInfo::extensions[i].ext) {
-				matchFound = true;
-				type = GLSLShaderInfo::extensions[i].type;
-				break;
-			}
-		}
+		bool matchFound = getShaderType(fileName, type);
 
 		// If we didn't find a match, throw an exception
 		if (!matchFound) {
-			string msg = "Unrecognized extension: " + ext;
+			string msg = "Unrecognized extension: " + getExtension(fileName);
 			throw GLSLProgramException(msg);
 		}
 
@@ -78,6 +106,23 @@ namespace basicgraphics {
 		compileShader(fileName, type);
 	}
 
+	bool GLSLProgram::getShaderType(const char * fileName, GLSLShader::GLSLShaderType & type)
+	{
+		int numExts = sizeof(GLSLShaderInfo::extensions) / sizeof(GLSLShaderInfo::shader_file_extension);
+
+		string nameStr(fileName);
+		size_t loc = nameStr.find_last_of('.');
+		string ext = (loc != string::npos) ? nameStr.substr(loc, string::npos) : "";
+
+		for (int i = 0; i < numExts; i++) {
+			if (ext == GLSLShaderInfo::extensions[i].ext) {
+				type = GLSLShaderInfo::extensions[i].type;
+				return true;
+			}
+		}
+		return false;
+	}
+
 	string GLSLProgram::getExtension(const char * name) {
 		string nameStr(name);
 
@@ -124,6 +169,7 @@ namespace basicgraphics {
 		const char * fileName)
 		throw(GLSLProgramException)
 	{
+		TRACE_SCOPE_DETAIL("shaders", "Compile shader", fileName);
 		if (handle <= 0) {
 			handle = glCreateProgram();
 			if (handle == 0) {
@@ -144,16 +190,8 @@ namespace basicgraphics {
 		glGetShaderiv(shaderHandle, GL_COMPILE_STATUS, &result);
 		if (GL_FALSE == result) {
 			// Compile failed, get log
-			int length = 0;
-			string logString;
-			glGetShaderiv(shaderHandle, GL_INFO_LOG_LENGTH, &length);
-			if (length > 0) {
-				char * c_log = new char[length];
-				int written = 0;
-				glGetShaderInfoLog(shaderHandle, length, &written, c_log);
-				logString = c_log;
-				delete[] c_log;
-			}
+			string logString = getShaderLog(shaderHandle);
+			glDeleteShader(shaderHandle);
 			string msg;
 			if (fileName) {
 				msg = string(fileName) + ": shader compliation failed\n";
@@ -169,6 +207,7 @@ namespace basicgraphics {
 		else {
 			// Compile succeeded, attach shader
 			glAttachShader(handle, shaderHandle);
+			addMemoryTag(fileName);
 		}
 	}
 
@@ -177,32 +216,131 @@ namespace basicgraphics {
 		if (linked) return;
 		if (handle <= 0)
 			throw GLSLProgramException("Program has not been compiled.");
+		TRACE_SCOPE("shaders", "Link program");
 
 		glLinkProgram(handle);
 
 		int status = 0;
 		glGetProgramiv(handle, GL_LINK_STATUS, &status);
+		deleteShaders();
 		if (GL_FALSE == status) {
-			// Store log and return false
-			int length = 0;
-			string logString;
-
-			glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &length);
-
-			if (length > 0) {
-				char * c_log = new char[length];
-				int written = 0;
-				glGetProgramInfoLog(handle, length, &written, c_log);
-				logString = c_log;
-				delete[] c_log;
-			}
-
-			throw GLSLProgramException(string("Program link failed:\n") + logString);
+			throw GLSLProgramException(string("Program link failed:\n") + getProgramLog());
 		}
 		else {
 			uniformLocations.clear();
 			linked = true;
+			updateMemory();
+		}
+	}
+
+	void GLSLProgram::beginCompileShader(const string & source,
+		GLSLShader::GLSLShaderType type,
+		const char * fileName)
+		throw(GLSLProgramException)
+	{
+		if (handle <= 0) {
+			handle = glCreateProgram();
+			if (handle == 0) {
+				throw GLSLProgramException("Unable to create shader program.");
+			}
+		}
+
+		GLuint shaderHandle = glCreateShader(type);
+
+		const char * c_code = source.c_str();
+		glShaderSource(shaderHandle, 1, &c_code, NULL);
+		glCompileShader(shaderHandle);
+
+		// Attach right away, the status is checked in finishLink so we don't wait on the compiler here
+		glAttachShader(handle, shaderHandle);
+		pendingShaders[shaderHandle] = fileName ? fileName : "";
+		addMemoryTag(fileName);
+	}
+
+	void GLSLProgram::beginLink() throw(GLSLProgramException)
+	{
+		if (linked) return;
+		if (handle <= 0)
+			throw GLSLProgramException("Program has not been compiled.");
+
+		glLinkProgram(handle);
+	}
+
+	bool GLSLProgram::isLinkComplete()
+	{
+		if (linked || handle <= 0) return true;
+
+		// Without GL_KHR_parallel_shader_compile this query is not supported and status stays GL_TRUE,
+		// the status queries in finishLink will then block until the driver is done.
+		GLint status = GL_TRUE;
+		glGetProgramiv(handle, GL_COMPLETION_STATUS_KHR, &status);
+		return status == GL_TRUE;
+	}
+
+	void GLSLProgram::finishLink() throw(GLSLProgramException)
+	{
+		if (linked) return;
+		if (handle <= 0)
+			throw GLSLProgramException("Program has not been compiled.");
+		TRACE_SCOPE("shaders", "finishLink");
+
+		// Report compile errors first, a failed link is usually just a consequence of them
+		std::map<GLuint, string> shaders;
+		shaders.swap(pendingShaders);
+		for (std::map<GLuint, string>::iterator it = shaders.begin(); it != shaders.end(); ++it) {
+			int result;
+			glGetShaderiv(it->first, GL_COMPILE_STATUS, &result);
+			if (GL_FALSE == result) {
+				string msg;
+				if (!it->second.empty()) {
+					msg = it->second + ": shader compliation failed\n";
+				}
+				else {
+					msg = "Shader compilation failed.\n";
+				}
+				msg += getShaderLog(it->first);
+				deleteShaders();
+				throw GLSLProgramException(msg);
+			}
+		}
+
+		int status = 0;
+		glGetProgramiv(handle, GL_LINK_STATUS, &status);
+		deleteShaders();
+		if (GL_FALSE == status) {
+			throw GLSLProgramException(string("Program link failed:\n") + getProgramLog());
+		}
+
+		uniformLocations.clear();
+		linked = true;
+		updateMemory();
+	}
+
+	void GLSLProgram::swap(GLSLProgram & other)
+	{
+		std::swap(handle, other.handle);
+		std::swap(linked, other.linked);
+		uniformLocations.swap(other.uniformLocations);
+		pendingShaders.swap(other.pendingShaders);
+		memory.swap(other.memory);
+	}
+
+	void GLSLProgram::addMemoryTag(const char * fileName)
+	{
+		if (fileName == NULL || fileName[0] == '\0') {
+			return;
+		}
+		string tag = memory.getTag();
+		memory.setTag(tag.empty() ? string(fileName) : tag + "+" + fileName);
+	}
+
+	void GLSLProgram::updateMemory()
+	{
+		GLint length = 0;
+		if (hasProgramBinaryLength()) {
+			glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &length);
 		}
+		memory.setBytes(length);
 	}
 
 	void GLSLProgram::use() throw(GLSLProgramException)
@@ -232,6 +370,14 @@ namespace basicgraphics {
 		glBindFragDataLocation(handle, location, name);
 	}
 
+	void GLSLProgram::bindUniformBlock(const char * blockName, GLuint bindingPoint)
+	{
+		GLuint index = glGetUniformBlockIndex(handle, blockName);
+		if (index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(handle, index, bindingPoint);
+		}
+	}
+
 	void GLSLProgram::setUniform(const char *name, float x, float y, float z)
 	{
 		GLint loc = getUniformLocation(name);
@@ -498,35 +644,54 @@ namespace basicgraphics {
 		glGetProgramiv(handle, GL_VALIDATE_STATUS, &status);
 
 		if (GL_FALSE == status) {
-			// Store log and return false
-			int length = 0;
-			string logString;
-
-			glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &length);
-
-			if (length > 0) {
-				char * c_log = new char[length];
-				int written = 0;
-				glGetProgramInfoLog(handle, length, &written, c_log);
-				logString = c_log;
-				delete[] c_log;
-			}
-
-			throw GLSLProgramException(string("Program failed to validate\n") + logString);
+			throw GLSLProgramException(string("Program failed to validate\n") + getProgramLog());
 
 		}
 	}
 
 	int GLSLProgram::getUniformLocation(const char * name)
 	{
-		std::map<string, int>::iterator pos;
-		pos = uniformLocations.find(name);
+		for (int i = 0; i < uniformLocations.size(); i++) {
+			if (strcmp(uniformLocations[i].first.c_str(), name) == 0) {
+				Metrics::recordCacheLookup(Metrics::UNIFORM_LOCATIONS, true);
+				return uniformLocations[i].second;
+			}
+		}
+
+		Metrics::recordCacheLookup(Metrics::UNIFORM_LOCATIONS, false);
+		const GLint location = glGetUniformLocation(handle, name);
+		uniformLocations.push_back(std::make_pair(string(name), location));
+		return location;
+	}
 
-		if (pos == uniformLocations.end()) {
-			uniformLocations[name] = glGetUniformLocation(handle, name);
+	string GLSLProgram::getShaderLog(GLuint shaderHandle)
+	{
+		int length = 0;
+		string logString;
+		glGetShaderiv(shaderHandle, GL_INFO_LOG_LENGTH, &length);
+		if (length > 0) {
+			char * c_log = new char[length];
+			int written = 0;
+			glGetShaderInfoLog(shaderHandle, length, &written, c_log);
+			logString = c_log;
+			delete[] c_log;
 		}
+		return logString;
+	}
 
-		return uniformLocations[name];
+	string GLSLProgram::getProgramLog()
+	{
+		int length = 0;
+		string logString;
+		glGetProgramiv(handle, GL_INFO_LOG_LENGTH, &length);
+		if (length > 0) {
+			char * c_log = new char[length];
+			int written = 0;
+			glGetProgramInfoLog(handle, length, &written, c_log);
+			logString = c_log;
+			delete[] c_log;
+		}
+		return logString;
 	}
 
 	bool GLSLProgram::fileExists(const string & fileName)
@@ -16,10 +16,13 @@
 #include <string>
 using std::string;
 #include <map>
+#include <vector>
 #include <iostream>
 
 #include <glad/glad.h>
 
+#include "MemoryAccounting.h"
+
 #define GLM_FORCE_RADIANS
 #include <glm/glm/glm.hpp>
 using glm::vec2;
@@ -53,14 +56,23 @@ namespace basicgraphics {
 	private:
 		int  handle;
 		bool linked;
-		std::map<string, int> uniformLocations;
+		std::vector<std::pair<string, int>> uniformLocations; // looked up by strcmp, so setUniform never builds a string
+		std::map<GLuint, string> pendingShaders; // shaders compiled with beginCompileShader, checked in finishLink
+		MemoryRecord memory; // size of the linked binary, tagged with the shader files
+
+		// Detaches and deletes the attached shaders, called once a link has succeeded or failed
+		void deleteShaders();
+		string getShaderLog(GLuint shaderHandle);
+		string getProgramLog();
 
 		GLint  getUniformLocation(const char * name);
 		bool fileExists(const string & fileName);
 		string getExtension(const char * fileName);
+		void addMemoryTag(const char * fileName);
+		void updateMemory();
 
 		// Make these private in order to make the object non-copyable
-		GLSLProgram(const GLSLProgram & other) { }
+		GLSLProgram(const GLSLProgram & other) : memory(MemoryAccounting::SHADERS) { }
 		GLSLProgram & operator=(const GLSLProgram &other) { return *this; }
 
 	public:
@@ -73,6 +85,20 @@ namespace basicgraphics {
 			const char *fileName = NULL) throw (GLSLProgramException);
 
 		void   link() throw (GLSLProgramException);
+
+		// Non-blocking variants used for background rebuilds. beginCompileShader and beginLink
+		// only issue the GL calls; with GL_KHR_parallel_shader_compile the driver compiles on its
+		// own threads and isLinkComplete can be polled each frame. finishLink checks the compile
+		// and link status and throws like compileShader/link would have.
+		void   beginCompileShader(const string & source, GLSLShader::GLSLShaderType type,
+			const char *fileName = NULL) throw (GLSLProgramException);
+		void   beginLink() throw (GLSLProgramException);
+		bool   isLinkComplete();
+		void   finishLink() throw (GLSLProgramException);
+
+		// Exchanges the underlying GL program with other, e.g. to install a program that was
+		// rebuilt in the background into the object the application renders with.
+		void   swap(GLSLProgram & other);
 		void   validate() throw(GLSLProgramException);
 		void   use() throw (GLSLProgramException);
 
@@ -81,6 +107,8 @@ namespace basicgraphics {
 
 		void   bindAttribLocation(GLuint location, const char * name);
 		void   bindFragDataLocation(GLuint location, const char * name);
+		// Connects a uniform block to a GL_UNIFORM_BUFFER binding point, does nothing if the program has no such block
+		void   bindUniformBlock(const char * blockName, GLuint bindingPoint);
 
 		void   setUniform(const char *name, float x, float y, float z);
 		void   setUniform(const char *name, const vec2 & v);
@@ -98,6 +126,9 @@ namespace basicgraphics {
 		void   printActiveAttribs();
 
 		const char * getTypeString(GLenum type);
+
+		// Determines the shader type from the file extension (.vert, .frag, ...). Returns false if it is not recognized.
+		static bool  getShaderType(const char * fileName, GLSLShader::GLSLShaderType & type);
 	};
 
 }
@@ -0,0 +1,542 @@
+//
+//  GLStats.cpp
+//
+//
+
+#include "GLStats.h"
+
+#include <cstring>
+#include <iomanip>
+
+namespace basicgraphics {
+
+	static const char* OTHER_SITE = "other";
+
+	// The entry points the wrappers forward to, saved when they are installed
+	static PFNGLDRAWARRAYSPROC realDrawArrays;
+	static PFNGLDRAWELEMENTSPROC realDrawElements;
+	static PFNGLDRAWARRAYSINSTANCEDPROC realDrawArraysInstanced;
+	static PFNGLDRAWELEMENTSINSTANCEDPROC realDrawElementsInstanced;
+	static PFNGLBINDVERTEXARRAYPROC realBindVertexArray;
+	static PFNGLACTIVETEXTUREPROC realActiveTexture;
+	static PFNGLBINDTEXTUREPROC realBindTexture;
+	static PFNGLUSEPROGRAMPROC realUseProgram;
+	static PFNGLLINKPROGRAMPROC realLinkProgram;
+	static PFNGLDELETEPROGRAMPROC realDeleteProgram;
+	static PFNGLDELETETEXTURESPROC realDeleteTextures;
+	static PFNGLDELETEVERTEXARRAYSPROC realDeleteVertexArrays;
+	static PFNGLUNIFORM1IPROC realUniform1i;
+	static PFNGLUNIFORM1UIPROC realUniform1ui;
+	static PFNGLUNIFORM1FPROC realUniform1f;
+	static PFNGLUNIFORM2FPROC realUniform2f;
+	static PFNGLUNIFORM3FPROC realUniform3f;
+	static PFNGLUNIFORM4FPROC realUniform4f;
+	static PFNGLUNIFORMMATRIX3FVPROC realUniformMatrix3fv;
+	static PFNGLUNIFORMMATRIX4FVPROC realUniformMatrix4fv;
+	static PFNGLBUFFERDATAPROC realBufferData;
+	static PFNGLBUFFERSUBDATAPROC realBufferSubData;
+	static PFNGLENABLEPROC realEnable;
+	static PFNGLDISABLEPROC realDisable;
+
+	struct GLStats::Wrappers {
+
+		static void APIENTRY drawArrays(GLenum mode, GLint first, GLsizei count)
+		{
+			getInstance().count(DRAW_CALLS, false);
+			realDrawArrays(mode, first, count);
+		}
+
+		static void APIENTRY drawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+		{
+			getInstance().count(DRAW_CALLS, false);
+			realDrawElements(mode, count, type, indices);
+		}
+
+		static void APIENTRY drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount)
+		{
+			getInstance().count(DRAW_CALLS, false);
+			realDrawArraysInstanced(mode, first, count, instanceCount);
+		}
+
+		static void APIENTRY drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount)
+		{
+			getInstance().count(DRAW_CALLS, false);
+			realDrawElementsInstanced(mode, count, type, indices, instanceCount);
+		}
+
+		static void APIENTRY bindVertexArray(GLuint array)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				stats.count(VAO_BINDS, stats._vertexArray == array);
+				stats._vertexArray = array;
+			}
+			realBindVertexArray(array);
+		}
+
+		static void APIENTRY activeTexture(GLenum texture)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				stats._activeTexture = texture - GL_TEXTURE0;
+			}
+			realActiveTexture(texture);
+		}
+
+		static void APIENTRY bindTexture(GLenum target, GLuint texture)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				const std::pair<int, GLenum> key(stats._activeTexture, target);
+				std::map<std::pair<int, GLenum>, GLuint>::iterator it = stats._textures.find(key);
+				stats.count(TEXTURE_BINDS, it != stats._textures.end() && it->second == texture);
+				stats._textures[key] = texture;
+			}
+			realBindTexture(target, texture);
+		}
+
+		static void APIENTRY useProgram(GLuint program)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				stats.count(PROGRAM_SWITCHES, stats._program == program);
+				stats._program = program;
+			}
+			realUseProgram(program);
+		}
+
+		// Linking resets the program's uniforms to their defaults
+		static void APIENTRY linkProgram(GLuint program)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				stats.forgetUniforms(program);
+			}
+			realLinkProgram(program);
+		}
+
+		static void APIENTRY deleteProgram(GLuint program)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting() && program != 0) {
+				stats.forgetUniforms(program);
+				if (stats._program == program) {
+					stats._program = UNKNOWN;
+				}
+			}
+			realDeleteProgram(program);
+		}
+
+		// Deleted textures and vertex arrays that are bound revert to 0
+		static void APIENTRY deleteTextures(GLsizei n, const GLuint* textures)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				for (GLsizei i = 0; i < n; i++) {
+					for (std::map<std::pair<int, GLenum>, GLuint>::iterator it = stats._textures.begin(); it != stats._textures.end(); ++it) {
+						if (textures[i] != 0 && it->second == textures[i]) {
+							it->second = 0;
+						}
+					}
+				}
+			}
+			realDeleteTextures(n, textures);
+		}
+
+		static void APIENTRY deleteVertexArrays(GLsizei n, const GLuint* arrays)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				for (GLsizei i = 0; i < n; i++) {
+					if (arrays[i] != 0 && stats._vertexArray == arrays[i]) {
+						stats._vertexArray = 0;
+					}
+				}
+			}
+			realDeleteVertexArrays(n, arrays);
+		}
+
+		static void APIENTRY uniform1i(GLint location, GLint v0)
+		{
+			getInstance().setUniform(location, &v0, sizeof(v0));
+			realUniform1i(location, v0);
+		}
+
+		static void APIENTRY uniform1ui(GLint location, GLuint v0)
+		{
+			getInstance().setUniform(location, &v0, sizeof(v0));
+			realUniform1ui(location, v0);
+		}
+
+		static void APIENTRY uniform1f(GLint location, GLfloat v0)
+		{
+			getInstance().setUniform(location, &v0, sizeof(v0));
+			realUniform1f(location, v0);
+		}
+
+		static void APIENTRY uniform2f(GLint location, GLfloat v0, GLfloat v1)
+		{
+			const GLfloat value[2] = { v0, v1 };
+			getInstance().setUniform(location, value, sizeof(value));
+			realUniform2f(location, v0, v1);
+		}
+
+		static void APIENTRY uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+		{
+			const GLfloat value[3] = { v0, v1, v2 };
+			getInstance().setUniform(location, value, sizeof(value));
+			realUniform3f(location, v0, v1, v2);
+		}
+
+		static void APIENTRY uniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+		{
+			const GLfloat value[4] = { v0, v1, v2, v3 };
+			getInstance().setUniform(location, value, sizeof(value));
+			realUniform4f(location, v0, v1, v2, v3);
+		}
+
+		static void APIENTRY uniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+		{
+			getInstance().setUniform(location, value, count * 9 * sizeof(GLfloat));
+			realUniformMatrix3fv(location, count, transpose, value);
+		}
+
+		static void APIENTRY uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+		{
+			getInstance().setUniform(location, value, count * 16 * sizeof(GLfloat));
+			realUniformMatrix4fv(location, count, transpose, value);
+		}
+
+		static void APIENTRY bufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+		{
+			GLStats &stats = getInstance();
+			stats.count(BUFFER_UPLOADS, false);
+			if (data != nullptr) {
+				stats.count(BUFFER_UPLOAD_BYTES, false, size);
+			}
+			realBufferData(target, size, data, usage);
+		}
+
+		static void APIENTRY bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+		{
+			GLStats &stats = getInstance();
+			stats.count(BUFFER_UPLOADS, false);
+			stats.count(BUFFER_UPLOAD_BYTES, false, size);
+			realBufferSubData(target, offset, size, data);
+		}
+
+		static void setCapability(GLenum capability, bool enabled)
+		{
+			GLStats &stats = getInstance();
+			if (stats.isCounting()) {
+				std::map<GLenum, bool>::iterator it = stats._capabilities.find(capability);
+				stats.count(STATE_TOGGLES, it != stats._capabilities.end() && it->second == enabled);
+				stats._capabilities[capability] = enabled;
+			}
+		}
+
+		static void APIENTRY enable(GLenum capability)
+		{
+			setCapability(capability, true);
+			realEnable(capability);
+		}
+
+		static void APIENTRY disable(GLenum capability)
+		{
+			setCapability(capability, false);
+			realDisable(capability);
+		}
+	};
+
+	void GLStats::Counts::clear()
+	{
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			calls[i] = 0;
+			redundant[i] = 0;
+		}
+	}
+
+	void GLStats::Counts::add(const Counts &other)
+	{
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			calls[i] += other.calls[i];
+			redundant[i] += other.redundant[i];
+		}
+	}
+
+	GLStats& GLStats::getInstance()
+	{
+		static GLStats stats;
+		return stats;
+	}
+
+	GLStats::GLStats() : _enabled(false), _numFrames(0), _callSiteDepth(0)
+	{
+		_currentSite = &_sites[OTHER_SITE];
+		resetState();
+	}
+
+	const char* GLStats::getCounterName(Counter counter)
+	{
+		switch (counter) {
+		case DRAW_CALLS: return "draw calls";
+		case VAO_BINDS: return "vertex array binds";
+		case TEXTURE_BINDS: return "texture binds";
+		case PROGRAM_SWITCHES: return "program switches";
+		case UNIFORM_UPLOADS: return "uniform uploads";
+		case BUFFER_UPLOADS: return "buffer uploads";
+		case BUFFER_UPLOAD_BYTES: return "buffer upload bytes";
+		case STATE_TOGGLES: return "enable/disable";
+		default: return "";
+		}
+	}
+
+	void GLStats::setEnabled(bool enabled)
+	{
+		if (enabled == _enabled) {
+			return;
+		}
+		if (enabled) {
+			_glThread = std::this_thread::get_id();
+			_frame.clear();
+			_lastFrame.clear();
+			_total.clear();
+			_numFrames = 0;
+			for (std::map<std::string, Site>::iterator it = _sites.begin(); it != _sites.end(); ++it) {
+				it->second.frame.clear();
+				it->second.lastFrame.clear();
+				it->second.total.clear();
+			}
+			resetState();
+		}
+		_currentSite = &_sites[OTHER_SITE];
+		_callSiteDepth = 0;
+		install(enabled);
+		_enabled = enabled;
+	}
+
+	void GLStats::install(bool enabled)
+	{
+		if (enabled) {
+			realDrawArrays = glad_glDrawArrays;
+			realDrawElements = glad_glDrawElements;
+			realDrawArraysInstanced = glad_glDrawArraysInstanced;
+			realDrawElementsInstanced = glad_glDrawElementsInstanced;
+			realBindVertexArray = glad_glBindVertexArray;
+			realActiveTexture = glad_glActiveTexture;
+			realBindTexture = glad_glBindTexture;
+			realUseProgram = glad_glUseProgram;
+			realLinkProgram = glad_glLinkProgram;
+			realDeleteProgram = glad_glDeleteProgram;
+			realDeleteTextures = glad_glDeleteTextures;
+			realDeleteVertexArrays = glad_glDeleteVertexArrays;
+			realUniform1i = glad_glUniform1i;
+			realUniform1ui = glad_glUniform1ui;
+			realUniform1f = glad_glUniform1f;
+			realUniform2f = glad_glUniform2f;
+			realUniform3f = glad_glUniform3f;
+			realUniform4f = glad_glUniform4f;
+			realUniformMatrix3fv = glad_glUniformMatrix3fv;
+			realUniformMatrix4fv = glad_glUniformMatrix4fv;
+			realBufferData = glad_glBufferData;
+			realBufferSubData = glad_glBufferSubData;
+			realEnable = glad_glEnable;
+			realDisable = glad_glDisable;
+
+			glad_glDrawArrays = Wrappers::drawArrays;
+			glad_glDrawElements = Wrappers::drawElements;
+			glad_glDrawArraysInstanced = Wrappers::drawArraysInstanced;
+			glad_glDrawElementsInstanced = Wrappers::drawElementsInstanced;
+			glad_glBindVertexArray = Wrappers::bindVertexArray;
+			glad_glActiveTexture = Wrappers::activeTexture;
+			glad_glBindTexture = Wrappers::bindTexture;
+			glad_glUseProgram = Wrappers::useProgram;
+			glad_glLinkProgram = Wrappers::linkProgram;
+			glad_glDeleteProgram = Wrappers::deleteProgram;
+			glad_glDeleteTextures = Wrappers::deleteTextures;
+			glad_glDeleteVertexArrays = Wrappers::deleteVertexArrays;
+			glad_glUniform1i = Wrappers::uniform1i;
+			glad_glUniform1ui = Wrappers::uniform1ui;
+			glad_glUniform1f = Wrappers::uniform1f;
+			glad_glUniform2f = Wrappers::uniform2f;
+			glad_glUniform3f = Wrappers::uniform3f;
+			glad_glUniform4f = Wrappers::uniform4f;
+			glad_glUniformMatrix3fv = Wrappers::uniformMatrix3fv;
+			glad_glUniformMatrix4fv = Wrappers::uniformMatrix4fv;
+			glad_glBufferData = Wrappers::bufferData;
+			glad_glBufferSubData = Wrappers::bufferSubData;
+			glad_glEnable = Wrappers::enable;
+			glad_glDisable = Wrappers::disable;
+		}
+		else {
+			glad_glDrawArrays = realDrawArrays;
+			glad_glDrawElements = realDrawElements;
+			glad_glDrawArraysInstanced = realDrawArraysInstanced;
+			glad_glDrawElementsInstanced = realDrawElementsInstanced;
+			glad_glBindVertexArray = realBindVertexArray;
+			glad_glActiveTexture = realActiveTexture;
+			glad_glBindTexture = realBindTexture;
+			glad_glUseProgram = realUseProgram;
+			glad_glLinkProgram = realLinkProgram;
+			glad_glDeleteProgram = realDeleteProgram;
+			glad_glDeleteTextures = realDeleteTextures;
+			glad_glDeleteVertexArrays = realDeleteVertexArrays;
+			glad_glUniform1i = realUniform1i;
+			glad_glUniform1ui = realUniform1ui;
+			glad_glUniform1f = realUniform1f;
+			glad_glUniform2f = realUniform2f;
+			glad_glUniform3f = realUniform3f;
+			glad_glUniform4f = realUniform4f;
+			glad_glUniformMatrix3fv = realUniformMatrix3fv;
+			glad_glUniformMatrix4fv = realUniformMatrix4fv;
+			glad_glBufferData = realBufferData;
+			glad_glBufferSubData = realBufferSubData;
+			glad_glEnable = realEnable;
+			glad_glDisable = realDisable;
+		}
+	}
+
+	void GLStats::resetState()
+	{
+		_vertexArray = UNKNOWN;
+		_program = UNKNOWN;
+		_activeTexture = 0;
+		_textures.clear();
+		_capabilities.clear();
+		_uniforms.clear();
+	}
+
+	void GLStats::count(Counter counter, bool redundant, unsigned long long amount /*=1*/)
+	{
+		if (!isCounting()) {
+			return;
+		}
+		_frame.calls[counter] += amount;
+		_currentSite->frame.calls[counter] += amount;
+		if (redundant) {
+			_frame.redundant[counter] += amount;
+			_currentSite->frame.redundant[counter] += amount;
+		}
+	}
+
+	void GLStats::setUniform(GLint location, const void* value, size_t size)
+	{
+		if (!isCounting()) {
+			return;
+		}
+		std::vector<unsigned char> &current = _uniforms[std::make_pair(_program, location)];
+		const bool redundant = size > 0 && current.size() == size && memcmp(&current[0], value, size) == 0;
+		if (!redundant) {
+			current.assign((const unsigned char*)value, (const unsigned char*)value + size);
+		}
+		count(UNIFORM_UPLOADS, redundant);
+	}
+
+	void GLStats::forgetUniforms(GLuint program)
+	{
+		std::map<std::pair<GLuint, GLint>, std::vector<unsigned char>>::iterator it = _uniforms.lower_bound(std::make_pair(program, (GLint)-1));
+		while (it != _uniforms.end() && it->first.first == program) {
+			it = _uniforms.erase(it);
+		}
+	}
+
+	void GLStats::pushCallSite(const char* name)
+	{
+		if (!isCounting()) {
+			return;
+		}
+		if (_callSiteDepth++ == 0) {
+			_currentSite = &_sites[name];
+		}
+	}
+
+	void GLStats::popCallSite()
+	{
+		if (!isCounting() || _callSiteDepth == 0) {
+			return;
+		}
+		if (--_callSiteDepth == 0) {
+			_currentSite = &_sites[OTHER_SITE];
+		}
+	}
+
+	void GLStats::endFrame()
+	{
+		if (!_enabled) {
+			return;
+		}
+		_lastFrame = _frame;
+		_total.add(_frame);
+		_frame.clear();
+		for (std::map<std::string, Site>::iterator it = _sites.begin(); it != _sites.end(); ++it) {
+			it->second.lastFrame = it->second.frame;
+			it->second.total.add(it->second.frame);
+			it->second.frame.clear();
+		}
+		_numFrames++;
+	}
+
+	const GLStats::Counts& GLStats::getLastFrame() const
+	{
+		return _lastFrame;
+	}
+
+	const GLStats::Counts& GLStats::getTotals() const
+	{
+		return _total;
+	}
+
+	int GLStats::getNumFrames() const
+	{
+		return _numFrames;
+	}
+
+	void GLStats::printFrame(std::ostream &out) const
+	{
+		out << "GL calls in the last frame (redundant)" << std::endl;
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			out << "  " << std::left << std::setw(22) << getCounterName((Counter)i) << std::right << std::setw(10) << _lastFrame.calls[i];
+			if (_lastFrame.redundant[i] > 0) {
+				out << " (" << _lastFrame.redundant[i] << ")";
+			}
+			out << std::endl;
+		}
+
+		out << "By call site: draws, vertex array binds, texture binds, uniforms (redundant), enable/disable (redundant), buffer upload bytes" << std::endl;
+		for (std::map<std::string, Site>::const_iterator it = _sites.begin(); it != _sites.end(); ++it) {
+			const Counts &frame = it->second.lastFrame;
+			unsigned long long numCalls = 0;
+			for (int i = 0; i < NUM_COUNTERS; i++) {
+				numCalls += i == BUFFER_UPLOAD_BYTES ? 0 : frame.calls[i];
+			}
+			if (numCalls == 0) {
+				continue;
+			}
+			out << "  " << std::left << std::setw(22) << it->first << std::right
+				<< std::setw(8) << frame.calls[DRAW_CALLS]
+				<< std::setw(8) << frame.calls[VAO_BINDS]
+				<< std::setw(8) << frame.calls[TEXTURE_BINDS]
+				<< std::setw(8) << frame.calls[UNIFORM_UPLOADS] << " (" << frame.redundant[UNIFORM_UPLOADS] << ")"
+				<< std::setw(8) << frame.calls[STATE_TOGGLES] << " (" << frame.redundant[STATE_TOGGLES] << ")"
+				<< std::setw(12) << frame.calls[BUFFER_UPLOAD_BYTES] << std::endl;
+		}
+	}
+
+	void GLStats::printTotals(std::ostream &out) const
+	{
+		if (_numFrames == 0) {
+			return;
+		}
+		out << "GL calls per frame over " << _numFrames << " frames, average (redundant)" << std::endl;
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			out << "  " << std::left << std::setw(22) << getCounterName((Counter)i) << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(12) << (double)_total.calls[i] / _numFrames;
+			if (_total.redundant[i] > 0) {
+				out << " (" << (double)_total.redundant[i] / _numFrames << ")";
+			}
+			out << std::endl;
+		}
+		out.unsetf(std::ios::floatfield);
+	}
+
+}
@@ -0,0 +1,162 @@
+/*!
+ *  GLStats.h
+ *
+ * Counts the GL calls and state changes of each frame, by call site, and flags the redundant ones.
+ */
+
+#ifndef GLStats_h
+#define GLStats_h
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** GLStats replaces glad's function pointers for draws, binds, program switches, uniform and buffer
+	uploads and glEnable/glDisable with wrappers that count the call and then forward it. While it is
+	disabled the original pointers are in place, so the GL calls cost nothing extra.
+	Only calls on the thread that enabled it are counted, the ShaderManager's context is left alone.
+	A call is redundant if it sets state to what it already was: the same vertex array, program or
+	texture (per unit and target), the same capability state, or the same uniform value for the
+	current program. State that was set before enabling is unknown, so the first call is never redundant.
+	Deleting or relinking a program forgets its uniforms and deleting a texture or vertex array forgets its
+	bindings, so a name the driver hands out again isn't mistaken for the old object.
+	Calls are attributed to the outermost GLCallSite that is open (Mesh::draw, Sphere::draw, Line::draw),
+	the rest to "other". BaseApp turns it on with --gl-stats and calls endFrame after every frame.
+	------------------------------------------------------------------------
+	GLStats::getInstance().setEnabled(true);
+	... render frames ...
+	GLStats::getInstance().printFrame(std::cout);
+	GLStats::getInstance().printTotals(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class GLStats
+	{
+	public:
+
+		enum Counter {
+			DRAW_CALLS,
+			VAO_BINDS,
+			TEXTURE_BINDS,
+			PROGRAM_SWITCHES,
+			UNIFORM_UPLOADS,
+			BUFFER_UPLOADS,
+			BUFFER_UPLOAD_BYTES,
+			STATE_TOGGLES, // glEnable/glDisable, e.g. blending and the depth test
+			NUM_COUNTERS
+		};
+
+		struct Counts {
+			unsigned long long calls[NUM_COUNTERS];
+			unsigned long long redundant[NUM_COUNTERS];
+
+			Counts() { clear(); }
+			void clear();
+			void add(const Counts &other);
+		};
+
+		static GLStats& getInstance();
+
+		/*!
+		 * Installs or removes the wrappers, the GL functions must be loaded. Enabling starts new totals.
+		 */
+		void setEnabled(bool enabled);
+		bool isEnabled() const { return _enabled; }
+
+		// Makes the current frame the last one and adds it to the totals
+		void endFrame();
+
+		const Counts& getLastFrame() const;
+		const Counts& getTotals() const;
+		int getNumFrames() const;
+
+		void printFrame(std::ostream &out) const;  // the last frame, by call site
+		void printTotals(std::ostream &out) const; // averages per frame since enabling
+
+		static const char* getCounterName(Counter counter);
+
+		// Used through GLCallSite
+		void pushCallSite(const char* name);
+		void popCallSite();
+
+	private:
+		GLStats();
+		GLStats(const GLStats&) {}; // prevent copying
+
+		struct Wrappers; // the replacement entry points, in GLStats.cpp
+
+		static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+		struct Site {
+			Counts frame;
+			Counts lastFrame;
+			Counts total;
+		};
+
+		bool _enabled;
+		std::thread::id _glThread;
+
+		Counts _frame;
+		Counts _lastFrame;
+		Counts _total;
+		int _numFrames;
+
+		std::map<std::string, Site> _sites;
+		Site* _currentSite;   // outermost open call site, or "other"
+		int _callSiteDepth;
+
+		// What the counted calls set the state to
+		GLuint _vertexArray;
+		GLuint _program;
+		int _activeTexture;
+		std::map<std::pair<int, GLenum>, GLuint> _textures;       // (unit, target)
+		std::map<GLenum, bool> _capabilities;
+		std::map<std::pair<GLuint, GLint>, std::vector<unsigned char>> _uniforms; // (program, location) to value
+
+		bool isCounting() const { return _enabled && std::this_thread::get_id() == _glThread; }
+		void count(Counter counter, bool redundant, unsigned long long amount = 1);
+		void setUniform(GLint location, const void* value, size_t size);
+		void forgetUniforms(GLuint program);
+		void resetState();
+		void install(bool enabled);
+	};
+
+	/** Attributes the GL calls until it goes out of scope to name, a string literal, if no other call site is open.
+	------------------------------------------------------------------------
+	void Sphere::draw(GLSLProgram &shader, const glm::mat4 &modelMatrix) {
+		GLCallSite site("Sphere::draw");
+		...
+	}
+	------------------------------------------------------------------------
+	*/
+	class GLCallSite
+	{
+	public:
+		GLCallSite(const char* name) : _pushed(GLStats::getInstance().isEnabled())
+		{
+			if (_pushed) {
+				GLStats::getInstance().pushCallSite(name);
+			}
+		}
+
+		~GLCallSite()
+		{
+			if (_pushed) {
+				GLStats::getInstance().popCallSite();
+			}
+		}
+
+	private:
+		GLCallSite(const GLCallSite&) {}; // prevent copying
+		bool _pushed;
+	};
+
+}
+
+#endif /* GLStats_h */
@@ -0,0 +1,577 @@
+//
+//  GoldenImageTest.cpp
+//
+//  golden_image_test renders a fixed set of scenes headlessly and compares each one against its image in
+//  the golden directory, with a perceptual tolerance: pixels are compared by their CIELAB color difference
+//  (delta E), so changes the eye can't see, like rounding in a different shader compiler, pass. Every
+//  scene is also held to a frame time and a memory budget. The budgets and the golden images are for
+//  Mesa's llvmpipe at 256x256, which needs no GPU. After the timed frames one more frame is rendered with the
+//  AllocationTracker on, a scene fails if it allocates or creates GL objects once it is loaded:
+//
+//      LIBGL_ALWAYS_SOFTWARE=1 ./golden_image_test --golden ../golden
+//
+//  The renders and difference images of failed scenes are written to --output. After a change that is
+//  meant to change the pictures, check them there and then replace the golden images with --update.
+//  A scene without a golden image fails, its render is written to --output like the others.
+//
+//      --golden DIR         where the golden images are (golden)
+//      --output DIR         where failed renders and their differences go (golden-results)
+//      --update             write the renders as the new golden images instead of comparing
+//      --scene NAME         only run scenes whose name contains NAME
+//      --budget-scale X     multiply the frame time budgets by X, for slower machines
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "App.h"
+#include "ImageWriter.h"
+
+using namespace basicgraphics;
+
+static const int IMAGE_SIZE = 256;
+static const int NUM_TIMED_FRAMES = 10;
+
+// A pixel differs visibly above PIXEL_DELTA_E (2.3 is about one just noticeable difference). A scene fails if more
+// than MAX_DIFFERENT_FRACTION of its pixels do, which leaves room for antialiased edges, or if the mean is above MAX_MEAN_DELTA_E.
+static const double PIXEL_DELTA_E = 4.0;
+static const double MAX_DIFFERENT_FRACTION = 0.005;
+static const double MAX_MEAN_DELTA_E = 0.5;
+
+static const char* TEXTURED_VERTEX_SHADER =
+	"#version 330\n"
+	"uniform mat4 projection_mat, view_mat, model_mat;\n"
+	"uniform mat3 normal_mat;\n"
+	"layout (location = 0) in vec3 vertex_position;\n"
+	"layout (location = 1) in vec3 vertex_normal;\n"
+	"layout (location = 2) in vec2 vertex_texcoord;\n"
+	"out vec3 interpSurfPosition;\n"
+	"out vec3 interpSurfNormal;\n"
+	"out vec2 interpTexCoord;\n"
+	"void main() {\n"
+	"	vec4 position = model_mat * vec4(vertex_position, 1.0);\n"
+	"	interpSurfPosition = position.xyz;\n"
+	"	interpSurfNormal = normal_mat * vertex_normal;\n"
+	"	interpTexCoord = vertex_texcoord;\n"
+	"	gl_Position = projection_mat * view_mat * position;\n"
+	"}\n";
+
+// Uses the uniforms Mesh::draw sets, lit from both sides so quads look the same from behind
+static const char* TEXTURED_FRAGMENT_SHADER =
+	"#version 330\n"
+	"uniform vec4 lightPosition;\n"
+	"uniform int hasTexture;\n"
+	"uniform sampler2D textureSampler;\n"
+	"uniform vec4 materialColor;\n"
+	"uniform float alphaCutoff;\n"
+	"in vec3 interpSurfPosition;\n"
+	"in vec3 interpSurfNormal;\n"
+	"in vec2 interpTexCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	vec4 color = hasTexture != 0 ? texture(textureSampler, interpTexCoord) : materialColor;\n"
+	"	if (color.a < alphaCutoff) {\n"
+	"		discard;\n"
+	"	}\n"
+	"	vec3 lightDir = normalize(lightPosition.xyz - interpSurfPosition);\n"
+	"	float diffuse = abs(dot(normalize(interpSurfNormal), lightDir));\n"
+	"	fragColor = vec4(color.rgb * (0.3 + 0.7 * diffuse), color.a);\n"
+	"}\n";
+
+// Resident memory of the process, 0 where it is not known
+static double getResidentMegabytes()
+{
+#ifdef __linux__
+	long pages = 0;
+	long resident = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file != NULL) {
+		if (fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(file);
+	}
+	return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#else
+	return 0.0;
+#endif
+}
+
+// sRGB bytes to CIELAB with a D65 white point
+static glm::vec3 toLab(const unsigned char* rgb)
+{
+	glm::vec3 linear;
+	for (int c = 0; c < 3; c++) {
+		const double value = rgb[c] / 255.0;
+		linear[c] = (float)(value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4));
+	}
+	const double x = (0.4124 * linear.r + 0.3576 * linear.g + 0.1805 * linear.b) / 0.95047;
+	const double y = 0.2126 * linear.r + 0.7152 * linear.g + 0.0722 * linear.b;
+	const double z = (0.0193 * linear.r + 0.1192 * linear.g + 0.9505 * linear.b) / 1.08883;
+	const double xyz[3] = { x, y, z };
+	double f[3];
+	for (int i = 0; i < 3; i++) {
+		f[i] = xyz[i] > 0.008856 ? std::cbrt(xyz[i]) : 7.787 * xyz[i] + 16.0 / 116.0;
+	}
+	return glm::vec3((float)(116.0 * f[1] - 16.0), (float)(500.0 * (f[0] - f[1])), (float)(200.0 * (f[1] - f[2])));
+}
+
+struct Comparison {
+	double meanDeltaE;
+	double differentFraction; // of the pixels above PIXEL_DELTA_E
+	std::vector<unsigned char> difference; // RGB, the render in grey with the differing pixels in red
+};
+
+static Comparison compareImages(const std::vector<unsigned char> &image, const unsigned char* golden, int numPixels)
+{
+	Comparison comparison;
+	comparison.difference.resize(numPixels * 3);
+	double sum = 0.0;
+	int numDifferent = 0;
+	for (int i = 0; i < numPixels; i++) {
+		const unsigned char* a = &image[i * 3];
+		const unsigned char* b = golden + i * 3;
+		const double deltaE = glm::length(toLab(a) - toLab(b));
+		sum += deltaE;
+		if (deltaE > PIXEL_DELTA_E) {
+			numDifferent++;
+		}
+		const unsigned char grey = (unsigned char)((a[0] + a[1] + a[2]) / 12);
+		const unsigned char red = (unsigned char)std::min(255.0, grey + 255.0 * deltaE / (2.0 * PIXEL_DELTA_E));
+		comparison.difference[i * 3 + 0] = deltaE > 0.0 ? red : grey;
+		comparison.difference[i * 3 + 1] = grey;
+		comparison.difference[i * 3 + 2] = grey;
+	}
+	comparison.meanDeltaE = numPixels > 0 ? sum / numPixels : 0.0;
+	comparison.differentFraction = numPixels > 0 ? (double)numDifferent / numPixels : 0.0;
+	return comparison;
+}
+
+static void makeDirectory(const std::string &directory)
+{
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+// App rendering one scene at a time into its headless framebuffer, from the camera and light the turntable and poster renders use
+class GoldenApp : public App {
+public:
+
+	struct Scene {
+		std::string name;
+		std::function<void()> setup; // not timed, creates what draw needs
+		std::function<void()> draw;
+		double frameBudgetMilliseconds; // median time of a frame, on llvmpipe
+		double memoryBudgetMegabytes;   // resident memory the setup and the frames may add
+	};
+
+	GoldenApp(int argc, char** argv) : App(argc, argv, "golden_image_test", IMAGE_SIZE, IMAGE_SIZE, true)
+	{
+		glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+		updateLightPosition(2.0);
+		_bunny.reset(new Model("bunny-simplified.obj", 1.0, glm::vec4(1.0)));
+		_bunny->useMaterialBuffer(); // like App's bunny
+		try {
+			_texturedShader.compileShader(TEXTURED_VERTEX_SHADER, GLSLShader::VERTEX, "golden textured");
+			_texturedShader.compileShader(TEXTURED_FRAGMENT_SHADER, GLSLShader::FRAGMENT, "golden textured");
+			_texturedShader.link();
+		}
+		catch (GLSLProgramException &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	std::vector<Scene> getScenes()
+	{
+		std::vector<Scene> scenes;
+		const char* rampNames[3] = { "normal", "toon", "funky" };
+		for (int i = 0; i < 3; i++) {
+			Scene scene;
+			scene.name = std::string("bunny_") + rampNames[i];
+			scene.setup = [this, i]() { currentLUT = i; };
+			scene.draw = [this]() { drawBunny(); };
+			scene.frameBudgetMilliseconds = 40.0;
+			scene.memoryBudgetMegabytes = 16.0;
+			scenes.push_back(scene);
+		}
+
+		Scene quad;
+		quad.name = "textured_quad";
+		quad.setup = [this]() { addQuad(loadTexture("lightingToon.jpg"), 0.0f); };
+		quad.draw = [this]() { drawTextured(); };
+		quad.frameBudgetMilliseconds = 20.0;
+		quad.memoryBudgetMegabytes = 16.0;
+		scenes.push_back(quad);
+
+		Scene sphere;
+		sphere.name = "textured_sphere";
+		sphere.setup = [this]() { addSphere(loadTexture("lightingFunky.jpg")); };
+		sphere.draw = [this]() { drawTextured(); };
+		sphere.frameBudgetMilliseconds = 40.0;
+		sphere.memoryBudgetMegabytes = 32.0;
+		scenes.push_back(sphere);
+
+		// A quad in front of the bunny, see-through in stripes (blended) or holes (alpha tested), drawn with the app's shader
+		Scene blend;
+		blend.name = "transparent_blend";
+		blend.setup = [this]() { currentLUT = 0; addQuad(createAlphaTexture(false), 0.4f); };
+		blend.draw = [this]() { drawBunny(); drawWithAppShader(); };
+		blend.frameBudgetMilliseconds = 50.0;
+		blend.memoryBudgetMegabytes = 16.0;
+		scenes.push_back(blend);
+
+		Scene cutout;
+		cutout.name = "transparent_cutout";
+		cutout.setup = [this]() { currentLUT = 0; addQuad(createAlphaTexture(true), 0.4f); };
+		cutout.draw = [this]() { drawBunny(); drawWithAppShader(); };
+		cutout.frameBudgetMilliseconds = 50.0;
+		cutout.memoryBudgetMegabytes = 16.0;
+		scenes.push_back(cutout);
+
+		// Quads in front of the bunny whose textures and color all come from one MaterialBuffer, see addMaterialQuads
+		Scene materials;
+		materials.name = "material_buffer";
+		materials.setup = [this]() { currentLUT = 0; addMaterialQuads(); };
+		materials.draw = [this]() { drawBunny(); drawWithAppShader(); };
+		materials.frameBudgetMilliseconds = 50.0;
+		materials.memoryBudgetMegabytes = 16.0;
+		scenes.push_back(materials);
+		return scenes;
+	}
+
+	// Renders one frame of the scene and waits for it
+	void renderFrame(const Scene &scene)
+	{
+		_framebuffer->bind();
+		glViewport(0, 0, _windowWidth, _windowHeight);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.draw();
+		_framebuffer->resolve();
+		glFinish();
+	}
+
+	// The last frame as RGB, top row first
+	std::vector<unsigned char> readImage()
+	{
+		_framebuffer->bindForReading();
+		std::vector<unsigned char> pixels(_windowWidth * _windowHeight * 4);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, _windowWidth, _windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		std::vector<unsigned char> image(_windowWidth * _windowHeight * 3);
+		for (int y = 0; y < _windowHeight; y++) {
+			const unsigned char* row = &pixels[(_windowHeight - 1 - y) * _windowWidth * 4];
+			for (int x = 0; x < _windowWidth; x++) {
+				image[(y * _windowWidth + x) * 3 + 0] = row[x * 4 + 0];
+				image[(y * _windowWidth + x) * 3 + 1] = row[x * 4 + 1];
+				image[(y * _windowWidth + x) * 3 + 2] = row[x * 4 + 2];
+			}
+		}
+		return image;
+	}
+
+	// Frees what the last scene's setup created
+	void clearScene()
+	{
+		_meshes.clear();
+		_materials.reset();
+	}
+
+	int getWidth() const { return _windowWidth; }
+	int getHeight() const { return _windowHeight; }
+
+private:
+	std::unique_ptr<Model> _bunny;
+	GLSLProgram _texturedShader;
+	std::vector<std::unique_ptr<Mesh>> _meshes;
+	std::shared_ptr<MaterialBuffer> _materials; // of the meshes, if the scene uses one
+
+	glm::mat4 getProjection() const
+	{
+		return glm::perspective(glm::radians(45.0f), (GLfloat)_windowWidth / (GLfloat)_windowHeight, 0.1f, 100.0f);
+	}
+
+	void drawBunny()
+	{
+		drawScene(*_bunny, turntable->frame(), getProjection(), turntable->getPos(), _windowHeight);
+	}
+
+	void drawTextured()
+	{
+		if (!_texturedShader.isLinked()) {
+			return;
+		}
+		const glm::mat4 model(1.0);
+		_texturedShader.use();
+		_texturedShader.setUniform("view_mat", turntable->frame());
+		_texturedShader.setUniform("projection_mat", getProjection());
+		_texturedShader.setUniform("model_mat", model);
+		_texturedShader.setUniform("normal_mat", glm::mat3(1.0));
+		_texturedShader.setUniform("lightPosition", lightPosition);
+		for (int i = 0; i < _meshes.size(); i++) {
+			_meshes[i]->draw(_texturedShader);
+		}
+	}
+
+	// After drawBunny, which left the app's BlinnPhong shader in use with the camera, light and lighting table set
+	void drawWithAppShader()
+	{
+		if (_materials) {
+			_materials->bind(shader);
+		}
+		for (int i = 0; i < _meshes.size(); i++) {
+			_meshes[i]->draw(shader);
+		}
+	}
+
+	std::shared_ptr<Texture> loadTexture(const std::string &fileName)
+	{
+		std::shared_ptr<Texture> texture = Texture::create2DTextureFromFile(fileName);
+		texture->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		texture->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		return texture;
+	}
+
+	// Diagonal stripes at half opacity, or a checkerboard of holes
+	std::shared_ptr<Texture> createAlphaTexture(bool cutout)
+	{
+		const int size = 64;
+		std::vector<unsigned char> pixels(size * size * 4);
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				unsigned char* pixel = &pixels[(y * size + x) * 4];
+				pixel[0] = (unsigned char)(x * 4);
+				pixel[1] = (unsigned char)(y * 4);
+				pixel[2] = 200;
+				if (cutout) {
+					pixel[3] = ((x / 8 + y / 8) % 2 == 0) ? 255 : 0;
+				}
+				else {
+					pixel[3] = ((x + y) / 8 % 2 == 0) ? 128 : 64;
+				}
+			}
+		}
+		std::shared_ptr<Texture> texture = Texture::createFromMemory(cutout ? "golden cutout" : "golden blend", &pixels[0], GL_UNSIGNED_BYTE, GL_RGBA, GL_RGBA8, GL_TEXTURE_2D, size, size, 1);
+		texture->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		texture->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return texture;
+	}
+
+	// A square facing the camera across the middle of the bunny, moved towards the camera by forward and to the right by sideways
+	void addQuad(std::shared_ptr<Texture> texture, float forward, float sideways = 0.0f, float halfSize = 0.9f)
+	{
+		const glm::vec3 center = turntable->getCenterPosition();
+		const glm::vec3 toCamera = glm::normalize(turntable->getPos() - center);
+		const glm::vec3 right = glm::normalize(glm::cross(glm::vec3(0.0, 1.0, 0.0), toCamera));
+		const glm::vec3 up = glm::cross(toCamera, right);
+		const glm::vec3 middle = center + forward * toCamera + sideways * right;
+
+		std::vector<Mesh::Vertex> vertices(4);
+		const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+		for (int i = 0; i < 4; i++) {
+			vertices[i].position = middle + halfSize * (corners[i][0] * right + corners[i][1] * up);
+			vertices[i].normal = toCamera;
+			vertices[i].texCoord0 = glm::vec2(0.5f * (corners[i][0] + 1.0f), 0.5f * (corners[i][1] + 1.0f));
+		}
+		std::vector<int> indices = { 0, 1, 2, 0, 2, 3 };
+		addMesh(texture, vertices, indices);
+	}
+
+	// Two textured materials, which share a texture array without bindless textures, and a plain one, a quad each
+	void addMaterialQuads()
+	{
+		_materials.reset(new MaterialBuffer());
+		const int materials[3] = {
+			_materials->addMaterial(glm::vec4(1.0), "lightingToon.jpg"),
+			_materials->addMaterial(glm::vec4(1.0, 0.8, 0.8, 1.0), "lightingFunky.jpg"),
+			_materials->addMaterial(glm::vec4(0.2, 0.6, 1.0, 1.0))
+		};
+		_materials->build();
+		for (int i = 0; i < 3; i++) {
+			addQuad(nullptr, 0.4f, 0.6f * (i - 1), 0.28f);
+			_meshes.back()->setMaterial(_materials, materials[i]);
+		}
+	}
+
+	// sphere.obj has no texture coordinates, they are made from the normals
+	void addSphere(std::shared_ptr<Texture> texture)
+	{
+		std::vector<Mesh::Vertex> vertices;
+		std::vector<int> indices;
+		if (!Model::loadGeometry("sphere.obj", 1.0, vertices, indices)) {
+			return;
+		}
+		const glm::vec3 center = turntable->getCenterPosition();
+		for (int i = 0; i < vertices.size(); i++) {
+			const glm::vec3 normal = vertices[i].normal;
+			vertices[i].texCoord0 = glm::vec2(0.5f + std::atan2(normal.z, normal.x) / 6.2831853f, 0.5f + std::asin(glm::clamp(normal.y, -1.0f, 1.0f)) / 3.1415927f);
+			vertices[i].position = center + vertices[i].position;
+		}
+		addMesh(texture, vertices, indices);
+	}
+
+	void addMesh(std::shared_ptr<Texture> texture, const std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices)
+	{
+		std::vector<std::shared_ptr<Texture>> textures;
+		if (texture) {
+			textures.push_back(texture);
+		}
+		const int vertexBytes = (int)(sizeof(Mesh::Vertex) * vertices.size());
+		const int indexBytes = (int)(sizeof(int) * indices.size());
+		_meshes.emplace_back(new Mesh(textures, GL_TRIANGLES, GL_STATIC_DRAW, vertexBytes, indexBytes, 0, vertices, (int)indices.size(), indexBytes, &indices[0]));
+	}
+};
+
+int main(int argc, char** argv)
+{
+	std::string goldenDirectory = "golden";
+	std::string outputDirectory = "golden-results";
+	std::string filter;
+	bool update = false;
+	double budgetScale = 1.0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--update") {
+			update = true;
+		}
+		else if (i + 1 >= argc) {
+			break;
+		}
+		else if (arg == "--golden") {
+			goldenDirectory = argv[++i];
+		}
+		else if (arg == "--output") {
+			outputDirectory = argv[++i];
+		}
+		else if (arg == "--scene") {
+			filter = argv[++i];
+		}
+		else if (arg == "--budget-scale") {
+			budgetScale = std::max(atof(argv[++i]), 0.01);
+		}
+	}
+
+	std::unique_ptr<GoldenApp> app(new GoldenApp(argc, argv));
+	if (!app->isHeadless()) {
+		std::cerr << "No headless context, install EGL or OSMesa (e.g. Mesa's llvmpipe)" << std::endl;
+		return 1;
+	}
+	const int width = app->getWidth();
+	const int height = app->getHeight();
+	makeDirectory(update ? goldenDirectory : outputDirectory);
+
+	int numRun = 0;
+	int numPassed = 0;
+	const std::vector<GoldenApp::Scene> scenes = app->getScenes();
+	printf("%-22s %9s %9s %9s %9s %9s  %s\n", "scene", "mean dE", "differ", "ms", "budget", "MB", "result");
+	for (int s = 0; s < scenes.size(); s++) {
+		const GoldenApp::Scene &scene = scenes[s];
+		if (!filter.empty() && scene.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		numRun++;
+
+		const double memoryBefore = getResidentMegabytes();
+		scene.setup();
+		app->renderFrame(scene); // uploads and shader variants happen on the first frame
+		std::vector<double> times;
+		for (int f = 0; f < NUM_TIMED_FRAMES; f++) {
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			app->renderFrame(scene);
+			times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		const double milliseconds = times[times.size() / 2];
+		const double megabytes = std::max(getResidentMegabytes() - memoryBefore, 0.0);
+
+		AllocationTracker &allocations = AllocationTracker::getInstance();
+		allocations.setEnabled(true, 0);
+		app->renderFrame(scene);
+		allocations.endFrame();
+		allocations.setEnabled(false);
+		const bool allocates = allocations.getNumAllocatingFrames() > 0;
+
+		const std::vector<unsigned char> image = app->readImage();
+		app->clearScene();
+
+		std::vector<std::string> failures;
+		if (allocates) {
+			failures.push_back("allocates in a steady state frame");
+		}
+		const double budget = scene.frameBudgetMilliseconds * budgetScale;
+		if (milliseconds > budget) {
+			failures.push_back("over the frame time budget");
+		}
+		if (megabytes > scene.memoryBudgetMegabytes) {
+			failures.push_back("over the memory budget");
+		}
+
+		std::string error;
+		const std::string goldenFile = goldenDirectory + "/" + scene.name + ".png";
+		Comparison comparison = { 0.0, 0.0 };
+		if (update) {
+			if (!ImageWriter::writePNG(goldenFile, width, height, 3, &image[0], error)) {
+				failures.push_back(error);
+			}
+		}
+		else {
+			int goldenWidth = 0, goldenHeight = 0, goldenChannels = 0;
+			unsigned char* golden = SOIL_load_image(goldenFile.c_str(), &goldenWidth, &goldenHeight, &goldenChannels, SOIL_LOAD_RGB);
+			if (golden == NULL) {
+				// A scene is only checked against its image, so a missing one fails it like a wrong one
+				failures.push_back("no golden image " + goldenFile + ", create it with --update");
+			}
+			else if (goldenWidth != width || goldenHeight != height) {
+				failures.push_back("the golden image is " + std::to_string(goldenWidth) + "x" + std::to_string(goldenHeight));
+			}
+			else {
+				comparison = compareImages(image, golden, width * height);
+				if (comparison.differentFraction > MAX_DIFFERENT_FRACTION || comparison.meanDeltaE > MAX_MEAN_DELTA_E) {
+					failures.push_back("looks different from " + goldenFile);
+				}
+			}
+			if (golden != NULL) {
+				SOIL_free_image_data(golden);
+			}
+			if (!failures.empty()) {
+				ImageWriter::writePNG(outputDirectory + "/" + scene.name + ".png", width, height, 3, &image[0], error);
+				if (!comparison.difference.empty()) {
+					ImageWriter::writePNG(outputDirectory + "/" + scene.name + ".diff.png", width, height, 3, &comparison.difference[0], error);
+				}
+			}
+		}
+
+		printf("%-22s %9.3f %8.3f%% %9.2f %9.2f %9.1f  %s\n", scene.name.c_str(), comparison.meanDeltaE, 100.0 * comparison.differentFraction,
+			milliseconds, budget, megabytes, !failures.empty() ? "FAILED" : update ? "updated" : "ok");
+		for (int i = 0; i < failures.size(); i++) {
+			printf("    %s\n", failures[i].c_str());
+		}
+		if (allocates) {
+			fflush(stdout);
+			AllocationTracker::printFrame(allocations.getLastFrame(), std::cout);
+		}
+		if (failures.empty()) {
+			numPassed++;
+		}
+	}
+
+	printf("%d of %d scenes passed\n", numPassed, numRun);
+	return (numRun > 0 && numPassed == numRun) ? 0 : 1;
+}
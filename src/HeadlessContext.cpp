@@ -0,0 +1,252 @@
+//
+//  HeadlessContext.cpp
+//
+//
+
+#include "HeadlessContext.h"
+
+// glad before anything that includes GL/gl.h (osmesa.h does)
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+#ifdef BASICGRAPHICS_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+namespace basicgraphics {
+
+	static thread_local HeadlessContext* currentContext = nullptr;
+
+	HeadlessContext::HeadlessContext(Backend backend /*=BACKEND_AUTO*/) : _backend(backend), _valid(false), _display(nullptr), _context(nullptr)
+	{
+		memset(_buffer, 0, sizeof(_buffer));
+
+		if (backend == BACKEND_AUTO || backend == BACKEND_EGL) {
+			_backend = BACKEND_EGL;
+			_valid = createEGL();
+		}
+		if (!_valid && (backend == BACKEND_AUTO || backend == BACKEND_OSMESA)) {
+			_backend = BACKEND_OSMESA;
+			_valid = createOSMesa();
+		}
+
+		if (_valid) {
+			currentContext = this;
+		}
+	}
+
+	HeadlessContext::~HeadlessContext()
+	{
+		if (currentContext == this) {
+			currentContext = nullptr;
+		}
+
+#ifdef BASICGRAPHICS_HAVE_EGL
+		if (_backend == BACKEND_EGL && _display != nullptr) {
+			eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (_context != nullptr) {
+				eglDestroyContext((EGLDisplay)_display, (EGLContext)_context);
+			}
+			eglTerminate((EGLDisplay)_display);
+		}
+#endif
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+		if (_backend == BACKEND_OSMESA && _context != nullptr) {
+			OSMesaDestroyContext((OSMesaContext)_context);
+		}
+#endif
+	}
+
+	bool HeadlessContext::isValid() const
+	{
+		return _valid;
+	}
+
+	HeadlessContext::Backend HeadlessContext::getBackend() const
+	{
+		return _backend;
+	}
+
+	std::string HeadlessContext::getError() const
+	{
+		return _error;
+	}
+
+	void HeadlessContext::makeCurrent()
+	{
+		if (!_valid) {
+			return;
+		}
+#ifdef BASICGRAPHICS_HAVE_EGL
+		if (_backend == BACKEND_EGL) {
+			eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, (EGLContext)_context);
+		}
+#endif
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+		if (_backend == BACKEND_OSMESA) {
+			OSMesaMakeCurrent((OSMesaContext)_context, _buffer, GL_UNSIGNED_BYTE, 1, 1);
+		}
+#endif
+		currentContext = this;
+	}
+
+	void* HeadlessContext::getProcAddress(const char* name)
+	{
+		HeadlessContext* context = currentContext;
+		if (context == nullptr) {
+			return (void*)glfwGetProcAddress(name);
+		}
+#ifdef BASICGRAPHICS_HAVE_EGL
+		if (context->_backend == BACKEND_EGL) {
+			return (void*)eglGetProcAddress(name);
+		}
+#endif
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+		if (context->_backend == BACKEND_OSMESA) {
+			return (void*)OSMesaGetProcAddress(name);
+		}
+#endif
+		return nullptr;
+	}
+
+	HeadlessContext* HeadlessContext::getCurrent()
+	{
+		return currentContext;
+	}
+
+	bool HeadlessContext::isAvailable(Backend backend)
+	{
+		switch (backend) {
+#ifdef BASICGRAPHICS_HAVE_EGL
+		case BACKEND_EGL:
+			return true;
+#endif
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+		case BACKEND_OSMESA:
+			return true;
+#endif
+		case BACKEND_AUTO:
+			return isAvailable(BACKEND_EGL) || isAvailable(BACKEND_OSMESA);
+		default:
+			return false;
+		}
+	}
+
+	bool HeadlessContext::createEGL()
+	{
+#ifdef BASICGRAPHICS_HAVE_EGL
+		// Prefer Mesa's surfaceless platform, it needs neither X11 nor a GPU device node
+		EGLDisplay display = EGL_NO_DISPLAY;
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (clientExtensions != nullptr && strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != nullptr) {
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay != nullptr) {
+				display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			}
+		}
+		if (display == EGL_NO_DISPLAY) {
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+			_error = "HeadlessContext: unable to initialize an EGL display";
+			return false;
+		}
+		_display = display;
+
+		// eglTerminate also releases a context that was already created
+		auto failEGL = [this](const char* error) {
+			_error = error;
+			eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglTerminate((EGLDisplay)_display);
+			_display = nullptr;
+			_context = nullptr;
+			return false;
+		};
+
+		const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if (extensions == nullptr || strstr(extensions, "EGL_KHR_surfaceless_context") == nullptr) {
+			return failEGL("HeadlessContext: EGL_KHR_surfaceless_context is not supported");
+		}
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			return failEGL("HeadlessContext: EGL does not support desktop OpenGL");
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+			return failEGL("HeadlessContext: no EGL config for desktop OpenGL");
+		}
+
+		// Same version and profile as the window BaseApp creates
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 3,
+			EGL_CONTEXT_MINOR_VERSION, 2,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT) {
+			return failEGL("HeadlessContext: unable to create an OpenGL 3.2 core context with EGL");
+		}
+		_context = context;
+
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+			return failEGL("HeadlessContext: unable to make the EGL context current");
+		}
+		return true;
+#else
+		_error = "HeadlessContext: built without EGL";
+		return false;
+#endif
+	}
+
+	bool HeadlessContext::createOSMesa()
+	{
+#ifdef BASICGRAPHICS_HAVE_OSMESA
+		const int attributes[] = {
+			OSMESA_FORMAT, OSMESA_RGBA,
+			OSMESA_DEPTH_BITS, 24,
+			OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+			OSMESA_CONTEXT_MAJOR_VERSION, 3,
+			OSMESA_CONTEXT_MINOR_VERSION, 2,
+			0
+		};
+		OSMesaContext context = OSMesaCreateContextAttribs(attributes, NULL);
+		if (context == NULL) {
+			_error = "HeadlessContext: unable to create an OpenGL 3.2 core context with OSMesa";
+			return false;
+		}
+		_context = context;
+
+		if (!OSMesaMakeCurrent(context, _buffer, GL_UNSIGNED_BYTE, 1, 1)) {
+			_error = "HeadlessContext: unable to make the OSMesa context current";
+			OSMesaDestroyContext(context);
+			_context = nullptr;
+			return false;
+		}
+		return true;
+#else
+		if (_error.empty()) {
+			_error = "HeadlessContext: built without OSMesa";
+		}
+		else {
+			_error += ", built without OSMesa";
+		}
+		return false;
+#endif
+	}
+
+}
@@ -0,0 +1,78 @@
+/*!
+ *  HeadlessContext.h
+ *
+ * An OpenGL context without a window, for rendering on machines without a display.
+ */
+
+#ifndef HeadlessContext_h
+#define HeadlessContext_h
+
+#include <string>
+
+namespace basicgraphics {
+
+	/** HeadlessContext creates a 3.2 core context through surfaceless EGL or, if that isn't available,
+	OSMesa. Both work with Mesa's llvmpipe, so any CPU-only Linux box or container can render. There
+	is no default framebuffer, draw into a Framebuffer instead (BaseApp does this in headless mode).
+
+	The backends are compiled in when CMake finds libEGL (BASICGRAPHICS_HAVE_EGL) or libOSMesa
+	(BASICGRAPHICS_HAVE_OSMESA). Set EGL_PLATFORM=surfaceless or LIBGL_ALWAYS_SOFTWARE=1 to steer Mesa.
+	------------------------------------------------------------------------
+	HeadlessContext context;
+	if (!context.isValid()) {
+		std::cerr << context.getError() << std::endl;
+	}
+	gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress);
+	------------------------------------------------------------------------
+	*/
+	class HeadlessContext
+	{
+	public:
+
+		enum Backend {
+			BACKEND_AUTO = 0, /// EGL, then OSMesa
+			BACKEND_EGL = 1,
+			BACKEND_OSMESA = 2
+		};
+
+		// Creates the context and makes it current on the calling thread
+		HeadlessContext(Backend backend = BACKEND_AUTO);
+		virtual ~HeadlessContext();
+
+		bool isValid() const;
+		Backend getBackend() const;
+		std::string getError() const;
+
+		void makeCurrent();
+
+		/*!
+		 * Looks up a GL function in the current context. Falls back to GLFW when no headless context is current,
+		 * so code that loads extensions works the same with and without a window.
+		 */
+		static void* getProcAddress(const char* name);
+
+		// The headless context current on this thread, if any
+		static HeadlessContext* getCurrent();
+
+		// True if the backend was compiled in
+		static bool isAvailable(Backend backend);
+
+	private:
+		HeadlessContext(const HeadlessContext&) {}; // prevent copying
+
+		Backend _backend;
+		bool _valid;
+		std::string _error;
+
+		// Opaque EGL or OSMesa handles so this header doesn't pull in either API
+		void* _display;
+		void* _context;
+		unsigned char _buffer[4]; // OSMesa needs a color buffer to make the context current, it is never drawn to
+
+		bool createEGL();
+		bool createOSMesa();
+	};
+
+}
+
+#endif /* HeadlessContext_h */
@@ -0,0 +1,355 @@
+//
+//  HttpSocket.cpp
+//
+//
+
+#include "HttpSocket.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace basicgraphics {
+
+	// Limits what a misbehaving client can make the server buffer
+	static const size_t MAX_HEADER_SIZE = 16384;
+
+	static const char* getStatusText(int status)
+	{
+		switch (status) {
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 503: return "Service Unavailable";
+		default: return "Internal Server Error";
+		}
+	}
+
+#ifndef _WIN32
+
+	// Fills in a sockaddr for "unix:/path" or "host:port"
+	static bool makeAddress(const std::string &address, sockaddr_storage &storage, socklen_t &length, std::string &error)
+	{
+		memset(&storage, 0, sizeof(storage));
+		if (address.compare(0, 5, "unix:") == 0) {
+			const std::string path = address.substr(5);
+			sockaddr_un* unixAddress = (sockaddr_un*)&storage;
+			if (path.empty() || path.size() >= sizeof(unixAddress->sun_path)) {
+				error = "HttpSocket: invalid socket path in " + address;
+				return false;
+			}
+			unixAddress->sun_family = AF_UNIX;
+			strncpy(unixAddress->sun_path, path.c_str(), sizeof(unixAddress->sun_path) - 1);
+			length = sizeof(sockaddr_un);
+			return true;
+		}
+
+		size_t colon = address.find_last_of(':');
+		if (colon == std::string::npos) {
+			error = "HttpSocket: expected unix:/path or host:port, got " + address;
+			return false;
+		}
+		std::string host = address.substr(0, colon);
+		const int port = atoi(address.substr(colon + 1).c_str());
+		if (host.empty() || host == "localhost") {
+			host = "127.0.0.1";
+		}
+		sockaddr_in* inetAddress = (sockaddr_in*)&storage;
+		inetAddress->sin_family = AF_INET;
+		inetAddress->sin_port = htons((unsigned short)port);
+		if (port <= 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &inetAddress->sin_addr) != 1) {
+			error = "HttpSocket: invalid address " + address;
+			return false;
+		}
+		length = sizeof(sockaddr_in);
+		return true;
+	}
+
+	static void setOptions(int socket)
+	{
+		HttpSocket::setTimeout(socket, HttpSocket::DEFAULT_TIMEOUT_MILLISECONDS);
+#ifdef SO_NOSIGPIPE
+		int on = 1;
+		setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+	}
+
+	int HttpSocket::listen(const std::string &address, std::string &error)
+	{
+		sockaddr_storage storage;
+		socklen_t length;
+		if (!makeAddress(address, storage, length, error)) {
+			return -1;
+		}
+
+		int listenSocket = socket(storage.ss_family, SOCK_STREAM, 0);
+		if (listenSocket < 0) {
+			error = "HttpSocket: unable to create a socket for " + address;
+			return -1;
+		}
+		if (storage.ss_family == AF_UNIX) {
+			unlink(((sockaddr_un*)&storage)->sun_path);
+		}
+		else {
+			int on = 1;
+			setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		}
+
+		if (::bind(listenSocket, (sockaddr*)&storage, length) != 0 || ::listen(listenSocket, 64) != 0) {
+			error = "HttpSocket: unable to listen on " + address + ": " + strerror(errno);
+			::close(listenSocket);
+			return -1;
+		}
+		return listenSocket;
+	}
+
+	int HttpSocket::accept(int listenSocket, int timeoutMilliseconds)
+	{
+		pollfd request;
+		request.fd = listenSocket;
+		request.events = POLLIN;
+		request.revents = 0;
+		if (poll(&request, 1, timeoutMilliseconds) <= 0 || (request.revents & POLLIN) == 0) {
+			return -1;
+		}
+		int connection = ::accept(listenSocket, NULL, NULL);
+		if (connection >= 0) {
+			setOptions(connection);
+		}
+		return connection;
+	}
+
+	int HttpSocket::connect(const std::string &address, std::string &error)
+	{
+		sockaddr_storage storage;
+		socklen_t length;
+		if (!makeAddress(address, storage, length, error)) {
+			return -1;
+		}
+		int connection = socket(storage.ss_family, SOCK_STREAM, 0);
+		if (connection < 0) {
+			error = "HttpSocket: unable to create a socket for " + address;
+			return -1;
+		}
+		if (::connect(connection, (sockaddr*)&storage, length) != 0) {
+			error = "HttpSocket: unable to connect to " + address + ": " + strerror(errno);
+			::close(connection);
+			return -1;
+		}
+		setOptions(connection);
+		return connection;
+	}
+
+	void HttpSocket::close(int socket)
+	{
+		if (socket >= 0) {
+			::close(socket);
+		}
+	}
+
+	void HttpSocket::setTimeout(int socket, int timeoutMilliseconds)
+	{
+		timeval timeout;
+		timeout.tv_sec = timeoutMilliseconds / 1000;
+		timeout.tv_usec = (timeoutMilliseconds % 1000) * 1000;
+		setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	}
+
+	bool HttpSocket::sendAll(int socket, const unsigned char* bytes, size_t size)
+	{
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL; // a client that hung up shouldn't kill the server with SIGPIPE
+#else
+		const int flags = 0;
+#endif
+		while (size > 0) {
+			ssize_t sent = send(socket, bytes, size, flags);
+			if (sent <= 0) {
+				return false;
+			}
+			bytes += sent;
+			size -= sent;
+		}
+		return true;
+	}
+
+	bool HttpSocket::receiveUntil(int socket, const std::string &terminator, size_t maxSize, std::string &received)
+	{
+		char buffer[4096];
+		while (received.size() < maxSize) {
+			ssize_t count = recv(socket, buffer, sizeof(buffer), 0);
+			if (count <= 0) {
+				// The end of the stream terminates the response body
+				return terminator.empty() && count == 0;
+			}
+			received.append(buffer, count);
+			if (!terminator.empty() && received.find(terminator) != std::string::npos) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+#else
+
+	int HttpSocket::listen(const std::string &address, std::string &error)
+	{
+		error = "HttpSocket: sockets are not implemented on Windows";
+		return -1;
+	}
+
+	int HttpSocket::accept(int listenSocket, int timeoutMilliseconds)
+	{
+		return -1;
+	}
+
+	int HttpSocket::connect(const std::string &address, std::string &error)
+	{
+		error = "HttpSocket: sockets are not implemented on Windows";
+		return -1;
+	}
+
+	void HttpSocket::close(int socket)
+	{
+	}
+
+	void HttpSocket::setTimeout(int socket, int timeoutMilliseconds)
+	{
+	}
+
+	bool HttpSocket::sendAll(int socket, const unsigned char* bytes, size_t size)
+	{
+		return false;
+	}
+
+	bool HttpSocket::receiveUntil(int socket, const std::string &terminator, size_t maxSize, std::string &received)
+	{
+		return false;
+	}
+
+#endif
+
+	bool HttpSocket::readRequest(int connection, std::string &method, std::string &path)
+	{
+		std::string header;
+		if (!receiveUntil(connection, "\r\n\r\n", MAX_HEADER_SIZE, header)) {
+			return false;
+		}
+		// "GET /render?model=bunny.obj HTTP/1.1"
+		const size_t lineEnd = header.find("\r\n");
+		const std::string line = header.substr(0, lineEnd);
+		const size_t firstSpace = line.find(' ');
+		const size_t secondSpace = line.find(' ', firstSpace + 1);
+		if (firstSpace == std::string::npos || secondSpace == std::string::npos) {
+			return false;
+		}
+		method = line.substr(0, firstSpace);
+		path = line.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+		return true;
+	}
+
+	bool HttpSocket::sendResponse(int connection, int status, const std::string &contentType, const unsigned char* body, size_t size)
+	{
+		char header[256];
+		int headerSize = snprintf(header, sizeof(header), "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+			status, getStatusText(status), contentType.c_str(), (unsigned long)size);
+		if (headerSize < 0 || headerSize >= (int)sizeof(header)) {
+			return false;
+		}
+		return sendAll(connection, (const unsigned char*)header, headerSize) && (size == 0 || sendAll(connection, body, size));
+	}
+
+	bool HttpSocket::sendResponse(int connection, int status, const std::string &text)
+	{
+		return sendResponse(connection, status, "text/plain", (const unsigned char*)text.c_str(), text.size());
+	}
+
+	bool HttpSocket::get(const std::string &address, const std::string &path, int &status, std::vector<unsigned char> &body, std::string &error,
+		int timeoutMilliseconds /*=DEFAULT_TIMEOUT_MILLISECONDS*/)
+	{
+		int connection = connect(address, error);
+		if (connection < 0) {
+			return false;
+		}
+		setTimeout(connection, timeoutMilliseconds);
+		const std::string request = "GET " + path + " HTTP/1.0\r\nHost: localhost\r\n\r\n";
+		std::string response;
+		bool ok = sendAll(connection, (const unsigned char*)request.c_str(), request.size()) && receiveUntil(connection, "", (size_t)-1, response);
+		close(connection);
+		if (!ok) {
+			error = "HttpSocket: no response from " + address;
+			return false;
+		}
+
+		const size_t headerEnd = response.find("\r\n\r\n");
+		if (headerEnd == std::string::npos || sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+			error = "HttpSocket: malformed response from " + address;
+			return false;
+		}
+		body.assign(response.begin() + headerEnd + 4, response.end());
+		return true;
+	}
+
+	std::string HttpSocket::parsePath(const std::string &path, std::vector<std::pair<std::string, std::string>> &query)
+	{
+		query.clear();
+		const size_t questionMark = path.find('?');
+		if (questionMark == std::string::npos) {
+			return path;
+		}
+
+		size_t start = questionMark + 1;
+		while (start < path.size()) {
+			size_t end = path.find('&', start);
+			if (end == std::string::npos) {
+				end = path.size();
+			}
+			const std::string pair = path.substr(start, end - start);
+			const size_t equals = pair.find('=');
+			if (!pair.empty()) {
+				if (equals == std::string::npos) {
+					query.push_back(std::make_pair(decode(pair), std::string()));
+				}
+				else {
+					query.push_back(std::make_pair(decode(pair.substr(0, equals)), decode(pair.substr(equals + 1))));
+				}
+			}
+			start = end + 1;
+		}
+		return path.substr(0, questionMark);
+	}
+
+	std::string HttpSocket::decode(const std::string &text)
+	{
+		std::string decoded;
+		decoded.reserve(text.size());
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2])) {
+				decoded += (char)strtol(text.substr(i + 1, 2).c_str(), NULL, 16);
+				i += 2;
+			}
+			else if (text[i] == '+') {
+				decoded += ' ';
+			}
+			else {
+				decoded += text[i];
+			}
+		}
+		return decoded;
+	}
+
+}
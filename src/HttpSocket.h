@@ -0,0 +1,77 @@
+/*!
+ *  HttpSocket.h
+ *
+ * Just enough HTTP/1.0 over localhost TCP or a Unix domain socket to talk to other local processes.
+ */
+
+#ifndef HttpSocket_h
+#define HttpSocket_h
+
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** HttpSocket wraps the socket calls for a local server and client. Addresses are "unix:/path/to/socket"
+	for a Unix domain socket or "host:port" for TCP, e.g. "127.0.0.1:8080"; a bare ":8080" means localhost.
+	Every connection carries one request and one response, then it is closed (HTTP/1.0, no keep-alive), so
+	curl or a browser can talk to the server too. Sockets are plain file descriptors, -1 is invalid.
+
+	Only POSIX sockets are implemented. On Windows listen and connect fail with an error.
+	------------------------------------------------------------------------
+	std::string error;
+	int server = HttpSocket::listen("127.0.0.1:8080", error);
+	int connection = HttpSocket::accept(server, 100);
+	std::string method, path;
+	if (connection != -1 && HttpSocket::readRequest(connection, method, path)) {
+		HttpSocket::sendResponse(connection, 200, "text/plain", (const unsigned char*)"hello", 5);
+	}
+	HttpSocket::close(connection);
+	------------------------------------------------------------------------
+	*/
+	class HttpSocket
+	{
+	public:
+
+		// Send and receive timeout of accepted and connected sockets, a stalled peer fails the call after this long
+		static const int DEFAULT_TIMEOUT_MILLISECONDS = 10000;
+
+		// Binds and listens, an existing Unix domain socket file is replaced
+		static int listen(const std::string &address, std::string &error);
+
+		// Waits up to timeoutMilliseconds for a connection, returns -1 if none arrived
+		static int accept(int listenSocket, int timeoutMilliseconds);
+
+		static int connect(const std::string &address, std::string &error);
+
+		static void close(int socket);
+
+		// Replaces the send and receive timeout of a connected socket
+		static void setTimeout(int socket, int timeoutMilliseconds);
+
+		// Reads the request line and headers, the body (if any) is ignored
+		static bool readRequest(int connection, std::string &method, std::string &path);
+
+		static bool sendResponse(int connection, int status, const std::string &contentType, const unsigned char* body, size_t size);
+		static bool sendResponse(int connection, int status, const std::string &text);
+
+		/*!
+		 * Client side: sends GET path and reads the whole response. Returns false if the server couldn't be reached
+		 * or the response was malformed, otherwise status holds the HTTP status. timeoutMilliseconds bounds each send
+		 * and receive, raise it for renders that take longer than that to answer.
+		 */
+		static bool get(const std::string &address, const std::string &path, int &status, std::vector<unsigned char> &body, std::string &error,
+			int timeoutMilliseconds = DEFAULT_TIMEOUT_MILLISECONDS);
+
+		// Splits "/render?a=1&b=x%20y" into "/render" and {a: "1", b: "x y"}
+		static std::string parsePath(const std::string &path, std::vector<std::pair<std::string, std::string>> &query);
+
+	private:
+		static bool sendAll(int socket, const unsigned char* bytes, size_t size);
+		static bool receiveUntil(int socket, const std::string &terminator, size_t maxSize, std::string &received);
+		static std::string decode(const std::string &text);
+	};
+
+}
+
+#endif /* HttpSocket_h */
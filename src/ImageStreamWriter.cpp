@@ -0,0 +1,221 @@
+//
+//  ImageStreamWriter.cpp
+//
+//
+
+#include "ImageStreamWriter.h"
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace basicgraphics {
+
+	// Size of the IDAT chunks, the compressor output is flushed to the file whenever this much has built up
+	static const size_t CHUNK_SIZE = 1 << 20;
+
+	static void storeUInt32(unsigned char* out, unsigned int value)
+	{
+		out[0] = (value >> 24) & 0xFF;
+		out[1] = (value >> 16) & 0xFF;
+		out[2] = (value >> 8) & 0xFF;
+		out[3] = value & 0xFF;
+	}
+
+	ImageStreamWriter::ImageStreamWriter() : _file(NULL), _png(false), _ok(false), _width(0), _height(0), _channels(0), _numRowsWritten(0)
+	{
+		memset(&_stream, 0, sizeof(_stream));
+	}
+
+	ImageStreamWriter::~ImageStreamWriter()
+	{
+		if (_file != NULL) {
+			if (_png) {
+				deflateEnd(&_stream);
+			}
+			fclose(_file);
+		}
+	}
+
+	bool ImageStreamWriter::open(const std::string &fileName, int width, int height, int channels, std::string &error)
+	{
+		if (_file != NULL) {
+			error = "ImageStreamWriter: " + _fileName + " is still open";
+			return false;
+		}
+		if (channels < 1 || channels > 4 || width < 1 || height < 1) {
+			error = "ImageStreamWriter: invalid image size for " + fileName;
+			return false;
+		}
+
+		std::string extension;
+		size_t dot = fileName.find_last_of('.');
+		if (dot != std::string::npos) {
+			extension = fileName.substr(dot + 1);
+			std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		}
+		if (extension != "png" && extension != "raw") {
+			error = "ImageStreamWriter: " + fileName + " is not a .png or .raw file";
+			return false;
+		}
+
+		_png = (extension == "png");
+		if (_png && deflateInit(&_stream, Z_BEST_SPEED) != Z_OK) {
+			error = "ImageStreamWriter: unable to start the compressor";
+			return false;
+		}
+
+		_file = fopen(fileName.c_str(), "wb");
+		if (_file == NULL) {
+			if (_png) {
+				deflateEnd(&_stream);
+			}
+			error = "Unable to open " + fileName + " for writing";
+			return false;
+		}
+
+		_fileName = fileName;
+		_width = width;
+		_height = height;
+		_channels = channels;
+		_numRowsWritten = 0;
+		_ok = true;
+
+		if (_png) {
+			static const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 }; // grey, grey+alpha, RGB, RGBA
+			static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			_ok = fwrite(signature, 1, 8, _file) == 8;
+
+			unsigned char header[13];
+			storeUInt32(header, width);
+			storeUInt32(header + 4, height);
+			header[8] = 8; // bit depth
+			header[9] = colorTypes[channels];
+			header[10] = 0; // deflate
+			header[11] = 0; // adaptive filtering
+			header[12] = 0; // not interlaced
+			_ok = _ok && writeChunk("IHDR", header, sizeof(header));
+
+			_compressed.resize(CHUNK_SIZE);
+			_stream.next_out = &_compressed[0];
+			_stream.avail_out = (uInt)_compressed.size();
+		}
+		if (!_ok) {
+			error = "Unable to write " + fileName;
+		}
+		return _ok;
+	}
+
+	bool ImageStreamWriter::writeRows(const unsigned char* pixels, int numRows)
+	{
+		if (_file == NULL || !_ok) {
+			return false;
+		}
+		numRows = std::min(numRows, _height - _numRowsWritten);
+		const size_t stride = (size_t)_width * _channels;
+
+		if (_png) {
+			// One row at a time, so a band of a huge image doesn't need a filtered copy
+			_filtered.resize(stride + 1);
+			for (int y = 0; y < numRows && _ok; y++) {
+				ImageWriter::filterPNGRow(pixels + y * stride, _width, _channels, &_filtered[0]);
+				_ok = compressBytes(&_filtered[0], _filtered.size(), Z_NO_FLUSH);
+			}
+		}
+		else {
+			_ok = fwrite(pixels, 1, stride * numRows, _file) == stride * numRows;
+		}
+		_numRowsWritten += numRows;
+		return _ok;
+	}
+
+	bool ImageStreamWriter::close(std::string &error)
+	{
+		if (_file == NULL) {
+			error = "ImageStreamWriter: no file is open";
+			return false;
+		}
+		if (_numRowsWritten < _height) {
+			_ok = false;
+			error = "ImageStreamWriter: only " + std::to_string(_numRowsWritten) + " of " + std::to_string(_height) + " rows were written to " + _fileName;
+		}
+
+		if (_png) {
+			if (_ok) {
+				_ok = compressBytes(NULL, 0, Z_FINISH) && writeChunk("IEND", NULL, 0);
+			}
+			deflateEnd(&_stream);
+			_compressed.clear();
+			_compressed.shrink_to_fit();
+			_filtered.clear();
+			_filtered.shrink_to_fit();
+		}
+		bool closed = fclose(_file) == 0;
+		_file = NULL;
+
+		if (_ok && !closed) {
+			_ok = false;
+		}
+		if (!_ok && error.empty()) {
+			error = "Unable to write " + _fileName;
+		}
+		return _ok;
+	}
+
+	bool ImageStreamWriter::isOpen() const
+	{
+		return _file != NULL;
+	}
+
+	int ImageStreamWriter::getNumRowsWritten() const
+	{
+		return _numRowsWritten;
+	}
+
+	bool ImageStreamWriter::compressBytes(const unsigned char* bytes, size_t size, int flush)
+	{
+		_stream.next_in = (Bytef*)bytes;
+		_stream.avail_in = (uInt)size;
+		while (true) {
+			int result = deflate(&_stream, flush);
+			if (result == Z_STREAM_ERROR) {
+				return false;
+			}
+			const bool full = _stream.avail_out == 0;
+			const bool finished = (result == Z_STREAM_END);
+			if (full || finished) {
+				const size_t used = _compressed.size() - _stream.avail_out;
+				if (used > 0 && !writeChunk("IDAT", &_compressed[0], used)) {
+					return false;
+				}
+				_stream.next_out = &_compressed[0];
+				_stream.avail_out = (uInt)_compressed.size();
+			}
+			if (finished || (flush == Z_NO_FLUSH && !full && _stream.avail_in == 0)) {
+				return true;
+			}
+		}
+	}
+
+	bool ImageStreamWriter::writeChunk(const char type[4], const unsigned char* data, size_t size)
+	{
+		unsigned char length[4];
+		storeUInt32(length, (unsigned int)size);
+
+		// The CRC covers the chunk type and data
+		uLong crc = crc32(0L, (const Bytef*)type, 4);
+		if (size > 0) {
+			crc = crc32(crc, data, (uInt)size);
+		}
+		unsigned char crcBytes[4];
+		storeUInt32(crcBytes, (unsigned int)crc);
+
+		bool ok = fwrite(length, 1, 4, _file) == 4;
+		ok = ok && fwrite(type, 1, 4, _file) == 4;
+		ok = ok && (size == 0 || fwrite(data, 1, size, _file) == size);
+		ok = ok && fwrite(crcBytes, 1, 4, _file) == 4;
+		return ok;
+	}
+
+}
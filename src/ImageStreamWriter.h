@@ -0,0 +1,76 @@
+/*!
+ *  ImageStreamWriter.h
+ *
+ * Writes an image to a file a few rows at a time, for images too large to hold in memory.
+ */
+
+#ifndef ImageStreamWriter_h
+#define ImageStreamWriter_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+namespace basicgraphics {
+
+	/** ImageStreamWriter writes the rows of a PNG or raw file as they arrive, top row first, and only
+	keeps the compressor state and one pending IDAT chunk in memory. Like ImageWriter it touches no GL,
+	but the rows have to come in order, so only one thread at a time may call writeRows.
+	------------------------------------------------------------------------
+	ImageStreamWriter writer;
+	std::string error;
+	if (writer.open("poster.png", 16384, 16384, 3, error)) {
+		for (each band of rows, top to bottom) {
+			writer.writeRows(&band[0], bandHeight);
+		}
+		writer.close(error);
+	}
+	------------------------------------------------------------------------
+	*/
+	class ImageStreamWriter
+	{
+	public:
+
+		ImageStreamWriter();
+
+		// Closes the file if it is still open, the image is incomplete in that case
+		virtual ~ImageStreamWriter();
+
+		// The format comes from the extension, .png or .raw
+		bool open(const std::string &fileName, int width, int height, int channels, std::string &error);
+
+		// Appends numRows tightly packed rows
+		bool writeRows(const unsigned char* pixels, int numRows);
+
+		// Flushes the compressor and writes the end of the file. Fails if fewer rows than the height were written.
+		bool close(std::string &error);
+
+		bool isOpen() const;
+		int getNumRowsWritten() const;
+
+	private:
+		ImageStreamWriter(const ImageStreamWriter&) {}; // prevent copying
+
+		std::string _fileName;
+		FILE* _file;
+		bool _png;
+		bool _ok;
+		int _width;
+		int _height;
+		int _channels;
+		int _numRowsWritten;
+
+		// PNG only
+		z_stream _stream;
+		std::vector<unsigned char> _filtered;
+		std::vector<unsigned char> _compressed;
+
+		bool compressBytes(const unsigned char* bytes, size_t size, int flush);
+		bool writeChunk(const char type[4], const unsigned char* data, size_t size);
+	};
+
+}
+
+#endif /* ImageStreamWriter_h */
@@ -0,0 +1,253 @@
+//
+//  ImageWriter.cpp
+//
+//
+
+#include "ImageWriter.h"
+
+#include <SOIL.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+namespace basicgraphics {
+
+	static void appendUInt32(std::vector<unsigned char> &out, unsigned int value)
+	{
+		out.push_back((value >> 24) & 0xFF);
+		out.push_back((value >> 16) & 0xFF);
+		out.push_back((value >> 8) & 0xFF);
+		out.push_back(value & 0xFF);
+	}
+
+	static void appendPNGChunk(std::vector<unsigned char> &out, const char type[4], const unsigned char* data, size_t size)
+	{
+		appendUInt32(out, (unsigned int)size);
+		const size_t typeStart = out.size();
+		out.insert(out.end(), type, type + 4);
+		if (size > 0) {
+			out.insert(out.end(), data, data + size);
+		}
+		// The CRC covers the chunk type and data
+		uLong crc = crc32(0L, &out[typeStart], (uInt)(4 + size));
+		appendUInt32(out, (unsigned int)crc);
+	}
+
+	static std::string getExtension(const std::string &fileName)
+	{
+		size_t dot = fileName.find_last_of('.');
+		if (dot == std::string::npos) {
+			return "";
+		}
+		std::string extension = fileName.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		return extension;
+	}
+
+	bool ImageWriter::write(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error)
+	{
+		std::string extension = getExtension(fileName);
+		if (extension == "png") {
+			return writePNG(fileName, width, height, channels, pixels, error);
+		}
+		if (extension == "qoi") {
+			return writeQOI(fileName, width, height, channels, pixels, error);
+		}
+		if (extension == "raw") {
+			return writeRaw(fileName, width, height, channels, pixels, error);
+		}
+
+		int type = (extension == "tga") ? SOIL_SAVE_TYPE_TGA : SOIL_SAVE_TYPE_BMP;
+		if (SOIL_save_image(fileName.c_str(), type, width, height, channels, pixels) == 0) {
+			error = "Unable to write " + fileName + ": " + SOIL_last_result();
+			return false;
+		}
+		return true;
+	}
+
+	bool ImageWriter::writePNG(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error)
+	{
+		std::vector<unsigned char> bytes;
+		if (!encodePNG(width, height, channels, pixels, bytes)) {
+			error = "Unable to encode " + fileName + " as PNG";
+			return false;
+		}
+		return writeFile(fileName, &bytes[0], bytes.size(), error);
+	}
+
+	bool ImageWriter::writeQOI(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error)
+	{
+		std::vector<unsigned char> bytes;
+		if (!encodeQOI(width, height, channels, pixels, bytes)) {
+			error = "Unable to encode " + fileName + " as QOI";
+			return false;
+		}
+		return writeFile(fileName, &bytes[0], bytes.size(), error);
+	}
+
+	bool ImageWriter::writeRaw(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error)
+	{
+		return writeFile(fileName, pixels, (size_t)width * height * channels, error);
+	}
+
+	bool ImageWriter::encodePNG(int width, int height, int channels, const unsigned char* pixels, std::vector<unsigned char> &out)
+	{
+		static const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 }; // grey, grey+alpha, RGB, RGBA
+		if (channels < 1 || channels > 4 || width < 1 || height < 1) {
+			return false;
+		}
+
+		const size_t stride = (size_t)width * channels;
+		std::vector<unsigned char> filtered((stride + 1) * height);
+		for (int y = 0; y < height; y++) {
+			filterPNGRow(pixels + y * stride, width, channels, &filtered[y * (stride + 1)]);
+		}
+
+		uLongf compressedSize = compressBound((uLong)filtered.size());
+		std::vector<unsigned char> compressed(compressedSize);
+		if (compress2(&compressed[0], &compressedSize, &filtered[0], (uLong)filtered.size(), Z_BEST_SPEED) != Z_OK) {
+			return false;
+		}
+
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		out.assign(signature, signature + 8);
+
+		std::vector<unsigned char> header;
+		appendUInt32(header, width);
+		appendUInt32(header, height);
+		header.push_back(8); // bit depth
+		header.push_back(colorTypes[channels]);
+		header.push_back(0); // deflate
+		header.push_back(0); // adaptive filtering
+		header.push_back(0); // not interlaced
+		appendPNGChunk(out, "IHDR", &header[0], header.size());
+		appendPNGChunk(out, "IDAT", &compressed[0], compressedSize);
+		appendPNGChunk(out, "IEND", nullptr, 0);
+		return true;
+	}
+
+	void ImageWriter::filterPNGRow(const unsigned char* row, int width, int channels, unsigned char* out)
+	{
+		// Every row starts with its filter type. Sub (1) predicts each byte from the pixel to its left,
+		// which is cheap and compresses rendered images much better than no filter.
+		const size_t stride = (size_t)width * channels;
+		out[0] = 1;
+		memcpy(out + 1, row, channels);
+		for (size_t i = channels; i < stride; i++) {
+			out[1 + i] = (unsigned char)(row[i] - row[i - channels]);
+		}
+	}
+
+	bool ImageWriter::encodeQOI(int width, int height, int channels, const unsigned char* pixels, std::vector<unsigned char> &out)
+	{
+		// QOI only stores RGB or RGBA, grey images are expanded
+		if (channels < 1 || channels > 4 || width < 1 || height < 1) {
+			return false;
+		}
+		const int qoiChannels = (channels == 2 || channels == 4) ? 4 : 3;
+		const size_t numPixels = (size_t)width * height;
+
+		out.clear();
+		out.reserve(14 + numPixels * (qoiChannels + 1) + 8);
+		out.push_back('q');
+		out.push_back('o');
+		out.push_back('i');
+		out.push_back('f');
+		appendUInt32(out, width);
+		appendUInt32(out, height);
+		out.push_back(qoiChannels);
+		out.push_back(0); // sRGB with linear alpha
+
+		unsigned char index[64][4];
+		memset(index, 0, sizeof(index));
+		unsigned char previous[4] = { 0, 0, 0, 255 };
+		int run = 0;
+
+		for (size_t p = 0; p < numPixels; p++) {
+			const unsigned char* src = pixels + p * channels;
+			unsigned char px[4];
+			if (channels >= 3) {
+				px[0] = src[0];
+				px[1] = src[1];
+				px[2] = src[2];
+				px[3] = (channels == 4) ? src[3] : 255;
+			}
+			else {
+				px[0] = px[1] = px[2] = src[0];
+				px[3] = (channels == 2) ? src[1] : 255;
+			}
+
+			if (memcmp(px, previous, 4) == 0) {
+				run++;
+				if (run == 62 || p == numPixels - 1) {
+					out.push_back(0xC0 | (run - 1)); // QOI_OP_RUN
+					run = 0;
+				}
+				continue;
+			}
+
+			if (run > 0) {
+				out.push_back(0xC0 | (run - 1));
+				run = 0;
+			}
+
+			const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+			if (memcmp(index[hash], px, 4) == 0) {
+				out.push_back(hash); // QOI_OP_INDEX
+			}
+			else {
+				memcpy(index[hash], px, 4);
+
+				if (px[3] == previous[3]) {
+					const signed char dr = (signed char)(px[0] - previous[0]);
+					const signed char dg = (signed char)(px[1] - previous[1]);
+					const signed char db = (signed char)(px[2] - previous[2]);
+					const signed char drdg = (signed char)(dr - dg);
+					const signed char dbdg = (signed char)(db - dg);
+
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+						out.push_back(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)); // QOI_OP_DIFF
+					}
+					else if (drdg >= -8 && drdg <= 7 && dg >= -32 && dg <= 31 && dbdg >= -8 && dbdg <= 7) {
+						out.push_back(0x80 | (dg + 32)); // QOI_OP_LUMA
+						out.push_back(((drdg + 8) << 4) | (dbdg + 8));
+					}
+					else {
+						out.push_back(0xFE); // QOI_OP_RGB
+						out.push_back(px[0]);
+						out.push_back(px[1]);
+						out.push_back(px[2]);
+					}
+				}
+				else {
+					out.push_back(0xFF); // QOI_OP_RGBA
+					out.insert(out.end(), px, px + 4);
+				}
+			}
+			memcpy(previous, px, 4);
+		}
+
+		static const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+		out.insert(out.end(), padding, padding + 8);
+		return true;
+	}
+
+	bool ImageWriter::writeFile(const std::string &fileName, const unsigned char* bytes, size_t size, std::string &error)
+	{
+		FILE* file = fopen(fileName.c_str(), "wb");
+		if (file == NULL) {
+			error = "Unable to open " + fileName + " for writing";
+			return false;
+		}
+		bool ok = fwrite(bytes, 1, size, file) == size;
+		ok = (fclose(file) == 0) && ok;
+		if (!ok) {
+			error = "Unable to write " + fileName;
+		}
+		return ok;
+	}
+
+}
@@ -0,0 +1,45 @@
+/*!
+ *  ImageWriter.h
+ *
+ * Encodes 8 bit images to PNG, QOI, raw bytes, or (through SOIL) BMP and TGA files.
+ */
+
+#ifndef ImageWriter_h
+#define ImageWriter_h
+
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** ImageWriter only touches memory and files, no GL, so it is safe to call from worker threads.
+	Pixels are tightly packed with the top row first and 1-4 channels (grey, grey+alpha, RGB, RGBA).
+	PNG is compressed with zlib at its fastest setting, which is usually the better trade when writing
+	image sequences. QOI compresses about as well as fast PNG and encodes several times faster. Raw
+	files hold only the pixel bytes, the reader has to know the size and channel count.
+	*/
+	class ImageWriter
+	{
+	public:
+
+		// Picks the encoder from the extension: .png, .qoi, .raw, .tga, anything else is written as BMP
+		static bool write(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error);
+
+		static bool writePNG(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error);
+		static bool writeQOI(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error);
+		static bool writeRaw(const std::string &fileName, int width, int height, int channels, const unsigned char* pixels, std::string &error);
+
+		// In-memory encoders used by the functions above
+		static bool encodePNG(int width, int height, int channels, const unsigned char* pixels, std::vector<unsigned char> &out);
+		static bool encodeQOI(int width, int height, int channels, const unsigned char* pixels, std::vector<unsigned char> &out);
+
+		// Writes one PNG scanline, filter type byte first, so out needs width * channels + 1 bytes
+		static void filterPNGRow(const unsigned char* row, int width, int channels, unsigned char* out);
+
+	private:
+		static bool writeFile(const std::string &fileName, const unsigned char* bytes, size_t size, std::string &error);
+	};
+
+}
+
+#endif /* ImageWriter_h */
@@ -0,0 +1,163 @@
+//
+//  LightingLUT.cpp
+//
+//
+
+#include "LightingLUT.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace basicgraphics {
+
+	LightingLUT::LightingLUT(const std::string &diffuseRampFile, const std::string &specularRampFile, int size /*=256*/) :
+		_size(size), _numRows(size), _specularExponent(1.0f), _diffuseScale(1.0f), _specularScale(1.0f), _dirty(true), _uploadNeeded(false)
+	{
+		_diffuseRamp = loadRamp(diffuseRampFile);
+		_specularRamp = (specularRampFile == diffuseRampFile) ? _diffuseRamp : loadRamp(specularRampFile);
+	}
+
+	LightingLUT::~LightingLUT()
+	{
+	}
+
+	void LightingLUT::setDiffuseRamp(const std::string &fileName)
+	{
+		_diffuseRamp = loadRamp(fileName);
+		_dirty = true;
+	}
+
+	void LightingLUT::setSpecularRamp(const std::string &fileName)
+	{
+		_specularRamp = loadRamp(fileName);
+		_dirty = true;
+	}
+
+	void LightingLUT::setSpecularExponent(float exponent)
+	{
+		if (exponent != _specularExponent) {
+			_specularExponent = exponent;
+			_dirty = true;
+		}
+	}
+
+	void LightingLUT::setScales(const glm::vec3 &diffuseScale, const glm::vec3 &specularScale)
+	{
+		if (diffuseScale != _diffuseScale || specularScale != _specularScale) {
+			_diffuseScale = diffuseScale;
+			_specularScale = specularScale;
+			_dirty = true;
+		}
+	}
+
+	const std::vector<float>& LightingLUT::getTable()
+	{
+		if (_dirty) {
+			_numRows = getNumRows(_size, _specularExponent);
+			bake(_diffuseRamp, _specularRamp, _specularExponent, _diffuseScale, _specularScale, _size, _numRows, _table);
+			_dirty = false;
+			_uploadNeeded = true;
+		}
+		return _table;
+	}
+
+	std::shared_ptr<Texture> LightingLUT::getTexture()
+	{
+		const std::vector<float> &table = getTable();
+		if (_uploadNeeded) {
+			// Half floats since the sum of both terms can go above 1. A new exponent can change the number of rows.
+			if (_texture.get() == nullptr || _texture->getHeight() != _numRows) {
+				_texture = Texture::createFromMemory("lightingLUT", &table[0], GL_FLOAT, GL_RGB, GL_RGB16F, GL_TEXTURE_2D, _size, _numRows, 1);
+				_texture->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				_texture->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				_texture->setTexParameteri(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				_texture->setTexParameteri(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			}
+			else {
+				_texture->update(&table[0], GL_RGB, GL_FLOAT);
+			}
+			_uploadNeeded = false;
+		}
+		return _texture;
+	}
+
+	void LightingLUT::bind(GLSLProgram &shader, const char* samplerName, int textureUnit)
+	{
+		getTexture()->bind(textureUnit);
+		shader.setUniform(samplerName, textureUnit);
+	}
+
+	int LightingLUT::getSize() const
+	{
+		return _size;
+	}
+
+	int LightingLUT::getNumRows() const
+	{
+		return _numRows;
+	}
+
+	int LightingLUT::getNumRows(int size, float specularExponent)
+	{
+		// pow(N.H, n) is above 1/256 for N.H > 1 - ln(256) / n, roughly
+		const float highlight = std::min(5.5f / std::max(specularExponent, 1.0f), 1.0f);
+		int rows = size;
+		while (rows < MAX_ROWS && rows * highlight < HIGHLIGHT_ROWS) {
+			rows *= 2;
+		}
+		return rows;
+	}
+
+	void LightingLUT::bake(const std::vector<glm::vec3> &diffuseRamp, const std::vector<glm::vec3> &specularRamp, float specularExponent,
+		const glm::vec3 &diffuseScale, const glm::vec3 &specularScale, int size, int numRows, std::vector<float> &table)
+	{
+		table.resize((size_t)size * numRows * 3);
+
+		// Nearest lookup like the GL_NEAREST ramps did, at the center of the table texel
+		auto rampAt = [](const std::vector<glm::vec3> &ramp, float u) {
+			const int texel = std::min(std::max((int)(u * ramp.size()), 0), (int)ramp.size() - 1);
+			return ramp[texel];
+		};
+
+		// The diffuse term only depends on x, compute it once per column
+		std::vector<glm::vec3> diffuse(size);
+		for (int x = 0; x < size; x++) {
+			diffuse[x] = diffuseScale * rampAt(diffuseRamp, (x + 0.5f) / size);
+		}
+
+		ThreadPool::getShared().parallelFor(0, numRows, [&](int y) {
+			const float dotHN = (y + 0.5f) / numRows;
+			const glm::vec3 specular = specularScale * rampAt(specularRamp, std::pow(dotHN, specularExponent));
+			float* row = &table[(size_t)y * size * 3];
+			for (int x = 0; x < size; x++) {
+				const glm::vec3 color = diffuse[x] + specular;
+				row[x * 3 + 0] = color.r;
+				row[x * 3 + 1] = color.g;
+				row[x * 3 + 2] = color.b;
+			}
+		});
+	}
+
+	std::vector<glm::vec3> LightingLUT::loadRamp(const std::string &fileName)
+	{
+		TRACE_SCOPE_DETAIL("texture", "Load lighting ramp", fileName.c_str());
+		int width, height, channels;
+		unsigned char* image = SOIL_load_image(fileName.c_str(), &width, &height, &channels, SOIL_LOAD_RGB);
+		if (image == NULL) {
+			std::cerr << "Unable to load lighting ramp: " << fileName << "\n" << SOIL_last_result() << std::endl;
+			return std::vector<glm::vec3>(1, glm::vec3(1.0f));
+		}
+
+		// The shader sampled the ramps at y = 0.5
+		std::vector<glm::vec3> ramp(width);
+		const unsigned char* row = image + (size_t)(height / 2) * width * 3;
+		for (int x = 0; x < width; x++) {
+			ramp[x] = glm::vec3(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2]) / 255.0f;
+		}
+		SOIL_free_image_data(image);
+		return ramp;
+	}
+
+}
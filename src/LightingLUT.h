@@ -0,0 +1,110 @@
+/*!
+ *  LightingLUT.h
+ *
+ * Bakes ramp based diffuse and specular shading into one texture indexed by (N.L, N.H).
+ */
+
+#ifndef LightingLUT_h
+#define LightingLUT_h
+
+#include <glad/glad.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GLSLProgram.h"
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** LightingLUT replaces the two ramp lookups and the pow() of ramp shading with a single fetch:
+		lut(N.L, N.H) = diffuseScale * diffuseRamp(N.L) + specularScale * specularRamp(pow(N.H, specularExponent))
+	where the scales are the reflection coefficients times the light intensities. The ramps are read once
+	from the middle row of their images (the row the shader used to sample) and the table is baked on the
+	ThreadPool whenever one of the inputs changes, so switching lighting styles is just binding another
+	LightingLUT.
+	The highlight only covers the top ~5.5 / specularExponent of N.H, so the table gets more rows than
+	columns as the exponent grows (see getNumRows) and is sampled linearly. Nearest with one row per ramp
+	texel put the whole highlight into a dozen rows and it banded. Linear sampling softens the toon steps
+	by less than a column.
+	------------------------------------------------------------------------
+	LightingLUT toon("lightingToon.jpg", "lightingToon.jpg");
+	toon.setSpecularExponent(50.0);
+	toon.setScales(kd * Id, ks * Is);
+	...
+	toon.bind(shader, "lightingLUT", 0); // rebakes first if something changed
+	// in the shader: texture(lightingLUT, vec2(dotLN, dotHN))
+	------------------------------------------------------------------------
+	*/
+	class LightingLUT
+	{
+	public:
+
+		LightingLUT(const std::string &diffuseRampFile, const std::string &specularRampFile, int size = 256);
+		virtual ~LightingLUT();
+
+		void setDiffuseRamp(const std::string &fileName);
+		void setSpecularRamp(const std::string &fileName);
+		void setSpecularExponent(float exponent);
+
+		// Reflection coefficient times light intensity for each term. Unchanged values don't cause a rebake.
+		void setScales(const glm::vec3 &diffuseScale, const glm::vec3 &specularScale);
+
+		/*!
+		 * Returns the table, baking it first if anything changed since the last call. Must be called on the GL thread.
+		 */
+		std::shared_ptr<Texture> getTexture();
+
+		/*!
+		 * The same table on the CPU (see bake), for renderers that don't use GL. Doesn't need a GL context.
+		 */
+		const std::vector<float>& getTable();
+
+		// Binds getTexture() to textureUnit and points the sampler uniform at it
+		void bind(GLSLProgram &shader, const char* samplerName, int textureUnit);
+
+		// Columns, along N.L
+		int getSize() const;
+
+		// Rows of the current table, along N.H
+		int getNumRows() const;
+
+		/*!
+		 * Rows the table needs so the highlight of specularExponent spans at least HIGHLIGHT_ROWS of them: size
+		 * doubled until it does, up to MAX_ROWS.
+		 */
+		static int getNumRows(int size, float specularExponent);
+
+		/*!
+		 * Fills table (size * numRows RGB floats, N.L along x and N.H along y) from ramps holding RGB floats.
+		 */
+		static void bake(const std::vector<glm::vec3> &diffuseRamp, const std::vector<glm::vec3> &specularRamp, float specularExponent,
+			const glm::vec3 &diffuseScale, const glm::vec3 &specularScale, int size, int numRows, std::vector<float> &table);
+
+		static const int HIGHLIGHT_ROWS = 64;
+		static const int MAX_ROWS = 4096;
+
+	private:
+		LightingLUT(const LightingLUT&) {}; // prevent copying
+
+		int _size;
+		int _numRows;
+		std::vector<glm::vec3> _diffuseRamp;
+		std::vector<glm::vec3> _specularRamp;
+		float _specularExponent;
+		glm::vec3 _diffuseScale;
+		glm::vec3 _specularScale;
+		bool _dirty;
+		bool _uploadNeeded;
+		std::vector<float> _table;
+		std::shared_ptr<Texture> _texture;
+
+		static std::vector<glm::vec3> loadRamp(const std::string &fileName);
+	};
+
+}
+
+#endif /* LightingLUT_h */
@@ -7,6 +7,7 @@
 //
 
 #include "Line.h"
+#include "GLStats.h"
 
 namespace basicgraphics {
 
@@ -50,6 +51,7 @@ namespace basicgraphics {
 		const int cpuIndexByteSize = sizeof(int) * cpuIndexArray.size();
 		_mesh.reset(new Mesh(textures, GL_TRIANGLE_STRIP, GL_STATIC_DRAW, cpuVertexByteSize, cpuIndexByteSize, 0, cpuVertexArray, cpuIndexArray.size(), cpuIndexByteSize, &cpuIndexArray[0]));
 		_mesh->setMaterialColor(_color);
+		_mesh->setMemoryTag("lines");
 
 	}
 
@@ -59,6 +61,7 @@ namespace basicgraphics {
 
 	void Line::draw(GLSLProgram &shader, const glm::mat4 &modelMatrix)
 	{
+		GLCallSite site("Line::draw");
         shader.setUniform("model_mat", modelMatrix);
         shader.setUniform("normal_mat", mat3(transpose(inverse(modelMatrix))));
 		_mesh->draw(shader);
@@ -0,0 +1,289 @@
+//
+//  MaterialBuffer.cpp
+//
+//
+
+#include "MaterialBuffer.h"
+#include "MipMapGenerator.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace basicgraphics {
+
+	// The sampler uniforms in Material.glsl, one per array
+	static const char* ARRAY_SAMPLER_NAMES[MaterialBuffer::MAX_ARRAYS] = { "materialArray0", "materialArray1", "materialArray2", "materialArray3" };
+
+	MaterialBuffer::MaterialBuffer(bool allowBindless /*=true*/) : _ubo(0), _allowBindless(allowBindless), _bindless(false)
+	{
+	}
+
+	MaterialBuffer::~MaterialBuffer()
+	{
+		if (_ubo != 0) {
+			glDeleteBuffers(1, &_ubo);
+		}
+	}
+
+	int MaterialBuffer::addMaterial(const glm::vec4 &color, std::shared_ptr<Texture> texture)
+	{
+		if (texture.get() == nullptr) {
+			return addMaterial(color);
+		}
+		const int index = addMaterial(color, texture->getFileName());
+		const int t = _materials[index].texture;
+		if (_textureSources[t].get() == nullptr) {
+			_textureSources[t] = texture;
+		}
+		return index;
+	}
+
+	int MaterialBuffer::addMaterial(const glm::vec4 &color, const std::string &textureFile /*=""*/)
+	{
+		assert(_materials.size() < MAX_MATERIALS && "Too many materials");
+
+		Material material;
+		material.color = color;
+		material.texture = -1;
+		material.alphaMode = (color.a < 1.0) ? Texture::ALPHA_BLEND : Texture::ALPHA_OPAQUE;
+
+		// Materials that share a texture share its layer
+		if (!textureFile.empty()) {
+			std::vector<std::string>::iterator it = std::find(_textureFiles.begin(), _textureFiles.end(), textureFile);
+			material.texture = it - _textureFiles.begin();
+			if (it == _textureFiles.end()) {
+				_textureFiles.push_back(textureFile);
+				_textureSources.push_back(std::shared_ptr<Texture>());
+			}
+		}
+
+		_materials.push_back(material);
+		return _materials.size() - 1;
+	}
+
+	void MaterialBuffer::build()
+	{
+		// Decode as RGBA so every image has the same format and can share an array
+		std::vector<DecodedImage> images(_textureFiles.size());
+
+		// Streamed textures were decoded when they were loaded, copy their pixels instead. This waits on the
+		// streamer's decode, which runs on the pool, so it is done here rather than inside parallelFor.
+		std::vector<bool> decoded(_textureFiles.size(), false);
+		for (int i = 0; i < _textureSources.size(); i++) {
+			std::vector<unsigned char> rgba;
+			DecodedImage &image = images[i];
+			if (_textureSources[i].get() != nullptr && TextureStreamer::getInstance().getImage(_textureSources[i].get(), rgba, image.width, image.height, image.alphaMode)) {
+				image.bytes = (unsigned char*)malloc(rgba.size()); // SOIL_free_image_data is free()
+				memcpy(image.bytes, &rgba[0], rgba.size());
+				decoded[i] = true;
+			}
+		}
+		// The pixels are copied, the arrays or bindless textures replace the streamed ones
+		_textureSources.assign(_textureSources.size(), std::shared_ptr<Texture>());
+
+		ThreadPool::getShared().parallelFor(0, _textureFiles.size(), [&](int i) {
+			if (decoded[i]) {
+				return;
+			}
+			DecodedImage &image = images[i];
+			int channels;
+			image.bytes = SOIL_load_image(_textureFiles[i].c_str(), &image.width, &image.height, &channels, SOIL_LOAD_RGBA);
+			image.alphaMode = (image.bytes != NULL) ? Texture::classifyAlpha(image.bytes, image.width, image.height, 4) : Texture::ALPHA_OPAQUE;
+		});
+
+		std::vector<GLint> arrayIndices(images.size(), -1);
+		std::vector<GLint> layers(images.size(), 0);
+		std::vector<GLuint64> handles(images.size(), 0);
+		_textures.clear();
+		_bindless = _allowBindless && Texture::isBindlessSupported();
+		if (_bindless) {
+			packBindless(images, arrayIndices, layers, handles);
+		}
+		else {
+			packArrays(images, arrayIndices, layers);
+		}
+
+		std::vector<GPUMaterial> gpuMaterials(MAX_MATERIALS);
+		for (int i = 0; i < _materials.size(); i++) {
+			Material &material = _materials[i];
+			GPUMaterial &gpu = gpuMaterials[i];
+			gpu.color = material.color;
+			gpu.arrayIndex = -1;
+			gpu.layer = 0;
+			gpu.handle[0] = 0;
+			gpu.handle[1] = 0;
+
+			if (material.texture >= 0 && images[material.texture].bytes != NULL) {
+				const int t = material.texture;
+				gpu.arrayIndex = arrayIndices[t];
+				gpu.layer = layers[t];
+				gpu.handle[0] = (GLuint)(handles[t] & 0xFFFFFFFF);
+				gpu.handle[1] = (GLuint)(handles[t] >> 32);
+				material.alphaMode = std::max(material.alphaMode, images[t].alphaMode);
+			}
+			else if (material.texture >= 0) {
+				std::cerr << "Unable to load material texture: " << _textureFiles[material.texture] << std::endl;
+			}
+		}
+
+		for (int i = 0; i < images.size(); i++) {
+			if (images[i].bytes != NULL) {
+				SOIL_free_image_data(images[i].bytes);
+			}
+		}
+
+		if (_ubo == 0) {
+			glGenBuffers(1, &_ubo);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, _ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(GPUMaterial) * gpuMaterials.size(), &gpuMaterials[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void MaterialBuffer::packBindless(std::vector<DecodedImage> &images, std::vector<GLint> &arrayIndices, std::vector<GLint> &layers, std::vector<GLuint64> &handles)
+	{
+		std::vector<std::vector<std::vector<unsigned char>>> levels(images.size());
+		ThreadPool::getShared().parallelFor(0, images.size(), [&](int i) {
+			if (images[i].bytes != NULL) {
+				MipMapGenerator::generate(images[i].bytes, images[i].width, images[i].height, 4, levels[i], MipMapGenerator::getDefaultFilter(), true);
+			}
+		});
+
+		for (int i = 0; i < images.size(); i++) {
+			if (images[i].bytes == NULL) {
+				continue;
+			}
+
+			std::shared_ptr<Texture> tex = Texture::createFromMemory(_textureFiles[i], images[i].bytes, GL_UNSIGNED_BYTE, GL_RGBA, GL_RGBA8, GL_TEXTURE_2D, images[i].width, images[i].height, 1);
+			tex->setFileName(_textureFiles[i]);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (int level = 1; level < levels[i].size(); level++) {
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, MipMapGenerator::getLevelWidth(images[i].width, level), MipMapGenerator::getLevelHeight(images[i].height, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, &levels[i][level][0]);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+			// The sampler state is frozen once the handle exists
+			tex->setTexParameteri(GL_TEXTURE_WRAP_S, GL_REPEAT);
+			tex->setTexParameteri(GL_TEXTURE_WRAP_T, GL_REPEAT);
+			tex->setTexParameteri(GL_TEXTURE_MAX_LEVEL, levels[i].size() - 1);
+			tex->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			handles[i] = tex->getBindlessHandle();
+			_textures.push_back(tex);
+		}
+	}
+
+	void MaterialBuffer::packArrays(std::vector<DecodedImage> &images, std::vector<GLint> &arrayIndices, std::vector<GLint> &layers)
+	{
+		// Group the images by size, the most common sizes get an array each
+		std::map<std::pair<int, int>, std::vector<int>> bySize;
+		for (int i = 0; i < images.size(); i++) {
+			if (images[i].bytes != NULL) {
+				bySize[std::make_pair(images[i].width, images[i].height)].push_back(i);
+			}
+		}
+		std::vector<std::vector<int>> groups;
+		for (std::map<std::pair<int, int>, std::vector<int>>::iterator it = bySize.begin(); it != bySize.end(); ++it) {
+			groups.push_back(it->second);
+		}
+		std::sort(groups.begin(), groups.end(), [](const std::vector<int> &a, const std::vector<int> &b) { return a.size() > b.size(); });
+
+		// Anything beyond MAX_ARRAYS sizes is resized into the array of the most common size
+		for (int g = MAX_ARRAYS; g < groups.size(); g++) {
+			for (int j = 0; j < groups[g].size(); j++) {
+				DecodedImage &image = images[groups[g][j]];
+				DecodedImage &target = images[groups[0][0]];
+				std::cerr << "MaterialBuffer: resizing " << _textureFiles[groups[g][j]] << " to " << target.width << "x" << target.height << " to fit a texture array" << std::endl;
+
+				unsigned char* bytes = (unsigned char*)malloc((size_t)target.width * target.height * 4);
+				resize(image.bytes, image.width, image.height, bytes, target.width, target.height);
+				SOIL_free_image_data(image.bytes);
+				image.bytes = bytes; // SOIL_free_image_data is free()
+				image.width = target.width;
+				image.height = target.height;
+				groups[0].push_back(groups[g][j]);
+			}
+		}
+		groups.resize(std::min((int)groups.size(), MAX_ARRAYS));
+
+		for (int g = 0; g < groups.size(); g++) {
+			std::vector<const unsigned char*> layerBytes;
+			for (int j = 0; j < groups[g].size(); j++) {
+				const int i = groups[g][j];
+				arrayIndices[i] = g;
+				layers[i] = j;
+				layerBytes.push_back(images[i].bytes);
+			}
+			const DecodedImage &first = images[groups[g][0]];
+			std::shared_ptr<Texture> tex = Texture::create2DArrayFromLayers("materials" + std::to_string(g), first.width, first.height, layerBytes, true);
+			tex->setTexParameteri(GL_TEXTURE_WRAP_S, GL_REPEAT);
+			tex->setTexParameteri(GL_TEXTURE_WRAP_T, GL_REPEAT);
+			_textures.push_back(tex);
+		}
+	}
+
+	void MaterialBuffer::bind(GLSLProgram &shader)
+	{
+		// Block bindings are per program and are lost when a program is rebuilt, so set them every time
+		shader.bindUniformBlock("Materials", BINDING_POINT);
+		glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, _ubo);
+		shader.setUniform("useBindless", _bindless ? 1 : 0);
+		setTextureUnits(shader);
+
+		for (int i = 0; i < _textures.size() && !_bindless; i++) {
+			_textures[i]->bind(FIRST_TEXTURE_UNIT + i);
+		}
+	}
+
+	void MaterialBuffer::setTextureUnits(GLSLProgram &shader)
+	{
+		for (int i = 0; i < MAX_ARRAYS; i++) {
+			shader.setUniform(ARRAY_SAMPLER_NAMES[i], FIRST_TEXTURE_UNIT + i);
+		}
+	}
+
+	Texture::AlphaMode MaterialBuffer::getAlphaMode(int material) const
+	{
+		return _materials[material].alphaMode;
+	}
+
+	bool MaterialBuffer::usesBindless() const
+	{
+		return _bindless;
+	}
+
+	int MaterialBuffer::getNumMaterials() const
+	{
+		return _materials.size();
+	}
+
+	int MaterialBuffer::getNumArrays() const
+	{
+		return _bindless ? 0 : _textures.size();
+	}
+
+	void MaterialBuffer::resize(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight)
+	{
+		// Bilinear, good enough for the rare image that doesn't match any array size
+		for (int y = 0; y < dstHeight; y++) {
+			float sy = std::max(0.0f, (y + 0.5f) * srcHeight / dstHeight - 0.5f);
+			int y0 = std::min((int)sy, srcHeight - 1);
+			int y1 = std::min(y0 + 1, srcHeight - 1);
+			float fy = sy - y0;
+			for (int x = 0; x < dstWidth; x++) {
+				float sx = std::max(0.0f, (x + 0.5f) * srcWidth / dstWidth - 0.5f);
+				int x0 = std::min((int)sx, srcWidth - 1);
+				int x1 = std::min(x0 + 1, srcWidth - 1);
+				float fx = sx - x0;
+				for (int c = 0; c < 4; c++) {
+					float top = src[((size_t)y0 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[((size_t)y0 * srcWidth + x1) * 4 + c] * fx;
+					float bottom = src[((size_t)y1 * srcWidth + x0) * 4 + c] * (1.0f - fx) + src[((size_t)y1 * srcWidth + x1) * 4 + c] * fx;
+					dst[((size_t)y * dstWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,130 @@
+/*!
+ *  MaterialBuffer.h
+ *
+ * All materials of a scene in one uniform buffer, with their textures packed so they are bound once instead of per mesh.
+ */
+
+#ifndef MaterialBuffer_h
+#define MaterialBuffer_h
+
+#include <glad/glad.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GLSLProgram.h"
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** MaterialBuffer holds a color and an optional texture per material. build() packs the textures
+	in one of two ways:
+	- With GL_ARB_bindless_texture every texture gets a resident handle that is stored in the material.
+	- Otherwise textures of the same size go into the layers of a GL_TEXTURE_2D_ARRAY (up to MAX_ARRAYS
+	  different sizes, other images are resized to fit) and the material stores the array and layer.
+	Either way bind() makes every material available at once and a mesh only has to set the
+	materialIndex uniform before it draws. resources/Material.glsl has the matching shader code, App's
+	BlinnPhong shader includes it and App draws the bunny through Model::useMaterialBuffer.
+	------------------------------------------------------------------------
+	std::shared_ptr<MaterialBuffer> materials(new MaterialBuffer());
+	int brick = materials->addMaterial(glm::vec4(1.0), "brick.jpg");
+	int red = materials->addMaterial(glm::vec4(1.0, 0.0, 0.0, 1.0));
+	materials->build();
+	mesh->setMaterial(materials, brick);
+	...
+	materials->bind(shader); // once per frame, before drawing the meshes
+	------------------------------------------------------------------------
+	*/
+	class MaterialBuffer
+	{
+	public:
+
+		// Must match Material.glsl
+		static const int MAX_MATERIALS = 256;
+		static const int MAX_ARRAYS = 4;
+		static const GLuint BINDING_POINT = 0;
+
+		// The texture arrays are bound starting at this unit, out of the way of textures the app binds itself
+		static const int FIRST_TEXTURE_UNIT = 8;
+
+		MaterialBuffer(bool allowBindless = true);
+		virtual ~MaterialBuffer();
+
+		/*!
+		 * Adds a material and returns its index. With a texture the final color is color * texture.
+		 */
+		int addMaterial(const glm::vec4 &color, const std::string &textureFile = "");
+
+		/*!
+		 * Same with a texture that is already loaded. A streamed texture's decoded pixels are taken from the
+		 * TextureStreamer, so its file isn't decoded again; other textures are decoded from their file.
+		 */
+		int addMaterial(const glm::vec4 &color, std::shared_ptr<Texture> texture);
+
+		/*!
+		 * Decodes the textures in parallel, packs them and uploads the materials. Call once after adding all materials.
+		 */
+		void build();
+
+		/*!
+		 * Binds the uniform buffer and the texture arrays for shader.
+		 */
+		void bind(GLSLProgram &shader);
+
+		/*!
+		 * Points the materialArray samplers of a shader that includes Material.glsl at their units. bind does this too;
+		 * call it once per frame when meshes without a MaterialBuffer may be drawn first, otherwise the array samplers
+		 * stay on unit 0 with the meshes' sampler2D and the draw fails.
+		 */
+		static void setTextureUnits(GLSLProgram &shader);
+
+		// Combines the color's alpha with the texture's classification, see Texture::AlphaMode
+		Texture::AlphaMode getAlphaMode(int material) const;
+
+		bool usesBindless() const;
+		int getNumMaterials() const;
+		int getNumArrays() const;
+
+	private:
+		MaterialBuffer(const MaterialBuffer&) {}; // prevent copying
+
+		struct Material {
+			glm::vec4 color;
+			int texture; // index into _textureFiles, -1 if none
+			Texture::AlphaMode alphaMode;
+		};
+
+		// std140 layout of MaterialData in Material.glsl
+		struct GPUMaterial {
+			glm::vec4 color;
+			GLuint handle[2];
+			GLint arrayIndex;
+			GLint layer;
+		};
+
+		struct DecodedImage {
+			unsigned char* bytes; // RGBA
+			int width;
+			int height;
+			Texture::AlphaMode alphaMode;
+		};
+
+		std::vector<Material> _materials;
+		std::vector<std::string> _textureFiles;
+		std::vector<std::shared_ptr<Texture>> _textureSources; // the loaded texture of each file, null if added by name
+		std::vector<std::shared_ptr<Texture>> _textures; // the arrays, or one texture per file with bindless
+		GLuint _ubo;
+		bool _allowBindless;
+		bool _bindless;
+
+		void packBindless(std::vector<DecodedImage> &images, std::vector<GLint> &arrayIndices, std::vector<GLint> &layers, std::vector<GLuint64> &handles);
+		void packArrays(std::vector<DecodedImage> &images, std::vector<GLint> &arrayIndices, std::vector<GLint> &layers);
+		static void resize(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int dstHeight);
+	};
+
+}
+
+#endif /* MaterialBuffer_h */
@@ -0,0 +1,315 @@
+//
+//  MemoryAccounting.cpp
+//
+//
+
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <utility>
+
+namespace basicgraphics {
+
+	static const char* CATEGORY_NAMES[MemoryAccounting::NUM_CATEGORIES] = { "geometry", "textures", "shaders", "render targets", "texture cache", "model import" };
+	static const char* POOL_NAMES[MemoryAccounting::NUM_POOLS] = { "GPU", "CPU" };
+
+	MemoryAccounting::MemoryAccounting() : _reportInterval(0.0), _lastReport(std::chrono::steady_clock::now())
+	{
+		for (int i = 0; i < NUM_CATEGORIES; i++) {
+			_bytes[i] = 0;
+			_highWaterMarks[i] = 0;
+			_numRecords[i] = 0;
+		}
+		for (int i = 0; i < NUM_POOLS; i++) {
+			_poolBytes[i] = 0;
+			_poolHighWaterMarks[i] = 0;
+		}
+	}
+
+	MemoryAccounting& MemoryAccounting::getInstance()
+	{
+		static MemoryAccounting accounting;
+		return accounting;
+	}
+
+	MemoryAccounting::Pool MemoryAccounting::getPool(Category category)
+	{
+		switch (category) {
+		case TEXTURE_CACHE:
+		case MODEL_IMPORT:
+			return CPU;
+		default:
+			return GPU;
+		}
+	}
+
+	const char* MemoryAccounting::getCategoryName(Category category)
+	{
+		return CATEGORY_NAMES[category];
+	}
+
+	size_t MemoryAccounting::getBytes(Category category) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _bytes[category];
+	}
+
+	size_t MemoryAccounting::getBytes(Pool pool) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _poolBytes[pool];
+	}
+
+	size_t MemoryAccounting::getHighWaterMark(Category category) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _highWaterMarks[category];
+	}
+
+	size_t MemoryAccounting::getHighWaterMark(Pool pool) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _poolHighWaterMarks[pool];
+	}
+
+	int MemoryAccounting::getNumRecords(Category category) const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _numRecords[category];
+	}
+
+	void MemoryAccounting::resetHighWaterMarks()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (int i = 0; i < NUM_CATEGORIES; i++) {
+			_highWaterMarks[i] = _bytes[i];
+		}
+		for (int i = 0; i < NUM_POOLS; i++) {
+			_poolHighWaterMarks[i] = _poolBytes[i];
+		}
+	}
+
+	std::vector<MemoryAccounting::Asset> MemoryAccounting::getAssets() const
+	{
+		std::map<std::string, Asset> byTag;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (std::set<const MemoryRecord*>::const_iterator it = _records.begin(); it != _records.end(); ++it) {
+				const MemoryRecord &record = **it;
+				const std::string tag = record._tag.empty() ? "(untagged)" : record._tag;
+				std::map<std::string, Asset>::iterator asset = byTag.find(tag);
+				if (asset == byTag.end()) {
+					Asset empty;
+					empty.tag = tag;
+					std::fill(empty.bytes, empty.bytes + NUM_CATEGORIES, 0);
+					empty.total = 0;
+					empty.numRecords = 0;
+					asset = byTag.insert(std::make_pair(tag, empty)).first;
+				}
+				asset->second.bytes[record._category] += record._bytes;
+				asset->second.total += record._bytes;
+				asset->second.numRecords++;
+			}
+		}
+
+		std::vector<Asset> assets;
+		assets.reserve(byTag.size());
+		for (std::map<std::string, Asset>::const_iterator it = byTag.begin(); it != byTag.end(); ++it) {
+			assets.push_back(it->second);
+		}
+		std::stable_sort(assets.begin(), assets.end(), [](const Asset &a, const Asset &b) {
+			return a.total > b.total;
+		});
+		return assets;
+	}
+
+	void MemoryAccounting::printSummary(std::ostream &out) const
+	{
+		size_t bytes[NUM_POOLS];
+		size_t peaks[NUM_POOLS];
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::copy(_poolBytes, _poolBytes + NUM_POOLS, bytes);
+			std::copy(_poolHighWaterMarks, _poolHighWaterMarks + NUM_POOLS, peaks);
+		}
+		out << "Memory:";
+		for (int pool = 0; pool < NUM_POOLS; pool++) {
+			out << " " << POOL_NAMES[pool] << " " << formatBytes(bytes[pool]) << " (peak " << formatBytes(peaks[pool]) << ")";
+		}
+		out << std::endl;
+	}
+
+	void MemoryAccounting::printReport(std::ostream &out, int maxAssets /*=20*/) const
+	{
+		size_t bytes[NUM_CATEGORIES];
+		size_t peaks[NUM_CATEGORIES];
+		int numRecords[NUM_CATEGORIES];
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::copy(_bytes, _bytes + NUM_CATEGORIES, bytes);
+			std::copy(_highWaterMarks, _highWaterMarks + NUM_CATEGORIES, peaks);
+			std::copy(_numRecords, _numRecords + NUM_CATEGORIES, numRecords);
+		}
+
+		printSummary(out);
+		out << "Category            Pool  Records        Bytes         Peak" << std::endl;
+		for (int i = 0; i < NUM_CATEGORIES; i++) {
+			const Category category = (Category)i;
+			out << std::left << std::setw(20) << CATEGORY_NAMES[i] << std::setw(4) << POOL_NAMES[getPool(category)] << std::right
+				<< std::setw(9) << numRecords[i] << std::setw(13) << formatBytes(bytes[i]) << std::setw(13) << formatBytes(peaks[i]) << std::endl;
+		}
+
+		const std::vector<Asset> assets = getAssets();
+		int numPrinted = 0;
+		for (int i = 0; i < assets.size() && numPrinted < maxAssets; i++) {
+			const Asset &asset = assets[i];
+			if (asset.total == 0) {
+				break; // sorted, the rest are empty too
+			}
+			if (numPrinted++ == 0) {
+				out << "Largest assets:" << std::endl;
+			}
+			out << std::right << std::setw(12) << formatBytes(asset.total) << "  " << asset.tag << " (";
+			bool first = true;
+			for (int category = 0; category < NUM_CATEGORIES; category++) {
+				if (asset.bytes[category] > 0) {
+					out << (first ? "" : ", ") << CATEGORY_NAMES[category] << " " << formatBytes(asset.bytes[category]);
+					first = false;
+				}
+			}
+			out << ")" << std::endl;
+		}
+	}
+
+	void MemoryAccounting::writeCSV(std::ostream &out) const
+	{
+		std::vector<const MemoryRecord*> records;
+		std::lock_guard<std::mutex> lock(_mutex);
+		records.assign(_records.begin(), _records.end());
+		// By category, then tag, so dumps of two runs can be diffed
+		std::sort(records.begin(), records.end(), [](const MemoryRecord* a, const MemoryRecord* b) {
+			return (a->_category != b->_category) ? a->_category < b->_category : a->_tag < b->_tag;
+		});
+
+		out << "category,pool,tag,bytes" << std::endl;
+		for (int i = 0; i < records.size(); i++) {
+			const MemoryRecord &record = *records[i];
+			std::string tag = record._tag;
+			for (size_t quote = tag.find('"'); quote != std::string::npos; quote = tag.find('"', quote + 2)) {
+				tag.insert(quote, 1, '"');
+			}
+			out << CATEGORY_NAMES[record._category] << "," << POOL_NAMES[getPool(record._category)] << ",\"" << tag << "\"," << record._bytes << "\n";
+		}
+		out.flush();
+	}
+
+	void MemoryAccounting::setReportInterval(double seconds)
+	{
+		_reportInterval = seconds;
+		_lastReport = std::chrono::steady_clock::now();
+	}
+
+	void MemoryAccounting::update()
+	{
+		if (_reportInterval <= 0.0) {
+			return;
+		}
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(now - _lastReport).count() >= _reportInterval) {
+			_lastReport = now;
+			printSummary(std::cout);
+		}
+	}
+
+	std::string MemoryAccounting::formatBytes(size_t bytes)
+	{
+		static const char* UNITS[] = { "B", "KB", "MB", "GB", "TB" };
+		double value = (double)bytes;
+		int unit = 0;
+		while (value >= 1024.0 && unit < 4) {
+			value /= 1024.0;
+			unit++;
+		}
+		// Short enough for the small string buffer, so the periodic summary doesn't allocate
+		char text[16];
+		snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, UNITS[unit]);
+		return std::string(text);
+	}
+
+	void MemoryAccounting::add(Category category, size_t bytes)
+	{
+		_bytes[category] += bytes;
+		_highWaterMarks[category] = std::max(_highWaterMarks[category], _bytes[category]);
+		const Pool pool = getPool(category);
+		_poolBytes[pool] += bytes;
+		_poolHighWaterMarks[pool] = std::max(_poolHighWaterMarks[pool], _poolBytes[pool]);
+	}
+
+	void MemoryAccounting::subtract(Category category, size_t bytes)
+	{
+		_bytes[category] -= bytes;
+		_poolBytes[getPool(category)] -= bytes;
+	}
+
+	MemoryRecord::MemoryRecord(MemoryAccounting::Category category, const std::string &tag /*=""*/) : _category(category), _tag(tag), _bytes(0)
+	{
+		MemoryAccounting &accounting = MemoryAccounting::getInstance();
+		std::lock_guard<std::mutex> lock(accounting._mutex);
+		accounting._records.insert(this);
+		accounting._numRecords[_category]++;
+	}
+
+	MemoryRecord::~MemoryRecord()
+	{
+		MemoryAccounting &accounting = MemoryAccounting::getInstance();
+		std::lock_guard<std::mutex> lock(accounting._mutex);
+		accounting.subtract(_category, _bytes);
+		accounting._numRecords[_category]--;
+		accounting._records.erase(this);
+	}
+
+	void MemoryRecord::setBytes(size_t bytes)
+	{
+		MemoryAccounting &accounting = MemoryAccounting::getInstance();
+		std::lock_guard<std::mutex> lock(accounting._mutex);
+		accounting.subtract(_category, _bytes);
+		accounting.add(_category, bytes);
+		_bytes = bytes;
+	}
+
+	size_t MemoryRecord::getBytes() const
+	{
+		std::lock_guard<std::mutex> lock(MemoryAccounting::getInstance()._mutex);
+		return _bytes;
+	}
+
+	void MemoryRecord::setTag(const std::string &tag)
+	{
+		std::lock_guard<std::mutex> lock(MemoryAccounting::getInstance()._mutex);
+		_tag = tag;
+	}
+
+	std::string MemoryRecord::getTag() const
+	{
+		std::lock_guard<std::mutex> lock(MemoryAccounting::getInstance()._mutex);
+		return _tag;
+	}
+
+	MemoryAccounting::Category MemoryRecord::getCategory() const
+	{
+		return _category;
+	}
+
+	void MemoryRecord::swap(MemoryRecord &other)
+	{
+		assert(_category == other._category && "Only records of the same category can be swapped");
+		std::lock_guard<std::mutex> lock(MemoryAccounting::getInstance()._mutex);
+		std::swap(_bytes, other._bytes);
+		_tag.swap(other._tag);
+	}
+
+}
@@ -0,0 +1,165 @@
+/*!
+ *  MemoryAccounting.h
+ *
+ * Keeps track of the CPU and GPU memory held by meshes, textures, shaders, render targets and model imports.
+ */
+
+#ifndef MemoryAccounting_h
+#define MemoryAccounting_h
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	class MemoryRecord;
+
+	/** MemoryAccounting adds up the bytes of every MemoryRecord, the member resources use to report what they
+	hold, by category and by tag. The tag names the asset the memory belongs to, usually the file it came from,
+	so the meshes and textures of one model add up to one asset. GPU sizes are computed from the sizes and
+	formats the buffers were created with, drivers may pad or compress them, so they are estimates.
+	Besides the current totals it keeps the high water mark of every category and of both pools, e.g. the
+	import peak of a model whose Assimp scene is released right after its meshes are built.
+	BaseApp prints a summary every few seconds with --memory-report and writes every record with --memory-dump.
+	------------------------------------------------------------------------
+	MemoryAccounting &memory = MemoryAccounting::getInstance();
+	size_t textureBytes = memory.getBytes(MemoryAccounting::TEXTURES);
+	size_t gpuPeak = memory.getHighWaterMark(MemoryAccounting::GPU);
+	memory.printReport(std::cout); // totals, peaks and the largest assets
+	------------------------------------------------------------------------
+	*/
+	class MemoryAccounting
+	{
+	public:
+
+		enum Category {
+			GEOMETRY,       // vertex and index buffers of Meshes
+			TEXTURES,       // every mip level, face and layer of Textures, only the resident levels of streamed ones
+			SHADERS,        // linked program binaries, where the driver reports their size
+			RENDER_TARGETS, // renderbuffers of Framebuffers
+			TEXTURE_CACHE,  // mip chains TextureStreamer keeps in system memory to stream levels from
+			MODEL_IMPORT,   // Assimp scenes while a Model is built from them
+			NUM_CATEGORIES
+		};
+
+		enum Pool {
+			GPU,
+			CPU,
+			NUM_POOLS
+		};
+
+		// The memory of one tag
+		struct Asset {
+			std::string tag;
+			size_t bytes[NUM_CATEGORIES];
+			size_t total;
+			int numRecords;
+		};
+
+		static MemoryAccounting& getInstance();
+
+		static Pool getPool(Category category);
+		static const char* getCategoryName(Category category);
+
+		size_t getBytes(Category category) const;
+		size_t getBytes(Pool pool) const;
+		size_t getHighWaterMark(Category category) const;
+		size_t getHighWaterMark(Pool pool) const;
+		int getNumRecords(Category category) const;
+
+		// Forgets the peaks, e.g. after loading so the high water marks show the steady state
+		void resetHighWaterMarks();
+
+		// The memory grouped by tag, largest first
+		std::vector<Asset> getAssets() const;
+
+		// One line with the totals of both pools
+		void printSummary(std::ostream &out) const;
+
+		// Every category with its peak, then the maxAssets largest assets
+		void printReport(std::ostream &out, int maxAssets = 20) const;
+
+		// One row per record: category, pool, tag, bytes
+		void writeCSV(std::ostream &out) const;
+
+		// Prints the summary from update every interval seconds, 0 turns it off
+		void setReportInterval(double seconds);
+
+		// Call once per frame, BaseApp::run does this
+		void update();
+
+		// Human readable size, e.g. "12.5 MB"
+		static std::string formatBytes(size_t bytes);
+
+	private:
+		friend class MemoryRecord;
+
+		MemoryAccounting();
+		MemoryAccounting(const MemoryAccounting&) {}; // prevent copying
+
+		mutable std::mutex _mutex;
+		std::set<const MemoryRecord*> _records;
+		size_t _bytes[NUM_CATEGORIES];
+		size_t _highWaterMarks[NUM_CATEGORIES];
+		int _numRecords[NUM_CATEGORIES];
+		size_t _poolBytes[NUM_POOLS];
+		size_t _poolHighWaterMarks[NUM_POOLS];
+
+		double _reportInterval;
+		std::chrono::steady_clock::time_point _lastReport;
+
+		// Called with the mutex locked
+		void add(Category category, size_t bytes);
+		void subtract(Category category, size_t bytes);
+	};
+
+	/** MemoryRecord is the share of one resource in MemoryAccounting. It is a member of the resource, registers
+	itself on construction and takes its bytes out of the totals when the resource is destroyed.
+	------------------------------------------------------------------------
+	class Mesh {
+		MemoryRecord _memory;
+	};
+
+	Mesh::Mesh(...) : _memory(MemoryAccounting::GEOMETRY)
+	{
+		...
+		_memory.setBytes(allocateVertexByteSize + allocateIndexByteSize);
+	}
+	------------------------------------------------------------------------
+	*/
+	class MemoryRecord
+	{
+	public:
+		MemoryRecord(MemoryAccounting::Category category, const std::string &tag = "");
+		~MemoryRecord();
+
+		void setBytes(size_t bytes);
+		size_t getBytes() const;
+
+		void setTag(const std::string &tag);
+		std::string getTag() const;
+
+		MemoryAccounting::Category getCategory() const;
+
+		// Exchanges bytes and tags with a record of the same category, for resources that swap their contents
+		void swap(MemoryRecord &other);
+
+	private:
+		friend class MemoryAccounting;
+
+		MemoryRecord(const MemoryRecord&) {}; // prevent copying
+		MemoryRecord& operator=(const MemoryRecord&) { return *this; }
+
+		MemoryAccounting::Category _category;
+		std::string _tag;
+		size_t _bytes;
+	};
+
+}
+
+#endif /* MemoryAccounting_h */
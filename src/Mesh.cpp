@@ -7,18 +7,30 @@
 //
 
 #include "Mesh.h"
+#include "GLStats.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <limits>
 
 namespace basicgraphics {
 
-	Mesh::Mesh(std::vector<std::shared_ptr<Texture>> textures, GLenum primitiveType, GLenum usage, int allocateVertexByteSize, int allocateIndexByteSize, int vertexOffset, const std::vector<Vertex> &data, int numIndices /*=0*/, int indexByteSize/*=0*/, int* index/*=nullptr*/)
+	constexpr float Mesh::ALPHA_CUTOFF;
+
+	Mesh::Mesh(std::vector<std::shared_ptr<Texture>> textures, GLenum primitiveType, GLenum usage, int allocateVertexByteSize, int allocateIndexByteSize, int vertexOffset, const std::vector<Vertex> &data, int numIndices /*=0*/, int indexByteSize/*=0*/, int* index/*=nullptr*/) : _memory(MemoryAccounting::GEOMETRY)
 	{
 		_textures = textures;
+		_materialIndex = -1;
 
 		_materialColor = glm::vec4(1.0);
 
 		assert(data.size() - vertexOffset >= 0);
 		int dataByteSize = sizeof(Vertex) * (data.size() - vertexOffset);
 
+		_boundsMin = glm::vec3(std::numeric_limits<float>::max());
+		_boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+		growBounds(vertexOffset, data);
+
 		_allocatedVertexByteSize = allocateVertexByteSize;
 		_allocatedIndexByteSize = allocateIndexByteSize;
 		_filledVertexByteSize = dataByteSize;
@@ -63,6 +75,9 @@ namespace basicgraphics {
 
 		// unbind the vao
 		glBindVertexArray(0);
+
+		_memory.setBytes((size_t)allocateVertexByteSize + allocateIndexByteSize);
+		Metrics::add(Metrics::BUFFER_UPLOAD_BYTES, (size_t)dataByteSize + ((index != nullptr) ? indexByteSize : 0));
 	}
 
 	Mesh::~Mesh()
@@ -74,44 +89,47 @@ namespace basicgraphics {
 	}
 
 	void Mesh::draw(GLSLProgram &shader) {
+		GLCallSite site("Mesh::draw");
 
-		bool translucent = false;
-		if (_textures.size() > 0) {
+		if (_materialBuffer) {
+			// Everything else was bound once by MaterialBuffer::bind
+			shader.setUniform("materialIndex", _materialIndex);
+		}
+		else if (_textures.size() > 0) {
+			shader.setUniform("materialIndex", -1);
 			shader.setUniform("hasTexture", 1);
 			shader.setUniform("materialColor", vec4(0.0, 0.0, 0.0, 1.0));
 
 			for (int i = 0; i < _textures.size(); i++) {
-				if (!_textures[i]->isOpaque()) {
-					translucent = true;
-					glDisable(GL_DEPTH_TEST);
-					//Note: This isn't going to work properly because the surfaces are not sorted back to front. Transparent surfaces should be drawn after all the opaque geometry.
-					glEnable(GL_BLEND);
-					glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-				}
 				_textures[i]->bind(i);
 				shader.setUniform("textureSampler", i);
 			}
 		}
 		else {
+			shader.setUniform("materialIndex", -1);
 			shader.setUniform("hasTexture", 0);
 			shader.setUniform("materialColor", _materialColor);
-			if (_materialColor.a != 1.0) {
-				translucent = true;
-				glDisable(GL_DEPTH_TEST);
-				//Note: This isn't going to work properly because the surfaces are not sorted back to front. Transparent surfaces should be drawn after all the opaque geometry.
-				glEnable(GL_BLEND);
-				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			}
+		}
+
+		// Opaque and cutout surfaces keep the depth test and depth writes so early-Z still works for them.
+		// Blended surfaces are still depth tested against what was drawn before, Model::draw draws them last.
+		const Texture::AlphaMode alphaMode = getAlphaMode();
+		shader.setUniform("alphaCutoff", (alphaMode == Texture::ALPHA_CUTOUT) ? ALPHA_CUTOFF : 0.0f);
+		if (alphaMode == Texture::ALPHA_BLEND) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_FALSE);
 		}
 
 		glBindVertexArray(this->getVAOID());
 		glDrawElements(_primitiveType, _numIndices, GL_UNSIGNED_INT, 0);
 		glBindVertexArray(0);
+		Metrics::add(Metrics::DRAW_CALLS);
 
-		if (translucent) {
+		if (alphaMode == Texture::ALPHA_BLEND) {
+			glDepthMask(GL_TRUE);
 			glBlendFunc(GL_ONE, GL_ZERO);
 			glDisable(GL_BLEND);
-			glEnable(GL_DEPTH_TEST);
 		}
 
 		// Reset state
@@ -122,11 +140,46 @@ namespace basicgraphics {
 		}
 	}
 
+	Texture::AlphaMode Mesh::getAlphaMode() const
+	{
+		if (_materialBuffer) {
+			return _materialBuffer->getAlphaMode(_materialIndex);
+		}
+		if (_textures.size() > 0) {
+			Texture::AlphaMode mode = Texture::ALPHA_OPAQUE;
+			for (int i = 0; i < _textures.size(); i++) {
+				mode = std::max(mode, _textures[i]->getAlphaMode());
+			}
+			return mode;
+		}
+		return (_materialColor.a != 1.0) ? Texture::ALPHA_BLEND : Texture::ALPHA_OPAQUE;
+	}
+
+	void Mesh::growBounds(int vertexOffset, const std::vector<Vertex> &data)
+	{
+		for (int i = vertexOffset; i < data.size(); i++) {
+			_boundsMin = glm::min(_boundsMin, data[i].position);
+			_boundsMax = glm::max(_boundsMax, data[i].position);
+		}
+	}
+
+	glm::vec3 Mesh::getCenter() const
+	{
+		return 0.5f * (_boundsMin + _boundsMax);
+	}
+
 	void Mesh::setMaterialColor(const glm::vec4 &color)
 	{
 		_materialColor = color;
 	}
 
+	void Mesh::setMaterial(std::shared_ptr<MaterialBuffer> materials, int materialIndex)
+	{
+		_materialBuffer = materials;
+		_materialIndex = materialIndex;
+		_textures.clear();
+	}
+
 	int Mesh::getAllocatedVertexByteSize() const
 	{
 		return _allocatedVertexByteSize;
@@ -152,6 +205,11 @@ namespace basicgraphics {
 		return _numIndices;
 	}
 
+	void Mesh::setMemoryTag(const std::string &tag)
+	{
+		_memory.setTag(tag);
+	}
+
 	GLuint Mesh::getVAOID() const
 	{
 		return _vaoID;
@@ -162,6 +220,7 @@ namespace basicgraphics {
 		assert(startByteOffset <= _filledVertexByteSize);
 
 		int dataByteSize = sizeof(Vertex)*(data.size() - vertexOffset);
+		growBounds(vertexOffset, data);
 
 		int totalBytes = startByteOffset + dataByteSize;
 		if (_filledVertexByteSize < totalBytes) {
@@ -172,6 +231,7 @@ namespace basicgraphics {
 		glBindBuffer(GL_ARRAY_BUFFER, _vertexVBO);
 
 		glBufferSubData(GL_ARRAY_BUFFER, startByteOffset, dataByteSize, &data[0]);
+		Metrics::add(Metrics::BUFFER_UPLOAD_BYTES, dataByteSize);
 	}
 
 	void Mesh::updateIndexData(int totalNumIndices, int startByteOffset, int indexByteSize, int* index)
@@ -185,6 +245,7 @@ namespace basicgraphics {
 		assert(_filledIndexByteSize <= _allocatedIndexByteSize);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexVBO);
 		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, startByteOffset, indexByteSize, index);
+		Metrics::add(Metrics::BUFFER_UPLOAD_BYTES, indexByteSize);
 	}
 
 }
\ No newline at end of file
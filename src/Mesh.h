@@ -16,6 +16,8 @@
 
 #include "Texture.h"
 #include "GLSLProgram.h"
+#include "MaterialBuffer.h"
+#include "MemoryAccounting.h"
 #include <Vector>
 
 namespace basicgraphics {
@@ -36,10 +38,23 @@ namespace basicgraphics {
 		Mesh(std::vector<std::shared_ptr<Texture>> textures, GLenum primitiveType, GLenum usage, int allocateVertexByteSize, int allocateIndexByteSize, int vertexOffset, const std::vector<Vertex> &data, int numIndices = 0, int indexByteSize = 0, int* index = nullptr);
 		virtual ~Mesh();
 
+		// Shaders should discard fragments with alpha below the alphaCutoff uniform, it is ALPHA_CUTOFF for cutout meshes and 0 otherwise
+		static constexpr float ALPHA_CUTOFF = 0.5f;
+
 		virtual void draw(GLSLProgram &shader);
 
+		// Which pass the mesh belongs in, see Texture::AlphaMode
+		Texture::AlphaMode getAlphaMode() const;
+
+		// Center of the bounding box of the vertices, used to sort blended meshes
+		glm::vec3 getCenter() const;
+
 		void setMaterialColor(const glm::vec4 &color);
 
+		// Draws with a material from a shared MaterialBuffer instead of the mesh's own textures and color.
+		// The buffer must be bound with MaterialBuffer::bind before draw.
+		void setMaterial(std::shared_ptr<MaterialBuffer> materials, int materialIndex);
+
 		// Returns the number of bytes allocated in the vertexVBO
 		int getAllocatedVertexByteSize() const;
 		int getAllocatedIndexByteSize() const;
@@ -48,6 +63,9 @@ namespace basicgraphics {
 		int getFilledIndexByteSize() const;
 		int getNumIndices() const;
 
+		// Names the asset the buffers are counted under in MemoryAccounting, e.g. the model file
+		void setMemoryTag(const std::string &tag);
+
 		GLuint getVAOID() const;
 
 		// Update the vbos. startByteOffset+dataByteSize must be <= allocatedByteSize
@@ -67,8 +85,17 @@ namespace basicgraphics {
 		int _numIndices;
 
 		glm::vec4 _materialColor;
+		glm::vec3 _boundsMin;
+		glm::vec3 _boundsMax;
 
 		std::vector<std::shared_ptr<Texture>> _textures;
+
+		std::shared_ptr<MaterialBuffer> _materialBuffer;
+		int _materialIndex;
+
+		MemoryRecord _memory; // the allocated vertex and index bytes
+
+		void growBounds(int vertexOffset, const std::vector<Vertex> &data);
 	};
 
 }
@@ -0,0 +1,209 @@
+//
+//  Metrics.cpp
+//
+//
+
+#include "Metrics.h"
+#include "MemoryAccounting.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace basicgraphics {
+
+	const double Metrics::FRAME_TIME_BUCKETS[Metrics::NUM_FRAME_TIME_BUCKETS] = { 1.0, 2.0, 4.0, 8.0, 16.7, 33.3, 50.0, 100.0, 250.0, 1000.0 };
+
+	static const char* COUNTER_NAMES[Metrics::NUM_COUNTERS] = { "bunny_draw_calls_total", "bunny_texture_uploads_total", "bunny_texture_upload_bytes_total", "bunny_buffer_upload_bytes_total" };
+	static const char* COUNTER_HELP[Metrics::NUM_COUNTERS] = {
+		"Draw calls issued by meshes.",
+		"Textures and mip levels uploaded to the GPU.",
+		"Bytes of texture data uploaded to the GPU.",
+		"Bytes of vertex and index data uploaded to the GPU."
+	};
+	static const char* CACHE_NAMES[Metrics::NUM_CACHES] = { "uniform_locations", "model_textures", "cooked_textures", "render_models" };
+	static const char* GAUGE_NAMES[Metrics::NUM_GAUGES] = { "bunny_texture_loads_pending", "bunny_textures_streaming", "bunny_render_requests_queued" };
+	static const char* GAUGE_HELP[Metrics::NUM_GAUGES] = {
+		"Asynchronous texture loads that are decoding or uploading.",
+		"Textures the streamer manages.",
+		"Render service requests waiting for the GL thread."
+	};
+
+	// Only the shard's own thread writes, so no read-modify-write is needed
+	static inline void increment(std::atomic<unsigned long long> &value, unsigned long long amount)
+	{
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	Metrics::Shard::Shard()
+	{
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			counters[i].store(0);
+		}
+		for (int i = 0; i < NUM_CACHES; i++) {
+			cacheHits[i].store(0);
+			cacheMisses[i].store(0);
+		}
+		for (int i = 0; i <= NUM_FRAME_TIME_BUCKETS; i++) {
+			frameTimeBuckets[i].store(0);
+		}
+		frameTimeMicroseconds.store(0);
+	}
+
+	Metrics::Metrics()
+	{
+		for (int i = 0; i < NUM_GAUGES; i++) {
+			_gauges[i].store(0);
+		}
+	}
+
+	Metrics& Metrics::getInstance()
+	{
+		static Metrics metrics;
+		return metrics;
+	}
+
+	Metrics::Shard& Metrics::getShard()
+	{
+		static thread_local Shard* shard = nullptr;
+		if (shard == nullptr) {
+			Metrics &metrics = getInstance();
+			std::lock_guard<std::mutex> lock(metrics._shardsMutex);
+			metrics._shards.emplace_back(new Shard());
+			shard = metrics._shards.back().get();
+		}
+		return *shard;
+	}
+
+	void Metrics::add(Counter counter, unsigned long long amount /*=1*/)
+	{
+		increment(getShard().counters[counter], amount);
+	}
+
+	void Metrics::recordCacheLookup(Cache cache, bool hit)
+	{
+		Shard &shard = getShard();
+		increment(hit ? shard.cacheHits[cache] : shard.cacheMisses[cache], 1);
+	}
+
+	void Metrics::observeFrameTime(double milliseconds)
+	{
+		int bucket = 0;
+		while (bucket < NUM_FRAME_TIME_BUCKETS && milliseconds > FRAME_TIME_BUCKETS[bucket]) {
+			bucket++;
+		}
+		Shard &shard = getShard();
+		increment(shard.frameTimeBuckets[bucket], 1);
+		increment(shard.frameTimeMicroseconds, (unsigned long long)(std::max(milliseconds, 0.0) * 1000.0));
+	}
+
+	void Metrics::setGauge(Gauge gauge, long long value)
+	{
+		getInstance()._gauges[gauge].store(value, std::memory_order_relaxed);
+	}
+
+	Metrics::Snapshot Metrics::getSnapshot() const
+	{
+		Snapshot snapshot;
+		std::fill(snapshot.counters, snapshot.counters + NUM_COUNTERS, 0);
+		std::fill(snapshot.cacheHits, snapshot.cacheHits + NUM_CACHES, 0);
+		std::fill(snapshot.cacheMisses, snapshot.cacheMisses + NUM_CACHES, 0);
+		std::fill(snapshot.frameTimeBuckets, snapshot.frameTimeBuckets + NUM_FRAME_TIME_BUCKETS + 1, 0);
+		unsigned long long microseconds = 0;
+		{
+			std::lock_guard<std::mutex> lock(_shardsMutex);
+			for (int s = 0; s < _shards.size(); s++) {
+				const Shard &shard = *_shards[s];
+				for (int i = 0; i < NUM_COUNTERS; i++) {
+					snapshot.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+				}
+				for (int i = 0; i < NUM_CACHES; i++) {
+					snapshot.cacheHits[i] += shard.cacheHits[i].load(std::memory_order_relaxed);
+					snapshot.cacheMisses[i] += shard.cacheMisses[i].load(std::memory_order_relaxed);
+				}
+				for (int i = 0; i <= NUM_FRAME_TIME_BUCKETS; i++) {
+					snapshot.frameTimeBuckets[i] += shard.frameTimeBuckets[i].load(std::memory_order_relaxed);
+				}
+				microseconds += shard.frameTimeMicroseconds.load(std::memory_order_relaxed);
+			}
+		}
+		for (int i = 0; i < NUM_GAUGES; i++) {
+			snapshot.gauges[i] = _gauges[i].load(std::memory_order_relaxed);
+		}
+		snapshot.numFrames = 0;
+		for (int i = 0; i <= NUM_FRAME_TIME_BUCKETS; i++) {
+			snapshot.numFrames += snapshot.frameTimeBuckets[i];
+		}
+		snapshot.frameTimeSeconds = microseconds / 1.0e6;
+		return snapshot;
+	}
+
+	void Metrics::writePrometheus(std::ostream &out) const
+	{
+		const Snapshot snapshot = getSnapshot();
+
+		out << "# HELP bunny_frame_time_seconds Wall clock time of each frame, including the swap." << "\n";
+		out << "# TYPE bunny_frame_time_seconds histogram" << "\n";
+		unsigned long long cumulative = 0;
+		for (int i = 0; i < NUM_FRAME_TIME_BUCKETS; i++) {
+			cumulative += snapshot.frameTimeBuckets[i];
+			out << "bunny_frame_time_seconds_bucket{le=\"" << FRAME_TIME_BUCKETS[i] / 1000.0 << "\"} " << cumulative << "\n";
+		}
+		out << "bunny_frame_time_seconds_bucket{le=\"+Inf\"} " << snapshot.numFrames << "\n";
+		out << "bunny_frame_time_seconds_sum " << std::setprecision(9) << snapshot.frameTimeSeconds << std::setprecision(6) << "\n";
+		out << "bunny_frame_time_seconds_count " << snapshot.numFrames << "\n";
+
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			out << "# HELP " << COUNTER_NAMES[i] << " " << COUNTER_HELP[i] << "\n";
+			out << "# TYPE " << COUNTER_NAMES[i] << " counter" << "\n";
+			out << COUNTER_NAMES[i] << " " << snapshot.counters[i] << "\n";
+		}
+
+		out << "# HELP bunny_cache_hits_total Lookups that found the entry." << "\n";
+		out << "# TYPE bunny_cache_hits_total counter" << "\n";
+		for (int i = 0; i < NUM_CACHES; i++) {
+			out << "bunny_cache_hits_total{cache=\"" << CACHE_NAMES[i] << "\"} " << snapshot.cacheHits[i] << "\n";
+		}
+		out << "# HELP bunny_cache_misses_total Lookups that had to create the entry." << "\n";
+		out << "# TYPE bunny_cache_misses_total counter" << "\n";
+		for (int i = 0; i < NUM_CACHES; i++) {
+			out << "bunny_cache_misses_total{cache=\"" << CACHE_NAMES[i] << "\"} " << snapshot.cacheMisses[i] << "\n";
+		}
+		out << "# HELP bunny_cache_hit_ratio Hits over all lookups since startup." << "\n";
+		out << "# TYPE bunny_cache_hit_ratio gauge" << "\n";
+		for (int i = 0; i < NUM_CACHES; i++) {
+			const unsigned long long lookups = snapshot.cacheHits[i] + snapshot.cacheMisses[i];
+			out << "bunny_cache_hit_ratio{cache=\"" << CACHE_NAMES[i] << "\"} " << (lookups > 0 ? (double)snapshot.cacheHits[i] / lookups : 0.0) << "\n";
+		}
+
+		for (int i = 0; i < NUM_GAUGES; i++) {
+			out << "# HELP " << GAUGE_NAMES[i] << " " << GAUGE_HELP[i] << "\n";
+			out << "# TYPE " << GAUGE_NAMES[i] << " gauge" << "\n";
+			out << GAUGE_NAMES[i] << " " << snapshot.gauges[i] << "\n";
+		}
+
+		MemoryAccounting &memory = MemoryAccounting::getInstance();
+		const char* families[] = { "bunny_memory_bytes", "bunny_memory_peak_bytes" };
+		const char* help[] = { "Memory held by each category, GPU sizes are estimates.", "High water mark of each category." };
+		for (int family = 0; family < 2; family++) {
+			out << "# HELP " << families[family] << " " << help[family] << "\n";
+			out << "# TYPE " << families[family] << " gauge" << "\n";
+			for (int i = 0; i < MemoryAccounting::NUM_CATEGORIES; i++) {
+				const MemoryAccounting::Category category = (MemoryAccounting::Category)i;
+				std::string name = MemoryAccounting::getCategoryName(category);
+				std::replace(name.begin(), name.end(), ' ', '_');
+				const size_t bytes = (family == 0) ? memory.getBytes(category) : memory.getHighWaterMark(category);
+				out << families[family] << "{category=\"" << name << "\",pool=\"" << (MemoryAccounting::getPool(category) == MemoryAccounting::GPU ? "gpu" : "cpu") << "\"} " << bytes << "\n";
+			}
+		}
+		out.flush();
+	}
+
+	std::string Metrics::getPrometheusText() const
+	{
+		std::ostringstream text;
+		writePrometheus(text);
+		return text.str();
+	}
+
+}
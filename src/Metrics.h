@@ -0,0 +1,122 @@
+/*!
+ *  Metrics.h
+ *
+ * Render statistics for monitoring long running renderers: frame times, draw calls, uploads, memory, cache hit rates and load queues.
+ */
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** Metrics collects the counters that are always on, unlike GLStats and the Profiler which are turned on to
+	investigate. Every thread counts into its own shard, a single writer, so an increment is a plain load and
+	store without a lock, an atomic read-modify-write or a cache line shared with another thread. Readers sum
+	the shards when they take a snapshot, which happens on the MetricsServer's thread when it is scraped,
+	so the render thread never pays for the aggregation. Gauges, like the length of the load queues, are set
+	by their single owner once per frame. Memory comes from MemoryAccounting when the text is written.
+	BaseApp times every frame and sets the queue gauges, --metrics ADDRESS serves them, see MetricsServer.
+	------------------------------------------------------------------------
+	Metrics::add(Metrics::DRAW_CALLS);
+	Metrics::recordCacheLookup(Metrics::MODEL_TEXTURES, found);
+	Metrics::setGauge(Metrics::TEXTURE_LOADS_PENDING, numPending);
+	Metrics::getInstance().observeFrameTime(milliseconds);
+	...
+	Metrics::getInstance().writePrometheus(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class Metrics
+	{
+	public:
+
+		enum Counter {
+			DRAW_CALLS,
+			TEXTURE_UPLOADS,      // textures and mip levels handed to the GPU
+			TEXTURE_UPLOAD_BYTES,
+			BUFFER_UPLOAD_BYTES,  // vertex and index data
+			NUM_COUNTERS
+		};
+
+		enum Cache {
+			UNIFORM_LOCATIONS, // GLSLProgram's uniform locations
+			MODEL_TEXTURES,    // textures shared by the meshes of a Model
+			COOKED_TEXTURES,   // TextureCooker's compressed files
+			RENDER_MODELS,     // RenderService's loaded models
+			NUM_CACHES
+		};
+
+		enum Gauge {
+			TEXTURE_LOADS_PENDING,   // TextureLoader
+			TEXTURES_STREAMING,      // TextureStreamer
+			RENDER_REQUESTS_QUEUED,  // RenderService
+			NUM_GAUGES
+		};
+
+		// Upper bounds of the frame time histogram buckets in milliseconds, a last bucket takes everything slower
+		static const int NUM_FRAME_TIME_BUCKETS = 10;
+		static const double FRAME_TIME_BUCKETS[NUM_FRAME_TIME_BUCKETS];
+
+		struct Snapshot {
+			unsigned long long counters[NUM_COUNTERS];
+			unsigned long long cacheHits[NUM_CACHES];
+			unsigned long long cacheMisses[NUM_CACHES];
+			long long gauges[NUM_GAUGES];
+			unsigned long long frameTimeBuckets[NUM_FRAME_TIME_BUCKETS + 1]; // not cumulative
+			unsigned long long numFrames;
+			double frameTimeSeconds; // sum over all frames
+		};
+
+		static Metrics& getInstance();
+
+		// Hot path, from any thread
+		static void add(Counter counter, unsigned long long amount = 1);
+		static void recordCacheLookup(Cache cache, bool hit);
+		void observeFrameTime(double milliseconds);
+
+		// Only the owner of what is measured sets a gauge
+		static void setGauge(Gauge gauge, long long value);
+
+		// Sums the shards, from any thread. Counts of a thread that is counting at the same time may be a moment behind.
+		Snapshot getSnapshot() const;
+
+		// Everything in the Prometheus text exposition format (version 0.0.4), including MemoryAccounting
+		void writePrometheus(std::ostream &out) const;
+		std::string getPrometheusText() const;
+
+	private:
+		Metrics();
+		Metrics(const Metrics&) {}; // prevent copying
+
+		// Written only by the thread it belongs to, read by getSnapshot. new doesn't align it to a cache line (C++11
+		// ignores over-alignment there), so a full line of padding on each side keeps the counters off the lines of
+		// whatever is allocated next to it, another shard or not.
+		struct Shard {
+			char frontPadding[64];
+			std::atomic<unsigned long long> counters[NUM_COUNTERS];
+			std::atomic<unsigned long long> cacheHits[NUM_CACHES];
+			std::atomic<unsigned long long> cacheMisses[NUM_CACHES];
+			std::atomic<unsigned long long> frameTimeBuckets[NUM_FRAME_TIME_BUCKETS + 1];
+			std::atomic<unsigned long long> frameTimeMicroseconds;
+			char backPadding[64];
+
+			Shard();
+		};
+
+		// The calling thread's shard, created on its first count and kept after the thread exits so its counts stay in the totals
+		static Shard& getShard();
+
+		mutable std::mutex _shardsMutex;
+		std::vector<std::unique_ptr<Shard>> _shards;
+		std::atomic<long long> _gauges[NUM_GAUGES];
+	};
+
+}
+
+#endif /* Metrics_h */
@@ -0,0 +1,100 @@
+//
+//  MetricsServer.cpp
+//
+//
+
+#include "MetricsServer.h"
+#include "HttpSocket.h"
+#include "Metrics.h"
+
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace basicgraphics {
+
+	// Prometheus' text exposition format
+	static const char* METRICS_CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+	MetricsServer::MetricsServer(const std::string &address) : _address(address), _listenSocket(-1), _running(false)
+	{
+	}
+
+	MetricsServer::~MetricsServer()
+	{
+		stop();
+	}
+
+	bool MetricsServer::start(std::string &error)
+	{
+		if (_running) {
+			return true;
+		}
+		_listenSocket = HttpSocket::listen(_address, error);
+		if (_listenSocket < 0) {
+			return false;
+		}
+		_running = true;
+		_listener = std::thread(&MetricsServer::listen, this);
+		return true;
+	}
+
+	void MetricsServer::stop()
+	{
+		if (!_running) {
+			return;
+		}
+		_running = false;
+		_listener.join();
+		HttpSocket::close(_listenSocket);
+		_listenSocket = -1;
+#ifndef _WIN32
+		if (_address.compare(0, 5, "unix:") == 0) {
+			unlink(_address.substr(5).c_str());
+		}
+#endif
+	}
+
+	std::string MetricsServer::getAddress() const
+	{
+		return _address;
+	}
+
+	void MetricsServer::listen()
+	{
+		while (_running) {
+			int connection = HttpSocket::accept(_listenSocket, 100);
+			if (connection >= 0) {
+				handleConnection(connection);
+			}
+		}
+	}
+
+	void MetricsServer::handleConnection(int connection)
+	{
+		std::string method, path;
+		if (!HttpSocket::readRequest(connection, method, path)) {
+			HttpSocket::close(connection);
+			return;
+		}
+		if (method != "GET") {
+			HttpSocket::sendResponse(connection, 405, "Only GET is supported\n");
+			HttpSocket::close(connection);
+			return;
+		}
+
+		std::vector<std::pair<std::string, std::string>> query;
+		const std::string resource = HttpSocket::parsePath(path, query);
+		if (resource != "/metrics") {
+			HttpSocket::sendResponse(connection, 404, "Unknown resource " + resource + ", try /metrics\n");
+			HttpSocket::close(connection);
+			return;
+		}
+
+		const std::string text = Metrics::getInstance().getPrometheusText();
+		HttpSocket::sendResponse(connection, 200, METRICS_CONTENT_TYPE, (const unsigned char*)text.c_str(), text.size());
+		HttpSocket::close(connection);
+	}
+
+}
@@ -0,0 +1,55 @@
+/*!
+ *  MetricsServer.h
+ *
+ * Serves Metrics over HTTP so monitoring can scrape a running renderer.
+ */
+
+#ifndef MetricsServer_h
+#define MetricsServer_h
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+namespace basicgraphics {
+
+	/** MetricsServer answers GET /metrics with Metrics in the Prometheus text format, on its own thread, so
+	scraping sums the counter shards there and never waits for or stalls the GL thread. Addresses are like
+	HttpSocket's, "127.0.0.1:9100" or "unix:/path/to/socket"; use a localhost one, there is no authentication.
+	BaseApp starts one with --metrics ADDRESS. A RenderService answers /metrics too.
+	------------------------------------------------------------------------
+	MetricsServer server("127.0.0.1:9100");
+	std::string error;
+	if (!server.start(error)) {
+		std::cerr << error << std::endl;
+	}
+	// curl http://127.0.0.1:9100/metrics
+	------------------------------------------------------------------------
+	*/
+	class MetricsServer
+	{
+	public:
+		MetricsServer(const std::string &address);
+		virtual ~MetricsServer();
+
+		// Starts the listener thread, fails if the address can't be bound
+		bool start(std::string &error);
+		void stop();
+
+		std::string getAddress() const;
+
+	private:
+		MetricsServer(const MetricsServer&) {}; // prevent copying
+
+		std::string _address;
+		int _listenSocket;
+		std::atomic<bool> _running;
+		std::thread _listener;
+
+		void listen();
+		void handleConnection(int connection);
+	};
+
+}
+
+#endif /* MetricsServer_h */
@@ -0,0 +1,225 @@
+//
+//  MicroBenchmark.cpp
+//
+//
+
+#include "MicroBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+namespace basicgraphics {
+
+	// Calibration stops growing the iteration count here, whatever the time
+	static const long long MAX_ITERATIONS = 1000000000LL;
+
+	static double getMedian(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+		const size_t middle = values.size() / 2;
+		return values.size() % 2 == 1 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+	}
+
+	// As a JSON string
+	static std::string quote(const std::string &text)
+	{
+		std::string quoted = "\"";
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] == '"' || text[i] == '\\') {
+				quoted += '\\';
+			}
+			quoted += text[i];
+		}
+		return quoted + "\"";
+	}
+
+	BenchmarkState::BenchmarkState(long long iterations) : _iterations(iterations), _remaining(iterations), _running(false),
+		_cpuStart(0), _seconds(0.0), _cpuSeconds(0.0), _bytesProcessed(0), _itemsProcessed(0)
+	{
+	}
+
+	bool BenchmarkState::keepRunning()
+	{
+		if (_remaining > 0 && _skipReason.empty()) {
+			if (_remaining == _iterations) {
+				resumeTiming();
+			}
+			_remaining--;
+			return true;
+		}
+		pauseTiming();
+		return false;
+	}
+
+	void BenchmarkState::pauseTiming()
+	{
+		if (_running) {
+			_seconds += std::chrono::duration<double>(Clock::now() - _start).count();
+			_cpuSeconds += (double)(std::clock() - _cpuStart) / CLOCKS_PER_SEC;
+			_running = false;
+		}
+	}
+
+	void BenchmarkState::resumeTiming()
+	{
+		if (!_running) {
+			_running = true;
+			_cpuStart = std::clock();
+			_start = Clock::now();
+		}
+	}
+
+	void BenchmarkState::skip(const std::string &reason)
+	{
+		_skipReason = reason;
+	}
+
+	MicroBenchmarks& MicroBenchmarks::getInstance()
+	{
+		static MicroBenchmarks benchmarks;
+		return benchmarks;
+	}
+
+	int MicroBenchmarks::add(const std::string &name, const Function &function)
+	{
+		Benchmark benchmark;
+		benchmark.name = name;
+		benchmark.function = function;
+		_benchmarks.push_back(benchmark);
+		return 0;
+	}
+
+	MicroBenchmarks::Result MicroBenchmarks::runOne(const Benchmark &benchmark, const Settings &settings)
+	{
+		Result result;
+		result.name = benchmark.name;
+		result.skipped = false;
+		result.iterations = 0;
+		result.nanoseconds = 0.0;
+		result.cpuNanoseconds = 0.0;
+		result.bytesPerSecond = 0.0;
+		result.itemsPerSecond = 0.0;
+
+		// Like Google Benchmark, aim a little past the minimum time from the last run, growing by at most 10x.
+		// The calibration runs also warm up caches and lazily created state, they are not reported.
+		long long iterations = 1;
+		std::vector<double> nanoseconds, cpuNanoseconds, bytesPerSecond, itemsPerSecond;
+		bool calibrated = false;
+		while ((int)nanoseconds.size() < std::max(settings.repetitions, 1)) {
+			BenchmarkState state(iterations);
+			benchmark.function(state);
+			if (!state._skipReason.empty() || state._remaining > 0) {
+				result.skipped = true;
+				result.skipReason = !state._skipReason.empty() ? state._skipReason : "the loop stopped before keepRunning returned false";
+				return result;
+			}
+
+			if (!calibrated) {
+				calibrated = state._seconds >= settings.minSeconds || iterations >= MAX_ITERATIONS;
+				double multiplier = state._seconds > 0.0 ? 1.4 * settings.minSeconds / state._seconds : 10.0;
+				multiplier = std::min(std::max(multiplier, 1.1), 10.0);
+				if (!calibrated) {
+					iterations = std::min((long long)std::ceil(iterations * multiplier), MAX_ITERATIONS);
+				}
+				continue;
+			}
+
+			const double seconds = std::max(state._seconds, 1e-12);
+			nanoseconds.push_back(1e9 * state._seconds / iterations);
+			cpuNanoseconds.push_back(1e9 * state._cpuSeconds / iterations);
+			bytesPerSecond.push_back(state._bytesProcessed / seconds);
+			itemsPerSecond.push_back(state._itemsProcessed / seconds);
+		}
+
+		result.iterations = iterations;
+		result.nanoseconds = getMedian(nanoseconds);
+		result.cpuNanoseconds = getMedian(cpuNanoseconds);
+		result.bytesPerSecond = getMedian(bytesPerSecond);
+		result.itemsPerSecond = getMedian(itemsPerSecond);
+		return result;
+	}
+
+	std::vector<MicroBenchmarks::Result> MicroBenchmarks::run(const Settings &settings, std::ostream &out)
+	{
+		std::vector<Result> results;
+		char line[256];
+		snprintf(line, sizeof(line), "%-44s %14s %14s %12s", "Benchmark", "Time", "CPU", "Iterations");
+		out << line << std::endl;
+		for (int i = 0; i < _benchmarks.size(); i++) {
+			if (!settings.filter.empty() && _benchmarks[i].name.find(settings.filter) == std::string::npos) {
+				continue;
+			}
+			const Result result = runOne(_benchmarks[i], settings);
+			if (result.skipped) {
+				snprintf(line, sizeof(line), "%-44s skipped: %s", result.name.c_str(), result.skipReason.c_str());
+			}
+			else {
+				int length = snprintf(line, sizeof(line), "%-44s %11.1f ns %11.1f ns %12lld", result.name.c_str(), result.nanoseconds, result.cpuNanoseconds, result.iterations);
+				if (result.bytesPerSecond > 0.0 && length < sizeof(line)) {
+					length += snprintf(line + length, sizeof(line) - length, " %10.1f MB/s", result.bytesPerSecond / (1024.0 * 1024.0));
+				}
+				if (result.itemsPerSecond > 0.0 && length < sizeof(line)) {
+					snprintf(line + length, sizeof(line) - length, " %10.3fM items/s", result.itemsPerSecond / 1e6);
+				}
+			}
+			out << line << std::endl;
+			results.push_back(result);
+		}
+		return results;
+	}
+
+	void MicroBenchmarks::writeJSON(const std::vector<Result> &results, const std::string &executable, std::ostream &out)
+	{
+		char date[64];
+		const std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+		out << "{\n";
+		out << "  \"context\": {\n";
+		out << "    \"date\": " << quote(date) << ",\n";
+		out << "    \"executable\": " << quote(executable) << ",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\"\n";
+#else
+		out << "    \"library_build_type\": \"debug\"\n";
+#endif
+		out << "  },\n";
+		out << "  \"benchmarks\": [";
+		char number[64];
+		for (int i = 0; i < results.size(); i++) {
+			const Result &result = results[i];
+			out << (i > 0 ? ",\n" : "\n") << "    {\n";
+			out << "      \"name\": " << quote(result.name) << ",\n";
+			out << "      \"run_name\": " << quote(result.name) << ",\n";
+			out << "      \"run_type\": \"iteration\",\n";
+			if (result.skipped) {
+				out << "      \"error_occurred\": true,\n";
+				out << "      \"error_message\": " << quote(result.skipReason) << "\n";
+			}
+			else {
+				out << "      \"iterations\": " << result.iterations << ",\n";
+				snprintf(number, sizeof(number), "%.4f", result.nanoseconds);
+				out << "      \"real_time\": " << number << ",\n";
+				snprintf(number, sizeof(number), "%.4f", result.cpuNanoseconds);
+				out << "      \"cpu_time\": " << number << ",\n";
+				out << "      \"time_unit\": \"ns\"";
+				if (result.bytesPerSecond > 0.0) {
+					snprintf(number, sizeof(number), "%.1f", result.bytesPerSecond);
+					out << ",\n      \"bytes_per_second\": " << number;
+				}
+				if (result.itemsPerSecond > 0.0) {
+					snprintf(number, sizeof(number), "%.1f", result.itemsPerSecond);
+					out << ",\n      \"items_per_second\": " << number;
+				}
+				out << "\n";
+			}
+			out << "    }";
+		}
+		out << "\n  ]\n";
+		out << "}\n";
+	}
+
+}
@@ -0,0 +1,158 @@
+/*!
+ *  MicroBenchmark.h
+ *
+ * A small Google Benchmark style harness for timing hot paths in isolation, used by bunny_microbench.
+ */
+
+#ifndef MicroBenchmark_h
+#define MicroBenchmark_h
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** The state a benchmark function times its loop with. Everything inside the loop is timed, the
+	setup before it is not. The harness calls the function with more and more iterations until the
+	loop takes at least the minimum time, so the function must do the same work every iteration.
+	------------------------------------------------------------------------
+	static void inverseMatrix(BenchmarkState &state) {
+		glm::mat4 m = glm::translate(glm::mat4(1.0), glm::vec3(1, 2, 3));
+		while (state.keepRunning()) {
+			doNotOptimize(glm::inverse(m));
+		}
+		state.setItemsProcessed(state.getIterations());
+	}
+	MICRO_BENCHMARK("Matrix/inverse", inverseMatrix);
+	------------------------------------------------------------------------
+	*/
+	class BenchmarkState
+	{
+	public:
+		BenchmarkState(long long iterations);
+
+		// True while there are iterations left, starts the clock on the first call and stops it after the last
+		bool keepRunning();
+
+		// Leaves out work inside the loop, e.g. resetting what an iteration changed
+		void pauseTiming();
+		void resumeTiming();
+
+		// Reported per second of real time
+		void setBytesProcessed(long long bytes) { _bytesProcessed = bytes; }
+		void setItemsProcessed(long long items) { _itemsProcessed = items; }
+
+		// Reports the benchmark as skipped, e.g. when a resource is missing. Call before the loop.
+		void skip(const std::string &reason);
+
+		long long getIterations() const { return _iterations; }
+
+	private:
+		friend class MicroBenchmarks;
+		typedef std::chrono::steady_clock Clock;
+
+		long long _iterations;
+		long long _remaining;
+		bool _running;
+		Clock::time_point _start;
+		std::clock_t _cpuStart;
+		double _seconds;
+		double _cpuSeconds;
+		long long _bytesProcessed;
+		long long _itemsProcessed;
+		std::string _skipReason;
+	};
+
+	/*!
+	 * Keeps the compiler from optimizing away a value that is computed but never used. For a variable it
+	 * also makes the compiler assume the value changed, so work on it is not hoisted out of the loop.
+	 */
+	template<class T>
+	inline void doNotOptimize(const T &value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	template<class T>
+	inline void doNotOptimize(T &value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : "+r,m"(value) : : "memory");
+#else
+		static volatile void* sink;
+		sink = &value;
+#endif
+	}
+
+	/** MicroBenchmarks holds the benchmarks registered with MICRO_BENCHMARK and runs them. Each one is
+	repeated, with the calibrated number of iterations, and reported with the median time per iteration.
+	The JSON report uses Google Benchmark's layout (context, then benchmarks with name, iterations,
+	real_time, cpu_time, time_unit, bytes_per_second and items_per_second) in registration order, so
+	tools written for it, like its compare.py, can compare two runs.
+	*/
+	class MicroBenchmarks
+	{
+	public:
+
+		typedef std::function<void(BenchmarkState&)> Function;
+
+		struct Settings {
+			std::string filter;    /// only run benchmarks whose name contains this, all if empty
+			double minSeconds;     /// the timed loop runs at least this long
+			int repetitions;
+
+			Settings() : minSeconds(0.5), repetitions(3) {}
+		};
+
+		struct Result {
+			std::string name;
+			bool skipped;
+			std::string skipReason;
+			long long iterations;
+			double nanoseconds;     /// real time per iteration, median of the repetitions
+			double cpuNanoseconds;  /// process CPU time per iteration
+			double bytesPerSecond;  /// 0 if not set
+			double itemsPerSecond;  /// 0 if not set
+		};
+
+		static MicroBenchmarks& getInstance();
+
+		// Returns 0 so it can initialize a static, see MICRO_BENCHMARK
+		int add(const std::string &name, const Function &function);
+
+		// Runs the benchmarks that pass the filter and prints a line for each as it finishes
+		std::vector<Result> run(const Settings &settings, std::ostream &out);
+
+		static void writeJSON(const std::vector<Result> &results, const std::string &executable, std::ostream &out);
+
+	private:
+		MicroBenchmarks() {}
+		MicroBenchmarks(const MicroBenchmarks&) {}; // prevent copying
+
+		struct Benchmark {
+			std::string name;
+			Function function;
+		};
+		std::vector<Benchmark> _benchmarks;
+
+		Result runOne(const Benchmark &benchmark, const Settings &settings);
+	};
+
+}
+
+#define MICRO_BENCHMARK_CONCAT_(a, b) a##b
+#define MICRO_BENCHMARK_CONCAT(a, b) MICRO_BENCHMARK_CONCAT_(a, b)
+// Registers function under name, at namespace scope
+#define MICRO_BENCHMARK(name, function) \
+	static int MICRO_BENCHMARK_CONCAT(microBenchmark, __LINE__) = basicgraphics::MicroBenchmarks::getInstance().add(name, function)
+
+#endif /* MicroBenchmark_h */
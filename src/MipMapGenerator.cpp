@@ -0,0 +1,284 @@
+//
+//  MipMapGenerator.cpp
+//
+//
+
+#include "MipMapGenerator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIPMAP_USE_NEON
+#endif
+
+namespace basicgraphics {
+
+	static std::atomic<int> defaultFilter(MipMapGenerator::FILTER_TENT);
+
+	static const int ROWS_PER_BAND = 8;
+	static const int LINEAR_TO_SRGB_SIZE = 4096;
+
+	static float filterRadius(MipMapGenerator::Filter filter)
+	{
+		switch (filter) {
+		case MipMapGenerator::FILTER_BOX: return 0.5f;
+		case MipMapGenerator::FILTER_TENT: return 1.0f;
+		default: return 3.0f;
+		}
+	}
+
+	static float sinc(float x)
+	{
+		if (std::fabs(x) < 1e-6f) {
+			return 1.0f;
+		}
+		x *= 3.14159265358979f;
+		return std::sin(x) / x;
+	}
+
+	// x is measured in destination pixels
+	static float filterWeight(MipMapGenerator::Filter filter, float x)
+	{
+		x = std::fabs(x);
+		switch (filter) {
+		case MipMapGenerator::FILTER_BOX:
+			return (x < 0.5f) ? 1.0f : ((x == 0.5f) ? 0.5f : 0.0f);
+		case MipMapGenerator::FILTER_TENT:
+			return std::max(0.0f, 1.0f - x);
+		default:
+			return (x < 3.0f) ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+		}
+	}
+
+	static const float* srgbToLinearTable()
+	{
+		static std::vector<float> table;
+		static std::once_flag once;
+		std::call_once(once, []() {
+			table.resize(256);
+			for (int i = 0; i < 256; i++) {
+				float c = i / 255.0f;
+				table[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+		});
+		return &table[0];
+	}
+
+	static const unsigned char* linearToSrgbTable()
+	{
+		static std::vector<unsigned char> table;
+		static std::once_flag once;
+		std::call_once(once, []() {
+			table.resize(LINEAR_TO_SRGB_SIZE);
+			for (int i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+				float c = i / (float)(LINEAR_TO_SRGB_SIZE - 1);
+				float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				table[i] = (unsigned char)std::min(255.0f, s * 255.0f + 0.5f);
+			}
+		});
+		return &table[0];
+	}
+
+	// dst[i] = sum over taps of weights[t] * rows[t][i]
+	static void weightedRowSum(const float* const* rows, const float* weights, int numTaps, int length, float* dst)
+	{
+		int i = 0;
+#if defined(MIPMAP_USE_SSE)
+		for (; i + 4 <= length; i += 4) {
+			__m128 sum = _mm_setzero_ps();
+			for (int t = 0; t < numTaps; t++) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(rows[t] + i)));
+			}
+			_mm_storeu_ps(dst + i, sum);
+		}
+#elif defined(MIPMAP_USE_NEON)
+		for (; i + 4 <= length; i += 4) {
+			float32x4_t sum = vdupq_n_f32(0.0f);
+			for (int t = 0; t < numTaps; t++) {
+				sum = vmlaq_n_f32(sum, vld1q_f32(rows[t] + i), weights[t]);
+			}
+			vst1q_f32(dst + i, sum);
+		}
+#endif
+		for (; i < length; i++) {
+			float sum = 0.0f;
+			for (int t = 0; t < numTaps; t++) {
+				sum += weights[t] * rows[t][i];
+			}
+			dst[i] = sum;
+		}
+	}
+
+	void MipMapGenerator::setDefaultFilter(Filter filter)
+	{
+		defaultFilter = filter;
+	}
+
+	MipMapGenerator::Filter MipMapGenerator::getDefaultFilter()
+	{
+		return (Filter)defaultFilter.load();
+	}
+
+	int MipMapGenerator::getNumLevels(int width, int height)
+	{
+		int numLevels = 1;
+		while ((width >> numLevels) > 0 || (height >> numLevels) > 0) {
+			numLevels++;
+		}
+		return numLevels;
+	}
+
+	int MipMapGenerator::getLevelWidth(int width, int level)
+	{
+		return std::max(1, width >> level);
+	}
+
+	int MipMapGenerator::getLevelHeight(int height, int level)
+	{
+		return std::max(1, height >> level);
+	}
+
+	void MipMapGenerator::generate(const unsigned char* pixels, int width, int height, int channels, std::vector<std::vector<unsigned char>> &levels, Filter filter /*=FILTER_TENT*/, bool sRGB /*=true*/, int numLevels /*=0*/)
+	{
+		const int maxLevels = getNumLevels(width, height);
+		if (numLevels <= 0 || numLevels > maxLevels) {
+			numLevels = maxLevels;
+		}
+
+		levels.resize(numLevels);
+		levels[0].assign(pixels, pixels + (size_t)width * height * channels);
+		if (numLevels == 1) {
+			return;
+		}
+
+		std::vector<float> current((size_t)width * height * channels);
+		std::vector<float> next;
+		toLinear(pixels, (size_t)width * height, channels, sRGB, &current[0]);
+
+		int levelWidth = width;
+		int levelHeight = height;
+		for (int level = 1; level < numLevels; level++) {
+			const int nextWidth = getLevelWidth(width, level);
+			const int nextHeight = getLevelHeight(height, level);
+			downsample(current, levelWidth, levelHeight, channels, filter, next, nextWidth, nextHeight);
+
+			levels[level].resize((size_t)nextWidth * nextHeight * channels);
+			fromLinear(&next[0], (size_t)nextWidth * nextHeight, channels, sRGB, &levels[level][0]);
+
+			current.swap(next);
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+		}
+	}
+
+	void MipMapGenerator::computeContributions(int srcSize, int dstSize, Filter filter, std::vector<Contribution> &contributions)
+	{
+		const float scale = srcSize / (float)dstSize;
+		const float support = filterRadius(filter) * scale;
+
+		contributions.resize(dstSize);
+		for (int x = 0; x < dstSize; x++) {
+			Contribution &contribution = contributions[x];
+			contribution.indices.clear();
+			contribution.weights.clear();
+
+			const float center = (x + 0.5f) * scale;
+			const int first = (int)std::floor(center - support);
+			const int last = (int)std::ceil(center + support);
+			float total = 0.0f;
+			for (int i = first; i <= last; i++) {
+				float weight = filterWeight(filter, (i + 0.5f - center) / scale);
+				if (weight == 0.0f) {
+					continue;
+				}
+				contribution.indices.push_back(std::min(std::max(i, 0), srcSize - 1));
+				contribution.weights.push_back(weight);
+				total += weight;
+			}
+
+			for (int i = 0; i < contribution.weights.size(); i++) {
+				contribution.weights[i] /= total;
+			}
+		}
+	}
+
+	void MipMapGenerator::downsample(const std::vector<float> &src, int srcWidth, int srcHeight, int channels, Filter filter, std::vector<float> &dst, int dstWidth, int dstHeight)
+	{
+		std::vector<Contribution> columns;
+		std::vector<Contribution> rows;
+		computeContributions(srcWidth, dstWidth, filter, columns);
+		computeContributions(srcHeight, dstHeight, filter, rows);
+
+		dst.resize((size_t)dstWidth * dstHeight * channels);
+		const int srcStride = srcWidth * channels;
+		const int numBands = (dstHeight + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+
+		ThreadPool::getShared().parallelFor(0, numBands, [&](int band) {
+			std::vector<float> filteredRow(srcStride);
+			std::vector<const float*> rowPointers;
+
+			const int endRow = std::min(dstHeight, (band + 1) * ROWS_PER_BAND);
+			for (int y = band * ROWS_PER_BAND; y < endRow; y++) {
+				// Vertical pass: blend whole source rows, which is contiguous and vectorizes well
+				const Contribution &row = rows[y];
+				rowPointers.resize(row.indices.size());
+				for (int t = 0; t < row.indices.size(); t++) {
+					rowPointers[t] = &src[(size_t)row.indices[t] * srcStride];
+				}
+				weightedRowSum(&rowPointers[0], &row.weights[0], row.indices.size(), srcStride, &filteredRow[0]);
+
+				// Horizontal pass on the blended row
+				float* out = &dst[(size_t)y * dstWidth * channels];
+				for (int x = 0; x < dstWidth; x++) {
+					const Contribution &column = columns[x];
+					for (int c = 0; c < channels; c++) {
+						float sum = 0.0f;
+						for (int t = 0; t < column.indices.size(); t++) {
+							sum += column.weights[t] * filteredRow[column.indices[t] * channels + c];
+						}
+						out[x * channels + c] = sum;
+					}
+				}
+			}
+		});
+	}
+
+	void MipMapGenerator::toLinear(const unsigned char* src, size_t numPixels, int channels, bool sRGB, float* dst)
+	{
+		const float* table = srgbToLinearTable();
+		const int colorChannels = (channels >= 3) ? 3 : 1;
+		for (size_t p = 0; p < numPixels; p++) {
+			for (int c = 0; c < channels; c++) {
+				unsigned char value = src[p * channels + c];
+				dst[p * channels + c] = (sRGB && c < colorChannels) ? table[value] : value / 255.0f;
+			}
+		}
+	}
+
+	void MipMapGenerator::fromLinear(const float* src, size_t numPixels, int channels, bool sRGB, unsigned char* dst)
+	{
+		const unsigned char* table = linearToSrgbTable();
+		const int colorChannels = (channels >= 3) ? 3 : 1;
+		for (size_t p = 0; p < numPixels; p++) {
+			for (int c = 0; c < channels; c++) {
+				// Lanczos lobes can overshoot, clamp before quantizing
+				float value = std::min(1.0f, std::max(0.0f, src[p * channels + c]));
+				if (sRGB && c < colorChannels) {
+					dst[p * channels + c] = table[(int)(value * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+				}
+				else {
+					dst[p * channels + c] = (unsigned char)(value * 255.0f + 0.5f);
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,72 @@
+/*!
+ *  MipMapGenerator.h
+ *
+ * Builds mip chains on the CPU, in parallel on the ThreadPool, instead of with glGenerateMipmap on the GL thread.
+ */
+
+#ifndef MipMapGenerator_h
+#define MipMapGenerator_h
+
+#include <cstddef>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** MipMapGenerator downsamples 8 bit images with 1-4 channels into a full mip chain.
+	Filtering happens in linear light: color channels of sRGB images are converted to linear floats
+	before they are averaged and back to sRGB afterwards, so bright and dark texels mix the way they
+	do on screen and minified textures don't get darker. Alpha is always treated as linear.
+	Each level is filtered from the previous one, kept in float so rounding errors don't pile up.
+	The separable filter runs in bands of rows on the shared ThreadPool and the vertical pass is
+	vectorized with SSE/NEON where available.
+	------------------------------------------------------------------------
+	std::vector<std::vector<unsigned char>> levels;
+	MipMapGenerator::generate(pixels, width, height, 4, levels, MipMapGenerator::FILTER_LANCZOS);
+	for (int i = 0; i < levels.size(); i++) {
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, MipMapGenerator::getLevelWidth(width, i), ...
+	}
+	------------------------------------------------------------------------
+	*/
+	class MipMapGenerator
+	{
+	public:
+
+		enum Filter {
+			FILTER_BOX = 0,    /// Plain 2x2 average, same as most glGenerateMipmap implementations
+			FILTER_TENT = 1,   /// 4x4 triangle filter, smoother with less aliasing
+			FILTER_LANCZOS = 2 /// 12x12 Lanczos-3, keeps the most detail but may ring slightly at hard edges
+		};
+
+		/*!
+		 * Fills levels with the base image (level 0) followed by successively halved levels, down to 1x1 or
+		 * numLevels in total if numLevels > 0. Level i holds getLevelWidth(width, i) * getLevelHeight(height, i) * channels
+		 * tightly packed bytes. If sRGB is true the first three channels (or the first one for 1-2 channel images) are
+		 * treated as sRGB encoded.
+		 */
+		static void generate(const unsigned char* pixels, int width, int height, int channels, std::vector<std::vector<unsigned char>> &levels, Filter filter = FILTER_TENT, bool sRGB = true, int numLevels = 0);
+
+		// Number of levels in a full chain down to 1x1
+		static int getNumLevels(int width, int height);
+		static int getLevelWidth(int width, int level);
+		static int getLevelHeight(int height, int level);
+
+		// Filter used by the texture loaders when mipmaps are requested
+		static void setDefaultFilter(Filter filter);
+		static Filter getDefaultFilter();
+
+	private:
+		// The source samples (clamped at the edges) and weights that make up one destination sample
+		struct Contribution {
+			std::vector<int> indices;
+			std::vector<float> weights;
+		};
+
+		static void computeContributions(int srcSize, int dstSize, Filter filter, std::vector<Contribution> &contributions);
+		static void downsample(const std::vector<float> &src, int srcWidth, int srcHeight, int channels, Filter filter, std::vector<float> &dst, int dstWidth, int dstHeight);
+		static void toLinear(const unsigned char* src, size_t numPixels, int channels, bool sRGB, float* dst);
+		static void fromLinear(const float* src, size_t numPixels, int channels, bool sRGB, unsigned char* dst);
+	};
+
+}
+
+#endif /* MipMapGenerator_h */
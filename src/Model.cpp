@@ -7,6 +7,12 @@
 //
 
 #include "Model.h"
+#include "TextureStreamer.h"
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <limits>
 
 namespace basicgraphics {
 
@@ -35,7 +41,8 @@ namespace basicgraphics {
 		return true;
 	}
 
-	Model::Model(const std::string &filename, const double scale, glm::vec4 materialColor /*=glm::vec4(1.0)*/) : _materialColor(materialColor)
+	Model::Model(const std::string &filename, const double scale, glm::vec4 materialColor /*=glm::vec4(1.0)*/) : _materialColor(materialColor), _boundsMin(std::numeric_limits<float>::max()), _boundsMax(-std::numeric_limits<float>::max()),
+		_importMemory(MemoryAccounting::MODEL_IMPORT)
 	{
 		//TODO not entirely sure this is threadsafe, although assimp says the library is as long as you have separate importer objects
 		Assimp::Logger::LogSeverity severity = Assimp::Logger::NORMAL;
@@ -46,7 +53,8 @@ namespace basicgraphics {
 		importMesh(filename, numIndices, scale);
 	}
 
-	Model::Model(const std::string &fileContents, glm::vec4 materialColor /*=glm::vec4(1.0)*/) : _materialColor(materialColor)
+	Model::Model(const std::string &fileContents, glm::vec4 materialColor /*=glm::vec4(1.0)*/) : _materialColor(materialColor), _boundsMin(std::numeric_limits<float>::max()), _boundsMax(-std::numeric_limits<float>::max()),
+		_importMemory(MemoryAccounting::MODEL_IMPORT)
 	{
 		Assimp::Logger::LogSeverity severity = Assimp::Logger::NORMAL;
 		// Create a logger instance for Console Output
@@ -62,8 +70,43 @@ namespace basicgraphics {
 	}
 
 	void Model::draw(GLSLProgram &shader) {
-		for (int i = 0; i < _meshes.size(); i++) {
-			_meshes[i]->draw(shader);
+		drawPasses(shader, nullptr);
+	}
+
+	void Model::draw(GLSLProgram &shader, const glm::vec3 &eyePosition) {
+		drawPasses(shader, &eyePosition);
+	}
+
+	void Model::drawPasses(GLSLProgram &shader, const glm::vec3* eyePosition) {
+		if (_materialBuffer) {
+			_materialBuffer->bind(shader);
+		}
+
+		// Opaque first so early-Z rejects what the other passes hide, blending last so it sees everything behind it
+		std::vector<Mesh*> &blended = _blended;
+		blended.clear();
+		for (int pass = Texture::ALPHA_OPAQUE; pass <= Texture::ALPHA_CUTOUT; pass++) {
+			for (int i = 0; i < _meshes.size(); i++) {
+				const Texture::AlphaMode mode = _meshes[i]->getAlphaMode();
+				if (mode == pass) {
+					_meshes[i]->draw(shader);
+				}
+				else if (mode == Texture::ALPHA_BLEND && pass == Texture::ALPHA_OPAQUE) {
+					blended.push_back(_meshes[i].get());
+				}
+			}
+		}
+
+		if (eyePosition != nullptr) {
+			const glm::vec3 eye = *eyePosition;
+			std::stable_sort(blended.begin(), blended.end(), [&eye](const Mesh* a, const Mesh* b) {
+				const glm::vec3 da = a->getCenter() - eye;
+				const glm::vec3 db = b->getCenter() - eye;
+				return glm::dot(da, da) > glm::dot(db, db);
+			});
+		}
+		for (int i = 0; i < blended.size(); i++) {
+			blended[i]->draw(shader);
 		}
 	}
 
@@ -73,7 +116,11 @@ namespace basicgraphics {
 			_importer.reset(new Assimp::Importer());
 		}
 
-		const aiScene* scene = _importer->ReadFile(filename, aiProcess_Triangulate);
+		const aiScene* scene;
+		{
+			TRACE_SCOPE_DETAIL("model", "Assimp import", filename.c_str());
+			scene = _importer->ReadFile(filename, aiProcess_Triangulate);
+		}
 
 		// If the import failed, report it
 		if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
@@ -82,7 +129,9 @@ namespace basicgraphics {
 			return;
 		}
 
+		recordImport(filename);
 
+		TRACE_SCOPE("model", "Build meshes");
 		glm::mat4 scaleMat(1.0);
 		scaleMat[0][0] = scale;
 		scaleMat[1][1] = scale;
@@ -90,8 +139,7 @@ namespace basicgraphics {
 
 		this->processNode(scene->mRootNode, scene, scaleMat);
 
-		_importer->FreeScene();
-
+		finishImport(filename);
 	}
 
 	void Model::importMeshFromString(const std::string &fileContents) {
@@ -110,11 +158,33 @@ namespace basicgraphics {
 		}
 
 
+		recordImport("nff model");
+
 		glm::mat4 scaleMat(1.0);
 
 		this->processNode(scene->mRootNode, scene, scaleMat);
 
+		finishImport("nff model");
+	}
+
+	void Model::recordImport(const std::string &tag)
+	{
+		aiMemoryInfo memoryInfo;
+		_importer->GetMemoryRequirements(memoryInfo);
+		_importMemory.setTag(tag);
+		_importMemory.setBytes(memoryInfo.total);
+	}
+
+	void Model::finishImport(const std::string &tag)
+	{
+		for (int i = 0; i < _meshes.size(); i++) {
+			_meshes[i]->setMemoryTag(tag);
+		}
+
+		// The importer keeps its post processing steps and buffers around, nothing needs it once the meshes exist
 		_importer->FreeScene();
+		_importer.reset();
+		_importMemory.setBytes(0);
 	}
 
 	// Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -143,6 +213,42 @@ namespace basicgraphics {
 		std::vector<int>			 cpuIndexArray;
 		std::vector<std::shared_ptr<Texture>> textures;
 
+		appendGeometry(mesh, scaleMat, cpuVertexArray, cpuIndexArray);
+		for (int i = 0; i < cpuVertexArray.size(); i++) {
+			_boundsMin = glm::min(_boundsMin, cpuVertexArray[i].position);
+			_boundsMax = glm::max(_boundsMax, cpuVertexArray[i].position);
+		}
+
+		// Process materials
+		if (scene->HasMaterials())
+		{
+			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+			// We assume a convention for sampler names in the shaders. Each diffuse texture should be named
+			// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+			// Same applies to other texture as the following list summarizes:
+			// Diffuse: texture_diffuseN
+			// Specular: texture_specularN
+			// Normal: texture_normalN
+
+			std::vector<std::shared_ptr<Texture>> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE);
+			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+
+		}
+		_meshTextures.push_back(textures.empty() ? std::shared_ptr<Texture>() : textures[0]);
+
+		const int numVertices = cpuVertexArray.size();
+		const int cpuVertexByteSize = sizeof(Mesh::Vertex) * numVertices;
+		const int cpuIndexByteSize = sizeof(int) * cpuIndexArray.size();
+		std::unique_ptr<Mesh> gpuMesh(new Mesh(textures, GL_TRIANGLES, GL_STATIC_DRAW, cpuVertexByteSize, cpuIndexByteSize, 0, cpuVertexArray, cpuIndexArray.size(), cpuIndexByteSize, &cpuIndexArray[0]));
+		gpuMesh->setMaterialColor(_materialColor);
+		return gpuMesh;
+	}
+
+	void Model::appendGeometry(aiMesh* mesh, const glm::mat4 scaleMat, std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices)
+	{
+		// Indices of later meshes point past the vertices already in the arrays
+		const int firstVertex = vertices.size();
+
 		// Walk through each of the mesh's vertices
 		for (GLuint i = 0; i < mesh->mNumVertices; i++)
 		{
@@ -169,7 +275,7 @@ namespace basicgraphics {
 				vertex.texCoord0 = glm::vec2(0.0f, 0.0f);
 			}
 
-			cpuVertexArray.push_back(vertex);
+			vertices.push_back(vertex);
 		}
 
 		for (GLuint i = 0; i < mesh->mNumFaces; i++)
@@ -177,31 +283,41 @@ namespace basicgraphics {
 			aiFace face = mesh->mFaces[i];
 
 			for (GLuint j = 0; j < face.mNumIndices; j++) {
-				cpuIndexArray.push_back(face.mIndices[j]);
+				indices.push_back(firstVertex + face.mIndices[j]);
 			}
 		}
-		// Process materials
-		if (scene->HasMaterials())
-		{
-			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-			// We assume a convention for sampler names in the shaders. Each diffuse texture should be named
-			// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
-			// Same applies to other texture as the following list summarizes:
-			// Diffuse: texture_diffuseN
-			// Specular: texture_specularN
-			// Normal: texture_normalN
+	}
 
-			std::vector<std::shared_ptr<Texture>> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE);
-			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+	static void appendNodeGeometry(aiNode* node, const aiScene* scene, const glm::mat4 &scaleMat, std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices)
+	{
+		for (GLuint i = 0; i < node->mNumMeshes; i++) {
+			Model::appendGeometry(scene->mMeshes[node->mMeshes[i]], scaleMat, vertices, indices);
+		}
+		for (GLuint i = 0; i < node->mNumChildren; i++) {
+			appendNodeGeometry(node->mChildren[i], scene, scaleMat, vertices, indices);
+		}
+	}
+
+	bool Model::loadGeometry(const std::string &filename, const double scale, std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices)
+	{
+		vertices.clear();
+		indices.clear();
 
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(filename, aiProcess_Triangulate);
+		if (!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+		{
+			std::cerr << "Unable to load model " << filename << ": " << importer.GetErrorString() << std::endl;
+			return false;
 		}
 
-		const int numVertices = cpuVertexArray.size();
-		const int cpuVertexByteSize = sizeof(Mesh::Vertex) * numVertices;
-		const int cpuIndexByteSize = sizeof(int) * cpuIndexArray.size();
-		std::unique_ptr<Mesh> gpuMesh(new Mesh(textures, GL_TRIANGLES, GL_STATIC_DRAW, cpuVertexByteSize, cpuIndexByteSize, 0, cpuVertexArray, cpuIndexArray.size(), cpuIndexByteSize, &cpuIndexArray[0]));
-		gpuMesh->setMaterialColor(_materialColor);
-		return gpuMesh;
+		glm::mat4 scaleMat(1.0);
+		scaleMat[0][0] = scale;
+		scaleMat[1][1] = scale;
+		scaleMat[2][2] = scale;
+
+		appendNodeGeometry(scene->mRootNode, scene, scaleMat, vertices, indices);
+		return true;
 	}
 
 	// Checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -224,13 +340,15 @@ namespace basicgraphics {
 					break;
 				}
 			}
+			Metrics::recordCacheLookup(Metrics::MODEL_TEXTURES, skip);
 			if (!skip)
 			{   // If texture hasn't been loaded already, load it
-				std::shared_ptr<Texture> texture = Texture::create2DTextureFromFile(str.C_Str());
+				// Mipmapped and streamed in the background, the mesh draws with a placeholder until the coarse levels are resident
+				std::shared_ptr<Texture> texture = Texture::create2DTextureFromFileStreaming(str.C_Str(), MipMapGenerator::getDefaultFilter());
 
 				texture->setTexParameteri(GL_TEXTURE_WRAP_S, GL_REPEAT);
 				texture->setTexParameteri(GL_TEXTURE_WRAP_T, GL_REPEAT);
-				texture->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				texture->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 				texture->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 				textures.push_back(texture);
@@ -240,6 +358,41 @@ namespace basicgraphics {
 		return textures;
 	}
 
+	void Model::requestTextureResolution(const glm::mat4 &modelViewProjection, int viewportHeight)
+	{
+		if (_textures.empty()) {
+			return;
+		}
+
+		glm::vec3 center = 0.5f * (_boundsMin + _boundsMax);
+		float radius = 0.5f * glm::length(_boundsMax - _boundsMin);
+		float pixels = TextureStreamer::estimateScreenSize(modelViewProjection, center, radius, viewportHeight);
+		for (int i = 0; i < _textures.size(); i++) {
+			TextureStreamer::getInstance().requestScreenSize(_textures[i].get(), pixels);
+		}
+	}
+
+	void Model::useMaterialBuffer(bool allowBindless /*=true*/)
+	{
+		_materialBuffer.reset(new MaterialBuffer(allowBindless));
+		std::vector<int> indices(_meshes.size());
+		for (int i = 0; i < _meshes.size(); i++) {
+			// Like Mesh::draw, a texture replaces the material color
+			const glm::vec4 color = (_meshTextures[i].get() == nullptr) ? _materialColor : glm::vec4(1.0);
+			indices[i] = _materialBuffer->addMaterial(color, _meshTextures[i]);
+		}
+		// Packs the pixels the streamer already decoded, the files aren't read again
+		_materialBuffer->build();
+
+		for (int i = 0; i < _meshes.size(); i++) {
+			_meshes[i]->setMaterial(_materialBuffer, indices[i]);
+		}
+		// The buffer holds every level of the textures now, so the streamed copies and their CPU mip chains
+		// are released and requestTextureResolution has nothing left to stream
+		_textures.clear();
+		_meshTextures.clear();
+	}
+
     void Model::setMaterialColor(const glm::vec4 &color){
         _materialColor = color;
         for(int i=0; i < _meshes.size(); i++){
@@ -26,6 +26,7 @@
 #include "Mesh.h"
 #include "Texture.h"
 #include "GLSLProgram.h"
+#include "MemoryAccounting.h"
 
 namespace basicgraphics {
 
@@ -57,20 +58,61 @@ namespace basicgraphics {
 		Model(const std::string &fileContents, glm::vec4 materialColor = glm::vec4(1.0));
 		virtual ~Model();
 
+		/*!
+		 * Draws the opaque meshes, then the alpha tested (cutout) ones, then the blended ones, see Texture::AlphaMode.
+		 * With eyePosition (in model space) the blended meshes are sorted back to front, otherwise they keep their order.
+		 */
 		virtual void draw(GLSLProgram &shader);
+		void draw(GLSLProgram &shader, const glm::vec3 &eyePosition);
         
         void setMaterialColor(const glm::vec4 &color);
 
+		/*!
+		 * Tells the TextureStreamer how large the model's textures appear on screen so it can stream in the mip levels they need.
+		 * Call once per frame before draw.
+		 */
+		void requestTextureResolution(const glm::mat4 &modelViewProjection, int viewportHeight);
+
+		/*!
+		 * Moves all mesh materials into one MaterialBuffer so draw binds the textures once for the whole model
+		 * instead of once per mesh. The shader must include resources/Material.glsl. Call after loading; the
+		 * material colors are captured at this point, so later calls to setMaterialColor have no effect.
+		 */
+		void useMaterialBuffer(bool allowBindless = true);
+
+		/*!
+		 * Loads only the vertices and triangle indices of all meshes into one pair of arrays, the way the
+		 * constructor would lay them out but without a GL context or textures. Returns false if the import failed.
+		 */
+		static bool loadGeometry(const std::string &filename, const double scale, std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices);
+
+		// Appends the vertices and indices of one assimp mesh, with the indices offset past the existing vertices
+		static void appendGeometry(aiMesh* mesh, const glm::mat4 scaleMat, std::vector<Mesh::Vertex> &vertices, std::vector<int> &indices);
+
 
 	private:
 
 		glm::vec4 _materialColor;
 
+		// Bounding box of all meshes
+		glm::vec3 _boundsMin;
+		glm::vec3 _boundsMax;
+
 		std::unique_ptr<Assimp::Importer> _importer;
 		std::unique_ptr<ProgressReporter> _reporter;
 		std::vector< std::unique_ptr<Mesh> > _meshes;
 		std::vector< std::shared_ptr<Texture> > _textures;
+		std::vector< std::shared_ptr<Texture> > _meshTextures; // diffuse texture of each mesh, null if none
+		std::shared_ptr<MaterialBuffer> _materialBuffer;
+		std::vector<Mesh*> _blended; // scratch for drawPasses, kept so drawing doesn't allocate
+		MemoryRecord _importMemory; // the Assimp scene while the meshes are built from it, the importer is released afterwards
+
+		// Counts the scene the importer holds under _importMemory
+		void recordImport(const std::string &tag);
+		// Tags the meshes, frees the scene and releases the importer
+		void finishImport(const std::string &tag);
 
+		void drawPasses(GLSLProgram &shader, const glm::vec3* eyePosition);
 		void importMesh(const std::string &filename, int &numIndices, const double scale);
 		void importMeshFromString(const std::string &fileContents);
 		void processNode(aiNode* node, const aiScene* scene, const glm::mat4 scaleMat);
@@ -0,0 +1,278 @@
+//
+//  PathTracer.cpp
+//
+//
+
+#include "PathTracer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace basicgraphics {
+
+	static const float PI = 3.14159265358979f;
+
+	// Decorrelates the seeds of neighboring pixels and passes
+	static unsigned int hashSeed(unsigned int seed)
+	{
+		seed = (seed ^ 61u) ^ (seed >> 16);
+		seed *= 9u;
+		seed = seed ^ (seed >> 4);
+		seed *= 0x27d4eb2du;
+		seed = seed ^ (seed >> 15);
+		return seed == 0 ? 1u : seed;
+	}
+
+	// Uniform in [0, 1), xorshift
+	static float nextRandom(unsigned int &state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Two unit vectors perpendicular to n and each other
+	static void makeBasis(const glm::vec3 &n, glm::vec3 &tangent, glm::vec3 &bitangent)
+	{
+		const float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+		const float a = -1.0f / (sign + n.z);
+		const float b = n.x * n.y * a;
+		tangent = glm::vec3(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+		bitangent = glm::vec3(b, sign + n.y * n.y * a, -n.y);
+	}
+
+	PathTracer::Settings::Settings() : width(1024), height(768), tileSize(16), maxBounces(3), background(0.2f),
+		groundPlane(true), groundColor(0.8f)
+	{
+	}
+
+	void PathTracer::Stats::print(std::ostream &out) const
+	{
+		out << "Path traced " << numSamples << " samples per pixel in " << renderSeconds << " s, "
+			<< numRays << " rays, " << raysPerSecond / 1e6 << " Mrays/s (BVH built in " << buildSeconds * 1000.0 << " ms)" << std::endl;
+	}
+
+	PathTracer::PathTracer(const Settings &settings, const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices) :
+		_settings(settings), _vertices(&vertices), _indices(&indices), _numSamples(0), _renderSeconds(0.0), _numRays(0)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		_bvh.build(vertices, indices);
+		_buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		_groundHeight = _bvh.getBoundsMin().y;
+		_epsilon = 1e-4f * std::max(glm::length(_bvh.getBoundsMax() - _bvh.getBoundsMin()), 1e-3f);
+
+		_inverseViewProjection = glm::mat4(1.0f);
+		_material.ambient = glm::vec3(0.2f);
+		_material.diffuse = glm::vec3(0.8f);
+		_material.specular = glm::vec3(0.0f);
+		_material.specularExponent = 1.0f;
+		_light.position = glm::vec3(5.0f);
+		_light.radius = 0.25f;
+		_light.ambientIntensity = glm::vec3(1.0f);
+		_light.diffuseIntensity = glm::vec3(1.0f);
+		_light.specularIntensity = glm::vec3(1.0f);
+
+		_accumulation.resize((size_t)_settings.width * _settings.height);
+		reset();
+	}
+
+	PathTracer::~PathTracer()
+	{
+	}
+
+	void PathTracer::setCamera(const glm::mat4 &view, const glm::mat4 &projection)
+	{
+		_inverseViewProjection = glm::inverse(projection * view);
+		reset();
+	}
+
+	void PathTracer::setMaterial(const Material &material)
+	{
+		_material = material;
+		reset();
+	}
+
+	void PathTracer::setLight(const Light &light)
+	{
+		_light = light;
+		reset();
+	}
+
+	void PathTracer::reset()
+	{
+		std::fill(_accumulation.begin(), _accumulation.end(), glm::vec3(0.0f));
+		_numSamples = 0;
+	}
+
+	void PathTracer::renderPass()
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		const int tilesX = (_settings.width + _settings.tileSize - 1) / _settings.tileSize;
+		const int tilesY = (_settings.height + _settings.tileSize - 1) / _settings.tileSize;
+		// Each tile is only written by one thread, so the accumulation buffer needs no locking
+		ThreadPool::getShared().parallelFor(0, tilesX * tilesY, [this](int tile) {
+			renderTile(tile);
+		});
+		_numSamples++;
+		_renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void PathTracer::renderTile(int tile)
+	{
+		const int tilesX = (_settings.width + _settings.tileSize - 1) / _settings.tileSize;
+		const int firstX = (tile % tilesX) * _settings.tileSize;
+		const int firstY = (tile / tilesX) * _settings.tileSize;
+		const int lastX = std::min(firstX + _settings.tileSize, _settings.width);
+		const int lastY = std::min(firstY + _settings.tileSize, _settings.height);
+
+		unsigned long long numRays = 0;
+		for (int y = firstY; y < lastY; y++) {
+			for (int x = firstX; x < lastX; x++) {
+				const size_t pixel = (size_t)y * _settings.width + x;
+				unsigned int random = hashSeed((unsigned int)pixel * 9781u + (unsigned int)_numSamples * 6271u + 1u);
+
+				// Jittered within the pixel, so the passes also antialias
+				const float ndcX = 2.0f * (x + nextRandom(random)) / _settings.width - 1.0f;
+				const float ndcY = 1.0f - 2.0f * (y + nextRandom(random)) / _settings.height;
+				const glm::vec4 nearPoint = _inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+				const glm::vec4 farPoint = _inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+				const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+				const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+				_accumulation[pixel] += tracePath(BVH::Ray(origin, direction), random, numRays);
+			}
+		}
+		_numRays += numRays;
+	}
+
+	glm::vec3 PathTracer::tracePath(BVH::Ray ray, unsigned int &random, unsigned long long &numRays) const
+	{
+		glm::vec3 radiance(0.0f);
+		glm::vec3 throughput(1.0f);
+		for (int depth = 0; depth <= _settings.maxBounces; depth++) {
+			Intersection hit;
+			numRays++;
+			if (!intersect(ray, hit)) {
+				radiance += throughput * (depth == 0 ? _settings.background : _light.ambientIntensity);
+				break;
+			}
+
+			const glm::vec3 ambient = hit.ground ? _settings.groundColor : _material.ambient;
+			const glm::vec3 diffuse = hit.ground ? _settings.groundColor : _material.diffuse;
+			const glm::vec3 specular = hit.ground ? glm::vec3(0.0f) : _material.specular;
+			const glm::vec3 origin = hit.position + hit.normal * _epsilon;
+
+			// Direct light from a random point on the disk the light sphere covers, as seen from the hit
+			glm::vec3 toLight = _light.position - hit.position;
+			glm::vec3 tangent, bitangent;
+			makeBasis(glm::normalize(toLight), tangent, bitangent);
+			const float diskRadius = _light.radius * std::sqrt(nextRandom(random));
+			const float diskAngle = 2.0f * PI * nextRandom(random);
+			toLight += (tangent * std::cos(diskAngle) + bitangent * std::sin(diskAngle)) * diskRadius;
+			const glm::vec3 lightDirection = glm::normalize(toLight);
+			const float dotLN = glm::dot(hit.normal, lightDirection);
+			if (dotLN > 0.0f) {
+				numRays++;
+				if (!occluded(BVH::Ray(origin, toLight, 0.0f, 1.0f))) {
+					const glm::vec3 halfway = glm::normalize(lightDirection - glm::normalize(ray.direction));
+					const float dotHN = std::max(glm::dot(hit.normal, halfway), 0.0f);
+					radiance += throughput * (diffuse * _light.diffuseIntensity * dotLN +
+						specular * _light.specularIntensity * std::pow(dotHN, _material.specularExponent));
+				}
+			}
+
+			// Indirect light, cosine distributed so the Lambert term and the pdf cancel
+			const float radius = std::sqrt(nextRandom(random));
+			const float angle = 2.0f * PI * nextRandom(random);
+			makeBasis(hit.normal, tangent, bitangent);
+			const glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) +
+				hit.normal * std::sqrt(std::max(1.0f - radius * radius, 0.0f));
+			throughput *= ambient;
+			ray = BVH::Ray(origin, direction);
+		}
+		return radiance;
+	}
+
+	bool PathTracer::intersect(const BVH::Ray &ray, Intersection &intersection) const
+	{
+		BVH::Ray clipped = ray;
+		BVH::Hit hit;
+		const bool hitModel = _bvh.intersect(clipped, hit);
+		if (hitModel) {
+			clipped.tMax = hit.t;
+		}
+
+		if (_settings.groundPlane && ray.direction.y != 0.0f) {
+			const float t = (_groundHeight - ray.origin.y) / ray.direction.y;
+			if (t > clipped.tMin && t < clipped.tMax) {
+				intersection.position = ray.origin + ray.direction * t;
+				intersection.normal = glm::vec3(0.0f, ray.direction.y < 0.0f ? 1.0f : -1.0f, 0.0f);
+				intersection.ground = true;
+				return true;
+			}
+		}
+		if (!hitModel) {
+			return false;
+		}
+
+		const int* triangle = &(*_indices)[hit.triangle * 3];
+		const glm::vec3 normal = (*_vertices)[triangle[0]].normal * (1.0f - hit.u - hit.v) +
+			(*_vertices)[triangle[1]].normal * hit.u + (*_vertices)[triangle[2]].normal * hit.v;
+		intersection.position = ray.origin + ray.direction * hit.t;
+		intersection.normal = glm::normalize(normal);
+		if (glm::dot(intersection.normal, ray.direction) > 0.0f) {
+			intersection.normal = -intersection.normal;
+		}
+		intersection.ground = false;
+		return true;
+	}
+
+	bool PathTracer::occluded(const BVH::Ray &ray) const
+	{
+		if (_settings.groundPlane && ray.direction.y != 0.0f) {
+			const float t = (_groundHeight - ray.origin.y) / ray.direction.y;
+			if (t > ray.tMin && t < ray.tMax) {
+				return true;
+			}
+		}
+		return _bvh.occluded(ray);
+	}
+
+	std::shared_ptr<PixelReadback::Image> PathTracer::getImage() const
+	{
+		std::shared_ptr<PixelReadback::Image> image(new PixelReadback::Image());
+		image->width = _settings.width;
+		image->height = _settings.height;
+		image->channels = 3;
+		image->pixels.resize((size_t)_settings.width * _settings.height * 3);
+		const float scale = _numSamples > 0 ? 1.0f / _numSamples : 0.0f;
+		for (size_t i = 0; i < _accumulation.size(); i++) {
+			const glm::vec3 color = glm::clamp(_accumulation[i] * scale, 0.0f, 1.0f);
+			image->pixels[i * 3 + 0] = (unsigned char)(color.r * 255.0f + 0.5f);
+			image->pixels[i * 3 + 1] = (unsigned char)(color.g * 255.0f + 0.5f);
+			image->pixels[i * 3 + 2] = (unsigned char)(color.b * 255.0f + 0.5f);
+		}
+		return image;
+	}
+
+	int PathTracer::getNumSamples() const
+	{
+		return _numSamples;
+	}
+
+	PathTracer::Stats PathTracer::getStats() const
+	{
+		Stats stats;
+		stats.numSamples = _numSamples;
+		stats.buildSeconds = _buildSeconds;
+		stats.renderSeconds = _renderSeconds;
+		stats.numRays = _numRays;
+		stats.raysPerSecond = _renderSeconds > 0.0 ? _numRays / _renderSeconds : 0.0;
+		return stats;
+	}
+
+}
@@ -0,0 +1,145 @@
+/*!
+ *  PathTracer.h
+ *
+ * Progressive CPU path tracer for reference renders with soft shadows, ambient occlusion and interreflection.
+ */
+
+#ifndef PathTracer_h
+#define PathTracer_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "BVH.h"
+#include "Mesh.h"
+#include "PixelReadback.h"
+
+namespace basicgraphics {
+
+	/** PathTracer renders the same geometry and lighting terms as the BlinnPhong raster path, but traced
+	through a BVH so the light can cast shadows and light can bounce:
+		- the light is a sphere of Light::radius, sampled once per hit, so its shadows are soft
+		- direct light uses the diffuse and specular (Blinn-Phong) terms, without distance falloff like the shader
+		- the ambient term becomes indirect light: each hit continues in a cosine distributed direction,
+		  weighted by the ambient reflection coefficient. Rays that escape see the ambient intensity, so an
+		  unoccluded surface gets exactly the raster ambient term and creases get darker (ambient occlusion),
+		  while rays that hit something pick up its direct light (interreflection).
+		- an optional ground plane under the model's bounding box catches the shadows
+	Every renderPass() adds one sample per pixel, rendered in tiles on the ThreadPool, so the image can
+	be looked at (or written with FrameCapture::captureImage) while it converges.
+	------------------------------------------------------------------------
+	PathTracer tracer(settings, vertices, indices);
+	tracer.setCamera(view, projection);
+	tracer.setMaterial(material);
+	tracer.setLight(light);
+	for (int i = 0; i < 256; i++) {
+		tracer.renderPass();
+	}
+	capture.captureImage(tracer.getImage());
+	tracer.getStats().print(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class PathTracer
+	{
+	public:
+
+		struct Settings {
+			int width;
+			int height;
+			int tileSize;
+			int maxBounces;        /// indirect bounces after the first hit
+			glm::vec3 background;  /// seen by camera rays that miss everything
+			bool groundPlane;
+			glm::vec3 groundColor; /// diffuse and ambient reflectance of the ground
+
+			Settings();
+		};
+
+		// The "K" terms of BlinnPhong
+		struct Material {
+			glm::vec3 ambient;
+			glm::vec3 diffuse;
+			glm::vec3 specular;
+			float specularExponent;
+		};
+
+		// The "I" terms of BlinnPhong and where the light is
+		struct Light {
+			glm::vec3 position;
+			float radius;
+			glm::vec3 ambientIntensity;
+			glm::vec3 diffuseIntensity;
+			glm::vec3 specularIntensity;
+		};
+
+		struct Stats {
+			int numSamples;           /// per pixel
+			double buildSeconds;      /// of the BVH
+			double renderSeconds;     /// in renderPass
+			unsigned long long numRays; /// camera, shadow and bounce rays
+			double raysPerSecond;
+
+			void print(std::ostream &out) const;
+		};
+
+		// Builds the BVH over indexed triangles (three indices each), the arrays must outlive the tracer
+		PathTracer(const Settings &settings, const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices);
+		virtual ~PathTracer();
+
+		// Changing any of these starts the image over
+		void setCamera(const glm::mat4 &view, const glm::mat4 &projection);
+		void setMaterial(const Material &material);
+		void setLight(const Light &light);
+
+		// Throws away the samples so far
+		void reset();
+
+		// Adds one sample to every pixel
+		void renderPass();
+
+		// The average of the samples so far, clamped to [0, 1], RGB and top row first
+		std::shared_ptr<PixelReadback::Image> getImage() const;
+
+		int getNumSamples() const;
+		Stats getStats() const;
+
+	private:
+		PathTracer(const PathTracer&) {}; // prevent copying
+
+		struct Intersection {
+			glm::vec3 position;
+			glm::vec3 normal; /// shading normal, facing the ray
+			bool ground;
+		};
+
+		Settings _settings;
+		const std::vector<Mesh::Vertex>* _vertices;
+		const std::vector<int>* _indices;
+		BVH _bvh;
+		float _groundHeight;
+		float _epsilon; /// ray offset, relative to the scene size
+
+		glm::mat4 _inverseViewProjection;
+		Material _material;
+		Light _light;
+
+		std::vector<glm::vec3> _accumulation; /// sum of all samples per pixel
+		int _numSamples;
+		double _buildSeconds;
+		double _renderSeconds;
+		std::atomic<unsigned long long> _numRays;
+
+		void renderTile(int tile);
+		glm::vec3 tracePath(BVH::Ray ray, unsigned int &random, unsigned long long &numRays) const;
+		bool intersect(const BVH::Ray &ray, Intersection &intersection) const;
+		bool occluded(const BVH::Ray &ray) const;
+	};
+
+}
+
+#endif /* PathTracer_h */
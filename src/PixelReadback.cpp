@@ -0,0 +1,195 @@
+//
+//  PixelReadback.cpp
+//
+//
+
+#include "PixelReadback.h"
+#include "ThreadPool.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace basicgraphics {
+
+	// Idle buffers kept around for reuse, enough for a few frames of capture in flight
+	static const int MAX_FREE_BUFFERS = 8;
+
+	PixelReadback& PixelReadback::getInstance()
+	{
+		static PixelReadback readback;
+		return readback;
+	}
+
+	void PixelReadback::readFramebuffer(int x, int y, int width, int height, int channels, Callback callback)
+	{
+		assert((channels == 3 || channels == 4) && "Framebuffer readback supports RGB or RGBA");
+
+		std::unique_ptr<PendingRead> read(new PendingRead());
+		read->buffer = acquireBuffer((size_t)width * height * 4);
+		read->width = width;
+		read->height = height;
+		read->channels = channels;
+		read->flip = true;
+		read->callback = callback;
+
+		// RGBA matches the framebuffer layout, so the driver can copy without converting
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer.pbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		startRead(std::move(read));
+	}
+
+	void PixelReadback::readTexture(std::shared_ptr<Texture> texture, Callback callback)
+	{
+		std::unique_ptr<PendingRead> read(new PendingRead());
+		read->buffer = acquireBuffer((size_t)texture->getWidth() * texture->getHeight() * 4);
+		read->width = texture->getWidth();
+		read->height = texture->getHeight();
+		read->channels = 4;
+		read->flip = false; // textures are uploaded top row first
+		read->callback = callback;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer.pbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, texture->getID());
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		startRead(std::move(read));
+	}
+
+	void PixelReadback::startRead(std::unique_ptr<PendingRead> read)
+	{
+		read->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		read->mapped = false;
+		_pending.push_back(std::move(read));
+	}
+
+	void PixelReadback::update()
+	{
+		for (int i = 0; i < _pending.size(); i++) {
+			PendingRead &read = *_pending[i];
+
+			if (!read.mapped) {
+				GLenum status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+				if (status == GL_TIMEOUT_EXPIRED) {
+					continue;
+				}
+				glDeleteSync(read.fence);
+				read.fence = 0;
+
+				const size_t bytes = (size_t)read.width * read.height * 4;
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer.pbo);
+				const unsigned char* mapped = (status == GL_WAIT_FAILED) ? nullptr : (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				if (mapped == nullptr) {
+					std::cerr << "Unable to map a pixel buffer for readback" << std::endl;
+					// Callers count their reads down in the callback, so a failed read still has to call it
+					Callback callback = read.callback;
+					ThreadPool::getShared().enqueue([callback]() { callback(std::shared_ptr<Image>()); });
+					releaseBuffer(read.buffer);
+					_pending.erase(_pending.begin() + i);
+					i--;
+					continue;
+				}
+
+				// Copying out of the mapped buffer is the slow part, do it on a worker and unmap once it is done
+				const int width = read.width;
+				const int height = read.height;
+				const int channels = read.channels;
+				const bool flip = read.flip;
+				Callback callback = read.callback;
+				read.copy = ThreadPool::getShared().enqueue([mapped, width, height, channels, flip, callback]() {
+					std::shared_ptr<Image> image(new Image());
+					image->width = width;
+					image->height = height;
+					image->channels = channels;
+					image->pixels.resize((size_t)width * height * channels);
+
+					for (int y = 0; y < height; y++) {
+						const unsigned char* src = mapped + (size_t)(flip ? height - 1 - y : y) * width * 4;
+						unsigned char* dst = &image->pixels[(size_t)y * width * channels];
+						if (channels == 4) {
+							memcpy(dst, src, (size_t)width * 4);
+						}
+						else {
+							for (int x = 0; x < width; x++) {
+								dst[x * 3 + 0] = src[x * 4 + 0];
+								dst[x * 3 + 1] = src[x * 4 + 1];
+								dst[x * 3 + 2] = src[x * 4 + 2];
+							}
+						}
+					}
+
+					// The callback is queued separately so the buffer can be unmapped without waiting for it
+					ThreadPool::getShared().enqueue([callback, image]() { callback(image); });
+				});
+				read.mapped = true;
+			}
+			else if (read.copy.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, read.buffer.pbo);
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+				releaseBuffer(read.buffer);
+				_pending.erase(_pending.begin() + i);
+				i--;
+			}
+		}
+	}
+
+	int PixelReadback::getNumPending() const
+	{
+		return _pending.size();
+	}
+
+	void PixelReadback::finish()
+	{
+		while (!_pending.empty()) {
+			update();
+			std::this_thread::yield();
+		}
+	}
+
+	PixelReadback::Buffer PixelReadback::acquireBuffer(size_t size)
+	{
+		// Smallest free buffer that is large enough
+		int best = -1;
+		for (int i = 0; i < _freeBuffers.size(); i++) {
+			if (_freeBuffers[i].size >= size && (best == -1 || _freeBuffers[i].size < _freeBuffers[best].size)) {
+				best = i;
+			}
+		}
+		if (best != -1) {
+			Buffer buffer = _freeBuffers[best];
+			_freeBuffers.erase(_freeBuffers.begin() + best);
+			return buffer;
+		}
+
+		Buffer buffer;
+		buffer.size = size;
+		glGenBuffers(1, &buffer.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return buffer;
+	}
+
+	void PixelReadback::releaseBuffer(const Buffer &buffer)
+	{
+		_freeBuffers.push_back(buffer);
+		if (_freeBuffers.size() > MAX_FREE_BUFFERS) {
+			// Drop the smallest, it is the least likely to fit the next read
+			int smallest = 0;
+			for (int i = 1; i < _freeBuffers.size(); i++) {
+				if (_freeBuffers[i].size < _freeBuffers[smallest].size) {
+					smallest = i;
+				}
+			}
+			glDeleteBuffers(1, &_freeBuffers[smallest].pbo);
+			_freeBuffers.erase(_freeBuffers.begin() + smallest);
+		}
+	}
+
+}
@@ -0,0 +1,105 @@
+/*!
+ *  PixelReadback.h
+ *
+ * Reads pixels back from textures and the framebuffer without stalling the GL thread.
+ */
+
+#ifndef PixelReadback_h
+#define PixelReadback_h
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** PixelReadback copies pixels into pixel buffer objects with glReadPixels/glGetTexImage, which
+	return right away, and puts a fence behind each copy. update() checks the fences without waiting.
+	Once a fence has signaled the buffer is mapped, a worker copies (and for the framebuffer flips) the
+	pixels out, and the callback runs on the ThreadPool with the finished image, or with null if the fence
+	or the map failed. Buffers are recycled
+	through a pool so a capture every frame doesn't allocate new ones.
+	------------------------------------------------------------------------
+	PixelReadback::getInstance().readFramebuffer(0, 0, width, height, 3, [](std::shared_ptr<PixelReadback::Image> image) {
+		std::string error;
+		if (image) {
+			ImageWriter::write("screenshot.png", image->width, image->height, image->channels, &image->pixels[0], error);
+		}
+	});
+	------------------------------------------------------------------------
+	*/
+	class PixelReadback
+	{
+	public:
+
+		struct Image {
+			int width;
+			int height;
+			int channels;
+			std::vector<unsigned char> pixels; // top row first, tightly packed
+		};
+
+		// Runs on a worker thread. The image is null if the read failed.
+		typedef std::function<void(std::shared_ptr<Image>)> Callback;
+
+		static PixelReadback& getInstance();
+
+		/*!
+		 * Reads a rectangle of the currently bound read framebuffer (the back buffer for the window).
+		 * channels is 3 (RGB) or 4 (RGBA).
+		 */
+		void readFramebuffer(int x, int y, int width, int height, int channels, Callback callback);
+
+		// Reads level 0 of a GL_TEXTURE_2D as RGBA
+		void readTexture(std::shared_ptr<Texture> texture, Callback callback);
+
+		/*!
+		 * Hands finished reads to the workers and recycles their buffers. Call once per frame on the GL thread.
+		 */
+		void update();
+
+		// Reads whose pixels have not been copied out of their buffer yet
+		int getNumPending() const;
+
+		/*!
+		 * Calls update() until every pending read has been copied out. The callbacks may still be running.
+		 */
+		void finish();
+
+	private:
+		PixelReadback() {};
+		PixelReadback(const PixelReadback&) {}; // prevent copying
+
+		struct Buffer {
+			GLuint pbo;
+			size_t size;
+		};
+
+		struct PendingRead {
+			Buffer buffer;
+			GLsync fence;
+			std::future<void> copy;
+			bool mapped;
+			int width;
+			int height;
+			int channels; // delivered to the callback, the buffer always holds RGBA
+			bool flip; // framebuffer rows are bottom up
+			Callback callback;
+		};
+
+		std::vector<std::unique_ptr<PendingRead>> _pending;
+		std::vector<Buffer> _freeBuffers;
+
+		Buffer acquireBuffer(size_t size);
+		void releaseBuffer(const Buffer &buffer);
+		void startRead(std::unique_ptr<PendingRead> read);
+	};
+
+}
+
+#endif /* PixelReadback_h */
@@ -0,0 +1,175 @@
+//
+//  PosterRenderer.cpp
+//
+//
+
+#include "PosterRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace basicgraphics {
+
+	PosterRenderer::Settings::Settings() : width(16384), height(16384), tileSize(2048), samples(4), maxBandsInFlight(2)
+	{
+	}
+
+	PosterRenderer::PosterRenderer(const Settings &settings) : _settings(settings), _nextBandToWrite(0), _bandsInFlight(0), _writeFailed(false), _readFailed(false)
+	{
+		_settings.maxBandsInFlight = std::max(_settings.maxBandsInFlight, 1);
+	}
+
+	PosterRenderer::~PosterRenderer()
+	{
+		waitForBandsInFlight(0);
+	}
+
+	bool PosterRenderer::render(const std::string &fileName, const glm::mat4 &projection, DrawFunction draw)
+	{
+		const int width = _settings.width;
+		const int height = _settings.height;
+		const int tileSize = std::max(std::min(_settings.tileSize, getMaxTileSize()), 1);
+
+		std::string error;
+		if (!_writer.open(fileName, width, height, CHANNELS, error)) {
+			std::cerr << "PosterRenderer: " << error << std::endl;
+			return false;
+		}
+
+		const int numBands = (height + tileSize - 1) / tileSize;
+		{
+			std::lock_guard<std::mutex> lock(_writeMutex);
+			_bands.clear();
+			_bands.resize(numBands);
+			_nextBandToWrite = 0;
+			_writeFailed = false;
+			_readFailed = false;
+		}
+
+		Framebuffer target(tileSize, tileSize, _settings.samples);
+
+		for (int bandIndex = 0; bandIndex < numBands; bandIndex++) {
+			// Keeps the memory bounded, the oldest band has to be written before a new one is started
+			waitForBandsInFlight(_settings.maxBandsInFlight - 1);
+
+			Band* band = new Band();
+			band->y = bandIndex * tileSize;
+			band->height = std::min(tileSize, height - band->y);
+			band->pixels.resize((size_t)width * band->height * CHANNELS);
+			band->tilesRemaining = (width + tileSize - 1) / tileSize;
+			{
+				std::lock_guard<std::mutex> lock(_writeMutex);
+				_bands[bandIndex].reset(band);
+			}
+			_bandsInFlight++;
+
+			for (int x = 0; x < width; x += tileSize) {
+				const int tileWidth = std::min(tileSize, width - x);
+
+				target.bind();
+				glViewport(0, 0, tileWidth, band->height);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				draw(getTileProjection(projection, width, height, x, band->y, x + tileWidth, band->y + band->height), band->height);
+				target.resolve();
+
+				// The copy into the pixel buffer is queued behind the draw calls, so the next tile can reuse the framebuffer right away
+				target.bindForReading();
+				PixelReadback::getInstance().readFramebuffer(0, 0, tileWidth, band->height, CHANNELS, [this, band, x](std::shared_ptr<PixelReadback::Image> tile) {
+					if (tile) {
+						copyTile(*band, x, *tile);
+					}
+					else {
+						// The band is still written, with the tile left black, so the bands after it are too
+						std::lock_guard<std::mutex> lock(_writeMutex);
+						_readFailed = true;
+					}
+					if (--band->tilesRemaining == 0) {
+						writeFinishedBands();
+					}
+				});
+				PixelReadback::getInstance().update();
+			}
+		}
+		waitForBandsInFlight(0);
+		Framebuffer::unbind();
+
+		if (!_writer.close(error)) {
+			std::cerr << "PosterRenderer: " << error << std::endl;
+			return false;
+		}
+		if (_readFailed) {
+			std::cerr << "PosterRenderer: unable to read back every tile of " << fileName << std::endl;
+			return false;
+		}
+		if (_writeFailed) {
+			std::cerr << "PosterRenderer: unable to write " << fileName << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	glm::mat4 PosterRenderer::getTileProjection(const glm::mat4 &projection, int width, int height, int x0, int y0, int x1, int y1)
+	{
+		// The tile's bounds in normalized device coordinates, y0 and y1 count from the top
+		const float left = 2.0f * x0 / width - 1.0f;
+		const float right = 2.0f * x1 / width - 1.0f;
+		const float top = 1.0f - 2.0f * y0 / height;
+		const float bottom = 1.0f - 2.0f * y1 / height;
+
+		// Scales and shifts clip space so the tile fills [-1, 1]. Applying it after the projection works for
+		// perspective and orthographic projections alike and gives the same off-center frustum as glm::frustum.
+		glm::mat4 crop(1.0f);
+		crop[0][0] = 2.0f / (right - left);
+		crop[1][1] = 2.0f / (top - bottom);
+		crop[3][0] = -(right + left) / (right - left);
+		crop[3][1] = -(top + bottom) / (top - bottom);
+		return crop * projection;
+	}
+
+	int PosterRenderer::getMaxTileSize()
+	{
+		GLint viewportDims[2] = { 0, 0 };
+		glGetIntegerv(GL_MAX_VIEWPORT_DIMS, viewportDims);
+		return std::min(Framebuffer::getMaxSize(), (int)std::min(viewportDims[0], viewportDims[1]));
+	}
+
+	void PosterRenderer::copyTile(Band &band, int x, const PixelReadback::Image &tile)
+	{
+		const size_t bandStride = (size_t)_settings.width * CHANNELS;
+		const size_t tileStride = (size_t)tile.width * CHANNELS;
+		for (int row = 0; row < tile.height; row++) {
+			memcpy(&band.pixels[row * bandStride + (size_t)x * CHANNELS], &tile.pixels[row * tileStride], tileStride);
+		}
+	}
+
+	void PosterRenderer::writeFinishedBands()
+	{
+		// Bands can finish out of order, but the file needs them top to bottom. Whoever finishes a band writes it
+		// and any later bands that were waiting on it.
+		std::lock_guard<std::mutex> lock(_writeMutex);
+		while (_nextBandToWrite < (int)_bands.size()) {
+			Band* band = _bands[_nextBandToWrite].get();
+			if (band == nullptr || band->tilesRemaining > 0) {
+				break;
+			}
+			if (!_writer.writeRows(&band->pixels[0], band->height)) {
+				_writeFailed = true;
+			}
+			_bands[_nextBandToWrite].reset();
+			_nextBandToWrite++;
+			_bandsInFlight--;
+		}
+	}
+
+	void PosterRenderer::waitForBandsInFlight(int maxBands)
+	{
+		// Readback only advances through update(), so keep calling it while waiting on the GL thread
+		while (_bandsInFlight > maxBands) {
+			PixelReadback::getInstance().update();
+			std::this_thread::yield();
+		}
+	}
+
+}
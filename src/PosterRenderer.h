@@ -0,0 +1,109 @@
+/*!
+ *  PosterRenderer.h
+ *
+ * Renders images larger than the GL viewport and framebuffer limits by splitting them into tiles.
+ */
+
+#ifndef PosterRenderer_h
+#define PosterRenderer_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "ImageStreamWriter.h"
+#include "PixelReadback.h"
+
+namespace basicgraphics {
+
+	/** PosterRenderer splits the view volume of a projection into a grid of off-center sub-volumes, one per
+	tile, and renders each tile into the same tile-sized Framebuffer. Tiles are read back through
+	PixelReadback and copied into a band, a row of tiles across the full width. Once every tile of a band
+	is in, a worker appends its rows to the output file with an ImageStreamWriter, so rendering carries on
+	with the next band while the last one is compressed. Only maxBandsInFlight bands are held in memory;
+	a 16384x16384 poster with 2048 pixel tiles needs about 200 MB instead of the 768 MB of the whole image.
+
+	The output is a .png or .raw file. The draw function should not depend on the viewport size for anything
+	other than level of detail, since it sees tile sized viewports.
+	------------------------------------------------------------------------
+	PosterRenderer::Settings settings;
+	settings.width = 16384;
+	settings.height = 16384;
+	PosterRenderer poster(settings);
+	poster.render("poster.png", projection, [&](const glm::mat4 &tileProjection, int tileHeight) {
+		drawScene(view, tileProjection, eyePosition, tileHeight);
+	});
+	------------------------------------------------------------------------
+	*/
+	class PosterRenderer
+	{
+	public:
+
+		struct Settings {
+			int width;
+			int height;
+			int tileSize;         /// clamped to the framebuffer and viewport limits
+			int samples;          /// multisampling of the tile framebuffer
+			int maxBandsInFlight; /// bands being read back or written at once, bounds the memory use
+
+			Settings();
+		};
+
+		// projection covers just the tile, the framebuffer is bound and cleared and the viewport set
+		typedef std::function<void(const glm::mat4 &projection, int viewportHeight)> DrawFunction;
+
+		PosterRenderer(const Settings &settings);
+		virtual ~PosterRenderer();
+
+		/*!
+		 * Renders the whole image as seen through projection and writes it to fileName. Returns once the file
+		 * is complete. Needs a current GL context.
+		 */
+		bool render(const std::string &fileName, const glm::mat4 &projection, DrawFunction draw);
+
+		/*!
+		 * The part of projection that covers the pixels [x0, x1) x [y0, y1) of a width x height image, with y
+		 * counted from the top. Same as glm::frustum (or glm::ortho) with the bounds of the tile.
+		 */
+		static glm::mat4 getTileProjection(const glm::mat4 &projection, int width, int height, int x0, int y0, int x1, int y1);
+
+		// Largest tile the driver can render, the smaller of GL_MAX_RENDERBUFFER_SIZE and GL_MAX_VIEWPORT_DIMS
+		static int getMaxTileSize();
+
+	private:
+		PosterRenderer(const PosterRenderer&) {}; // prevent copying
+
+		struct Band {
+			int y;
+			int height;
+			std::vector<unsigned char> pixels; // width x height RGB, top row first
+			std::atomic<int> tilesRemaining;
+		};
+
+		static const int CHANNELS = 3;
+
+		Settings _settings;
+
+		ImageStreamWriter _writer;
+		std::vector<std::unique_ptr<Band>> _bands;
+		int _nextBandToWrite;
+		std::mutex _writeMutex;
+		std::atomic<int> _bandsInFlight;
+		bool _writeFailed;
+		bool _readFailed;
+
+		void copyTile(Band &band, int x, const PixelReadback::Image &tile);
+		void writeFinishedBands();
+		void waitForBandsInFlight(int maxBands);
+	};
+
+}
+
+#endif /* PosterRenderer_h */
@@ -0,0 +1,501 @@
+//
+//  Profiler.cpp
+//
+//
+
+#include "Profiler.h"
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace basicgraphics {
+
+	// Overlay layout in pixels from the bottom left corner, the graph spans 0 to GRAPH_MILLISECONDS
+	static const float OVERLAY_MARGIN = 10.0f;
+	static const float GRAPH_HEIGHT = 150.0f;
+	static const float GRAPH_MILLISECONDS = 50.0f;
+	static const float STACK_HEIGHT = 10.0f;
+
+	// Colors of the top level scopes in the stacked bar, printStats names them
+	static const int NUM_SCOPE_COLORS = 6;
+	static const glm::vec4 SCOPE_COLORS[NUM_SCOPE_COLORS] = {
+		glm::vec4(0.3f, 0.6f, 1.0f, 1.0f), glm::vec4(1.0f, 0.3f, 0.3f, 1.0f), glm::vec4(1.0f, 1.0f, 0.3f, 1.0f),
+		glm::vec4(0.8f, 0.4f, 1.0f, 1.0f), glm::vec4(0.3f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)
+	};
+	static const char* SCOPE_COLOR_NAMES[NUM_SCOPE_COLORS] = { "blue", "red", "yellow", "purple", "cyan", "white" };
+
+	static const char* OVERLAY_VERTEX_SHADER =
+		"#version 330\n"
+		"layout(location = 0) in vec2 position;\n"
+		"layout(location = 1) in vec4 color;\n"
+		"uniform vec2 viewport_size;\n"
+		"out vec4 interpolated_color;\n"
+		"void main() {\n"
+		"	gl_Position = vec4(position / viewport_size * 2.0 - 1.0, 0.0, 1.0);\n"
+		"	interpolated_color = color;\n"
+		"}\n";
+
+	static const char* OVERLAY_FRAGMENT_SHADER =
+		"#version 330\n"
+		"in vec4 interpolated_color;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	fragColor = interpolated_color;\n"
+		"}\n";
+
+	static bool hasExtension(const char *name)
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (int i = 0; i < numExtensions; i++) {
+			const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (ext != nullptr && strcmp(ext, name) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Profiler::History::add(float milliseconds)
+	{
+		samples[next] = milliseconds;
+		next = (next + 1) % HISTORY_SIZE;
+		count = std::min(count + 1, (int)HISTORY_SIZE);
+	}
+
+	float Profiler::History::latest() const
+	{
+		return get(0);
+	}
+
+	float Profiler::History::get(int age) const
+	{
+		if (age >= count) {
+			return 0.0f;
+		}
+		return samples[(next - 1 - age + HISTORY_SIZE) % HISTORY_SIZE];
+	}
+
+	Profiler::Percentiles Profiler::History::getPercentiles() const
+	{
+		Percentiles percentiles = { 0.0f, 0.0f, 0.0f, 0.0f };
+		if (count == 0) {
+			return percentiles;
+		}
+		std::vector<float> sorted(samples.begin(), samples.begin() + count);
+		std::sort(sorted.begin(), sorted.end());
+		percentiles.p50 = sorted[(count - 1) * 50 / 100];
+		percentiles.p95 = sorted[(count - 1) * 95 / 100];
+		percentiles.p99 = sorted[(count - 1) * 99 / 100];
+		percentiles.max = sorted.back();
+		return percentiles;
+	}
+
+	Profiler& Profiler::getInstance()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	Profiler::Profiler() : _frameNumber(0), _numIgnored(0), _initialized(false), _timerQueries(false), _numDroppedFrames(0),
+		_overlayVisible(false), _overlayVAO(0), _overlayVBO(0)
+	{
+		for (int i = 0; i < QUERY_LATENCY; i++) {
+			_frames[i].number = 0;
+			_frames[i].pending = false;
+			_frames[i].numQueries = 0;
+		}
+	}
+
+	void Profiler::initialize()
+	{
+		GLint major = 0;
+		GLint minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		_timerQueries = major > 3 || (major == 3 && minor >= 3) || hasExtension("GL_ARB_timer_query");
+		if (!_timerQueries) {
+			std::cerr << "Profiler: timer queries are not supported, only timing the CPU" << std::endl;
+		}
+		_initialized = true;
+	}
+
+	void Profiler::beginFrame()
+	{
+		if (!_initialized) {
+			initialize();
+		}
+
+		// This slot was last used QUERY_LATENCY frames ago, its queries should be done by now
+		Frame &frame = _frames[_frameNumber % QUERY_LATENCY];
+		if (frame.pending) {
+			resolve(frame);
+		}
+		frame.number = _frameNumber;
+		frame.records.clear();
+		frame.numQueries = 0;
+		_open.clear();
+
+		openScope("Frame", true);
+	}
+
+	void Profiler::endFrame()
+	{
+		if (_open.empty()) {
+			return;
+		}
+		if (_open.size() > 1) {
+			Frame &frame = _frames[_frameNumber % QUERY_LATENCY];
+			std::cerr << "Profiler: scope " << _scopes[frame.records[_open.back()].scope].path << " was not closed" << std::endl;
+		}
+		while (!_open.empty()) {
+			endScope();
+		}
+		_frames[_frameNumber % QUERY_LATENCY].pending = true;
+		_frameNumber++;
+	}
+
+	int Profiler::findScope(int parent, const char* name)
+	{
+		// Compares the names without making a string, there are only a few dozen scopes
+		for (int i = 0; i < _scopes.size(); i++) {
+			if (_scopes[i].parent == parent && strcmp(_scopes[i].name.c_str(), name) == 0) {
+				return i;
+			}
+		}
+
+		Scope scope;
+		scope.name = name;
+		scope.path = parent < 0 ? scope.name : _scopes[parent].path + "/" + scope.name;
+		scope.parent = parent;
+		scope.depth = parent < 0 ? 0 : _scopes[parent].depth + 1;
+		scope.timedOnGPU = false;
+		_scopes.push_back(scope);
+		return (int)_scopes.size() - 1;
+	}
+
+	void Profiler::beginScope(const char* name, bool gpu /*=true*/)
+	{
+		if (_open.empty()) {
+			// Not inside beginFrame/endFrame, so there is nothing to attribute the time to
+			_numIgnored++;
+			return;
+		}
+		openScope(name, gpu);
+	}
+
+	void Profiler::openScope(const char* name, bool gpu)
+	{
+		Frame &frame = _frames[_frameNumber % QUERY_LATENCY];
+		Record record;
+		record.scope = findScope(_open.empty() ? -1 : frame.records[_open.back()].scope, name);
+		record.name = name;
+		record.cpuMilliseconds = 0.0f;
+		record.query = -1;
+		if (gpu && _timerQueries) {
+			if (frame.numQueries + 2 > (int)frame.queries.size()) {
+				const int first = (int)frame.queries.size();
+				frame.queries.resize(std::max(first * 2, 16));
+				glGenQueries((GLsizei)frame.queries.size() - first, &frame.queries[first]);
+			}
+			record.query = frame.numQueries;
+			frame.numQueries += 2;
+			glQueryCounter(frame.queries[record.query], GL_TIMESTAMP);
+		}
+		record.start = Clock::now();
+
+		frame.records.push_back(record);
+		_open.push_back((int)frame.records.size() - 1);
+	}
+
+	void Profiler::endScope()
+	{
+		if (_numIgnored > 0) {
+			_numIgnored--;
+			return;
+		}
+		if (_open.empty()) {
+			std::cerr << "Profiler: endScope without beginScope" << std::endl;
+			return;
+		}
+
+		Frame &frame = _frames[_frameNumber % QUERY_LATENCY];
+		Record &record = frame.records[_open.back()];
+		_open.pop_back();
+		if (record.query >= 0) {
+			glQueryCounter(frame.queries[record.query + 1], GL_TIMESTAMP);
+		}
+		const Clock::time_point end = Clock::now();
+		record.cpuMilliseconds = std::chrono::duration<float, std::milli>(end - record.start).count();
+#ifdef BASICGRAPHICS_TRACING
+		Tracer::getInstance().addEvent("frame", record.name, nullptr, record.start, end);
+#endif
+	}
+
+	void Profiler::resolve(Frame &frame)
+	{
+		frame.pending = false;
+
+		// Timestamps complete in order and the frame's end is the last one issued, so if it is there they all are
+		bool gpuAvailable = false;
+		if (!frame.records.empty() && frame.records[0].query >= 0) {
+			GLint available = 0;
+			glGetQueryObjectiv(frame.queries[frame.records[0].query + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			gpuAvailable = available != 0;
+			if (!gpuAvailable) {
+				_numDroppedFrames++;
+			}
+		}
+
+		// A scope opened more than once in the frame counts with its total time
+		_resolveOrder.clear();
+		_resolveTotals.resize(_scopes.size());
+		_resolveSeen.resize(_scopes.size(), false);
+		for (int i = 0; i < frame.records.size(); i++) {
+			const Record &record = frame.records[i];
+			float gpuMilliseconds = -1.0f;
+			if (gpuAvailable && record.query >= 0) {
+				GLuint64 begin = 0;
+				GLuint64 end = 0;
+				glGetQueryObjectui64v(frame.queries[record.query], GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(frame.queries[record.query + 1], GL_QUERY_RESULT, &end);
+				gpuMilliseconds = end > begin ? (float)((end - begin) / 1e6) : 0.0f;
+			}
+
+			std::pair<float, float> &total = _resolveTotals[record.scope];
+			if (!_resolveSeen[record.scope]) {
+				_resolveSeen[record.scope] = true;
+				_resolveOrder.push_back(record.scope);
+				total = std::make_pair(record.cpuMilliseconds, gpuMilliseconds);
+			}
+			else {
+				total.first += record.cpuMilliseconds;
+				if (gpuMilliseconds >= 0.0f) {
+					total.second = std::max(total.second, 0.0f) + gpuMilliseconds;
+				}
+			}
+		}
+
+		for (int i = 0; i < _resolveOrder.size(); i++) {
+			Scope &scope = _scopes[_resolveOrder[i]];
+			const std::pair<float, float> &time = _resolveTotals[_resolveOrder[i]];
+			_resolveSeen[_resolveOrder[i]] = false;
+			scope.cpu.add(time.first);
+			if (time.second >= 0.0f) {
+				scope.gpu.add(time.second);
+				scope.timedOnGPU = true;
+			}
+
+			if (_csv.is_open()) {
+				_csv << frame.number << "," << scope.path << "," << scope.depth << "," << time.first << ",";
+				if (time.second >= 0.0f) {
+					_csv << time.second;
+				}
+				_csv << "\n";
+			}
+			if (_listener) {
+				_listener(frame.number, scope.path, scope.depth, time.first, time.second);
+			}
+		}
+	}
+
+	std::vector<Profiler::ScopeStats> Profiler::getStats() const
+	{
+		std::vector<ScopeStats> stats;
+		for (int i = 0; i < _scopes.size(); i++) {
+			const Scope &scope = _scopes[i];
+			ScopeStats scopeStats;
+			scopeStats.name = scope.name;
+			scopeStats.depth = scope.depth;
+			scopeStats.numSamples = scope.cpu.count;
+			scopeStats.cpu = scope.cpu.getPercentiles();
+			scopeStats.gpu = scope.timedOnGPU;
+			scopeStats.gpuTime = scope.gpu.getPercentiles();
+			stats.push_back(scopeStats);
+		}
+		return stats;
+	}
+
+	void Profiler::printStats(std::ostream &out) const
+	{
+		const std::vector<ScopeStats> stats = getStats();
+		out << "Scope (ms over the last " << HISTORY_SIZE << " frames)        CPU p50    p95    p99    max   GPU p50    p95    p99    max" << std::endl;
+		int topLevel = 0;
+		for (int i = 0; i < stats.size(); i++) {
+			const ScopeStats &scope = stats[i];
+			std::string name = std::string(scope.depth * 2, ' ') + scope.name;
+			if (scope.depth == 1) {
+				name += std::string(" (") + SCOPE_COLOR_NAMES[topLevel++ % NUM_SCOPE_COLORS] + ")";
+			}
+			out << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(8) << scope.cpu.p50 << std::setw(7) << scope.cpu.p95 << std::setw(7) << scope.cpu.p99 << std::setw(7) << scope.cpu.max;
+			if (scope.gpu) {
+				out << std::setw(10) << scope.gpuTime.p50 << std::setw(7) << scope.gpuTime.p95 << std::setw(7) << scope.gpuTime.p99 << std::setw(7) << scope.gpuTime.max;
+			}
+			out << std::endl;
+		}
+		out.unsetf(std::ios::floatfield);
+		if (_numDroppedFrames > 0) {
+			out << _numDroppedFrames << " frames had no GPU times, their queries were not done " << QUERY_LATENCY << " frames later" << std::endl;
+		}
+	}
+
+	bool Profiler::setCSVFile(const std::string &fileName)
+	{
+		_csv.close();
+		_csv.clear();
+		_csv.open(fileName.c_str());
+		if (!_csv.is_open()) {
+			std::cerr << "Profiler: could not open " << fileName << std::endl;
+			return false;
+		}
+		_csv << "frame,scope,depth,cpu_ms,gpu_ms\n";
+		return true;
+	}
+
+	void Profiler::setListener(const Listener &listener)
+	{
+		_listener = listener;
+	}
+
+	void Profiler::finish()
+	{
+		// Collect the frames still in flight, waiting is fine now
+		if (_initialized) {
+			glFinish();
+			for (int i = 0; i < QUERY_LATENCY; i++) {
+				Frame &frame = _frames[(_frameNumber + i) % QUERY_LATENCY];
+				if (frame.pending) {
+					resolve(frame);
+				}
+			}
+			for (int i = 0; i < QUERY_LATENCY; i++) {
+				if (!_frames[i].queries.empty()) {
+					glDeleteQueries((GLsizei)_frames[i].queries.size(), &_frames[i].queries[0]);
+					_frames[i].queries.clear();
+				}
+			}
+		}
+		if (_overlayVAO != 0) {
+			glDeleteVertexArrays(1, &_overlayVAO);
+			glDeleteBuffers(1, &_overlayVBO);
+			_overlayVAO = 0;
+			_overlayVBO = 0;
+		}
+		_overlayShader.reset();
+		_csv.close();
+		_initialized = false;
+	}
+
+	void Profiler::setOverlayVisible(bool visible)
+	{
+		_overlayVisible = visible;
+	}
+
+	bool Profiler::isOverlayVisible() const
+	{
+		return _overlayVisible;
+	}
+
+	void Profiler::addRectangle(float x0, float y0, float x1, float y1, const glm::vec4 &color)
+	{
+		const float corners[6][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y0 }, { x1, y1 }, { x0, y1 } };
+		for (int i = 0; i < 6; i++) {
+			_overlayVertices.push_back(corners[i][0]);
+			_overlayVertices.push_back(corners[i][1]);
+			_overlayVertices.push_back(color.r);
+			_overlayVertices.push_back(color.g);
+			_overlayVertices.push_back(color.b);
+			_overlayVertices.push_back(color.a);
+		}
+	}
+
+	void Profiler::drawOverlay(int viewportWidth, int viewportHeight)
+	{
+		if (!_overlayVisible || _scopes.empty()) {
+			return;
+		}
+
+		if (_overlayVAO == 0) {
+			std::unique_ptr<GLSLProgram> shader(new GLSLProgram());
+			try {
+				shader->compileShader(OVERLAY_VERTEX_SHADER, GLSLShader::VERTEX, "profiler overlay");
+				shader->compileShader(OVERLAY_FRAGMENT_SHADER, GLSLShader::FRAGMENT, "profiler overlay");
+				shader->link();
+			}
+			catch (GLSLProgramException &e) {
+				std::cerr << "Profiler: " << e.what() << std::endl;
+				_overlayVisible = false;
+				return;
+			}
+			_overlayShader = std::move(shader);
+
+			glGenVertexArrays(1, &_overlayVAO);
+			glBindVertexArray(_overlayVAO);
+			glGenBuffers(1, &_overlayVBO);
+			glBindBuffer(GL_ARRAY_BUFFER, _overlayVBO);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(2 * sizeof(float)));
+		}
+
+		// The frame is scope 0, its top level scopes are stacked above the graph
+		const Scope &frame = _scopes[0];
+		const float width = 2.0f * HISTORY_SIZE;
+		const float left = OVERLAY_MARGIN;
+		const float bottom = OVERLAY_MARGIN;
+		const float top = bottom + GRAPH_HEIGHT;
+		const float scale = GRAPH_HEIGHT / GRAPH_MILLISECONDS;
+
+		_overlayVertices.clear();
+		addRectangle(left - 4.0f, bottom - 4.0f, left + width + 4.0f, top + STACK_HEIGHT + 8.0f, glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+		// Newest frame on the right, a CPU and a GPU bar per frame
+		for (int age = 0; age < frame.cpu.count; age++) {
+			const float x = left + width - 2.0f * (age + 1);
+			addRectangle(x, bottom, x + 1.0f, bottom + std::min(frame.cpu.get(age) * scale, GRAPH_HEIGHT), glm::vec4(0.3f, 0.9f, 0.3f, 0.9f));
+			if (age < frame.gpu.count) {
+				addRectangle(x + 1.0f, bottom, x + 2.0f, bottom + std::min(frame.gpu.get(age) * scale, GRAPH_HEIGHT), glm::vec4(1.0f, 0.6f, 0.1f, 0.9f));
+			}
+		}
+		addRectangle(left, bottom + 16.7f * scale, left + width, bottom + 16.7f * scale + 1.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.5f));
+		addRectangle(left, bottom + 33.3f * scale, left + width, bottom + 33.3f * scale + 1.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.5f));
+
+		// Median CPU time of each top level scope, on the same scale as the graph but across
+		float x = left;
+		int topLevel = 0;
+		for (int i = 0; i < _scopes.size(); i++) {
+			if (_scopes[i].depth != 1) {
+				continue;
+			}
+			const float end = std::min(x + _scopes[i].cpu.getPercentiles().p50 * width / GRAPH_MILLISECONDS, left + width);
+			addRectangle(x, top + 4.0f, end, top + 4.0f + STACK_HEIGHT, SCOPE_COLORS[topLevel++ % NUM_SCOPE_COLORS]);
+			x = end;
+		}
+
+		const GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		const GLboolean blend = glIsEnabled(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		_overlayShader->use();
+		_overlayShader->setUniform("viewport_size", glm::vec2(viewportWidth, viewportHeight));
+		glBindVertexArray(_overlayVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, _overlayVBO);
+		glBufferData(GL_ARRAY_BUFFER, _overlayVertices.size() * sizeof(float), &_overlayVertices[0], GL_STREAM_DRAW);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(_overlayVertices.size() / 6));
+		glBindVertexArray(0);
+
+		if (depthTest) {
+			glEnable(GL_DEPTH_TEST);
+		}
+		if (!blend) {
+			glDisable(GL_BLEND);
+		}
+	}
+
+}
@@ -0,0 +1,208 @@
+/*!
+ *  Profiler.h
+ *
+ * Measures where the frame time goes, on the CPU and on the GPU, and draws it as an overlay.
+ */
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "GLSLProgram.h"
+
+namespace basicgraphics {
+
+	/** Profiler times named scopes on the CPU with a steady clock and on the GPU with timer queries.
+	Scopes nest, a scope is identified by its name and the scope it was opened in, and BaseApp::run wraps
+	every frame in a "Frame" scope. The GPU results of a frame are read QUERY_LATENCY frames later, once
+	GL_QUERY_RESULT_AVAILABLE says they are there, so reading them never waits for the GPU. If they are
+	still not there the frame's GPU times are dropped rather than waited for.
+	Every scope keeps its last HISTORY_SIZE times to report percentiles. The overlay graphs the CPU
+	(green) and GPU (orange) time of the last HISTORY_SIZE frames against 16.7 and 33.3 ms lines, with
+	the median time of each top level scope stacked above it. With setCSVFile every scope of every frame
+	is written as a row of frame,scope,depth,cpu_ms,gpu_ms.
+	Scopes may only be opened on the GL thread, between beginFrame and endFrame. Their names should be
+	string literals, they are also recorded by the Tracer.
+	------------------------------------------------------------------------
+	void MyApp::onRenderGraphics() {
+		ProfileScope scope("Shadows");
+		drawShadows();
+	}
+	...
+	Profiler::getInstance().printStats(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class Profiler
+	{
+	public:
+
+		static const int HISTORY_SIZE = 240;
+		static const int QUERY_LATENCY = 3; // frames between issuing timer queries and reading them
+
+		struct Percentiles {
+			float p50;
+			float p95;
+			float p99;
+			float max;
+		};
+
+		// Times are in milliseconds, over the last HISTORY_SIZE frames the scope was open in
+		struct ScopeStats {
+			std::string name;
+			int depth;        /// 0 for the frame, 1 for scopes directly in the frame, ...
+			int numSamples;
+			Percentiles cpu;
+			bool gpu;         /// false if the scope is not timed on the GPU or timer queries are not supported
+			Percentiles gpuTime;
+		};
+
+		static Profiler& getInstance();
+
+		// Called by BaseApp::run around each frame
+		void beginFrame();
+		void endFrame();
+
+		/*!
+		 * Opens a scope inside the innermost open one. With gpu the commands issued until endScope are
+		 * timed as well, leave it off for scopes that only wait, like swapping buffers.
+		 */
+		void beginScope(const char* name, bool gpu = true);
+		void endScope();
+
+		// In the order the scopes were first opened, which keeps children after their parents
+		std::vector<ScopeStats> getStats() const;
+		void printStats(std::ostream &out) const;
+
+		/*!
+		 * Writes every scope of every frame to fileName as it is measured, until finish(). Returns false if the file can't be opened.
+		 */
+		bool setCSVFile(const std::string &fileName);
+
+		// Gets the same rows as the CSV, gpuMilliseconds is -1 if the scope has no GPU time in that frame
+		typedef std::function<void(int frame, const std::string &path, int depth, float cpuMilliseconds, float gpuMilliseconds)> Listener;
+
+		/*!
+		 * Calls listener for every scope of every frame as it is measured, e.g. to keep all frame times of a benchmark. Pass nullptr to stop.
+		 */
+		void setListener(const Listener &listener);
+
+		// Closes the CSV file and frees the GL objects, call before the context goes away
+		void finish();
+
+		void setOverlayVisible(bool visible);
+		bool isOverlayVisible() const;
+
+		/*!
+		 * Draws the overlay into the bottom left of the bound framebuffer if it is visible. Called by BaseApp::run.
+		 */
+		void drawOverlay(int viewportWidth, int viewportHeight);
+
+	private:
+		Profiler();
+		Profiler(const Profiler&) {}; // prevent copying
+
+		typedef std::chrono::steady_clock Clock;
+
+		// A ring of the last HISTORY_SIZE times
+		struct History {
+			std::vector<float> samples;
+			int next;
+			int count;
+
+			History() : samples(HISTORY_SIZE, 0.0f), next(0), count(0) {}
+			void add(float milliseconds);
+			float latest() const;
+			float get(int age) const; // 0 is the latest
+			Percentiles getPercentiles() const;
+		};
+
+		struct Scope {
+			std::string name;
+			std::string path; // e.g. Frame/Render/Scene, for the CSV
+			int parent; // -1 for the frame
+			int depth;
+			History cpu;
+			History gpu;
+			bool timedOnGPU;
+		};
+
+		// One open or closed scope in a frame
+		struct Record {
+			int scope;
+			const char* name;
+			Clock::time_point start;
+			float cpuMilliseconds;
+			int query; // first of its two timestamp queries, -1 if not timed on the GPU
+		};
+
+		// Everything measured in one frame, reused every QUERY_LATENCY frames
+		struct Frame {
+			int number;
+			bool pending; // the GPU results are not read yet
+			std::vector<Record> records;
+			std::vector<GLuint> queries;
+			int numQueries;
+		};
+
+		std::vector<Scope> _scopes;
+		Frame _frames[QUERY_LATENCY];
+		int _frameNumber;
+		std::vector<int> _open; // records of the current frame that are still open, innermost last
+		// Scratch for resolve, kept so that steady state frames don't allocate
+		std::vector<int> _resolveOrder; // scopes in the order they were first opened
+		std::vector<std::pair<float, float> > _resolveTotals; // cpu and gpu time by scope
+		std::vector<bool> _resolveSeen; // by scope
+		int _numIgnored; // scopes opened outside of a frame, e.g. by an offline render
+
+		bool _initialized;
+		bool _timerQueries; // GL 3.3 or GL_ARB_timer_query
+		int _numDroppedFrames;
+
+		std::ofstream _csv;
+		Listener _listener;
+
+		bool _overlayVisible;
+		std::unique_ptr<GLSLProgram> _overlayShader;
+		GLuint _overlayVAO;
+		GLuint _overlayVBO;
+		std::vector<float> _overlayVertices;
+
+		void initialize();
+		void resolve(Frame &frame);
+		int findScope(int parent, const char* name);
+		void openScope(const char* name, bool gpu);
+		void addRectangle(float x0, float y0, float x1, float y1, const glm::vec4 &color);
+	};
+
+	/** Opens a Profiler scope until it goes out of scope.
+	------------------------------------------------------------------------
+	{
+		ProfileScope scope("Bloom");
+		drawBloom();
+	}
+	------------------------------------------------------------------------
+	*/
+	class ProfileScope
+	{
+	public:
+		ProfileScope(const char* name, bool gpu = true) { Profiler::getInstance().beginScope(name, gpu); }
+		~ProfileScope() { Profiler::getInstance().endScope(); }
+
+	private:
+		ProfileScope(const ProfileScope&) {}; // prevent copying
+	};
+
+}
+
+#endif /* Profiler_h */
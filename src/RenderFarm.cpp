@@ -0,0 +1,408 @@
+//
+//  RenderFarm.cpp
+//
+//
+
+#include "RenderFarm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace basicgraphics {
+
+	RenderFarm::Settings::Settings() : numWorkers(4), numFrames(120), minChunkSize(2), maxRestarts(3), chunkTimeoutSeconds(600.0),
+		directory("turntable"), prefix("frame"), format(FrameCapture::FORMAT_PNG)
+	{
+	}
+
+	void RenderFarm::Report::print(std::ostream &out) const
+	{
+		out << std::fixed << std::setprecision(2);
+		out << "Render farm: " << numFrames << " frames in " << totalSeconds << " s, " << framesPerSecond << " fps";
+		if (numMissing > 0) {
+			out << ", " << numMissing << " missing";
+		}
+		out << std::endl;
+		out << "  worker  frames  chunks  restarts  busy s   draw ms  readback ms  encode ms  stall ms  (per frame)" << std::endl;
+		for (size_t i = 0; i < workers.size(); i++) {
+			const WorkerStats &stats = workers[i];
+			const double frames = std::max(stats.numFrames, 1);
+			out << "  " << std::setw(6) << i << "  " << std::setw(6) << stats.numFrames << "  " << std::setw(6) << stats.numChunks
+				<< "  " << std::setw(8) << stats.numRestarts << "  " << std::setw(7) << stats.busySeconds
+				<< "  " << std::setw(7) << 1000.0 * stats.drawSeconds / frames << "  " << std::setw(11) << 1000.0 * stats.readbackSeconds / frames
+				<< "  " << std::setw(9) << 1000.0 * stats.encodeSeconds / frames << "  " << std::setw(8) << 1000.0 * stats.stallSeconds / frames << std::endl;
+		}
+		out << std::defaultfloat;
+	}
+
+	RenderFarm::RenderFarm(const Settings &settings) : _settings(settings), _nextFrame(0), _numFramesDone(0)
+	{
+		_settings.numWorkers = std::max(_settings.numWorkers, 1);
+		_settings.minChunkSize = std::max(_settings.minChunkSize, 1);
+	}
+
+	RenderFarm::~RenderFarm()
+	{
+		for (size_t i = 0; i < _workers.size(); i++) {
+			stopWorker(_workers[i], true);
+		}
+	}
+
+	bool RenderFarm::nextChunk(Chunk &chunk)
+	{
+		// Chunks that failed go first, they are usually what everybody else ends up waiting for
+		if (!_failedChunks.empty()) {
+			chunk = _failedChunks.front();
+			_failedChunks.pop_front();
+			return true;
+		}
+		const int remaining = _settings.numFrames - _nextFrame;
+		if (remaining <= 0) {
+			return false;
+		}
+		chunk.firstFrame = _nextFrame;
+		chunk.count = std::min(remaining, std::max(_settings.minChunkSize, remaining / (2 * _settings.numWorkers)));
+		_nextFrame += chunk.count;
+		return true;
+	}
+
+	void RenderFarm::assignChunk(Worker &worker)
+	{
+		if (worker.busy || worker.pid <= 0 || !nextChunk(worker.chunk)) {
+			return;
+		}
+		std::ostringstream command;
+		command << "render " << worker.chunk.firstFrame << " " << worker.chunk.count;
+		worker.busy = true;
+		worker.chunkStart = Clock::now();
+		if (!writeLine(worker.commandFd, command.str())) {
+			handleFailure(worker);
+		}
+	}
+
+	void RenderFarm::handleFailure(Worker &worker)
+	{
+		if (worker.busy) {
+			_failedChunks.push_back(worker.chunk);
+			worker.busy = false;
+		}
+		stopWorker(worker, true);
+
+		if (worker.stats.numRestarts < _settings.maxRestarts) {
+			worker.stats.numRestarts++;
+			std::cerr << "RenderFarm: restarting worker " << (&worker - &_workers[0]) << std::endl;
+			if (startWorker(worker)) {
+				assignChunk(worker);
+			}
+		}
+		else {
+			std::cerr << "RenderFarm: worker " << (&worker - &_workers[0]) << " failed too often, giving up on it" << std::endl;
+		}
+	}
+
+#ifndef _WIN32
+
+	bool RenderFarm::startWorker(Worker &worker)
+	{
+		// commandPipe carries commands to the worker, resultPipe the answers back
+		int commandPipe[2], resultPipe[2];
+		if (pipe(commandPipe) != 0) {
+			return false;
+		}
+		if (pipe(resultPipe) != 0) {
+			close(commandPipe[0]);
+			close(commandPipe[1]);
+			return false;
+		}
+		// Only the worker's own ends may survive exec, otherwise a worker that dies goes unnoticed because a
+		// sibling still holds its pipe open
+		const int fds[4] = { commandPipe[0], commandPipe[1], resultPipe[0], resultPipe[1] };
+		for (int i = 0; i < 4; i++) {
+			fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		}
+
+		std::vector<std::string> arguments;
+		arguments.push_back(_settings.executable);
+		arguments.insert(arguments.end(), _settings.arguments.begin(), _settings.arguments.end());
+		arguments.push_back("--farm-worker");
+		arguments.push_back(std::to_string(commandPipe[0]));
+		arguments.push_back(std::to_string(resultPipe[1]));
+		std::vector<char*> argv;
+		for (size_t i = 0; i < arguments.size(); i++) {
+			argv.push_back(&arguments[i][0]);
+		}
+		argv.push_back(nullptr);
+
+		int pid = fork();
+		if (pid == 0) {
+			fcntl(commandPipe[0], F_SETFD, 0);
+			fcntl(resultPipe[1], F_SETFD, 0);
+			execv(argv[0], &argv[0]);
+			_exit(127);
+		}
+
+		close(commandPipe[0]);
+		close(resultPipe[1]);
+		if (pid < 0) {
+			close(commandPipe[1]);
+			close(resultPipe[0]);
+			return false;
+		}
+		worker.pid = pid;
+		worker.commandFd = commandPipe[1];
+		worker.resultFd = resultPipe[0];
+		worker.received.clear();
+		worker.busy = false;
+		return true;
+	}
+
+	void RenderFarm::stopWorker(Worker &worker, bool kill)
+	{
+		if (worker.pid <= 0) {
+			return;
+		}
+		if (kill) {
+			::kill(worker.pid, SIGKILL);
+		}
+		else {
+			writeLine(worker.commandFd, "quit");
+		}
+		close(worker.commandFd);
+		close(worker.resultFd);
+		waitpid(worker.pid, NULL, 0);
+		worker.pid = -1;
+		worker.commandFd = worker.resultFd = -1;
+	}
+
+	bool RenderFarm::writeLine(int fd, const std::string &line)
+	{
+		const std::string text = line + "\n";
+		size_t written = 0;
+		while (written < text.size()) {
+			ssize_t count = write(fd, text.c_str() + written, text.size() - written);
+			if (count <= 0) {
+				return false;
+			}
+			written += count;
+		}
+		return true;
+	}
+
+	bool RenderFarm::readResults(Worker &worker)
+	{
+		char buffer[1024];
+		ssize_t count = read(worker.resultFd, buffer, sizeof(buffer));
+		if (count <= 0) {
+			return false; // the worker exited or crashed
+		}
+		worker.received.append(buffer, count);
+
+		size_t end;
+		while ((end = worker.received.find('\n')) != std::string::npos) {
+			std::istringstream line(worker.received.substr(0, end));
+			worker.received.erase(0, end + 1);
+
+			std::string message;
+			int firstFrame, numFrames;
+			double draw, readback, encode, stall;
+			line >> message >> firstFrame >> numFrames >> draw >> readback >> encode >> stall;
+			if (!line || message != "done" || !worker.busy || firstFrame != worker.chunk.firstFrame) {
+				std::cerr << "RenderFarm: unexpected message from worker " << (&worker - &_workers[0]) << std::endl;
+				continue;
+			}
+
+			numFrames = std::min(std::max(numFrames, 0), worker.chunk.count);
+			WorkerStats &stats = worker.stats;
+			stats.numFrames += numFrames;
+			stats.numChunks++;
+			stats.busySeconds += std::chrono::duration<double>(Clock::now() - worker.chunkStart).count();
+			stats.drawSeconds += draw;
+			stats.readbackSeconds += readback;
+			stats.encodeSeconds += encode;
+			stats.stallSeconds += stall;
+			_numFramesDone += numFrames;
+			worker.busy = false;
+
+			// A short chunk is a failure: the rest goes back in the queue and the worker is restarted, which counts
+			// against maxRestarts, so a worker that keeps coming back short can't keep run() polling forever
+			if (numFrames < worker.chunk.count) {
+				std::cerr << "RenderFarm: worker " << (&worker - &_workers[0]) << " rendered " << numFrames << " of " << worker.chunk.count << " frames" << std::endl;
+				Chunk rest;
+				rest.firstFrame = worker.chunk.firstFrame + numFrames;
+				rest.count = worker.chunk.count - numFrames;
+				_failedChunks.push_back(rest);
+				handleFailure(worker);
+				return true;
+			}
+			assignChunk(worker);
+		}
+		return true;
+	}
+
+	RenderFarm::Report RenderFarm::run()
+	{
+		// Writing to a worker that just died must fail with EPIPE instead of killing the coordinator
+		signal(SIGPIPE, SIG_IGN);
+
+		const Clock::time_point start = Clock::now();
+		_nextFrame = 0;
+		_numFramesDone = 0;
+		_failedChunks.clear();
+
+		_workers.resize(_settings.numWorkers);
+		for (size_t i = 0; i < _workers.size(); i++) {
+			Worker &worker = _workers[i];
+			worker.pid = -1;
+			worker.commandFd = worker.resultFd = -1;
+			worker.busy = false;
+			worker.stats = WorkerStats();
+			if (startWorker(worker)) {
+				assignChunk(worker);
+			}
+			else {
+				std::cerr << "RenderFarm: unable to start " << _settings.executable << std::endl;
+			}
+		}
+
+		while (_numFramesDone < _settings.numFrames) {
+			std::vector<pollfd> fds;
+			std::vector<Worker*> polled;
+			for (size_t i = 0; i < _workers.size(); i++) {
+				if (_workers[i].pid > 0) {
+					pollfd fd;
+					fd.fd = _workers[i].resultFd;
+					fd.events = POLLIN;
+					fd.revents = 0;
+					fds.push_back(fd);
+					polled.push_back(&_workers[i]);
+				}
+			}
+			if (fds.empty()) {
+				std::cerr << "RenderFarm: no workers left" << std::endl;
+				break;
+			}
+
+			if (poll(&fds[0], fds.size(), 100) < 0 && errno != EINTR) {
+				break;
+			}
+			for (size_t i = 0; i < fds.size(); i++) {
+				Worker &worker = *polled[i];
+				if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0 && !readResults(worker)) {
+					handleFailure(worker);
+				}
+				else if (worker.busy && _settings.chunkTimeoutSeconds > 0.0 &&
+					std::chrono::duration<double>(Clock::now() - worker.chunkStart).count() > _settings.chunkTimeoutSeconds) {
+					std::cerr << "RenderFarm: worker " << (&worker - &_workers[0]) << " timed out" << std::endl;
+					handleFailure(worker);
+				}
+			}
+
+			// Workers that were restarted while the queue was empty may have work again
+			for (size_t i = 0; i < _workers.size(); i++) {
+				assignChunk(_workers[i]);
+			}
+		}
+
+		for (size_t i = 0; i < _workers.size(); i++) {
+			stopWorker(_workers[i], false);
+		}
+
+		Report report;
+		report.numFrames = _settings.numFrames;
+		report.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		report.framesPerSecond = (report.totalSeconds > 0.0) ? _numFramesDone / report.totalSeconds : 0.0;
+		report.numMissing = 0;
+		for (int frame = 0; frame < _settings.numFrames; frame++) {
+			if (!std::ifstream(FrameCapture::getFileName(_settings.directory, _settings.prefix, _settings.format, frame).c_str()).good()) {
+				report.numMissing++;
+			}
+		}
+		for (size_t i = 0; i < _workers.size(); i++) {
+			report.workers.push_back(_workers[i].stats);
+		}
+		return report;
+	}
+
+	int RenderFarm::serveWorker(int commandFd, int resultFd, RenderFunction render)
+	{
+		FILE* commands = fdopen(commandFd, "r");
+		if (commands == NULL) {
+			return EXIT_FAILURE;
+		}
+		signal(SIGPIPE, SIG_IGN);
+
+		char line[256];
+		while (fgets(line, sizeof(line), commands) != NULL) {
+			int firstFrame, count;
+			if (sscanf(line, "render %d %d", &firstFrame, &count) == 2) {
+				TurntableRenderer::Report report = render(firstFrame, count);
+				std::ostringstream result;
+				result << "done " << firstFrame << " " << report.numFrames << " " << report.drawSeconds << " " << report.readbackSeconds
+					<< " " << report.encodeSeconds << " " << report.stallSeconds;
+				if (!writeLine(resultFd, result.str())) {
+					break;
+				}
+			}
+			else if (strncmp(line, "quit", 4) == 0) {
+				break;
+			}
+		}
+		fclose(commands);
+		close(resultFd);
+		return EXIT_SUCCESS;
+	}
+
+#else
+
+	bool RenderFarm::startWorker(Worker &worker)
+	{
+		return false;
+	}
+
+	void RenderFarm::stopWorker(Worker &worker, bool kill)
+	{
+	}
+
+	bool RenderFarm::writeLine(int fd, const std::string &line)
+	{
+		return false;
+	}
+
+	bool RenderFarm::readResults(Worker &worker)
+	{
+		return false;
+	}
+
+	RenderFarm::Report RenderFarm::run()
+	{
+		std::cerr << "RenderFarm: not implemented on Windows" << std::endl;
+		Report report;
+		report.numFrames = _settings.numFrames;
+		report.numMissing = _settings.numFrames;
+		report.totalSeconds = 0.0;
+		report.framesPerSecond = 0.0;
+		return report;
+	}
+
+	int RenderFarm::serveWorker(int commandFd, int resultFd, RenderFunction render)
+	{
+		return EXIT_FAILURE;
+	}
+
+#endif
+
+}
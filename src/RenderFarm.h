@@ -0,0 +1,145 @@
+/*!
+ *  RenderFarm.h
+ *
+ * Splits a turntable render across several headless renderer processes on the same machine.
+ */
+
+#ifndef RenderFarm_h
+#define RenderFarm_h
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "FrameCapture.h"
+#include "TurntableRenderer.h"
+
+namespace basicgraphics {
+
+	/** RenderFarm is the coordinator: it starts numWorkers copies of an executable, each with its own GL
+	context, and hands out chunks of frames as workers become free. Chunks start large and shrink as the
+	remaining frames run out (guided scheduling), so all workers finish at about the same time without a
+	message per frame. A worker that crashes, exits or takes longer than chunkTimeoutSeconds is killed and
+	restarted, up to maxRestarts times, and its chunk goes back in the queue. So is one that reports fewer
+	frames done than its chunk had, for the frames it didn't render.
+
+	Workers are started as "executable arguments... --farm-worker <commandFd> <resultFd>" and talk over a
+	pair of pipes, one line per message, so their stdout stays free for logging:
+		coordinator -> worker   "render <firstFrame> <count>", "quit"
+		worker -> coordinator   "done <firstFrame> <count> <draw> <readback> <encode> <stall>" (seconds)
+	The worker side of the protocol is serveWorker. Every worker writes into the same directory using the
+	frame numbers of the whole sequence; at the end the coordinator checks that every file is there.
+
+	Needs fork and pipes, so it is only implemented on POSIX systems.
+	------------------------------------------------------------------------
+	RenderFarm::Settings settings;
+	settings.executable = argv[0];
+	settings.arguments = { "--headless", "--size", "1920x1080", "--output", "turntable" };
+	settings.numWorkers = 4;
+	settings.numFrames = 360;
+	settings.directory = "turntable";
+	RenderFarm farm(settings);
+	farm.run().print(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class RenderFarm
+	{
+	public:
+
+		struct Settings {
+			std::string executable;
+			std::vector<std::string> arguments; /// passed to every worker before --farm-worker
+			int numWorkers;
+			int numFrames;
+			int minChunkSize;
+			int maxRestarts;           /// per worker
+			double chunkTimeoutSeconds; /// 0 waits forever
+
+			// Where the workers write, to check the output
+			std::string directory;
+			std::string prefix;
+			FrameCapture::Format format;
+
+			Settings();
+		};
+
+		struct WorkerStats {
+			int numFrames;
+			int numChunks;
+			int numRestarts;
+			double busySeconds;     /// from handing out a chunk until it was reported done
+			double drawSeconds;     /// the worker's own TurntableRenderer::Report, summed
+			double readbackSeconds;
+			double encodeSeconds;
+			double stallSeconds;
+		};
+
+		struct Report {
+			int numFrames;
+			int numMissing; /// frames that failed on every try or whose file isn't there
+			double totalSeconds;
+			double framesPerSecond;
+			std::vector<WorkerStats> workers;
+
+			void print(std::ostream &out) const;
+		};
+
+		// Renders the frames [firstFrame, firstFrame + count) on the worker
+		typedef std::function<TurntableRenderer::Report(int firstFrame, int count)> RenderFunction;
+
+		RenderFarm(const Settings &settings);
+
+		// Kills workers that are still running
+		virtual ~RenderFarm();
+
+		// Renders all frames and returns once every chunk is done or no worker is left
+		Report run();
+
+		/*!
+		 * The worker's side: reads commands from commandFd and answers on resultFd until "quit" or the
+		 * coordinator goes away. Returns the process exit code.
+		 */
+		static int serveWorker(int commandFd, int resultFd, RenderFunction render);
+
+	private:
+		RenderFarm(const RenderFarm&) {}; // prevent copying
+
+		typedef std::chrono::steady_clock Clock;
+
+		struct Chunk {
+			int firstFrame;
+			int count;
+		};
+
+		struct Worker {
+			int pid;
+			int commandFd;
+			int resultFd;
+			std::string received; // partial line
+			bool busy;
+			Chunk chunk;
+			Clock::time_point chunkStart;
+			WorkerStats stats;
+		};
+
+		Settings _settings;
+		std::vector<Worker> _workers;
+		std::deque<Chunk> _failedChunks;
+		int _nextFrame;
+		int _numFramesDone;
+
+		bool startWorker(Worker &worker);
+		void stopWorker(Worker &worker, bool kill);
+		bool nextChunk(Chunk &chunk);
+		void assignChunk(Worker &worker);
+		bool readResults(Worker &worker);
+		void handleFailure(Worker &worker);
+		static bool writeLine(int fd, const std::string &line);
+	};
+
+}
+
+#endif /* RenderFarm_h */
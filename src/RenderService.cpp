@@ -0,0 +1,437 @@
+//
+//  RenderService.cpp
+//
+//
+
+#include "RenderService.h"
+#include "HttpSocket.h"
+#include "ImageWriter.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace basicgraphics {
+
+	// Requests beyond this are turned away with 503 instead of piling up
+	static const size_t MAX_QUEUED_REQUESTS = 1024;
+
+	static bool parseVec3(const std::string &text, glm::vec3 &value)
+	{
+		return sscanf(text.c_str(), "%f,%f,%f", &value.x, &value.y, &value.z) == 3;
+	}
+
+	RenderService::Request::Request() : program("default"), format("png"), width(512), height(512), fieldOfView(45.0f),
+		eye(0.0f, 0.0f, 3.0f), center(0.0f), up(0.0f, 1.0f, 0.0f), light(5.0f, 5.0f, 5.0f)
+	{
+	}
+
+	RenderService::RenderService(const std::string &address, const std::string &defaultModel, int maxModels /*=8*/) : _address(address), _defaultModel(defaultModel),
+		_maxModels(std::max(maxModels, 1)), _listenSocket(-1), _running(false), _useCounter(0), _startTime(Clock::now()), _numRequests(0), _numErrors(0),
+		_numBatches(0), _numModels(0), _numInFlight(0)
+	{
+	}
+
+	RenderService::~RenderService()
+	{
+		stop();
+
+		// Connection handlers and readback callbacks still use this object
+		while (_numInFlight > 0) {
+			PixelReadback::getInstance().update();
+			std::this_thread::yield();
+		}
+
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		for (size_t i = 0; i < _queue.size(); i++) {
+			HttpSocket::sendResponse(_queue[i].connection, 503, "The render service is shutting down\n");
+			HttpSocket::close(_queue[i].connection);
+		}
+		_queue.clear();
+	}
+
+	bool RenderService::start(std::string &error)
+	{
+		if (_running) {
+			return true;
+		}
+		_listenSocket = HttpSocket::listen(_address, error);
+		if (_listenSocket < 0) {
+			return false;
+		}
+		_startTime = Clock::now();
+		_running = true;
+		_listener = std::thread(&RenderService::listen, this);
+		return true;
+	}
+
+	void RenderService::stop()
+	{
+		if (!_running) {
+			return;
+		}
+		_running = false;
+		_listener.join();
+		HttpSocket::close(_listenSocket);
+		_listenSocket = -1;
+#ifndef _WIN32
+		if (_address.compare(0, 5, "unix:") == 0) {
+			unlink(_address.substr(5).c_str());
+		}
+#endif
+	}
+
+	void RenderService::update(DrawFunction draw, int maxWaitMilliseconds /*=5*/)
+	{
+		std::vector<PendingRequest> batch;
+		{
+			std::unique_lock<std::mutex> lock(_queueMutex);
+			// Don't sleep while readbacks are waiting for update()
+			if (_queue.empty() && PixelReadback::getInstance().getNumPending() == 0) {
+				_queueCondition.wait_for(lock, std::chrono::milliseconds(maxWaitMilliseconds));
+			}
+			batch.swap(_queue);
+			Metrics::setGauge(Metrics::RENDER_REQUESTS_QUEUED, 0);
+		}
+
+		if (!batch.empty()) {
+			// Group requests that share state so switching programs, models and framebuffer sizes happens once per group.
+			// stable_sort keeps the arrival order within a group.
+			std::stable_sort(batch.begin(), batch.end(), [](const PendingRequest &a, const PendingRequest &b) {
+				if (a.request.program != b.request.program) {
+					return a.request.program < b.request.program;
+				}
+				if (a.request.model != b.request.model) {
+					return a.request.model < b.request.model;
+				}
+				if (a.request.width != b.request.width) {
+					return a.request.width < b.request.width;
+				}
+				return a.request.height < b.request.height;
+			});
+
+			for (size_t i = 0; i < batch.size(); i++) {
+				render(batch[i], draw);
+				PixelReadback::getInstance().update();
+			}
+			Framebuffer::unbind();
+
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			_numBatches++;
+		}
+		PixelReadback::getInstance().update();
+	}
+
+	RenderService::Stats RenderService::getStats() const
+	{
+		Stats stats;
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			stats.numQueued = (int)_queue.size();
+		}
+		stats.numModels = _numModels;
+
+		std::vector<double> latencies;
+		{
+			std::lock_guard<std::mutex> lock(_statsMutex);
+			stats.numRequests = _numRequests;
+			stats.numErrors = _numErrors;
+			stats.numBatches = _numBatches;
+			stats.uptimeSeconds = std::chrono::duration<double>(Clock::now() - _startTime).count();
+			latencies.assign(_latencies.begin(), _latencies.end());
+		}
+		stats.requestsPerSecond = (stats.uptimeSeconds > 0.0) ? stats.numRequests / stats.uptimeSeconds : 0.0;
+
+		std::sort(latencies.begin(), latencies.end());
+		static const double percentiles[3] = { 0.5, 0.9, 0.99 };
+		for (int i = 0; i < 3; i++) {
+			stats.latencyMilliseconds[i] = latencies.empty() ? 0.0 : latencies[(size_t)(percentiles[i] * (latencies.size() - 1) + 0.5)];
+		}
+		stats.latencyMilliseconds[3] = latencies.empty() ? 0.0 : latencies.back();
+		return stats;
+	}
+
+	std::string RenderService::getStatsText() const
+	{
+		Stats stats = getStats();
+		std::ostringstream text;
+		text << "requests " << stats.numRequests << "\n";
+		text << "errors " << stats.numErrors << "\n";
+		text << "queued " << stats.numQueued << "\n";
+		text << "batches " << stats.numBatches << "\n";
+		text << "models_cached " << stats.numModels << "\n";
+		text << "uptime_seconds " << stats.uptimeSeconds << "\n";
+		text << "requests_per_second " << stats.requestsPerSecond << "\n";
+		text << "latency_ms_p50 " << stats.latencyMilliseconds[0] << "\n";
+		text << "latency_ms_p90 " << stats.latencyMilliseconds[1] << "\n";
+		text << "latency_ms_p99 " << stats.latencyMilliseconds[2] << "\n";
+		text << "latency_ms_max " << stats.latencyMilliseconds[3] << "\n";
+		return text.str();
+	}
+
+	void RenderService::listen()
+	{
+		while (_running) {
+			int connection = HttpSocket::accept(_listenSocket, 100);
+			if (connection >= 0) {
+				// Reading the request can take up to the socket timeout for a slow client, so it happens on the pool
+				// instead of holding up the next accept. The destructor waits for _numInFlight.
+				_numInFlight++;
+				ThreadPool::getShared().enqueue([this, connection]() {
+					handleConnection(connection);
+					_numInFlight--;
+				});
+			}
+		}
+	}
+
+	void RenderService::handleConnection(int connection)
+	{
+		PendingRequest pending;
+		pending.connection = connection;
+		pending.received = Clock::now();
+
+		std::string method, path;
+		if (!HttpSocket::readRequest(connection, method, path)) {
+			HttpSocket::close(connection);
+			return;
+		}
+		if (method != "GET") {
+			HttpSocket::sendResponse(connection, 405, "Only GET is supported\n");
+			HttpSocket::close(connection);
+			return;
+		}
+
+		std::vector<std::pair<std::string, std::string>> query;
+		const std::string resource = HttpSocket::parsePath(path, query);
+		if (resource == "/stats") {
+			HttpSocket::sendResponse(connection, 200, getStatsText());
+			HttpSocket::close(connection);
+			return;
+		}
+		if (resource == "/metrics") {
+			const std::string text = Metrics::getInstance().getPrometheusText();
+			HttpSocket::sendResponse(connection, 200, "text/plain; version=0.0.4; charset=utf-8", (const unsigned char*)text.c_str(), text.size());
+			HttpSocket::close(connection);
+			return;
+		}
+		if (resource != "/render") {
+			HttpSocket::sendResponse(connection, 404, "Unknown resource " + resource + ", try /render, /stats or /metrics\n");
+			HttpSocket::close(connection);
+			return;
+		}
+
+		std::string error;
+		if (!parseRequest(path, pending.request, error)) {
+			HttpSocket::sendResponse(connection, 400, error + "\n");
+			HttpSocket::close(connection);
+			finishRequest(pending, true);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			if (_queue.size() < MAX_QUEUED_REQUESTS) {
+				_queue.push_back(pending);
+				Metrics::setGauge(Metrics::RENDER_REQUESTS_QUEUED, _queue.size());
+				_queueCondition.notify_one();
+				return;
+			}
+		}
+		HttpSocket::sendResponse(connection, 503, "Too many queued requests\n");
+		HttpSocket::close(connection);
+		finishRequest(pending, true);
+	}
+
+	bool RenderService::parseRequest(const std::string &path, Request &request, std::string &error) const
+	{
+		std::vector<std::pair<std::string, std::string>> query;
+		HttpSocket::parsePath(path, query);
+
+		request.model = _defaultModel;
+		for (size_t i = 0; i < query.size(); i++) {
+			const std::string &key = query[i].first;
+			const std::string &value = query[i].second;
+			bool ok = true;
+			if (key == "model") {
+				request.model = value;
+			}
+			else if (key == "program") {
+				request.program = value;
+			}
+			else if (key == "format") {
+				request.format = value;
+				ok = (value == "png" || value == "qoi" || value == "raw");
+			}
+			else if (key == "width") {
+				request.width = atoi(value.c_str());
+				ok = request.width > 0;
+			}
+			else if (key == "height") {
+				request.height = atoi(value.c_str());
+				ok = request.height > 0;
+			}
+			else if (key == "fov") {
+				request.fieldOfView = (float)atof(value.c_str());
+				ok = request.fieldOfView > 0.0f && request.fieldOfView < 180.0f;
+			}
+			else if (key == "eye") {
+				ok = parseVec3(value, request.eye);
+			}
+			else if (key == "center") {
+				ok = parseVec3(value, request.center);
+			}
+			else if (key == "up") {
+				ok = parseVec3(value, request.up);
+			}
+			else if (key == "light") {
+				ok = parseVec3(value, request.light);
+			}
+			else {
+				request.parameters[key] = value;
+			}
+			if (!ok) {
+				error = "Invalid value for " + key + ": " + value;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::shared_ptr<Model> RenderService::getModel(const std::string &fileName)
+	{
+		_useCounter++;
+		std::map<std::string, CachedModel>::iterator it = _models.find(fileName);
+		Metrics::recordCacheLookup(Metrics::RENDER_MODELS, it != _models.end());
+		if (it != _models.end()) {
+			it->second.lastUsed = _useCounter;
+			return it->second.model;
+		}
+
+		// Model doesn't report failed imports, so check the file first
+		if (!std::ifstream(fileName.c_str()).good()) {
+			return nullptr;
+		}
+
+		if ((int)_models.size() >= _maxModels) {
+			std::map<std::string, CachedModel>::iterator oldest = _models.begin();
+			for (it = _models.begin(); it != _models.end(); ++it) {
+				if (it->second.lastUsed < oldest->second.lastUsed) {
+					oldest = it;
+				}
+			}
+			_models.erase(oldest);
+		}
+
+		CachedModel cached;
+		cached.model.reset(new Model(fileName, 1.0, glm::vec4(1.0)));
+		cached.lastUsed = _useCounter;
+		_models[fileName] = cached;
+		_numModels = (int)_models.size();
+		return cached.model;
+	}
+
+	void RenderService::render(const PendingRequest &pending, DrawFunction &draw)
+	{
+		const Request &request = pending.request;
+
+		const int maxSize = Framebuffer::getMaxSize();
+		if (request.width > maxSize || request.height > maxSize) {
+			const std::string message = "Images are limited to " + std::to_string(maxSize) + " pixels on a side, use a poster render for larger ones\n";
+			respond(pending.connection, 400, "text/plain", (const unsigned char*)message.c_str(), message.size());
+			finishRequest(pending, true);
+			return;
+		}
+
+		std::shared_ptr<Model> model = getModel(request.model);
+		if (model.get() == nullptr) {
+			const std::string message = "Unable to load " + request.model + "\n";
+			respond(pending.connection, 404, "text/plain", (const unsigned char*)message.c_str(), message.size());
+			finishRequest(pending, true);
+			return;
+		}
+
+		if (_framebuffer.get() == nullptr) {
+			_framebuffer.reset(new Framebuffer(request.width, request.height, 4));
+		}
+		_framebuffer->resize(request.width, request.height);
+		_framebuffer->bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		const glm::mat4 view = glm::lookAt(request.eye, request.center, request.up);
+		const glm::mat4 projection = glm::perspective(glm::radians(request.fieldOfView), (float)request.width / (float)request.height, 0.1f, 100.0f);
+		if (!draw(request, *model, view, projection)) {
+			const std::string message = "Unknown program " + request.program + "\n";
+			respond(pending.connection, 400, "text/plain", (const unsigned char*)message.c_str(), message.size());
+			finishRequest(pending, true);
+			return;
+		}
+		_framebuffer->resolve();
+		_framebuffer->bindForReading();
+
+		_numInFlight++;
+		PixelReadback::getInstance().readFramebuffer(0, 0, request.width, request.height, 3, [this, pending](std::shared_ptr<PixelReadback::Image> image) {
+			if (!image) {
+				const std::string message = "Unable to read back the image\n";
+				respond(pending.connection, 500, "text/plain", (const unsigned char*)message.c_str(), message.size());
+				finishRequest(pending, true);
+				_numInFlight--;
+				return;
+			}
+			std::vector<unsigned char> encoded;
+			bool ok = true;
+			std::string contentType = "application/octet-stream";
+			const std::string &format = pending.request.format;
+			if (format == "png") {
+				ok = ImageWriter::encodePNG(image->width, image->height, image->channels, &image->pixels[0], encoded);
+				contentType = "image/png";
+			}
+			else if (format == "qoi") {
+				ok = ImageWriter::encodeQOI(image->width, image->height, image->channels, &image->pixels[0], encoded);
+				contentType = "image/qoi";
+			}
+			else {
+				encoded.swap(image->pixels);
+			}
+
+			if (ok) {
+				respond(pending.connection, 200, contentType, encoded.empty() ? nullptr : &encoded[0], encoded.size());
+			}
+			else {
+				respond(pending.connection, 500, "text/plain", nullptr, 0);
+			}
+			finishRequest(pending, !ok);
+			_numInFlight--;
+		});
+	}
+
+	void RenderService::respond(int connection, int status, const std::string &contentType, const unsigned char* body, size_t size)
+	{
+		HttpSocket::sendResponse(connection, status, contentType, body, size);
+		HttpSocket::close(connection);
+	}
+
+	void RenderService::finishRequest(const PendingRequest &pending, bool error)
+	{
+		const double latency = std::chrono::duration<double, std::milli>(Clock::now() - pending.received).count();
+		std::lock_guard<std::mutex> lock(_statsMutex);
+		_latencies.push_back(latency);
+		if (_latencies.size() > MAX_LATENCIES) {
+			_latencies.pop_front();
+		}
+		_numRequests++;
+		if (error) {
+			_numErrors++;
+		}
+	}
+
+}
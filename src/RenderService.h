@@ -0,0 +1,169 @@
+/*!
+ *  RenderService.h
+ *
+ * Serves render requests from other local processes over HTTP, on a localhost port or a Unix domain socket.
+ */
+
+#ifndef RenderService_h
+#define RenderService_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "Model.h"
+#include "PixelReadback.h"
+
+namespace basicgraphics {
+
+	/** RenderService keeps the GL context, compiled shaders and loaded models of a running app around so
+	a render costs only the draw, not GLFW init, shader compiles and a model import. A listener thread
+	accepts connections and hands them to the ThreadPool, which reads the requests and queues them;
+	update(), called on the GL thread, renders everything queued since the last call as one batch, sorted
+	so requests for the same program, model and size are drawn one after another. Models stay loaded in a least recently used cache. The pixels are read back through
+	PixelReadback and encoded and sent on the ThreadPool.
+
+	GET /render?model=bunny.obj&width=512&height=512&eye=0,1,3&center=0,0.8,0&light=5,5,5&format=png
+		returns the image. Every parameter is optional, see Request for the defaults; fov, up and program
+		are understood too and anything else is passed on to the draw function in Request::parameters.
+		Formats are png, qoi and raw (RGB bytes).
+	GET /stats
+		returns plain text with the number of requests, throughput and latency percentiles.
+	GET /metrics
+		returns Metrics in the Prometheus text format, including the queue length and model cache hits.
+
+	Addresses are "unix:/path/to/socket" or "host:port" (e.g. "127.0.0.1:8080"), see HttpSocket.
+	------------------------------------------------------------------------
+	RenderService service("127.0.0.1:8080", "bunny.obj");
+	std::string error;
+	service.start(error);
+	while (running) {
+		service.update([&](const RenderService::Request &request, Model &model, const glm::mat4 &view, const glm::mat4 &projection) {
+			return drawScene(request, model, view, projection);
+		});
+	}
+	------------------------------------------------------------------------
+	*/
+	class RenderService
+	{
+	public:
+
+		struct Request {
+			std::string model;
+			std::string program;
+			std::string format;
+			int width;
+			int height;
+			float fieldOfView;   /// vertical, in degrees
+			glm::vec3 eye;
+			glm::vec3 center;
+			glm::vec3 up;
+			glm::vec3 light;
+			std::map<std::string, std::string> parameters; /// everything else in the query string
+
+			Request();
+		};
+
+		struct Stats {
+			int numRequests;   /// answered, including errors
+			int numErrors;
+			int numQueued;
+			int numBatches;
+			int numModels;     /// in the cache
+			double uptimeSeconds;
+			double requestsPerSecond;
+			double latencyMilliseconds[4]; /// 50th, 90th, 99th percentile and maximum of the recent requests
+		};
+
+		/*!
+		 * Draws the request into the bound framebuffer, with the viewport set to its size. view and projection
+		 * come from the request. Returning false answers the request with an error, e.g. for an unknown program.
+		 */
+		typedef std::function<bool(const Request &request, Model &model, const glm::mat4 &view, const glm::mat4 &projection)> DrawFunction;
+
+		RenderService(const std::string &address, const std::string &defaultModel, int maxModels = 8);
+
+		// Stops listening and waits for the responses that are still being encoded
+		virtual ~RenderService();
+
+		// Starts the listener thread, fails if the address can't be bound
+		bool start(std::string &error);
+		void stop();
+
+		/*!
+		 * Renders the requests queued since the last call. Call on the GL thread as often as possible, it waits
+		 * up to maxWaitMilliseconds for requests when there is nothing to do.
+		 */
+		void update(DrawFunction draw, int maxWaitMilliseconds = 5);
+
+		Stats getStats() const;
+		std::string getStatsText() const;
+
+	private:
+		RenderService(const RenderService&) {}; // prevent copying
+
+		typedef std::chrono::steady_clock Clock;
+
+		struct PendingRequest {
+			Request request;
+			int connection;
+			Clock::time_point received;
+		};
+
+		struct CachedModel {
+			std::shared_ptr<Model> model;
+			unsigned long long lastUsed;
+		};
+
+		std::string _address;
+		std::string _defaultModel;
+		int _maxModels;
+
+		int _listenSocket;
+		std::atomic<bool> _running;
+		std::thread _listener;
+
+		mutable std::mutex _queueMutex;
+		std::condition_variable _queueCondition;
+		std::vector<PendingRequest> _queue;
+
+		// Only touched on the GL thread
+		std::map<std::string, CachedModel> _models;
+		unsigned long long _useCounter;
+		std::unique_ptr<Framebuffer> _framebuffer;
+
+		// Latencies of the most recent requests, for the percentiles
+		static const size_t MAX_LATENCIES = 4096;
+		mutable std::mutex _statsMutex;
+		std::deque<double> _latencies;
+		Clock::time_point _startTime;
+		int _numRequests;
+		int _numErrors;
+		int _numBatches;
+		std::atomic<int> _numModels;
+		std::atomic<int> _numInFlight;
+
+		void listen();
+		void handleConnection(int connection);
+		bool parseRequest(const std::string &path, Request &request, std::string &error) const;
+		std::shared_ptr<Model> getModel(const std::string &fileName);
+		void render(const PendingRequest &pending, DrawFunction &draw);
+		void respond(int connection, int status, const std::string &contentType, const unsigned char* body, size_t size);
+		void finishRequest(const PendingRequest &pending, bool error);
+	};
+
+}
+
+#endif /* RenderService_h */
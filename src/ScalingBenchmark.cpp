@@ -0,0 +1,256 @@
+//
+//  ScalingBenchmark.cpp
+//
+//
+
+#include "ScalingBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+namespace basicgraphics {
+
+	static const float GRID_SPACING = 2.5f;
+	static const float SPHERE_SCALE = 0.8f;
+	static const float TWO_PI = 6.2831853f;
+
+	// Blinn-Phong with up to MAX_LIGHTS point lights, the vertex shader is BlinnPhong.vert
+	static std::string getFragmentShader()
+	{
+		std::ostringstream source;
+		source << "#version 330\n"
+			"const int MAX_LIGHTS = " << ScalingBenchmark::MAX_LIGHTS << ";\n"
+			"uniform vec3 eye_world;\n"
+			"uniform vec4 materialColor;\n"
+			"uniform vec3 specularColor;\n"
+			"uniform float shininess;\n"
+			"uniform int numLights;\n"
+			"uniform vec4 lightPositions[MAX_LIGHTS];\n"
+			"uniform vec3 lightColors[MAX_LIGHTS];\n"
+			"in vec4 interpSurfPosition;\n"
+			"in vec3 interpSurfNormal;\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	vec3 normal = normalize(interpSurfNormal);\n"
+			"	vec3 viewDir = normalize(eye_world - interpSurfPosition.xyz);\n"
+			"	vec3 color = 0.1 * materialColor.rgb;\n"
+			"	for (int i = 0; i < numLights; i++) {\n"
+			"		vec3 lightDir = normalize(lightPositions[i].xyz - interpSurfPosition.xyz);\n"
+			"		vec3 halfwayVector = normalize(lightDir + viewDir);\n"
+			"		float diffuse = max(dot(normal, lightDir), 0.0);\n"
+			"		float specular = pow(max(dot(normal, halfwayVector), 0.0), shininess);\n"
+			"		color += lightColors[i] * (materialColor.rgb * diffuse + specularColor * specular);\n"
+			"	}\n"
+			"	fragColor = vec4(color, 1.0);\n"
+			"}\n";
+		return source.str();
+	}
+
+	static float getPercentile(std::vector<float> times, int percent)
+	{
+		if (times.empty()) {
+			return 0.0f;
+		}
+		std::sort(times.begin(), times.end());
+		return times[(times.size() - 1) * percent / 100];
+	}
+
+	ScalingBenchmark::Settings::Settings() : numFrames(60), numWarmupFrames(10)
+	{
+		numObjects = { 1, 4, 16, 64, 256, 1024 };
+		numMaterials = { 1, 8, 64 };
+		numLights = { 1, 4, 16 };
+	}
+
+	ScalingBenchmark::ScalingBenchmark(int argc, char** argv, const Settings &settings) :
+		BaseApp(argc, argv, "bunny_bench --scaling", 1024, 768), _settings(settings)
+	{
+		// Measure the rendering, not the display's refresh rate
+		if (_window != nullptr) {
+			glfwSwapInterval(0);
+		}
+
+		for (int o = 0; o < _settings.numObjects.size(); o++) {
+			for (int m = 0; m < _settings.numMaterials.size(); m++) {
+				for (int l = 0; l < _settings.numLights.size(); l++) {
+					// More materials than objects renders the same as one material per object
+					if (_settings.numMaterials[m] > _settings.numObjects[o] && _settings.numMaterials[m] > 1) {
+						continue;
+					}
+					Result result;
+					result.numObjects = std::max(_settings.numObjects[o], 0);
+					result.numMaterials = std::max(_settings.numMaterials[m], 1);
+					result.numLights = std::min(std::max(_settings.numLights[l], 0), (int)MAX_LIGHTS);
+					_results.push_back(result);
+				}
+			}
+		}
+		_settings.numFrames = std::max(_settings.numFrames, 1);
+		_settings.numWarmupFrames = std::max(_settings.numWarmupFrames, 0);
+		_framesPerConfig = _settings.numWarmupFrames + _settings.numFrames + 1;
+		// One more frame collects the GL counts of the last configuration
+		_maxFrames = (int)_results.size() * _framesPerConfig + 1;
+
+		try {
+			_shader.compileShader("BlinnPhong.vert");
+			_shader.compileShader(getFragmentShader(), GLSLShader::FRAGMENT, "scaling benchmark");
+			_shader.link();
+		}
+		catch (GLSLProgramException &e) {
+			std::cerr << "ScalingBenchmark: " << e.what() << std::endl;
+			requestExit();
+		}
+		_bunny.reset(new Model("bunny-simplified.obj", 1.0));
+		_sphere.reset(new Model("sphere.obj", 1.0));
+
+		for (int i = 0; i < MAX_LIGHTS; i++) {
+			std::ostringstream index;
+			index << "[" << i << "]";
+			_lightPositionNames.push_back("lightPositions" + index.str());
+			_lightColorNames.push_back("lightColors" + index.str());
+		}
+
+		Profiler::getInstance().setListener([this](int frame, const std::string &path, int depth, float cpuMilliseconds, float gpuMilliseconds) {
+			const int config = frame / _framesPerConfig;
+			const int configFrame = frame % _framesPerConfig;
+			if (config >= _results.size() || configFrame < _settings.numWarmupFrames || configFrame >= _settings.numWarmupFrames + _settings.numFrames) {
+				return;
+			}
+			if (path == "Frame") {
+				_results[config].frameTimes.push_back(cpuMilliseconds);
+				if (gpuMilliseconds >= 0.0f) {
+					_results[config].gpuTimes.push_back(gpuMilliseconds);
+				}
+			}
+			else if (path == "Frame/onRenderGraphics") {
+				_results[config].cpuTimes.push_back(cpuMilliseconds);
+			}
+		});
+	}
+
+	ScalingBenchmark::~ScalingBenchmark()
+	{
+		Profiler::getInstance().setListener(nullptr);
+	}
+
+	void ScalingBenchmark::onRenderGraphics()
+	{
+		const int config = _frameNumber / _framesPerConfig;
+		const int configFrame = _frameNumber % _framesPerConfig;
+
+		// The last frame of a configuration is counted, its counts are there once it has ended
+		GLStats &glStats = GLStats::getInstance();
+		if (configFrame == 0 && config > 0 && glStats.isEnabled()) {
+			_results[config - 1].counts = glStats.getLastFrame();
+			glStats.setEnabled(false);
+		}
+		if (config >= _results.size() || !_shader.isLinked()) {
+			return;
+		}
+
+		const Result &result = _results[config];
+		if (configFrame == 0) {
+			std::cout << "Rendering " << result.numObjects << " objects, " << result.numMaterials << " materials, "
+				<< result.numLights << " lights (" << config + 1 << " of " << _results.size() << ")" << std::endl;
+		}
+		else if (configFrame == _framesPerConfig - 1) {
+			glStats.setEnabled(true);
+		}
+		drawConfig(result);
+	}
+
+	void ScalingBenchmark::drawConfig(const Result &config)
+	{
+		// Looking down on the middle of the grid from far enough away to see all of it
+		const int side = std::max((int)std::ceil(std::sqrt((double)config.numObjects)), 1);
+		const float extent = side * GRID_SPACING;
+		const glm::vec3 eye(0.0f, 0.8f * extent + 2.0f, 0.9f * extent + 3.0f);
+		const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)_windowWidth / (GLfloat)_windowHeight, 0.1f, 4.0f * extent + 10.0f);
+
+		_shader.use();
+		_shader.setUniform("view_mat", view);
+		_shader.setUniform("projection_mat", projection);
+		_shader.setUniform("eye_world", eye);
+
+		// In a ring above the grid, with different colors that add up to about the same brightness for any count
+		_shader.setUniform("numLights", config.numLights);
+		for (int i = 0; i < config.numLights; i++) {
+			const float angle = TWO_PI * i / config.numLights;
+			const glm::vec4 position(0.6f * extent * std::cos(angle), 0.3f * extent + 3.0f, 0.6f * extent * std::sin(angle), 1.0f);
+			const glm::vec3 color = glm::vec3(0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::cos(angle + TWO_PI / 3.0f), 0.5f + 0.5f * std::cos(angle + 2.0f * TWO_PI / 3.0f)) * (1.5f / config.numLights);
+			_shader.setUniform(_lightPositionNames[i].c_str(), position);
+			_shader.setUniform(_lightColorNames[i].c_str(), color);
+		}
+
+		int currentMaterial = -1;
+		for (int i = 0; i < config.numObjects; i++) {
+			const glm::vec3 position((i % side - 0.5f * (side - 1)) * GRID_SPACING, 0.0f, (i / side - 0.5f * (side - 1)) * GRID_SPACING);
+			const bool sphere = i % 2 == 1;
+			glm::mat4 model = glm::translate(glm::mat4(1.0), position);
+			if (sphere) {
+				model = glm::scale(model, glm::vec3(SPHERE_SCALE));
+			}
+			_shader.setUniform("model_mat", model);
+			_shader.setUniform("normal_mat", glm::mat3(glm::transpose(glm::inverse(model))));
+
+			const int materialIndex = i % config.numMaterials;
+			const Material material = getMaterial(materialIndex);
+			if (materialIndex != currentMaterial) {
+				_shader.setUniform("specularColor", material.specular);
+				_shader.setUniform("shininess", material.shininess);
+				currentMaterial = materialIndex;
+			}
+			Model &mesh = sphere ? *_sphere : *_bunny;
+			mesh.setMaterialColor(material.color);
+			mesh.draw(_shader);
+		}
+	}
+
+	ScalingBenchmark::Material ScalingBenchmark::getMaterial(int index)
+	{
+		// Hues spread by the golden ratio so neighbouring materials look different
+		const float hue = std::fmod(index * 0.618034f, 1.0f);
+		Material material;
+		material.color = glm::vec4(0.5f + 0.5f * std::cos(TWO_PI * hue), 0.5f + 0.5f * std::cos(TWO_PI * (hue + 1.0f / 3.0f)),
+			0.5f + 0.5f * std::cos(TWO_PI * (hue + 2.0f / 3.0f)), 1.0f);
+		material.specular = glm::vec3(0.2f + 0.6f * std::fmod(index * 0.37f, 1.0f));
+		material.shininess = 8.0f + 16.0f * (index % 8);
+		return material;
+	}
+
+	void ScalingBenchmark::writeCSV(std::ostream &out) const
+	{
+		out << "objects,materials,lights,frames,frame_ms_p50,frame_ms_p95,cpu_submit_ms_p50,cpu_submit_ms_p95,gpu_ms_p50,gpu_ms_p95,"
+			"draw_calls,state_changes,redundant_state_changes,uniform_uploads,redundant_uniform_uploads,cpu_us_per_draw,bound_by\n";
+		char row[512];
+		for (int i = 0; i < _results.size(); i++) {
+			const Result &result = _results[i];
+			const GLStats::Counts &counts = result.counts;
+			unsigned long long stateChanges = 0;
+			unsigned long long redundantStateChanges = 0;
+			const GLStats::Counter stateCounters[] = { GLStats::VAO_BINDS, GLStats::TEXTURE_BINDS, GLStats::PROGRAM_SWITCHES, GLStats::STATE_TOGGLES };
+			for (int c = 0; c < 4; c++) {
+				stateChanges += counts.calls[stateCounters[c]];
+				redundantStateChanges += counts.redundant[stateCounters[c]];
+			}
+			const unsigned long long drawCalls = counts.calls[GLStats::DRAW_CALLS];
+			const float cpu = getPercentile(result.cpuTimes, 50);
+			const float gpu = getPercentile(result.gpuTimes, 50);
+			const char* boundBy = result.gpuTimes.empty() ? "" : (cpu > gpu ? "cpu" : "gpu");
+
+			snprintf(row, sizeof(row), "%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%llu,%llu,%llu,%llu,%llu,%.3f,%s\n",
+				result.numObjects, result.numMaterials, result.numLights, (int)result.frameTimes.size(),
+				getPercentile(result.frameTimes, 50), getPercentile(result.frameTimes, 95),
+				cpu, getPercentile(result.cpuTimes, 95),
+				gpu, getPercentile(result.gpuTimes, 95),
+				drawCalls, stateChanges, redundantStateChanges,
+				counts.calls[GLStats::UNIFORM_UPLOADS], counts.redundant[GLStats::UNIFORM_UPLOADS],
+				drawCalls > 0 ? 1000.0 * cpu / drawCalls : 0.0, boundBy);
+			out << row;
+		}
+	}
+
+}
@@ -0,0 +1,100 @@
+/*!
+ *  ScalingBenchmark.h
+ *
+ * Renders grids of more and more objects, materials and lights to show how the frame time scales, for bunny_bench --scaling.
+ */
+
+#ifndef ScalingBenchmark_h
+#define ScalingBenchmark_h
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BaseApp.h"
+
+namespace basicgraphics {
+
+	/** ScalingBenchmark renders every combination of the numbers of objects, materials and lights in its
+	settings, one after the other, for numWarmupFrames plus numFrames frames each. The objects alternate
+	between bunny-simplified.obj and sphere.obj in a square grid the camera looks down on, and take the
+	materials in turn, so neighbours differ whenever there is more than one material. Every light is
+	evaluated for every pixel.
+	For each configuration it keeps the frame time, the time spent submitting the draws on the CPU
+	(onRenderGraphics) and the GPU time of the measured frames, and counts the GL calls of one more frame
+	with GLStats. writeCSV writes one row per configuration, so each column against the object count is
+	a scaling curve; where cpu_submit_ms passes gpu_ms the renderer is limited by draw calls and state
+	changes rather than by the GPU.
+	------------------------------------------------------------------------
+	ScalingBenchmark::Settings settings;
+	settings.numObjects = { 1, 16, 256 };
+	ScalingBenchmark benchmark(argc, argv, settings);
+	benchmark.run();
+	benchmark.writeCSV(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class ScalingBenchmark : public BaseApp
+	{
+	public:
+
+		static const int MAX_LIGHTS = 64;
+
+		struct Settings {
+			std::vector<int> numObjects;
+			std::vector<int> numMaterials;
+			std::vector<int> numLights; /// at most MAX_LIGHTS
+			int numFrames;              /// measured per configuration
+			int numWarmupFrames;        /// rendered first and not measured
+
+			Settings();
+		};
+
+		// One configuration, times in milliseconds
+		struct Result {
+			int numObjects;
+			int numMaterials;
+			int numLights;
+			std::vector<float> frameTimes;
+			std::vector<float> cpuTimes;
+			std::vector<float> gpuTimes;
+			GLStats::Counts counts; // of the one counted frame
+		};
+
+		ScalingBenchmark(int argc, char** argv, const Settings &settings);
+		~ScalingBenchmark();
+
+		const std::vector<Result>& getResults() const { return _results; }
+
+		// Writes the header and one row per configuration
+		void writeCSV(std::ostream &out) const;
+
+	protected:
+		void onRenderGraphics() override;
+		void onEvent(std::shared_ptr<Event> event) override {}
+
+	private:
+
+		struct Material {
+			glm::vec4 color;
+			glm::vec3 specular;
+			float shininess;
+		};
+
+		Settings _settings;
+		std::vector<Result> _results;
+		int _framesPerConfig; // warmup, measured and the counted frame
+
+		GLSLProgram _shader;
+		std::unique_ptr<Model> _bunny;
+		std::unique_ptr<Model> _sphere;
+		std::vector<std::string> _lightPositionNames; // lightPositions[i]
+		std::vector<std::string> _lightColorNames;    // lightColors[i]
+
+		void drawConfig(const Result &config);
+		static Material getMaterial(int index);
+	};
+
+}
+
+#endif /* ScalingBenchmark_h */
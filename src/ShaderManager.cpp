@@ -0,0 +1,485 @@
+//
+//  ShaderManager.cpp
+//
+//
+
+#include "ShaderManager.h"
+#include "Tracer.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace basicgraphics {
+
+#ifdef __linux__
+	// Drains all pending inotify events and adds the full path of every file that was written or replaced to changed
+	static void readWatchEvents(int fd, const std::map<int, std::string> &directories, std::set<std::string> &changed)
+	{
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t length;
+		while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+				const struct inotify_event* event = (const struct inotify_event*)ptr;
+				std::map<int, std::string>::const_iterator dir = directories.find(event->wd);
+				if (event->len > 0 && dir != directories.end()) {
+					changed.insert(dir->second == "." ? std::string(event->name) : dir->second + "/" + event->name);
+				}
+			}
+		}
+	}
+#endif
+
+	ShaderManager::ShaderManager(GLFWwindow* shareWindow) : _sharedWindow(nullptr), _parallelCompile(false), _stop(false)
+	{
+		_parallelCompile = hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile");
+
+		if (!_parallelCompile && shareWindow != nullptr) {
+			// A hidden window whose context shares objects with the application's. The worker thread compiles on it.
+			// The remaining window hints (context version, profile) are still the ones BaseApp set.
+			glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+			_sharedWindow = glfwCreateWindow(1, 1, "", NULL, shareWindow);
+			glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+			if (_sharedWindow == nullptr) {
+				std::cerr << "ShaderManager: unable to create a shared context, shaders will be rebuilt on the render thread" << std::endl;
+			}
+		}
+
+		_worker = std::thread(&ShaderManager::watchLoop, this);
+	}
+
+	ShaderManager::~ShaderManager()
+	{
+		_stop = true;
+		if (_worker.joinable()) {
+			_worker.join();
+		}
+
+		// Delete pending programs while the application's context is still current
+		_inFlight.clear();
+		_finished.clear();
+
+		if (_sharedWindow != nullptr) {
+			glfwDestroyWindow(_sharedWindow);
+		}
+	}
+
+	void ShaderManager::addProgram(GLSLProgram &program, const std::vector<std::string> &fileNames) throw (GLSLProgramException)
+	{
+		Entry entry;
+		entry.program = &program;
+		entry.fileNames = fileNames;
+
+		GLSLProgram newProgram;
+		for (int i = 0; i < fileNames.size(); i++) {
+			ShaderSource src;
+			src.fileName = fileNames[i];
+			if (!GLSLProgram::getShaderType(src.fileName.c_str(), src.type)) {
+				throw GLSLProgramException("Unrecognized extension: " + src.fileName);
+			}
+
+			// Include-once is per stage, a header shared by the .vert and the .frag has to be inlined into both
+			std::string error;
+			std::set<std::string> included;
+			included.insert(src.fileName);
+			const bool preprocessed = preprocess(src.fileName, included, src.sourceNames, src.source, error);
+			entry.dependencies.insert(included.begin(), included.end());
+			if (!preprocessed) {
+				throw GLSLProgramException(error);
+			}
+			newProgram.compileShader(src.source, src.type, src.fileName.c_str());
+		}
+		newProgram.link();
+		program.swap(newProgram);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.push_back(entry);
+	}
+
+	void ShaderManager::reloadAll()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (int i = 0; i < _entries.size(); i++) {
+			_dirty.insert(i);
+		}
+	}
+
+	void ShaderManager::update()
+	{
+		std::vector<std::unique_ptr<Build>> finished;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			finished.swap(_finished);
+		}
+
+		for (int i = 0; i < finished.size(); i++) {
+			Build &build = *finished[i];
+			if (!build.error.empty()) {
+				report(build);
+				continue;
+			}
+			if (build.program.get() != nullptr) {
+				// Already linked on the shared context
+				install(build);
+				continue;
+			}
+
+			// These sources are newer than anything still compiling for the same program
+			for (int j = _inFlight.size() - 1; j >= 0; j--) {
+				if (_inFlight[j]->entry == build.entry) {
+					_inFlight.erase(_inFlight.begin() + j);
+				}
+			}
+
+			if (_parallelCompile) {
+				build.program.reset(new GLSLProgram());
+				try {
+					for (int s = 0; s < build.sources.size(); s++) {
+						build.program->beginCompileShader(build.sources[s].source, build.sources[s].type, build.sources[s].fileName.c_str());
+					}
+					build.program->beginLink();
+					_inFlight.push_back(std::move(finished[i]));
+				}
+				catch (GLSLProgramException &e) {
+					build.error = e.what();
+					report(build);
+				}
+			}
+			else {
+				// No way to compile off this thread, at least a broken shader won't throw out of the render loop
+				compileAndLink(build);
+				if (build.error.empty()) {
+					install(build);
+				}
+				else {
+					report(build);
+				}
+			}
+		}
+
+		for (int i = _inFlight.size() - 1; i >= 0; i--) {
+			Build &build = *_inFlight[i];
+			if (!build.program->isLinkComplete()) {
+				continue;
+			}
+			try {
+				build.program->finishLink();
+				install(build);
+			}
+			catch (GLSLProgramException &e) {
+				build.error = e.what();
+				report(build);
+			}
+			_inFlight.erase(_inFlight.begin() + i);
+		}
+	}
+
+	bool ShaderManager::usesParallelCompile() const
+	{
+		return _parallelCompile;
+	}
+
+	std::string ShaderManager::getLastError() const
+	{
+		return _lastError;
+	}
+
+	void ShaderManager::install(Build &build)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		Entry &entry = _entries[build.entry];
+
+		// The previous program ends up in build.program and is deleted along with the build
+		entry.program->swap(*build.program);
+		entry.error = "";
+
+		_lastError = "";
+		for (int i = 0; i < _entries.size(); i++) {
+			if (!_entries[i].error.empty()) {
+				_lastError = _entries[i].error;
+			}
+		}
+
+		std::cout << "Reloaded shader program:";
+		for (int i = 0; i < entry.fileNames.size(); i++) {
+			std::cout << " " << entry.fileNames[i];
+		}
+		std::cout << std::endl;
+	}
+
+	void ShaderManager::report(Build &build)
+	{
+		std::string message = build.error;
+
+		// Compile logs refer to included files by their #line source string number
+		for (int s = 0; s < build.sources.size(); s++) {
+			const std::vector<std::string> &names = build.sources[s].sourceNames;
+			if (names.size() > 1) {
+				message += "Source strings for " + build.sources[s].fileName + ":";
+				for (int n = 0; n < names.size(); n++) {
+					message += " " + std::to_string(n) + "=" + names[n];
+				}
+				message += "\n";
+			}
+		}
+
+		std::cerr << message << std::endl << "Keeping the previous version of the program." << std::endl;
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries[build.entry].error = message;
+		_lastError = message;
+	}
+
+	void ShaderManager::compileAndLink(Build &build)
+	{
+		TRACE_SCOPE("shaders", "Compile and link");
+		build.program.reset(new GLSLProgram());
+		try {
+			for (int s = 0; s < build.sources.size(); s++) {
+				build.program->compileShader(build.sources[s].source, build.sources[s].type, build.sources[s].fileName.c_str());
+			}
+			build.program->link();
+
+			// Make sure the program is complete before another context uses it
+			glFinish();
+		}
+		catch (GLSLProgramException &e) {
+			build.error = e.what();
+			build.program.reset();
+		}
+	}
+
+	void ShaderManager::watchLoop()
+	{
+		TRACE_THREAD_NAME("ShaderManager");
+		if (_sharedWindow != nullptr) {
+			glfwMakeContextCurrent(_sharedWindow);
+		}
+
+		int fd = -1;
+#ifdef __linux__
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		std::map<int, std::string> watchDirectories;
+		std::set<std::string> watchedDirectories;
+#endif
+		std::map<std::string, time_t> modifiedTimes;
+
+		while (!_stop) {
+			std::set<std::string> dependencies;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				for (int i = 0; i < _entries.size(); i++) {
+					dependencies.insert(_entries[i].dependencies.begin(), _entries[i].dependencies.end());
+				}
+			}
+
+			std::set<std::string> changed;
+			if (fd >= 0) {
+#ifdef __linux__
+				// Watch directories rather than files, editors often save by writing a new file and renaming it
+				for (std::set<std::string>::iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+					std::string dir = getDirectory(*it);
+					if (watchedDirectories.insert(dir).second) {
+						int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+						if (wd >= 0) {
+							watchDirectories[wd] = dir;
+						}
+					}
+				}
+
+				struct pollfd pfd;
+				pfd.fd = fd;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				if (poll(&pfd, 1, 100) > 0) {
+					readWatchEvents(fd, watchDirectories, changed);
+					// Coalesce the burst of events a single save produces
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					readWatchEvents(fd, watchDirectories, changed);
+				}
+#endif
+			}
+			else {
+				std::this_thread::sleep_for(std::chrono::milliseconds(250));
+				for (std::set<std::string>::iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+					struct stat info;
+					if (stat(it->c_str(), &info) != 0) {
+						continue;
+					}
+					std::map<std::string, time_t>::iterator last = modifiedTimes.find(*it);
+					if (last != modifiedTimes.end() && last->second != info.st_mtime) {
+						changed.insert(*it);
+					}
+					modifiedTimes[*it] = info.st_mtime;
+				}
+			}
+
+			if (!changed.empty()) {
+				markChanged(changed);
+			}
+			buildDirty();
+		}
+
+#ifdef __linux__
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+		if (_sharedWindow != nullptr) {
+			glfwMakeContextCurrent(NULL);
+		}
+	}
+
+	void ShaderManager::markChanged(const std::set<std::string> &fileNames)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (int i = 0; i < _entries.size(); i++) {
+			for (std::set<std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); ++it) {
+				if (_entries[i].dependencies.count(*it) > 0) {
+					_dirty.insert(i);
+					break;
+				}
+			}
+		}
+	}
+
+	void ShaderManager::buildDirty()
+	{
+		std::set<int> dirty;
+		std::map<int, std::vector<std::string>> fileNames;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			dirty.swap(_dirty);
+			for (std::set<int>::iterator it = dirty.begin(); it != dirty.end(); ++it) {
+				fileNames[*it] = _entries[*it].fileNames;
+			}
+		}
+
+		for (std::set<int>::iterator it = dirty.begin(); it != dirty.end(); ++it) {
+			std::unique_ptr<Build> build(new Build());
+			build->entry = *it;
+
+			// Reading and resolving includes happens here so the render thread never touches the disk
+			std::set<std::string> dependencies;
+			const std::vector<std::string> &files = fileNames[*it];
+			for (int i = 0; i < files.size() && build->error.empty(); i++) {
+				ShaderSource src;
+				src.fileName = files[i];
+				GLSLProgram::getShaderType(src.fileName.c_str(), src.type);
+				std::set<std::string> included;
+				included.insert(src.fileName);
+				if (preprocess(src.fileName, included, src.sourceNames, src.source, build->error)) {
+					build->sources.push_back(src);
+				}
+				dependencies.insert(included.begin(), included.end());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (build->error.empty()) {
+					_entries[*it].dependencies = dependencies;
+				}
+				else {
+					// Keep watching what we had, plus whatever include could not be found so creating it triggers a rebuild
+					_entries[*it].dependencies.insert(dependencies.begin(), dependencies.end());
+				}
+			}
+
+			if (build->error.empty() && _sharedWindow != nullptr) {
+				compileAndLink(*build);
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			_finished.push_back(std::move(build));
+		}
+	}
+
+	bool ShaderManager::preprocess(const std::string &fileName, std::set<std::string> &included, std::vector<std::string> &sourceNames, std::string &output, std::string &error)
+	{
+		std::ifstream inFile(fileName.c_str());
+		if (!inFile) {
+			error = "Unable to open: " + fileName;
+			return false;
+		}
+
+		const int sourceNumber = sourceNames.size();
+		sourceNames.push_back(fileName);
+		if (sourceNumber > 0) {
+			output += "#line 1 " + std::to_string(sourceNumber) + "\n";
+		}
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(inFile, line)) {
+			lineNumber++;
+
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+				output += line + "\n";
+				continue;
+			}
+
+			size_t open = line.find('"', start + 8);
+			size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+			if (close == std::string::npos) {
+				error = fileName + "(" + std::to_string(lineNumber) + "): expected #include \"file\"";
+				return false;
+			}
+
+			std::string path = joinPath(getDirectory(fileName), line.substr(open + 1, close - open - 1));
+			if (included.insert(path).second) {
+				if (!preprocess(path, included, sourceNames, output, error)) {
+					return false;
+				}
+				output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceNumber) + "\n";
+			}
+			else {
+				// Every file is included at most once, keep the line count intact
+				output += "\n";
+			}
+		}
+		return true;
+	}
+
+	bool ShaderManager::hasExtension(const char *name)
+	{
+		GLint numExtensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+		for (int i = 0; i < numExtensions; i++) {
+			const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (ext != nullptr && strcmp(ext, name) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::string ShaderManager::getDirectory(const std::string &fileName)
+	{
+		size_t loc = fileName.find_last_of("/\\");
+		if (loc == std::string::npos) {
+			return ".";
+		}
+		if (loc == 0) {
+			return "/";
+		}
+		return fileName.substr(0, loc);
+	}
+
+	std::string ShaderManager::joinPath(const std::string &directory, const std::string &fileName)
+	{
+		if (directory == "." || (!fileName.empty() && fileName[0] == '/')) {
+			return fileName;
+		}
+		return directory + "/" + fileName;
+	}
+
+}
@@ -0,0 +1,126 @@
+/*!
+ *  ShaderManager.h
+ *
+ * Keeps GLSLPrograms in sync with their source files so shaders can be edited while the app is running.
+ */
+
+#ifndef ShaderManager_h
+#define ShaderManager_h
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLSLProgram.h"
+
+namespace basicgraphics {
+
+	/** ShaderManager watches the source files of registered programs on a background thread
+	(inotify on Linux, modification time polling elsewhere) and rebuilds a program when one of its
+	files, or any file it pulls in with #include "file", changes.
+
+	Rebuilds never block the render loop. If the driver supports GL_KHR_parallel_shader_compile the
+	compile and link are issued from update() and polled on later frames, otherwise they run on a
+	hidden window that shares the application's context. The program the application draws with
+	keeps its last good version until the new one links; errors are printed instead of thrown.
+	------------------------------------------------------------------------
+	ShaderManager shaders(_window);
+	shaders.addProgram(shader, {"BlinnPhong.vert", "BlinnPhong.frag"});
+	...
+	void onRenderGraphics() {
+		shaders.update();
+		shader.use();
+		...
+	}
+	------------------------------------------------------------------------
+	*/
+	class ShaderManager
+	{
+	public:
+
+		// shareWindow is the window whose context the programs are drawn with
+		ShaderManager(GLFWwindow* shareWindow);
+		virtual ~ShaderManager();
+
+		/*!
+		 * Builds program from the given files right away (throws on errors like GLSLProgram does) and
+		 * watches them for changes from then on. The shader type is taken from the file extension.
+		 */
+		void addProgram(GLSLProgram &program, const std::vector<std::string> &fileNames) throw (GLSLProgramException);
+
+		/*!
+		 * Queues a rebuild of every program, e.g. when the user presses a reload key.
+		 */
+		void reloadAll();
+
+		/*!
+		 * Call once per frame from the render thread. Starts queued builds and installs the ones that finished.
+		 */
+		void update();
+
+		// True if programs are compiled with GL_KHR_parallel_shader_compile
+		bool usesParallelCompile() const;
+
+		// The error from the most recent failed build, or "" if the latest build of every program succeeded
+		std::string getLastError() const;
+
+	private:
+
+		struct ShaderSource {
+			std::string fileName;
+			std::string source;
+			GLSLShader::GLSLShaderType type;
+			std::vector<std::string> sourceNames; // file name for each #line source string number
+		};
+
+		struct Entry {
+			GLSLProgram* program;
+			std::vector<std::string> fileNames;
+			std::set<std::string> dependencies; // fileNames plus everything they include
+			std::string error;
+		};
+
+		struct Build {
+			int entry;
+			std::vector<ShaderSource> sources;
+			std::unique_ptr<GLSLProgram> program; // already linked when built on the shared context
+			std::string error;
+		};
+
+		GLFWwindow* _sharedWindow;
+		bool _parallelCompile;
+		std::string _lastError;
+
+		std::vector<std::unique_ptr<Build>> _inFlight; // render thread only
+
+		mutable std::mutex _mutex; // guards everything below
+		std::vector<Entry> _entries;
+		std::set<int> _dirty;
+		std::vector<std::unique_ptr<Build>> _finished;
+
+		std::atomic<bool> _stop;
+		std::thread _worker;
+
+		void watchLoop();
+		void markChanged(const std::set<std::string> &fileNames);
+		void buildDirty();
+		void compileAndLink(Build &build);
+		void install(Build &build);
+		void report(Build &build);
+
+		static bool hasExtension(const char *name);
+		static bool preprocess(const std::string &fileName, std::set<std::string> &included, std::vector<std::string> &sourceNames, std::string &output, std::string &error);
+		static std::string getDirectory(const std::string &fileName);
+		static std::string joinPath(const std::string &directory, const std::string &fileName);
+	};
+
+}
+
+#endif /* ShaderManager_h */
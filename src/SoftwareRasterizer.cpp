@@ -0,0 +1,536 @@
+//
+//  SoftwareRasterizer.cpp
+//
+//
+
+#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define RASTERIZER_USE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTERIZER_USE_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RASTERIZER_USE_NEON
+#endif
+
+namespace basicgraphics {
+
+	// Triangles per setup chunk, bins are kept per chunk so tiles see the triangles in submission order
+	static const int TRIANGLES_PER_CHUNK = 2048;
+	static const int VERTICES_PER_TASK = 4096;
+
+	/** Eight floats processed together. Comparisons return masks with all bits of a lane set, like SSE. */
+	struct Float8
+	{
+#if defined(RASTERIZER_USE_AVX)
+		__m256 v;
+
+		Float8() {}
+		Float8(__m256 value) : v(value) {}
+		Float8(float value) : v(_mm256_set1_ps(value)) {}
+		static Float8 load(const float* p) { return _mm256_loadu_ps(p); }
+		void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		friend Float8 operator+(const Float8 &a, const Float8 &b) { return _mm256_add_ps(a.v, b.v); }
+		friend Float8 operator-(const Float8 &a, const Float8 &b) { return _mm256_sub_ps(a.v, b.v); }
+		friend Float8 operator*(const Float8 &a, const Float8 &b) { return _mm256_mul_ps(a.v, b.v); }
+		friend Float8 operator/(const Float8 &a, const Float8 &b) { return _mm256_div_ps(a.v, b.v); }
+		friend Float8 operator&(const Float8 &a, const Float8 &b) { return _mm256_and_ps(a.v, b.v); }
+		friend Float8 operator>=(const Float8 &a, const Float8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+		friend Float8 operator<=(const Float8 &a, const Float8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+		friend Float8 operator<(const Float8 &a, const Float8 &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+		friend Float8 min(const Float8 &a, const Float8 &b) { return _mm256_min_ps(a.v, b.v); }
+		friend Float8 max(const Float8 &a, const Float8 &b) { return _mm256_max_ps(a.v, b.v); }
+		friend Float8 sqrt(const Float8 &a) { return _mm256_sqrt_ps(a.v); }
+		// mask ? a : b
+		friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+		// One bit per lane
+		friend int movemask(const Float8 &mask) { return _mm256_movemask_ps(mask.v); }
+#elif defined(RASTERIZER_USE_SSE)
+		__m128 lo, hi;
+
+		Float8() {}
+		Float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+		Float8(float value) : lo(_mm_set1_ps(value)), hi(_mm_set1_ps(value)) {}
+		static Float8 load(const float* p) { return Float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+		void store(float* p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+
+		friend Float8 operator+(const Float8 &a, const Float8 &b) { return Float8(_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)); }
+		friend Float8 operator-(const Float8 &a, const Float8 &b) { return Float8(_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)); }
+		friend Float8 operator*(const Float8 &a, const Float8 &b) { return Float8(_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)); }
+		friend Float8 operator/(const Float8 &a, const Float8 &b) { return Float8(_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)); }
+		friend Float8 operator&(const Float8 &a, const Float8 &b) { return Float8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+		friend Float8 operator>=(const Float8 &a, const Float8 &b) { return Float8(_mm_cmpge_ps(a.lo, b.lo), _mm_cmpge_ps(a.hi, b.hi)); }
+		friend Float8 operator<=(const Float8 &a, const Float8 &b) { return Float8(_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)); }
+		friend Float8 operator<(const Float8 &a, const Float8 &b) { return Float8(_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)); }
+		friend Float8 min(const Float8 &a, const Float8 &b) { return Float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+		friend Float8 max(const Float8 &a, const Float8 &b) { return Float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+		friend Float8 sqrt(const Float8 &a) { return Float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+		friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b)
+		{
+			return Float8(_mm_or_ps(_mm_and_ps(mask.lo, a.lo), _mm_andnot_ps(mask.lo, b.lo)),
+				_mm_or_ps(_mm_and_ps(mask.hi, a.hi), _mm_andnot_ps(mask.hi, b.hi)));
+		}
+		friend int movemask(const Float8 &mask) { return _mm_movemask_ps(mask.lo) | (_mm_movemask_ps(mask.hi) << 4); }
+#elif defined(RASTERIZER_USE_NEON)
+		float32x4_t lo, hi;
+
+		Float8() {}
+		Float8(float32x4_t l, float32x4_t h) : lo(l), hi(h) {}
+		Float8(uint32x4_t l, uint32x4_t h) : lo(vreinterpretq_f32_u32(l)), hi(vreinterpretq_f32_u32(h)) {}
+		Float8(float value) : lo(vdupq_n_f32(value)), hi(vdupq_n_f32(value)) {}
+		static Float8 load(const float* p) { return Float8(vld1q_f32(p), vld1q_f32(p + 4)); }
+		void store(float* p) const { vst1q_f32(p, lo); vst1q_f32(p + 4, hi); }
+
+		static uint32x4_t bits(float32x4_t f) { return vreinterpretq_u32_f32(f); }
+		friend Float8 operator+(const Float8 &a, const Float8 &b) { return Float8(vaddq_f32(a.lo, b.lo), vaddq_f32(a.hi, b.hi)); }
+		friend Float8 operator-(const Float8 &a, const Float8 &b) { return Float8(vsubq_f32(a.lo, b.lo), vsubq_f32(a.hi, b.hi)); }
+		friend Float8 operator*(const Float8 &a, const Float8 &b) { return Float8(vmulq_f32(a.lo, b.lo), vmulq_f32(a.hi, b.hi)); }
+		friend Float8 operator/(const Float8 &a, const Float8 &b) { return Float8(vdivq_f32(a.lo, b.lo), vdivq_f32(a.hi, b.hi)); }
+		friend Float8 operator&(const Float8 &a, const Float8 &b) { return Float8(vandq_u32(bits(a.lo), bits(b.lo)), vandq_u32(bits(a.hi), bits(b.hi))); }
+		friend Float8 operator>=(const Float8 &a, const Float8 &b) { return Float8(vcgeq_f32(a.lo, b.lo), vcgeq_f32(a.hi, b.hi)); }
+		friend Float8 operator<=(const Float8 &a, const Float8 &b) { return Float8(vcleq_f32(a.lo, b.lo), vcleq_f32(a.hi, b.hi)); }
+		friend Float8 operator<(const Float8 &a, const Float8 &b) { return Float8(vcltq_f32(a.lo, b.lo), vcltq_f32(a.hi, b.hi)); }
+		friend Float8 min(const Float8 &a, const Float8 &b) { return Float8(vminq_f32(a.lo, b.lo), vminq_f32(a.hi, b.hi)); }
+		friend Float8 max(const Float8 &a, const Float8 &b) { return Float8(vmaxq_f32(a.lo, b.lo), vmaxq_f32(a.hi, b.hi)); }
+		friend Float8 sqrt(const Float8 &a) { return Float8(vsqrtq_f32(a.lo), vsqrtq_f32(a.hi)); }
+		friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b)
+		{
+			return Float8(vbslq_f32(bits(mask.lo), a.lo, b.lo), vbslq_f32(bits(mask.hi), a.hi, b.hi));
+		}
+		friend int movemask(const Float8 &mask)
+		{
+			uint32_t lanes[8];
+			vst1q_u32(lanes, bits(mask.lo));
+			vst1q_u32(lanes + 4, bits(mask.hi));
+			int result = 0;
+			for (int i = 0; i < 8; i++) {
+				result |= (lanes[i] >> 31) << i;
+			}
+			return result;
+		}
+#else
+		float v[8];
+
+		Float8() {}
+		Float8(float value) { for (int i = 0; i < 8; i++) v[i] = value; }
+		static Float8 load(const float* p) { Float8 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+		void store(float* p) const { memcpy(p, v, sizeof(v)); }
+
+		static float maskLane(bool set) { const unsigned int bits = set ? 0xFFFFFFFFu : 0u; float f; memcpy(&f, &bits, sizeof(f)); return f; }
+		static unsigned int laneBits(float f) { unsigned int bits; memcpy(&bits, &f, sizeof(bits)); return bits; }
+		friend Float8 operator+(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+		friend Float8 operator-(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+		friend Float8 operator*(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+		friend Float8 operator/(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = a.v[i] / b.v[i]; return r; }
+		friend Float8 operator&(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = maskLane((laneBits(a.v[i]) & laneBits(b.v[i])) != 0); return r; }
+		friend Float8 operator>=(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = maskLane(a.v[i] >= b.v[i]); return r; }
+		friend Float8 operator<=(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = maskLane(a.v[i] <= b.v[i]); return r; }
+		friend Float8 operator<(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = maskLane(a.v[i] < b.v[i]); return r; }
+		friend Float8 min(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = std::min(a.v[i], b.v[i]); return r; }
+		friend Float8 max(const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = std::max(a.v[i], b.v[i]); return r; }
+		friend Float8 sqrt(const Float8 &a) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+		friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) { Float8 r; for (int i = 0; i < 8; i++) r.v[i] = laneBits(mask.v[i]) ? a.v[i] : b.v[i]; return r; }
+		friend int movemask(const Float8 &mask) { int r = 0; for (int i = 0; i < 8; i++) r |= (laneBits(mask.v[i]) >> 31) << i; return r; }
+#endif
+	};
+
+	// Scales x, y and z to unit length, lanes of zero length stay finite
+	static void normalize8(Float8 &x, Float8 &y, Float8 &z)
+	{
+		const Float8 length = sqrt(max(x * x + y * y + z * z, Float8(1e-20f)));
+		const Float8 inverse = Float8(1.0f) / length;
+		x = x * inverse;
+		y = y * inverse;
+		z = z * inverse;
+	}
+
+	static unsigned int packColor(const glm::vec4 &color)
+	{
+		const glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f);
+		return (unsigned int)(clamped.r * 255.0f + 0.5f) | ((unsigned int)(clamped.g * 255.0f + 0.5f) << 8) |
+			((unsigned int)(clamped.b * 255.0f + 0.5f) << 16) | ((unsigned int)(clamped.a * 255.0f + 0.5f) << 24);
+	}
+
+	SoftwareRasterizer::SoftwareRasterizer(int width, int height) : _width(width), _height(height)
+	{
+		_tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+		_tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+		_stride = _tilesX * TILE_SIZE;
+		const size_t numPixels = (size_t)_stride * _tilesY * TILE_SIZE;
+		_color.resize(numPixels);
+		_depth.resize(numPixels);
+		_blockMaxDepth.resize(numPixels / (BLOCK_SIZE * BLOCK_SIZE));
+		_tileMaxDepth.resize(_tilesX * _tilesY);
+		clear(glm::vec4(0.0f));
+	}
+
+	SoftwareRasterizer::~SoftwareRasterizer()
+	{
+	}
+
+	void SoftwareRasterizer::clear(const glm::vec4 &color)
+	{
+		const unsigned int packed = packColor(color);
+		const int rowsPerTask = TILE_SIZE;
+		ThreadPool::getShared().parallelFor(0, _tilesY, [&](int tileY) {
+			const size_t first = (size_t)tileY * rowsPerTask * _stride;
+			std::fill(_color.begin() + first, _color.begin() + first + (size_t)rowsPerTask * _stride, packed);
+			std::fill(_depth.begin() + first, _depth.begin() + first + (size_t)rowsPerTask * _stride, 1.0f);
+		});
+		std::fill(_blockMaxDepth.begin(), _blockMaxDepth.end(), 1.0f);
+		std::fill(_tileMaxDepth.begin(), _tileMaxDepth.end(), 1.0f);
+	}
+
+	void SoftwareRasterizer::draw(const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices, const glm::mat4 &model,
+		const glm::mat4 &view, const glm::mat4 &projection, const Lighting &lighting)
+	{
+		ThreadPool &pool = ThreadPool::getShared();
+
+		// Vertex stage, the same as BlinnPhong.vert
+		const glm::mat4 viewProjection = projection * view;
+		const glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+		const int numVertices = vertices.size();
+		_clipVertices.resize(numVertices);
+		pool.parallelFor(0, (numVertices + VERTICES_PER_TASK - 1) / VERTICES_PER_TASK, [&](int task) {
+			const int end = std::min(numVertices, (task + 1) * VERTICES_PER_TASK);
+			for (int i = task * VERTICES_PER_TASK; i < end; i++) {
+				const glm::vec4 world = model * glm::vec4(vertices[i].position, 1.0f);
+				_clipVertices[i].world = glm::vec3(world);
+				_clipVertices[i].clip = viewProjection * world;
+				_clipVertices[i].normal = normalMatrix * vertices[i].normal;
+			}
+		});
+
+		// Clipping, setup and binning, in chunks whose bins are concatenated in order afterwards
+		const int numTriangles = indices.size() / 3;
+		const int numChunks = (numTriangles + TRIANGLES_PER_CHUNK - 1) / TRIANGLES_PER_CHUNK;
+		const int numTiles = _tilesX * _tilesY;
+		if ((int)_chunkTriangles.size() < numChunks) {
+			_chunkTriangles.resize(numChunks);
+			_chunkBins.resize(numChunks);
+		}
+		pool.parallelFor(0, numChunks, [&](int chunk) {
+			_chunkTriangles[chunk].clear();
+			_chunkBins[chunk].resize(numTiles);
+			for (int tile = 0; tile < numTiles; tile++) {
+				_chunkBins[chunk][tile].clear();
+			}
+			const int end = std::min(numTriangles, (chunk + 1) * TRIANGLES_PER_CHUNK);
+			for (int i = chunk * TRIANGLES_PER_CHUNK; i < end; i++) {
+				clipTriangle(_clipVertices[indices[i * 3]], _clipVertices[indices[i * 3 + 1]], _clipVertices[indices[i * 3 + 2]], chunk);
+			}
+		});
+
+		// Each tile is only touched by one thread, so the tiles need no locking
+		pool.parallelFor(0, numTiles, [&](int tile) {
+			for (int chunk = 0; chunk < numChunks; chunk++) {
+				const std::vector<int> &bin = _chunkBins[chunk][tile];
+				const std::vector<Triangle> &triangles = _chunkTriangles[chunk];
+				for (int i = 0; i < bin.size(); i++) {
+					const Triangle &triangle = triangles[bin[i]];
+					// Everything in the tile is already nearer than this triangle
+					if (triangle.minDepth >= _tileMaxDepth[tile]) {
+						continue;
+					}
+					if (rasterizeTriangle(triangle, tile % _tilesX, tile / _tilesX, lighting)) {
+						const int blocksPerTile = TILE_SIZE / BLOCK_SIZE;
+						const int blocksPerRow = _stride / BLOCK_SIZE;
+						const int firstBlockX = (tile % _tilesX) * blocksPerTile;
+						const int firstBlockY = (tile / _tilesX) * blocksPerTile;
+						float tileMax = 0.0f;
+						for (int y = 0; y < blocksPerTile; y++) {
+							const float* row = &_blockMaxDepth[(size_t)(firstBlockY + y) * blocksPerRow + firstBlockX];
+							tileMax = std::max(tileMax, *std::max_element(row, row + blocksPerTile));
+						}
+						_tileMaxDepth[tile] = tileMax;
+					}
+				}
+			}
+		});
+	}
+
+	void SoftwareRasterizer::clipTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, int chunk)
+	{
+		const ClipVertex* input[3] = { &v0, &v1, &v2 };
+
+		// Entirely outside one of the frustum planes
+		for (int axis = 0; axis < 3; axis++) {
+			bool allAbove = true;
+			bool allBelow = true;
+			for (int i = 0; i < 3; i++) {
+				allAbove = allAbove && input[i]->clip[axis] > input[i]->clip.w;
+				allBelow = allBelow && input[i]->clip[axis] < -input[i]->clip.w;
+			}
+			if (allAbove || allBelow) {
+				return;
+			}
+		}
+
+		// Only the near plane (z >= -w) is clipped against, the others are handled by the screen bounds
+		float distance[3];
+		bool allInside = true;
+		for (int i = 0; i < 3; i++) {
+			distance[i] = input[i]->clip.z + input[i]->clip.w;
+			allInside = allInside && distance[i] >= 0.0f;
+		}
+		if (allInside) {
+			setupTriangle(v0, v1, v2, chunk);
+			return;
+		}
+
+		ClipVertex polygon[4];
+		int numPolygon = 0;
+		for (int i = 0; i < 3; i++) {
+			const int next = (i + 1) % 3;
+			if (distance[i] >= 0.0f) {
+				polygon[numPolygon++] = *input[i];
+			}
+			if ((distance[i] >= 0.0f) != (distance[next] >= 0.0f)) {
+				const float t = distance[i] / (distance[i] - distance[next]);
+				ClipVertex &clipped = polygon[numPolygon++];
+				clipped.clip = glm::mix(input[i]->clip, input[next]->clip, t);
+				clipped.world = glm::mix(input[i]->world, input[next]->world, t);
+				clipped.normal = glm::mix(input[i]->normal, input[next]->normal, t);
+			}
+		}
+		for (int i = 1; i + 1 < numPolygon; i++) {
+			setupTriangle(polygon[0], polygon[i], polygon[i + 1], chunk);
+		}
+	}
+
+	void SoftwareRasterizer::setupTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, int chunk)
+	{
+		const ClipVertex* input[3] = { &v0, &v1, &v2 };
+		glm::vec2 screen[3];
+		float values[3][NUM_INTERPOLANTS];
+		for (int i = 0; i < 3; i++) {
+			const float invW = 1.0f / input[i]->clip.w;
+			const glm::vec3 ndc = glm::vec3(input[i]->clip) * invW;
+			// Window coordinates with y flipped, so row 0 is the top of the image
+			screen[i] = glm::vec2((ndc.x * 0.5f + 0.5f) * _width, (0.5f - ndc.y * 0.5f) * _height);
+			values[i][DEPTH] = ndc.z * 0.5f + 0.5f;
+			values[i][INV_W] = invW;
+			values[i][WORLD_X] = input[i]->world.x * invW;
+			values[i][WORLD_Y] = input[i]->world.y * invW;
+			values[i][WORLD_Z] = input[i]->world.z * invW;
+			values[i][NORMAL_X] = input[i]->normal.x * invW;
+			values[i][NORMAL_Y] = input[i]->normal.y * invW;
+			values[i][NORMAL_Z] = input[i]->normal.z * invW;
+		}
+
+		const float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+		if (!(std::fabs(area) > 1e-12f)) {
+			return;
+		}
+
+		Triangle triangle;
+		const glm::vec2 minScreen = glm::min(glm::min(screen[0], screen[1]), screen[2]);
+		const glm::vec2 maxScreen = glm::max(glm::max(screen[0], screen[1]), screen[2]);
+		triangle.minX = std::max(0, (int)std::floor(std::max(minScreen.x, -1.0f)));
+		triangle.minY = std::max(0, (int)std::floor(std::max(minScreen.y, -1.0f)));
+		triangle.maxX = std::min(_width - 1, (int)std::ceil(std::min(maxScreen.x, (float)_width)));
+		triangle.maxY = std::min(_height - 1, (int)std::ceil(std::min(maxScreen.y, (float)_height)));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+			return;
+		}
+
+		// Edge i is opposite vertex i, so dividing by the area makes it vertex i's barycentric coordinate.
+		// Dividing by the signed area also makes the inside positive for both windings.
+		for (int i = 0; i < 3; i++) {
+			const glm::vec2 &a = screen[(i + 1) % 3];
+			const glm::vec2 &b = screen[(i + 2) % 3];
+			triangle.edgeA[i] = (a.y - b.y) / area;
+			triangle.edgeB[i] = (b.x - a.x) / area;
+			triangle.edgeC[i] = (a.x * b.y - a.y * b.x) / area;
+		}
+		for (int k = 0; k < NUM_INTERPOLANTS; k++) {
+			triangle.base[k] = values[0][k];
+			triangle.d1[k] = values[1][k] - values[0][k];
+			triangle.d2[k] = values[2][k] - values[0][k];
+		}
+		triangle.minDepth = std::min(std::min(values[0][DEPTH], values[1][DEPTH]), values[2][DEPTH]);
+
+		std::vector<Triangle> &triangles = _chunkTriangles[chunk];
+		const int index = triangles.size();
+		triangles.push_back(triangle);
+		for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; tileY++) {
+			for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; tileX++) {
+				_chunkBins[chunk][tileY * _tilesX + tileX].push_back(index);
+			}
+		}
+	}
+
+	bool SoftwareRasterizer::rasterizeTriangle(const Triangle &triangle, int tileX, int tileY, const Lighting &lighting)
+	{
+		const int minX = std::max(triangle.minX, tileX * TILE_SIZE);
+		const int minY = std::max(triangle.minY, tileY * TILE_SIZE);
+		const int maxX = std::min(triangle.maxX, (tileX + 1) * TILE_SIZE - 1);
+		const int maxY = std::min(triangle.maxY, (tileY + 1) * TILE_SIZE - 1);
+		const int blocksPerRow = _stride / BLOCK_SIZE;
+
+		static const float laneOffsets[8] = { 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f };
+		const Float8 lanes = Float8::load(laneOffsets);
+		const Float8 zero(0.0f);
+		const Float8 lightX(lighting.lightPosition.x), lightY(lighting.lightPosition.y), lightZ(lighting.lightPosition.z);
+		const Float8 eyeX(lighting.eyePosition.x), eyeY(lighting.eyePosition.y), eyeZ(lighting.eyePosition.z);
+		const int tableSize = lighting.tableSize;
+		const int tableRows = lighting.tableRows;
+
+		bool wroteAny = false;
+		for (int blockY = minY / BLOCK_SIZE; blockY <= maxY / BLOCK_SIZE; blockY++) {
+			for (int blockX = minX / BLOCK_SIZE; blockX <= maxX / BLOCK_SIZE; blockX++) {
+				if (triangle.minDepth >= _blockMaxDepth[(size_t)blockY * blocksPerRow + blockX]) {
+					continue;
+				}
+
+				// The block is outside an edge if even its corner farthest inside that edge is outside
+				const float left = blockX * BLOCK_SIZE + 0.5f;
+				const float top = blockY * BLOCK_SIZE + 0.5f;
+				bool outside = false;
+				for (int i = 0; i < 3 && !outside; i++) {
+					const float x = triangle.edgeA[i] >= 0.0f ? left + BLOCK_SIZE - 1 : left;
+					const float y = triangle.edgeB[i] >= 0.0f ? top + BLOCK_SIZE - 1 : top;
+					outside = triangle.edgeA[i] * x + triangle.edgeB[i] * y + triangle.edgeC[i] < 0.0f;
+				}
+				if (outside) {
+					continue;
+				}
+
+				const Float8 x = Float8(left) + lanes;
+				const Float8 columnMask = (x >= Float8(minX + 0.5f)) & (x <= Float8(maxX + 0.5f));
+				bool wroteBlock = false;
+				for (int row = 0; row < BLOCK_SIZE; row++) {
+					const int pixelY = blockY * BLOCK_SIZE + row;
+					if (pixelY < minY || pixelY > maxY) {
+						continue;
+					}
+					const Float8 b0 = Float8(triangle.edgeA[0]) * x + Float8(triangle.edgeB[0] * (pixelY + 0.5f) + triangle.edgeC[0]);
+					const Float8 b1 = Float8(triangle.edgeA[1]) * x + Float8(triangle.edgeB[1] * (pixelY + 0.5f) + triangle.edgeC[1]);
+					const Float8 b2 = Float8(triangle.edgeA[2]) * x + Float8(triangle.edgeB[2] * (pixelY + 0.5f) + triangle.edgeC[2]);
+					Float8 mask = columnMask & (b0 >= zero) & (b1 >= zero) & (b2 >= zero);
+					if (movemask(mask) == 0) {
+						continue;
+					}
+
+					const size_t offset = (size_t)pixelY * _stride + blockX * BLOCK_SIZE;
+					const Float8 depth = Float8(triangle.base[DEPTH]) + b1 * Float8(triangle.d1[DEPTH]) + b2 * Float8(triangle.d2[DEPTH]);
+					const Float8 oldDepth = Float8::load(&_depth[offset]);
+					mask = mask & (depth < oldDepth);
+					const int bits = movemask(mask);
+					if (bits == 0) {
+						continue;
+					}
+					select(mask, depth, oldDepth).store(&_depth[offset]);
+
+					// Perspective correct world position and normal
+					Float8 interpolated[NUM_INTERPOLANTS];
+					for (int k = INV_W; k < NUM_INTERPOLANTS; k++) {
+						interpolated[k] = Float8(triangle.base[k]) + b1 * Float8(triangle.d1[k]) + b2 * Float8(triangle.d2[k]);
+					}
+					const Float8 w = Float8(1.0f) / interpolated[INV_W];
+					const Float8 worldX = interpolated[WORLD_X] * w;
+					const Float8 worldY = interpolated[WORLD_Y] * w;
+					const Float8 worldZ = interpolated[WORLD_Z] * w;
+					// The normal's length doesn't matter, so it doesn't need the multiply by w
+					Float8 normalX = interpolated[NORMAL_X], normalY = interpolated[NORMAL_Y], normalZ = interpolated[NORMAL_Z];
+					normalize8(normalX, normalY, normalZ);
+
+					// BlinnPhong.frag
+					Float8 toLightX = lightX - worldX, toLightY = lightY - worldY, toLightZ = lightZ - worldZ;
+					normalize8(toLightX, toLightY, toLightZ);
+					Float8 toEyeX = eyeX - worldX, toEyeY = eyeY - worldY, toEyeZ = eyeZ - worldZ;
+					normalize8(toEyeX, toEyeY, toEyeZ);
+					Float8 halfwayX = toLightX + toEyeX, halfwayY = toLightY + toEyeY, halfwayZ = toLightZ + toEyeZ;
+					normalize8(halfwayX, halfwayY, halfwayZ);
+					// In texels, relative to the texel centers like GL_LINEAR
+					const Float8 half(0.5f);
+					const Float8 dotLN = max(max(normalX * toLightX + normalY * toLightY + normalZ * toLightZ, zero) * Float8((float)tableSize) - half, zero);
+					const Float8 dotHN = max(max(normalX * halfwayX + normalY * halfwayY + normalZ * halfwayZ, zero) * Float8((float)tableRows) - half, zero);
+
+					// Bilinear, clamp to edge lookup, one lane at a time
+					float u[8], v[8];
+					dotLN.store(u);
+					dotHN.store(v);
+					unsigned int* color = &_color[offset];
+					for (int lane = 0; lane < 8; lane++) {
+						if (bits & (1 << lane)) {
+							const int x0 = std::min((int)u[lane], tableSize - 1);
+							const int y0 = std::min((int)v[lane], tableRows - 1);
+							const int x1 = std::min(x0 + 1, tableSize - 1);
+							const int y1 = std::min(y0 + 1, tableRows - 1);
+							const float fx = u[lane] - x0;
+							const float fy = v[lane] - y0;
+							const float* row0 = lighting.table + (size_t)y0 * tableSize * 3;
+							const float* row1 = lighting.table + (size_t)y1 * tableSize * 3;
+							glm::vec3 texel;
+							for (int c = 0; c < 3; c++) {
+								const float top = row0[x0 * 3 + c] + (row0[x1 * 3 + c] - row0[x0 * 3 + c]) * fx;
+								const float bottom = row1[x0 * 3 + c] + (row1[x1 * 3 + c] - row1[x0 * 3 + c]) * fx;
+								texel[c] = top + (bottom - top) * fy;
+							}
+							color[lane] = packColor(glm::vec4(lighting.ambient + texel, 1.0f));
+						}
+					}
+					wroteBlock = true;
+				}
+
+				if (wroteBlock) {
+					updateBlockMaxDepth(blockX, blockY);
+					wroteAny = true;
+				}
+			}
+		}
+		return wroteAny;
+	}
+
+	void SoftwareRasterizer::updateBlockMaxDepth(int blockX, int blockY)
+	{
+		const float* depth = &_depth[(size_t)blockY * BLOCK_SIZE * _stride + blockX * BLOCK_SIZE];
+		Float8 farthest = Float8::load(depth);
+		for (int row = 1; row < BLOCK_SIZE; row++) {
+			farthest = max(farthest, Float8::load(depth + (size_t)row * _stride));
+		}
+		float lanes[8];
+		farthest.store(lanes);
+		_blockMaxDepth[(size_t)blockY * (_stride / BLOCK_SIZE) + blockX] = *std::max_element(lanes, lanes + 8);
+	}
+
+	void SoftwareRasterizer::readPixels(int channels, std::vector<unsigned char> &pixels) const
+	{
+		pixels.resize((size_t)_width * _height * channels);
+		for (int y = 0; y < _height; y++) {
+			const unsigned int* source = &_color[(size_t)y * _stride];
+			unsigned char* destination = &pixels[(size_t)y * _width * channels];
+			for (int x = 0; x < _width; x++) {
+				for (int c = 0; c < channels; c++) {
+					destination[x * channels + c] = (unsigned char)(source[x] >> (8 * c));
+				}
+			}
+		}
+	}
+
+	float SoftwareRasterizer::getDepth(int x, int y) const
+	{
+		return _depth[(size_t)y * _stride + x];
+	}
+
+	int SoftwareRasterizer::getWidth() const
+	{
+		return _width;
+	}
+
+	int SoftwareRasterizer::getHeight() const
+	{
+		return _height;
+	}
+
+}
@@ -0,0 +1,134 @@
+/*!
+ *  SoftwareRasterizer.h
+ *
+ * Draws Mesh::Vertex triangles with the BlinnPhong lighting table on the CPU, without a GL context.
+ */
+
+#ifndef SoftwareRasterizer_h
+#define SoftwareRasterizer_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace basicgraphics {
+
+	/** SoftwareRasterizer is a tile based renderer for machines without a usable GPU, shading like
+	BlinnPhong.frag: ambient plus a bilinear lookup in a LightingLUT table at (N.L, N.H).
+
+	draw() runs in three passes on the ThreadPool: the vertices are transformed, the triangles are clipped
+	against the near plane, set up and binned into 64x64 pixel tiles (in chunks, so the bins keep the
+	submission order), then every tile is rasterized by one thread. Inside a tile the triangle's bounding
+	box is walked in 8x8 pixel blocks with 8 wide edge functions and interpolation (AVX, two SSE or NEON
+	vectors, or plain floats). Each tile and each block remembers its farthest depth, so blocks and whole
+	tiles that are already covered by something nearer are skipped before any pixel is touched.
+
+	Depth, attributes and the GL conventions match the GL path: GL_LESS depth test, perspective correct
+	interpolation, pixel centers at .5, no face culling. The result is read back top row first.
+	------------------------------------------------------------------------
+	SoftwareRasterizer rasterizer(1920, 1080);
+	SoftwareRasterizer::Lighting lighting;
+	lighting.lightPosition = lightPos;
+	lighting.eyePosition = eyePos;
+	lighting.ambient = ambientCoefficient * ambientIntensity;
+	lighting.table = &lut.getTable()[0];
+	lighting.tableSize = lut.getSize();
+	lighting.tableRows = lut.getNumRows();
+	rasterizer.clear(glm::vec4(1.0));
+	rasterizer.draw(vertices, indices, model, view, projection, lighting);
+	rasterizer.readPixels(3, pixels);
+	------------------------------------------------------------------------
+	*/
+	class SoftwareRasterizer
+	{
+	public:
+
+		static const int TILE_SIZE = 64;
+		static const int BLOCK_SIZE = 8;
+
+		struct Lighting {
+			glm::vec3 lightPosition; /// world space
+			glm::vec3 eyePosition;   /// world space
+			glm::vec3 ambient;       /// ambient coefficient times intensity
+			const float* table;      /// tableSize * tableRows RGB floats, see LightingLUT::bake
+			int tableSize;
+			int tableRows;
+		};
+
+		SoftwareRasterizer(int width, int height);
+		virtual ~SoftwareRasterizer();
+
+		// Clears the color to color and the depth to the far plane
+		void clear(const glm::vec4 &color);
+
+		// Draws indexed triangles (three indices each) into the color and depth buffers
+		void draw(const std::vector<Mesh::Vertex> &vertices, const std::vector<int> &indices, const glm::mat4 &model,
+			const glm::mat4 &view, const glm::mat4 &projection, const Lighting &lighting);
+
+		// Copies the color buffer, top row first, with 3 (RGB) or 4 (RGBA) bytes per pixel
+		void readPixels(int channels, std::vector<unsigned char> &pixels) const;
+
+		// Window space depth in [0, 1] of the pixel, top row first
+		float getDepth(int x, int y) const;
+
+		int getWidth() const;
+		int getHeight() const;
+
+	private:
+		SoftwareRasterizer(const SoftwareRasterizer&) {}; // prevent copying
+
+		// After the vertex stage, before the perspective divide
+		struct ClipVertex {
+			glm::vec4 clip;
+			glm::vec3 world;
+			glm::vec3 normal;
+		};
+
+		// Interpolated values in the order they are stored in Triangle
+		enum Interpolant { DEPTH, INV_W, WORLD_X, WORLD_Y, WORLD_Z, NORMAL_X, NORMAL_Y, NORMAL_Z, NUM_INTERPOLANTS };
+
+		/*!
+		 * Set up once, used by every tile the triangle touches. The edge functions are scaled so they give
+		 * the barycentric coordinates directly, and every interpolant (attributes divided by w, except depth)
+		 * is v0 + b1 * d1 + b2 * d2.
+		 */
+		struct Triangle {
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+			float base[NUM_INTERPOLANTS];
+			float d1[NUM_INTERPOLANTS];
+			float d2[NUM_INTERPOLANTS];
+			float minDepth;
+			int minX, minY, maxX, maxY; /// inclusive pixel bounds, clamped to the screen
+		};
+
+		int _width;
+		int _height;
+		int _tilesX;
+		int _tilesY;
+		int _stride; /// of the padded buffers, a whole number of tiles wide
+
+		std::vector<unsigned int> _color; /// RGBA8, padded to whole tiles
+		std::vector<float> _depth;
+		std::vector<float> _blockMaxDepth; /// hierarchical depth: farthest depth in each block
+		std::vector<float> _tileMaxDepth;  /// and in each tile
+
+		// Reused between draws so a frame doesn't allocate
+		std::vector<ClipVertex> _clipVertices;
+		std::vector<std::vector<Triangle>> _chunkTriangles;
+		std::vector<std::vector<std::vector<int>>> _chunkBins; /// [chunk][tile] indices into _chunkTriangles[chunk]
+
+		void setupTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, int chunk);
+		void clipTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, int chunk);
+		void rasterizeTile(int tile, const Lighting &lighting);
+		bool rasterizeTriangle(const Triangle &triangle, int tileX, int tileY, const Lighting &lighting);
+		void updateBlockMaxDepth(int blockX, int blockY);
+	};
+
+}
+
+#endif /* SoftwareRasterizer_h */
@@ -7,6 +7,7 @@
 //
 
 #include "Sphere.h"
+#include "GLStats.h"
 
 namespace basicgraphics {
 
@@ -27,6 +28,7 @@ namespace basicgraphics {
     }
 
 	void Sphere::draw(GLSLProgram &shader, const glm::mat4 &modelMatrix) {
+		GLCallSite site("Sphere::draw");
 
 		glm::mat4 translate = glm::translate(glm::mat4(1.0), _position);
         glm::mat4 scale = glm::scale(glm::mat4(1.0), glm::vec3(_radius));
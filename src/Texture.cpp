@@ -7,11 +7,63 @@
  */ 
 
 #include "Texture.h"
-
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+#include "PixelReadback.h"
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include "HeadlessContext.h"
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <cstring>
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_USE_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEXTURE_USE_NEON
+#endif
 
 namespace basicgraphics {
 
-	Texture::Texture(const std::string &name, int width, int height, int depth, int numMipMapLevels, bool autoMipMap, GLenum target, GLenum internalFormat, GLenum externalFormat, GLenum dataFormat, const void* bytes[6])
+	// GL_ARB_bindless_texture entry points, loaded on first use since the GL loader only covers core 3.2
+	struct BindlessFunctions {
+		typedef GLuint64(APIENTRYP GetTextureHandle)(GLuint texture);
+		typedef void (APIENTRYP MakeTextureHandleResident)(GLuint64 handle);
+		typedef void (APIENTRYP MakeTextureHandleNonResident)(GLuint64 handle);
+
+		bool supported;
+		GetTextureHandle getTextureHandle;
+		MakeTextureHandleResident makeTextureHandleResident;
+		MakeTextureHandleNonResident makeTextureHandleNonResident;
+	};
+
+	static const BindlessFunctions& bindless()
+	{
+		static BindlessFunctions functions;
+		static bool loaded = false;
+		if (!loaded) {
+			loaded = true;
+			functions.supported = false;
+			GLint numExtensions = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+			for (int i = 0; i < numExtensions && !functions.supported; i++) {
+				functions.supported = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_bindless_texture") == 0;
+			}
+			// Works with a window or a headless context
+			functions.getTextureHandle = (BindlessFunctions::GetTextureHandle)HeadlessContext::getProcAddress("glGetTextureHandleARB");
+			functions.makeTextureHandleResident = (BindlessFunctions::MakeTextureHandleResident)HeadlessContext::getProcAddress("glMakeTextureHandleResidentARB");
+			functions.makeTextureHandleNonResident = (BindlessFunctions::MakeTextureHandleNonResident)HeadlessContext::getProcAddress("glMakeTextureHandleNonResidentARB");
+			functions.supported = functions.supported && functions.getTextureHandle != nullptr && functions.makeTextureHandleResident != nullptr && functions.makeTextureHandleNonResident != nullptr;
+		}
+		return functions;
+	}
+
+	Texture::Texture(const std::string &name, int width, int height, int depth, int numMipMapLevels, bool autoMipMap, GLenum target, GLenum internalFormat, GLenum externalFormat, GLenum dataFormat, const void* bytes[6]) : _memory(MemoryAccounting::TEXTURES)
 	{
 		_name = name;
 		_fileName = "";
@@ -24,6 +76,9 @@ namespace basicgraphics {
 		_externalFormat = externalFormat;
 		_numMipMapLevels = numMipMapLevels;
 		_autoGenMipMaps = autoMipMap;
+		_resident = true;
+		_bindlessHandle = 0;
+		_alphaMode = getFormatAlphaMode(internalFormat);
 
 		_empty = false;
 		if (bytes[0] == nullptr) {
@@ -107,6 +162,12 @@ namespace basicgraphics {
 
 		//glPopClientAttrib();
 		//glPopAttrib();
+
+		updateMemory();
+		if (!_empty) {
+			Metrics::add(Metrics::TEXTURE_UPLOADS);
+			Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, getLevelBytes(0));
+		}
 	}
 
 	void Texture::update(const void* bytes, GLenum externalFormat, GLenum dataFormat, int unpackAlignment/*=4*/, int unpackRowLength/*=-1*/, int cubeMapFace/*=0*/)
@@ -154,6 +215,8 @@ namespace basicgraphics {
 		if (_empty) {
 			_empty = false;
 		}
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+		Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, (_target == GL_TEXTURE_CUBE_MAP) ? getLevelBytes(0) / 6 : getLevelBytes(0));
 
 		if (_autoGenMipMaps) {
 			glGenerateMipmap(_target);
@@ -184,6 +247,7 @@ namespace basicgraphics {
 	void Texture::setFileName(const std::string &filename)
 	{
 		_fileName = filename;
+		_memory.setTag(_fileName);
 	}
 
 	std::string Texture::getFileName() const
@@ -211,80 +275,270 @@ namespace basicgraphics {
 		return _height;
 	}
 
-	bool Texture::isOpaque() const
+	bool Texture::isResident() const
 	{
-		if (_internalFormat == GL_LUMINANCE_ALPHA ||
-			_internalFormat == GL_LUMINANCE8_ALPHA8 ||
-			_internalFormat == GL_RGBA ||
-			_internalFormat == GL_RGBA2 ||
-			_internalFormat == GL_RGBA4 ||
-			_internalFormat == GL_RGBA4 ||
-			_internalFormat == GL_RGB5_A1 ||
-			_internalFormat == GL_RGBA8 ||
-			_internalFormat == GL_RGBA8_SNORM ||
-			_internalFormat == GL_RGB10_A2 ||
-			_internalFormat == GL_RGB10_A2UI ||
-			_internalFormat == GL_RGBA12 ||
-			_internalFormat == GL_RGBA16 ||
-			_internalFormat == GL_RGBA16_SNORM ||
-			_internalFormat == GL_SRGB8_ALPHA8 ||
-			_internalFormat == GL_RGBA16F ||
-			_internalFormat == GL_RGBA32F ||
-			_internalFormat == GL_RGBA8I ||
-			_internalFormat == GL_RGBA8UI ||
-			_internalFormat == GL_RGBA16I ||
-			_internalFormat == GL_RGBA16UI ||
-			_internalFormat == GL_RGBA32I ||
-			_internalFormat == GL_RGBA32UI) {
-			return false;
-		}
-		return true;
+		return _resident;
 	}
 
-	void Texture::save2D(const std::string &file)
+	void Texture::makeResident(GLuint texID, int width, int height, GLenum internalFormat, AlphaMode alphaMode)
 	{
-		
-		assert(_target == GL_TEXTURE_2D);
+		// Carry over whatever the user set on the placeholder in the meantime
+		const GLenum params[] = { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R };
+		const int numParams = sizeof(params) / sizeof(GLenum);
+		GLint values[numParams];
+
 		glBindTexture(_target, _texID);
+		for (int i = 0; i < numParams; i++) {
+			glGetTexParameteriv(_target, params[i], &values[i]);
+		}
 
-		int size = sizeof(unsigned char) * _width * _height * 4;
-		unsigned char *raw_img = (unsigned char*)malloc(size);
-		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, raw_img);
+		glBindTexture(_target, texID);
+		for (int i = 0; i < numParams; i++) {
+			glTexParameteri(_target, params[i], values[i]);
+		}
 
-		int result = SOIL_save_image(file.c_str(), SOIL_SAVE_TYPE_BMP, _width, _height, 4, raw_img);
+		glDeleteTextures(1, &_texID);
+		_texID = texID;
+		_width = width;
+		_height = height;
+		_internalFormat = internalFormat;
+		_externalFormat = getExternalFormat(internalFormat);
+		_dataFormat = determineDataType(internalFormat);
+		_alphaMode = alphaMode;
+		_empty = false;
+		_resident = true;
+		updateMemory();
+	}
 
-		if (result == 0) {
-			std::cerr << SOIL_last_result() << std::endl;
-			assert(false);
+	size_t Texture::getMemoryBytes() const
+	{
+		return _memory.getBytes();
+	}
+
+	void Texture::updateMemory()
+	{
+		// Generated mipmaps always go down to 1x1, whatever numMipMapLevels said
+		int numLevels = _numMipMapLevels;
+		if (!isCompressed() && (_autoGenMipMaps || _numMipMapLevels > 1)) {
+			numLevels = MipMapGenerator::getNumLevels(_width, _height);
 		}
-		
-/*
-		assert(_target == GL_TEXTURE_2D);
-		glBindTexture(_target, _texID);
+		size_t bytes = 0;
+		for (int level = 0; level < numLevels; level++) {
+			bytes += getLevelBytes(level);
+		}
+		_memory.setTag(_fileName.empty() ? _name : _fileName);
+		_memory.setBytes(bytes);
+	}
 
-		int size = sizeof(BYTE) * _width * _height * 4;
-		BYTE *raw_img = (BYTE*)malloc(size);
-		glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, raw_img);
+	size_t Texture::getLevelBytes(int level) const
+	{
+		const int levelWidth = std::max(1, _width >> level);
+		const int levelHeight = std::max(1, _height >> level);
+		// The layers of an array keep their count, a 3D texture shrinks in depth too
+		const int levelDepth = (_target == GL_TEXTURE_3D) ? std::max(1, _depth >> level) : std::max(1, _depth);
+		const int numFaces = (_target == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+		const size_t slice = isCompressed() ? CompressedImage::getLevelByteSize(_internalFormat, levelWidth, levelHeight) : (size_t)levelWidth * levelHeight * getBytesPerTexel(_internalFormat);
+		return slice * levelDepth * numFaces;
+	}
 
-		fipImage* image = new fipImage(FIT_BITMAP, _width, _height, 32);
+	int Texture::getBytesPerTexel(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_LUMINANCE:
+		case GL_LUMINANCE8:
+		case GL_RED:
+		case GL_R8:
+			return 1;
+		case GL_LUMINANCE_ALPHA:
+		case GL_LUMINANCE8_ALPHA8:
+		case GL_LUMINANCE16:
+		case GL_RG8:
+			return 2;
+		case GL_RGB16F:
+		case GL_RGBA16F:
+		case GL_RG32F:
+			return 8;
+		case GL_RGB32F:
+		case GL_RGBA32F:
+			return 16;
+		default:
+			// RGB8, RGBA8, R32F and the 24 and 32 bit depth formats
+			return 4;
+		}
+	}
 
-		BYTE* pixels(image->accessPixels());
+	int Texture::getNumLayers() const
+	{
+		return (_target == GL_TEXTURE_2D_ARRAY) ? _depth : 1;
+	}
 
-		const size_t bytesPerPixel = 4;
-		const size_t rowStride = size_t(_width * bytesPerPixel);
+	bool Texture::isBindlessSupported()
+	{
+		return bindless().supported;
+	}
 
-		for (int row = 0; row < _height; ++row) {
-			std::memcpy(image->getScanLine(row), raw_img + rowStride * row, rowStride);
+	GLuint64 Texture::getBindlessHandle()
+	{
+		if (_bindlessHandle == 0 && isBindlessSupported()) {
+			_bindlessHandle = bindless().getTextureHandle(_texID);
+			if (_bindlessHandle != 0) {
+				bindless().makeTextureHandleResident(_bindlessHandle);
+			}
 		}
+		return _bindlessHandle;
+	}
 
-		int flag = 0;
-		if (!image->save(file.c_str(), flag)) {
-			assert(false);
+	bool Texture::isCompressed() const
+	{
+		return CompressedImage::isCompressedFormat(_internalFormat);
+	}
+
+	Texture::AlphaMode Texture::getAlphaMode() const
+	{
+		return _alphaMode;
+	}
+
+	void Texture::setAlphaMode(AlphaMode mode)
+	{
+		_alphaMode = mode;
+	}
+
+	bool Texture::isOpaque() const
+	{
+		return _alphaMode == ALPHA_OPAQUE;
+	}
+
+	Texture::AlphaMode Texture::classifyAlpha(const unsigned char* pixels, int width, int height, int channels)
+	{
+		if (channels != 2 && channels != 4) {
+			return ALPHA_OPAQUE;
 		}
-		free(raw_img);
-		delete image;
- */
 
+		const size_t numBytes = (size_t)width * height * channels;
+		const unsigned char low = ALPHA_CUTOUT_TOLERANCE;
+		const unsigned char high = 255 - ALPHA_CUTOUT_TOLERANCE;
+		unsigned char minAlpha = 255;
+		bool partial = false;
+		size_t i = 0;
+
+		// 16 bytes at a time. The color bytes are forced to 255 so only the alpha bytes can lower the minimum or
+		// land between low and high. Checking for a partial alpha every 64 blocks keeps the loop free of branches.
+#if defined(TEXTURE_USE_SSE)
+		const __m128i ones = _mm_set1_epi8((char)0xFF);
+		const __m128i colorMask = (channels == 4) ? _mm_set1_epi32(0x00FFFFFF) : _mm_set1_epi16(0x00FF);
+		const __m128i lowV = _mm_set1_epi8((char)low);
+		const __m128i highV = _mm_set1_epi8((char)high);
+		const __m128i zero = _mm_setzero_si128();
+		__m128i minV = ones;
+		__m128i partialV = zero;
+		while (i + 16 <= numBytes && !partial) {
+			const size_t end = std::min(numBytes - (numBytes - i) % 16, i + 16 * 64);
+			for (; i < end; i += 16) {
+				__m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(pixels + i)), colorMask);
+				minV = _mm_min_epu8(minV, a);
+				// a > low and a < high, saturating subtraction is zero exactly when the comparison fails
+				__m128i aboveLow = _mm_cmpeq_epi8(_mm_subs_epu8(a, lowV), zero);
+				__m128i belowHigh = _mm_cmpeq_epi8(_mm_subs_epu8(highV, a), zero);
+				partialV = _mm_or_si128(partialV, _mm_andnot_si128(_mm_or_si128(aboveLow, belowHigh), ones));
+			}
+			partial = _mm_movemask_epi8(partialV) != 0;
+		}
+		unsigned char lanes[16];
+		_mm_storeu_si128((__m128i*)lanes, minV);
+		for (int lane = 0; lane < 16; lane++) {
+			minAlpha = std::min(minAlpha, lanes[lane]);
+		}
+#elif defined(TEXTURE_USE_NEON)
+		const uint8x16_t colorMask = (channels == 4) ? vreinterpretq_u8_u32(vdupq_n_u32(0x00FFFFFF)) : vreinterpretq_u8_u16(vdupq_n_u16(0x00FF));
+		const uint8x16_t lowV = vdupq_n_u8(low);
+		const uint8x16_t highV = vdupq_n_u8(high);
+		uint8x16_t minV = vdupq_n_u8(255);
+		uint8x16_t partialV = vdupq_n_u8(0);
+		while (i + 16 <= numBytes && !partial) {
+			const size_t end = std::min(numBytes - (numBytes - i) % 16, i + 16 * 64);
+			for (; i < end; i += 16) {
+				uint8x16_t a = vorrq_u8(vld1q_u8(pixels + i), colorMask);
+				minV = vminq_u8(minV, a);
+				partialV = vorrq_u8(partialV, vandq_u8(vcgtq_u8(a, lowV), vcltq_u8(a, highV)));
+			}
+			uint8x8_t any = vpmax_u8(vget_low_u8(partialV), vget_high_u8(partialV));
+			any = vpmax_u8(any, any);
+			any = vpmax_u8(any, any);
+			any = vpmax_u8(any, any);
+			partial = vget_lane_u8(any, 0) != 0;
+		}
+		uint8x8_t m = vpmin_u8(vget_low_u8(minV), vget_high_u8(minV));
+		m = vpmin_u8(m, m);
+		m = vpmin_u8(m, m);
+		m = vpmin_u8(m, m);
+		minAlpha = vget_lane_u8(m, 0);
+#endif
+
+		// 16 is a multiple of both pixel sizes, so the rest starts on a pixel
+		for (; i < numBytes && !partial; i += channels) {
+			const unsigned char a = pixels[i + channels - 1];
+			minAlpha = std::min(minAlpha, a);
+			partial = a > low && a < high;
+		}
+
+		if (partial) {
+			return ALPHA_BLEND;
+		}
+		// Near 255 everywhere is opaque, so it keeps early-Z instead of going through the alpha test
+		return (minAlpha >= high) ? ALPHA_OPAQUE : ALPHA_CUTOUT;
+	}
+
+	Texture::AlphaMode Texture::getFormatAlphaMode(GLenum internalFormat)
+	{
+		if (CompressedImage::isCompressedFormat(internalFormat)) {
+			return CompressedImage::hasAlpha(internalFormat) ? ALPHA_BLEND : ALPHA_OPAQUE;
+		}
+
+		if (internalFormat == GL_LUMINANCE_ALPHA ||
+			internalFormat == GL_LUMINANCE8_ALPHA8 ||
+			internalFormat == GL_RGBA ||
+			internalFormat == GL_RGBA2 ||
+			internalFormat == GL_RGBA4 ||
+			internalFormat == GL_RGBA4 ||
+			internalFormat == GL_RGB5_A1 ||
+			internalFormat == GL_RGBA8 ||
+			internalFormat == GL_RGBA8_SNORM ||
+			internalFormat == GL_RGB10_A2 ||
+			internalFormat == GL_RGB10_A2UI ||
+			internalFormat == GL_RGBA12 ||
+			internalFormat == GL_RGBA16 ||
+			internalFormat == GL_RGBA16_SNORM ||
+			internalFormat == GL_SRGB8_ALPHA8 ||
+			internalFormat == GL_RGBA16F ||
+			internalFormat == GL_RGBA32F ||
+			internalFormat == GL_RGBA8I ||
+			internalFormat == GL_RGBA8UI ||
+			internalFormat == GL_RGBA16I ||
+			internalFormat == GL_RGBA16UI ||
+			internalFormat == GL_RGBA32I ||
+			internalFormat == GL_RGBA32UI) {
+			return ALPHA_BLEND;
+		}
+		return ALPHA_OPAQUE;
+	}
+
+	void Texture::save2D(const std::string &file)
+	{
+		assert(_target == GL_TEXTURE_2D);
+
+		// Read back through a PBO and encode on a worker, the format is picked from the file extension
+		std::string fileName = file;
+		PixelReadback::getInstance().readTexture(shared_from_this(), [fileName](std::shared_ptr<PixelReadback::Image> image) {
+			if (!image) {
+				std::cerr << "Unable to read back " << fileName << std::endl;
+				return;
+			}
+			std::string error;
+			if (!ImageWriter::write(fileName, image->width, image->height, image->channels, &image->pixels[0], error)) {
+				std::cerr << error << std::endl;
+			}
+		});
 	}
 
 	void Texture::setTexParameterfv(GLenum param, GLfloat* val)
@@ -353,47 +607,39 @@ namespace basicgraphics {
 	{
 		
 		GLenum internalFormat = 0;
-		int width, height, channels;
+		int widths[6], heights[6], channels[6];
 		const void* bytesArray[6];
 		unsigned char* images[6];
+
+		// The faces are independent, decode them in parallel
+		ThreadPool::getShared().parallelFor(0, 6, [&](int face) {
+			images[face] = SOIL_load_image(filenames[face].c_str(), &widths[face], &heights[face], &channels[face], SOIL_LOAD_AUTO);
+		});
+
 		for (int face = 0; face < 6; face++) {
-			images[face] = SOIL_load_image(filenames[face].c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
 			if (images[face] == NULL) {
 				assert(false && ("Unable to load texture: " + filenames[face] + "\n" + SOIL_last_result()).c_str());
 			}
 
-			GLenum faceInternalFormat = 0;
-			switch (channels) {
-			case 1:
-				faceInternalFormat = GL_LUMINANCE8;
-				break;
-
-			case 2:
-				faceInternalFormat = GL_LUMINANCE8_ALPHA8;
-
-			case 3:
-				faceInternalFormat = GL_RGB8;
-				break;
-
-			case 4:
-				faceInternalFormat = GL_RGBA8;
-				break;
-
-			default:
-				assert(false && ("Loaded image data in unsupported format: " + filenames[0]).c_str());
-			}
+			GLenum faceInternalFormat = getInternalFormat(channels[face], filenames[face]);
 
 			if (face == 0) {
 				internalFormat = faceInternalFormat;
 			}
-			else if (faceInternalFormat != internalFormat) {
-				assert(false && "All faces in a cubemap must have the same internal format");
+			else if (faceInternalFormat != internalFormat || widths[face] != widths[0] || heights[face] != heights[0]) {
+				assert(false && "All faces in a cubemap must have the same size and internal format");
 			}
 
 			bytesArray[face] = images[face];
 		}
+		int width = widths[0];
+		int height = heights[0];
 
 		std::shared_ptr<Texture> tex(new Texture(filenames[0], width, height, 1, numMipMapLevels, generateMipMaps, GL_TEXTURE_CUBE_MAP, internalFormat, getExternalFormat(internalFormat), determineDataType(internalFormat), bytesArray));
+		tex->_alphaMode = ALPHA_OPAQUE;
+		for (int face = 0; face < 6; face++) {
+			tex->_alphaMode = std::max(tex->_alphaMode, classifyAlpha(images[face], width, height, channels[face]));
+		}
 
 		// Don't delete the images until after the texture is generated or else the bytesArray gets deallocated
 		for (int i = 0; i < 6; i++) {
@@ -454,6 +700,10 @@ namespace basicgraphics {
 		}
 
 		std::shared_ptr<Texture> tex(new Texture(filenames[0], width, height, 1, numMipMapLevels, generateMipMaps, GL_TEXTURE_CUBE_MAP, internalFormat, getExternalFormat(internalFormat), determineDataType(internalFormat), bytesArray));
+		tex->_alphaMode = ALPHA_OPAQUE;
+		for (int face = 0; face < 6; face++) {
+			tex->_alphaMode = std::max(tex->_alphaMode, classifyAlpha(images[face], width, height, channels[face]));
+		}
 
 		// Don't delete the images until after the texture is generated or else the bytesArray gets deallocated
 		for (int i = 0; i < 6; i++) {
@@ -468,12 +718,24 @@ namespace basicgraphics {
 	{
 		const void* bytesArray[6];
 		bytesArray[0] = bytes;
-		return std::shared_ptr<Texture>(new Texture(name, width, height, depth, numMipMapLevels, generateMipMaps, target, internalFormat, externalFormat, dataFormat, bytesArray));
+		std::shared_ptr<Texture> tex(new Texture(name, width, height, depth, numMipMapLevels, generateMipMaps, target, internalFormat, externalFormat, dataFormat, bytesArray));
+
+		// Only 8 bit data with alpha can be scanned, everything else keeps the classification by format
+		if (bytes != nullptr && target == GL_TEXTURE_2D && dataFormat == GL_UNSIGNED_BYTE && tex->_alphaMode != ALPHA_OPAQUE) {
+			if (externalFormat == GL_RGBA) {
+				tex->_alphaMode = classifyAlpha((const unsigned char*)bytes, width, height, 4);
+			}
+			else if (externalFormat == GL_LUMINANCE_ALPHA || externalFormat == GL_RG) {
+				tex->_alphaMode = classifyAlpha((const unsigned char*)bytes, width, height, 2);
+			}
+		}
+		return tex;
 	}
 
 	std::shared_ptr<Texture> Texture::create2DTextureFromFile(const std::string &filename, bool generateMipMaps/*=false*/, int numMipMapLevels/*=1*/)
 	{
 	
+		TRACE_SCOPE_DETAIL("texture", "create2DTextureFromFile", filename.c_str());
 		int width, height, channels;
 		unsigned char* image = SOIL_load_image(filename.c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
 		if (image == NULL) {
@@ -481,32 +743,13 @@ namespace basicgraphics {
 			assert(false && ("Unable to load texture"));
 		}
 
-		GLenum internalFormat = 0;
-
-		switch (channels) {
-		case 1:
-			internalFormat = GL_LUMINANCE8;
-			break;
-
-		case 2:
-			internalFormat = GL_LUMINANCE8_ALPHA8;
-
-		case 3:
-			internalFormat = GL_RGB8;
-			break;
-
-		case 4:
-			internalFormat = GL_RGBA8;
-			break;
-
-		default:
-			assert(false && ("Loaded image data in unsupported format: " + filename).c_str());
-		}
+		GLenum internalFormat = getInternalFormat(channels, filename);
 
 
 		const void* bytesArray[6];
 		bytesArray[0] = image;
 		std::shared_ptr<Texture> tex(new Texture(filename, width, height, 1, numMipMapLevels, generateMipMaps, GL_TEXTURE_2D, internalFormat, getExternalFormat(internalFormat), determineDataType(internalFormat), bytesArray));//internalFormat, getExternalFormat(internalFormat), determineDataType(internalFormat), bytesArray));
+		tex->_alphaMode = classifyAlpha(image, width, height, channels);
 		SOIL_free_image_data(image);
 
 		return tex;
@@ -554,6 +797,192 @@ namespace basicgraphics {
 */
 	}
 
+	std::shared_ptr<Texture> Texture::create2DTextureFromFileAsync(const std::string &filename, bool generateMipMaps/*=false*/, int numMipMapLevels/*=1*/)
+	{
+		static const GLubyte white[4] = { 255, 255, 255, 255 };
+		const void* bytesArray[6];
+		bytesArray[0] = white;
+
+		std::shared_ptr<Texture> tex(new Texture(filename, 1, 1, 1, numMipMapLevels, generateMipMaps, GL_TEXTURE_2D, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, bytesArray));
+		tex->setFileName(filename);
+		tex->_resident = false;
+
+		TextureLoader::getInstance().load(tex, std::vector<std::string>(1, filename));
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::createCubeMapFromFilesAsync(const std::string filenames[6], bool generateMipMaps/*=false*/, int numMipMapLevels/*=1*/)
+	{
+		static const GLubyte white[4] = { 255, 255, 255, 255 };
+		const void* bytesArray[6];
+		for (int face = 0; face < 6; face++) {
+			bytesArray[face] = white;
+		}
+
+		std::shared_ptr<Texture> tex(new Texture(filenames[0], 1, 1, 1, numMipMapLevels, generateMipMaps, GL_TEXTURE_CUBE_MAP, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, bytesArray));
+		tex->setFileName(filenames[0]);
+		tex->_resident = false;
+
+		TextureLoader::getInstance().load(tex, std::vector<std::string>(filenames, filenames + 6));
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::create2DTextureFromFileStreaming(const std::string &filename, MipMapGenerator::Filter filter /*=MipMapGenerator::FILTER_TENT*/)
+	{
+		static const GLubyte white[4] = { 255, 255, 255, 255 };
+		const void* bytesArray[6];
+		bytesArray[0] = white;
+
+		// Mipmapped so the placeholder's sampler state (which carries over) uses trilinear filtering
+		std::shared_ptr<Texture> tex(new Texture(filename, 1, 1, 1, 1, true, GL_TEXTURE_2D, GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, bytesArray));
+		tex->setFileName(filename);
+		tex->_resident = false;
+
+		TextureStreamer::getInstance().load(tex, filename, filter);
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::create2DArrayFromFiles(const std::vector<std::string> &filenames, bool generateMipMaps/*=false*/)
+	{
+		assert(!filenames.empty());
+		std::vector<unsigned char*> images(filenames.size());
+		std::vector<int> widths(filenames.size()), heights(filenames.size()), channels(filenames.size());
+
+		ThreadPool::getShared().parallelFor(0, filenames.size(), [&](int i) {
+			images[i] = SOIL_load_image(filenames[i].c_str(), &widths[i], &heights[i], &channels[i], SOIL_LOAD_RGBA);
+		});
+
+		std::vector<const unsigned char*> layers;
+		for (int i = 0; i < filenames.size(); i++) {
+			if (images[i] == NULL) {
+				assert(false && ("Unable to load texture: " + filenames[i] + "\n" + SOIL_last_result()).c_str());
+			}
+			else if (widths[i] != widths[0] || heights[i] != heights[0]) {
+				assert(false && "All layers of a texture array must have the same size");
+			}
+			layers.push_back(images[i]);
+		}
+
+		std::shared_ptr<Texture> tex = create2DArrayFromLayers(filenames[0], widths[0], heights[0], layers, generateMipMaps);
+		for (int i = 0; i < images.size(); i++) {
+			SOIL_free_image_data(images[i]);
+		}
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::create2DArrayFromLayers(const std::string &name, int width, int height, const std::vector<const unsigned char*> &layers, bool generateMipMaps/*=false*/)
+	{
+		GLint maxLayers = 0;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+		assert(layers.size() <= maxLayers && "Too many layers for a texture array");
+
+		// Build every layer's mip chain in parallel
+		const int numLevels = generateMipMaps ? MipMapGenerator::getNumLevels(width, height) : 1;
+		std::vector<std::vector<std::vector<unsigned char>>> levels(layers.size());
+		if (generateMipMaps) {
+			ThreadPool::getShared().parallelFor(0, layers.size(), [&](int layer) {
+				MipMapGenerator::generate(layers[layer], width, height, 4, levels[layer], MipMapGenerator::getDefaultFilter(), true);
+			});
+		}
+
+		const void* bytesArray[6];
+		bytesArray[0] = nullptr;
+		std::shared_ptr<Texture> tex(new Texture(name, width, height, layers.size(), numLevels, false, GL_TEXTURE_2D_ARRAY, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, bytesArray));
+		std::vector<AlphaMode> layerModes(layers.size());
+		ThreadPool::getShared().parallelFor(0, layers.size(), [&](int layer) {
+			layerModes[layer] = classifyAlpha(layers[layer], width, height, 4);
+		});
+		tex->_alphaMode = layers.empty() ? ALPHA_OPAQUE : *std::max_element(layerModes.begin(), layerModes.end());
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, tex->_texID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int level = 0; level < numLevels; level++) {
+			const int levelWidth = MipMapGenerator::getLevelWidth(width, level);
+			const int levelHeight = MipMapGenerator::getLevelHeight(height, level);
+			if (level > 0) {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			}
+			for (int layer = 0; layer < layers.size(); layer++) {
+				const unsigned char* bytes = generateMipMaps ? &levels[layer][level][0] : layers[layer];
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+			}
+			Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, tex->getLevelBytes(level));
+		}
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		tex->_empty = false;
+		tex->setTexParameteri(GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+		if (generateMipMaps) {
+			tex->setTexParameteri(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		}
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::createFromCompressedFile(const std::string &filename)
+	{
+		CompressedImage image;
+		std::string error;
+		if (!image.load(filename, error)) {
+			std::cerr << error << std::endl;
+			assert(false && "Unable to load compressed texture");
+			return nullptr;
+		}
+
+		std::shared_ptr<Texture> tex = createFromCompressedImage(filename, image);
+		tex->setFileName(filename);
+		return tex;
+	}
+
+	std::shared_ptr<Texture> Texture::createFromCompressedImage(const std::string &name, const CompressedImage &image)
+	{
+		std::shared_ptr<Texture> tex(new Texture());
+		tex->_name = name;
+		tex->_fileName = "";
+		tex->_target = image.target;
+		tex->_internalFormat = image.internalFormat;
+		tex->_externalFormat = 0; // no client side format, the blocks are uploaded as is
+		tex->_dataFormat = 0;
+		tex->_width = image.width;
+		tex->_height = image.height;
+		tex->_depth = 1;
+		tex->_numMipMapLevels = image.numMipMapLevels;
+		tex->_autoGenMipMaps = false;
+		tex->_empty = false;
+		tex->_resident = true;
+		tex->_bindlessHandle = 0;
+		tex->updateMemory();
+
+		glGenTextures(1, &tex->_texID);
+		glBindTexture(tex->_target, tex->_texID);
+
+		for (int level = 0; level < image.numMipMapLevels; level++) {
+			int levelWidth = std::max(1, image.width >> level);
+			int levelHeight = std::max(1, image.height >> level);
+			for (int face = 0; face < image.numFaces; face++) {
+				GLenum faceTarget = (image.target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : image.target;
+				const std::vector<unsigned char> &bytes = image.getLevel(level, face);
+				glCompressedTexImage2D(faceTarget, level, image.internalFormat, levelWidth, levelHeight, 0, bytes.size(), &bytes[0]);
+				Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, bytes.size());
+			}
+		}
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+
+		GLenum err = glGetError();
+		if (err != GL_NO_ERROR) {
+			std::cerr << "Unable to upload " << name << ", compressed format 0x" << std::hex << image.internalFormat << std::dec << " may not be supported by this driver (OpenGL error " << err << ")" << std::endl;
+		}
+
+		tex->setTexParameteri(GL_TEXTURE_MAX_LEVEL, image.numMipMapLevels - 1);
+		tex->setTexParameteri(GL_TEXTURE_WRAP_S, GL_REPEAT);
+		tex->setTexParameteri(GL_TEXTURE_WRAP_T, GL_REPEAT);
+		tex->setTexParameteri(GL_TEXTURE_WRAP_R, GL_REPEAT);
+		tex->setTexParameteri(GL_TEXTURE_MIN_FILTER, image.numMipMapLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		tex->setTexParameteri(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		return tex;
+	}
+
     /*
 	GLenum Texture::determineImageFormat(const fipImage* image)
 	{
@@ -613,6 +1042,9 @@ namespace basicgraphics {
 
 	Texture::~Texture()
 	{
+		if (_bindlessHandle != 0) {
+			bindless().makeTextureHandleNonResident(_bindlessHandle);
+		}
 		glDeleteTextures(1, &_texID);
 	}
 
@@ -651,6 +1083,23 @@ namespace basicgraphics {
 		}
 	}
 
+	GLenum Texture::getInternalFormat(int channels, const std::string &filename)
+	{
+		switch (channels) {
+		case 1:
+			return GL_LUMINANCE8;
+		case 2:
+			return GL_LUMINANCE8_ALPHA8;
+		case 3:
+			return GL_RGB8;
+		case 4:
+			return GL_RGBA8;
+		default:
+			assert(false && ("Loaded image data in unsupported format: " + filename).c_str());
+			return GL_RGBA8;
+		}
+	}
+
 	GLenum Texture::getExternalFormat(const GLenum internalType)
 	{
 		switch (internalType)
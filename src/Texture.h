@@ -18,6 +18,10 @@
 #include <vector>
 #include <assert.h>
 
+#include "CompressedImage.h"
+#include "MipMapGenerator.h"
+#include "MemoryAccounting.h"
+
 //#include <FreeImage/FreeImagePlus.h>
 
 namespace basicgraphics {
@@ -50,13 +54,37 @@ namespace basicgraphics {
 		std::string getFileName() const;
 
 		/**
-		True if this texture was created with out an alpha channel.  Note that
-		a texture may have a format that is not opaque (e.g. RGBA8) yet still
-		have a completely opaque alpha channel, causing texture->opaque to
-		be false.  This is just a flag set for the user's convenience-- it does not affect rendering in any way.*/
+		How a texture's alpha channel has to be rendered:
+		- ALPHA_OPAQUE: every texel has alpha 1 (or there is no alpha channel), draw with the depth test and no blending.
+		- ALPHA_CUTOUT: every texel is (nearly) fully opaque or fully transparent, draw with an alpha test and depth writes.
+		- ALPHA_BLEND: there are partially transparent texels, blend in a back to front sorted pass.
+		The file loaders scan the alpha channel of 8 bit images to decide, so an RGBA8 texture whose alpha is all 255
+		is still ALPHA_OPAQUE. Textures created from other data fall back to whether the format has an alpha channel.*/
+		enum AlphaMode {
+			ALPHA_OPAQUE = 0,
+			ALPHA_CUTOUT = 1,
+			ALPHA_BLEND = 2
+		};
+
+		AlphaMode getAlphaMode() const;
+
+		// Overrides the classification, e.g. after update() changed the contents
+		void setAlphaMode(AlphaMode mode);
+
+		// True if getAlphaMode() is ALPHA_OPAQUE
 		bool isOpaque() const;
 
-		// saves a GL_TEXTURE_2D. Mostly used for debugging
+		/*!
+		 * Scans the alpha channel of 8 bit pixels with 2 (luminance alpha) or 4 (RGBA) channels, other channel counts are opaque.
+		 * Alpha within ALPHA_CUTOUT_TOLERANCE of 0 or 255 counts as fully transparent or opaque.
+		 */
+		static AlphaMode classifyAlpha(const unsigned char* pixels, int width, int height, int channels);
+
+		// Lets texture compression and resampling noise at the edges of cutouts pass as binary alpha
+		static const int ALPHA_CUTOUT_TOLERANCE = 8;
+
+		// saves a GL_TEXTURE_2D. Mostly used for debugging. The file is written in the background once the
+		// pixels have been read back (PixelReadback::update() runs every frame in BaseApp::run)
 		void save2D(const std::string &file);
 
 		static std::shared_ptr<Texture> createEmpty(const std::string &name,
@@ -74,9 +102,69 @@ namespace basicgraphics {
 
 		static std::shared_ptr<Texture> createFromMemory(const std::string &name, const void* bytes, GLenum dataFormat, GLenum externalFormat, GLenum internalFormat, GLenum target, int width, int height, int depth, bool generateMipMaps = false, int numMipMapLevels = 1);
 
+		/**
+		Asynchronous versions of the file loaders. They return right away with a 1x1 white placeholder
+		that can be bound and have its parameters set like any other texture. The images are decoded on
+		worker threads (all six cube faces in parallel), uploaded through a pixel buffer object, and the
+		texture switches to the real image once the upload's fence has signaled. TextureLoader::update()
+		must be called once per frame on the GL thread for this to progress (BaseApp::run does this).*/
+		static std::shared_ptr<Texture> create2DTextureFromFileAsync(const std::string &filename, bool generateMipMaps = false, int numMipMapLevels = 1);
+
+		static std::shared_ptr<Texture> createCubeMapFromFilesAsync(const std::string filenames[6], bool generateMipMaps = false, int numMipMapLevels = 1);
+
+		/**
+		Streams a mipmapped 2D texture. Like the asynchronous loaders it returns a placeholder right away. The mip chain
+		is built on worker threads with the given filter, the coarse levels are uploaded first and finer ones follow when
+		TextureStreamer::requestScreenSize says the texture is drawn large enough to need them, within the streamer's
+		memory budget. TextureStreamer::update() must be called once per frame on the GL thread (BaseApp::run does this).*/
+		static std::shared_ptr<Texture> create2DTextureFromFileStreaming(const std::string &filename, MipMapGenerator::Filter filter = MipMapGenerator::FILTER_TENT);
+
+		/**
+		Loads a block compressed texture (BC1-BC5, BC7 or ETC2/EAC) with all of its mip levels from a .ktx or .dds
+		file. The blocks are uploaded as they are with glCompressedTexImage2D, so they take 4-8x less video memory
+		than the RGB8/RGBA8 data SOIL produces. TextureCooker produces these files from ordinary images.*/
+		static std::shared_ptr<Texture> createFromCompressedFile(const std::string &filename);
+
+		static std::shared_ptr<Texture> createFromCompressedImage(const std::string &name, const CompressedImage &image);
+
+		/**
+		Packs images of the same size into the layers of one GL_TEXTURE_2D_ARRAY, so they can all be used with a single
+		bind and picked per draw (or per material) with a layer index. The files are decoded in parallel and converted to
+		RGBA8 so images with different channel counts can share an array. Mipmaps are built with MipMapGenerator.*/
+		static std::shared_ptr<Texture> create2DArrayFromFiles(const std::vector<std::string> &filenames, bool generateMipMaps = false);
+
+		// layers holds width * height RGBA8 pixels (top row first) per layer
+		static std::shared_ptr<Texture> create2DArrayFromLayers(const std::string &name, int width, int height, const std::vector<const unsigned char*> &layers, bool generateMipMaps = false);
+
+		// Number of layers of a GL_TEXTURE_2D_ARRAY, 1 for other targets
+		int getNumLayers() const;
+
+		/**
+		Returns a GL_ARB_bindless_texture handle for the texture and makes it resident, so shaders can sample it without it
+		being bound to a texture unit. Returns 0 if the extension is not available. Once a handle exists the texture's
+		sampler parameters can no longer be changed.*/
+		GLuint64 getBindlessHandle();
+
+		static bool isBindlessSupported();
+
+		// True if the texture holds block compressed data
+		bool isCompressed() const;
+
+		// False while an asynchronous load is still in progress and the placeholder is bound instead
+		bool isResident() const;
+
+		// Estimated video memory of all levels, faces and layers, as counted in MemoryAccounting
+		size_t getMemoryBytes() const;
+
+		// Bytes per texel of an uncompressed internal format, RGB formats are padded to four channels like drivers do
+		static int getBytesPerTexel(GLenum internalFormat);
+
 	private:
-		Texture() {};
-		Texture(const Texture& that) {}; // prevent copying
+		friend class TextureLoader;
+		friend class TextureStreamer;
+
+		Texture() : _memory(MemoryAccounting::TEXTURES) {};
+		Texture(const Texture& that) : _memory(MemoryAccounting::TEXTURES) {}; // prevent copying
 
 		Texture(const std::string &name,
 			int width, // in pixels 
@@ -93,6 +181,19 @@ namespace basicgraphics {
 		//static GLenum determineImageFormat(const fipImage* image);
 		static GLenum determineDataType(const GLenum internalType);
 		static GLenum getExternalFormat(const GLenum internalType);
+		static GLenum getInternalFormat(int channels, const std::string &filename);
+
+		// Replaces the placeholder with a finished asynchronous upload, keeping the sampler parameters set on the placeholder
+		void makeResident(GLuint texID, int width, int height, GLenum internalFormat, AlphaMode alphaMode);
+
+		// Classification used when the texels are not available to scan
+		static AlphaMode getFormatAlphaMode(GLenum internalFormat);
+
+		// Recomputes the bytes in _memory from the size, format and mip levels, and tags it with the file or name
+		void updateMemory();
+
+		// Bytes of one mip level with all of its faces and layers
+		size_t getLevelBytes(int level) const;
 
 		std::string _name;
 		std::string _fileName;
@@ -107,6 +208,10 @@ namespace basicgraphics {
 		int _numMipMapLevels;
 		bool _autoGenMipMaps;
 		bool _empty;
+		bool _resident;
+		GLuint64 _bindlessHandle;
+		AlphaMode _alphaMode;
+		MemoryRecord _memory;
 	};
 
 }
@@ -0,0 +1,279 @@
+//
+//  TextureCooker.cpp
+//
+//
+
+#include "TextureCooker.h"
+#include "ThreadPool.h"
+#include "MipMapGenerator.h"
+#include "Metrics.h"
+
+#include <SOIL.h>
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace basicgraphics {
+
+	TextureCooker::TextureCooker(const std::string &cacheDirectory /*="texture_cache"*/) : _cacheDirectory(cacheDirectory)
+	{
+#ifdef _WIN32
+		_mkdir(_cacheDirectory.c_str());
+#else
+		mkdir(_cacheDirectory.c_str(), 0755);
+#endif
+	}
+
+	TextureCooker::~TextureCooker()
+	{
+	}
+
+	std::string TextureCooker::getCachePath(const std::string &sourceFile, Format format) const
+	{
+		// Flatten the source path so files with the same name in different directories don't collide
+		std::string flat = sourceFile;
+		for (int i = 0; i < flat.size(); i++) {
+			if (flat[i] == '/' || flat[i] == '\\' || flat[i] == ':') {
+				flat[i] = '_';
+			}
+		}
+		return _cacheDirectory + "/" + flat + "." + getFormatName(format) + ".ktx";
+	}
+
+	std::string TextureCooker::getFormatName(Format format)
+	{
+		switch (format) {
+		case FORMAT_BC1: return "bc1";
+		case FORMAT_BC3: return "bc3";
+		case FORMAT_BC4: return "bc4";
+		case FORMAT_BC5: return "bc5";
+		default: return "auto";
+		}
+	}
+
+	std::string TextureCooker::cook(const std::string &sourceFile, Format format /*=FORMAT_AUTO*/)
+	{
+		struct stat sourceInfo;
+		if (stat(sourceFile.c_str(), &sourceInfo) != 0) {
+			std::cerr << "TextureCooker: unable to find " << sourceFile << std::endl;
+			return "";
+		}
+
+		std::string cachePath = getCachePath(sourceFile, format);
+		struct stat cacheInfo;
+		const bool upToDate = stat(cachePath.c_str(), &cacheInfo) == 0 && cacheInfo.st_mtime >= sourceInfo.st_mtime;
+		Metrics::recordCacheLookup(Metrics::COOKED_TEXTURES, upToDate);
+		if (upToDate) {
+			return cachePath;
+		}
+
+		int width, height, channels;
+		unsigned char* pixels = SOIL_load_image(sourceFile.c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
+		if (pixels == NULL) {
+			std::cerr << "TextureCooker: unable to load " << sourceFile << std::endl;
+			return "";
+		}
+
+		CompressedImage image;
+		std::string error;
+		bool encoded = encode(pixels, width, height, channels, format, image, error);
+		SOIL_free_image_data(pixels);
+
+		// Write next to the final name and rename, so a reader never sees a partially written file
+		std::string tempPath = cachePath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+		if (!encoded || !image.saveKTX(tempPath, error)) {
+			std::cerr << "TextureCooker: " << sourceFile << ": " << error << std::endl;
+			std::remove(tempPath.c_str());
+			return "";
+		}
+		std::remove(cachePath.c_str());
+		if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+			std::cerr << "TextureCooker: unable to write " << cachePath << std::endl;
+			std::remove(tempPath.c_str());
+			return "";
+		}
+
+		std::cout << "Cooked " << sourceFile << " -> " << cachePath << " (" << width << "x" << height << ", " << image.numMipMapLevels << " levels, "
+			<< image.getByteSize() / 1024 << " KB instead of " << (size_t)width * height * 4 * 4 / 3 / 1024 << " KB)" << std::endl;
+		return cachePath;
+	}
+
+	std::vector<std::string> TextureCooker::cookAll(const std::vector<std::string> &sourceFiles, Format format /*=FORMAT_AUTO*/)
+	{
+		std::vector<std::string> cooked(sourceFiles.size());
+		ThreadPool::getShared().parallelFor(0, sourceFiles.size(), [&](int i) {
+			cooked[i] = cook(sourceFiles[i], format);
+		});
+		return cooked;
+	}
+
+	std::shared_ptr<Texture> TextureCooker::load(const std::string &sourceFile, Format format /*=FORMAT_AUTO*/)
+	{
+		std::string cooked = cook(sourceFile, format);
+		if (cooked.empty()) {
+			return Texture::create2DTextureFromFile(sourceFile);
+		}
+		std::shared_ptr<Texture> tex = Texture::createFromCompressedFile(cooked);
+		tex->setFileName(sourceFile);
+		return tex;
+	}
+
+	bool TextureCooker::encode(const unsigned char* pixels, int width, int height, int channels, Format format, CompressedImage &image, std::string &error)
+	{
+		if (channels < 1 || channels > 4 || width < 1 || height < 1) {
+			error = "unsupported image layout";
+			return false;
+		}
+		if (format == FORMAT_AUTO) {
+			format = chooseFormat(pixels, width, height, channels);
+		}
+
+		switch (format) {
+		case FORMAT_BC1: image.internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+		case FORMAT_BC3: image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+		case FORMAT_BC4: image.internalFormat = GL_COMPRESSED_RED_RGTC1; break;
+		case FORMAT_BC5: image.internalFormat = GL_COMPRESSED_RG_RGTC2; break;
+		default:
+			error = "unknown format";
+			return false;
+		}
+
+		// Color is filtered in linear light, BC4/BC5 usually hold data (heights, normals) that is linear already
+		const bool sRGB = (format == FORMAT_BC1 || format == FORMAT_BC3);
+		std::vector<std::vector<unsigned char>> levels;
+		MipMapGenerator::generate(pixels, width, height, channels, levels, MipMapGenerator::getDefaultFilter(), sRGB);
+
+		image.target = GL_TEXTURE_2D;
+		image.width = width;
+		image.height = height;
+		image.numFaces = 1;
+		image.numMipMapLevels = levels.size();
+		image.data.assign(image.numMipMapLevels, std::vector<unsigned char>());
+
+		// The levels are independent now, encode them in parallel
+		std::vector<std::string> errors(image.numMipMapLevels);
+		ThreadPool::getShared().parallelFor(0, image.numMipMapLevels, [&](int l) {
+			const int levelWidth = MipMapGenerator::getLevelWidth(width, l);
+			const int levelHeight = MipMapGenerator::getLevelHeight(height, l);
+			const std::vector<unsigned char> &level = levels[l];
+			std::vector<unsigned char> &out = image.getLevel(l);
+
+			if (format == FORMAT_BC1 || format == FORMAT_BC3) {
+				int size = 0;
+				unsigned char* blocks = (format == FORMAT_BC1) ? convert_image_to_DXT1(&level[0], levelWidth, levelHeight, channels, &size)
+					: convert_image_to_DXT5(&level[0], levelWidth, levelHeight, channels, &size);
+				if (blocks == NULL || size != CompressedImage::getLevelByteSize(image.internalFormat, levelWidth, levelHeight)) {
+					free(blocks);
+					errors[l] = "DXT encoding failed";
+					return;
+				}
+				out.assign(blocks, blocks + size);
+				free(blocks);
+			}
+			else {
+				// BC4 encodes the first channel, BC5 the first two (red and green, or grey and alpha)
+				const int blocksWide = (levelWidth + 3) / 4;
+				const int blocksHigh = (levelHeight + 3) / 4;
+				const int numChannels = (format == FORMAT_BC4) ? 1 : 2;
+				out.resize(CompressedImage::getLevelByteSize(image.internalFormat, levelWidth, levelHeight));
+				unsigned char* block = &out[0];
+				for (int by = 0; by < blocksHigh; by++) {
+					for (int bx = 0; bx < blocksWide; bx++) {
+						for (int c = 0; c < numChannels; c++) {
+							encodeBC4Block(&level[0], levelWidth, levelHeight, channels, std::min(c, channels - 1), bx, by, block);
+							block += 8;
+						}
+					}
+				}
+			}
+		});
+
+		for (int l = 0; l < errors.size(); l++) {
+			if (!errors[l].empty()) {
+				error = errors[l];
+				return false;
+			}
+		}
+		return true;
+	}
+
+	TextureCooker::Format TextureCooker::chooseFormat(const unsigned char* pixels, int width, int height, int channels)
+	{
+		switch (channels) {
+		case 1:
+			return FORMAT_BC4;
+		case 2:
+			return FORMAT_BC5;
+		case 3:
+			return FORMAT_BC1;
+		default:
+			// Many RGBA images never use their alpha channel, those get the smaller format
+			const size_t numPixels = (size_t)width * height;
+			for (size_t i = 0; i < numPixels; i++) {
+				if (pixels[i * 4 + 3] != 255) {
+					return FORMAT_BC3;
+				}
+			}
+			return FORMAT_BC1;
+		}
+	}
+
+	void TextureCooker::encodeBC4Block(const unsigned char* pixels, int width, int height, int channels, int channel, int blockX, int blockY, unsigned char* out)
+	{
+		// Gather the block, repeating edge pixels for partial blocks
+		unsigned char values[16];
+		unsigned char lo = 255;
+		unsigned char hi = 0;
+		for (int y = 0; y < 4; y++) {
+			for (int x = 0; x < 4; x++) {
+				int px = std::min(blockX * 4 + x, width - 1);
+				int py = std::min(blockY * 4 + y, height - 1);
+				unsigned char v = pixels[((size_t)py * width + px) * channels + channel];
+				values[y * 4 + x] = v;
+				lo = std::min(lo, v);
+				hi = std::max(hi, v);
+			}
+		}
+
+		// With endpoint0 > endpoint1 the palette has the two endpoints and six evenly spaced values between them
+		out[0] = hi;
+		out[1] = lo;
+		int palette[8];
+		palette[0] = hi;
+		palette[1] = lo;
+		for (int i = 1; i < 7; i++) {
+			palette[i + 1] = ((7 - i) * hi + i * lo + 3) / 7;
+		}
+
+		unsigned long long indices = 0;
+		if (hi != lo) {
+			for (int i = 0; i < 16; i++) {
+				int best = 0;
+				int bestError = 256;
+				for (int p = 0; p < 8; p++) {
+					int err = std::abs(palette[p] - values[i]);
+					if (err < bestError) {
+						bestError = err;
+						best = p;
+					}
+				}
+				indices |= (unsigned long long)best << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++) {
+			out[2 + i] = (unsigned char)((indices >> (8 * i)) & 0xFF);
+		}
+	}
+
+}
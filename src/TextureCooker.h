@@ -0,0 +1,83 @@
+/*!
+ *  TextureCooker.h
+ *
+ * Offline encoder that turns ordinary images into block compressed KTX files and caches the result.
+ */
+
+#ifndef TextureCooker_h
+#define TextureCooker_h
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CompressedImage.h"
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** TextureCooker encodes JPEG/PNG/... images (anything SOIL can read) into BC1, BC3, BC4 or BC5
+	with a full mip chain and writes them as KTX files into a cache directory. An image is only
+	encoded again when the source file is newer than its cached version, so cooking the same set
+	of textures twice is almost free. cookAll encodes many images in parallel on the ThreadPool.
+	------------------------------------------------------------------------
+	TextureCooker cooker("texture_cache");
+	cooker.cookAll(fileNames); // e.g. as a build step or the first time the app starts
+	std::shared_ptr<Texture> tex = cooker.load("bunny_albedo.jpg");
+	------------------------------------------------------------------------
+	BC7 and ETC2 files produced by other tools can be loaded with Texture::createFromCompressedFile,
+	but there is no encoder for them here.
+	*/
+	class TextureCooker
+	{
+	public:
+
+		enum Format {
+			FORMAT_AUTO = 0, /// BC4 for grey, BC5 for grey+alpha, BC1 for opaque color, BC3 for color with alpha
+			FORMAT_BC1 = 1,  /// 4 bits per texel, RGB
+			FORMAT_BC3 = 2,  /// 8 bits per texel, RGBA
+			FORMAT_BC4 = 3,  /// 4 bits per texel, single channel
+			FORMAT_BC5 = 4   /// 8 bits per texel, two channels
+		};
+
+		TextureCooker(const std::string &cacheDirectory = "texture_cache");
+		virtual ~TextureCooker();
+
+		/*!
+		 * Returns the path of the cooked .ktx file for sourceFile, encoding it first if there is no
+		 * up to date version in the cache. Returns "" if the image could not be read or encoded.
+		 */
+		std::string cook(const std::string &sourceFile, Format format = FORMAT_AUTO);
+
+		/*!
+		 * Cooks all files in parallel. The result has the cooked path for each source file ("" on failure).
+		 */
+		std::vector<std::string> cookAll(const std::vector<std::string> &sourceFiles, Format format = FORMAT_AUTO);
+
+		/*!
+		 * Cooks sourceFile if needed and loads the compressed result. Falls back to the uncompressed
+		 * image if cooking fails.
+		 */
+		std::shared_ptr<Texture> load(const std::string &sourceFile, Format format = FORMAT_AUTO);
+
+		// Where the cooked version of sourceFile is (or would be) stored
+		std::string getCachePath(const std::string &sourceFile, Format format) const;
+
+		/*!
+		 * Encodes tightly packed 8 bit pixels with 1-4 channels, including a mip chain built by MipMapGenerator
+		 * with its default filter.
+		 */
+		static bool encode(const unsigned char* pixels, int width, int height, int channels, Format format, CompressedImage &image, std::string &error);
+
+		static std::string getFormatName(Format format);
+
+	private:
+		std::string _cacheDirectory;
+
+		static Format chooseFormat(const unsigned char* pixels, int width, int height, int channels);
+		static void encodeBC4Block(const unsigned char* pixels, int width, int height, int channels, int channel, int blockX, int blockY, unsigned char* out);
+	};
+
+}
+
+#endif /* TextureCooker_h */
@@ -0,0 +1,297 @@
+//
+//  TextureLoader.cpp
+//
+//
+
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "MipMapGenerator.h"
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace basicgraphics {
+
+	template<class T>
+	static bool isReady(const T &future)
+	{
+		return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	TextureLoader& TextureLoader::getInstance()
+	{
+		static TextureLoader loader;
+		return loader;
+	}
+
+	void TextureLoader::load(std::shared_ptr<Texture> texture, const std::vector<std::string> &fileNames)
+	{
+		std::unique_ptr<PendingLoad> load(new PendingLoad());
+		load->texture = texture;
+		load->target = texture->_target;
+		load->fileNames = fileNames;
+		load->stage = DECODING;
+		load->pbo = 0;
+		load->texID = 0;
+		load->fence = 0;
+		load->width = 0;
+		load->height = 0;
+		load->channels = 0;
+		load->internalFormat = 0;
+		load->numLevels = 1;
+
+		for (int i = 0; i < fileNames.size(); i++) {
+			std::string fileName = fileNames[i];
+			load->decodes.push_back(ThreadPool::getShared().enqueue([fileName]() { return decode(fileName); }).share());
+		}
+
+		_pending.push_back(std::move(load));
+	}
+
+	void TextureLoader::update()
+	{
+		for (int i = _pending.size() - 1; i >= 0; i--) {
+			PendingLoad &load = *_pending[i];
+			bool done = false;
+			switch (load.stage) {
+			case DECODING:
+				done = startCopy(load);
+				break;
+			case COPYING:
+				done = startTransfer(load);
+				break;
+			case TRANSFERRING:
+				done = checkTransfer(load);
+				break;
+			}
+
+			if (done) {
+				_pending.erase(_pending.begin() + i);
+			}
+		}
+	}
+
+	int TextureLoader::getNumPending() const
+	{
+		return _pending.size();
+	}
+
+	void TextureLoader::finish()
+	{
+		while (!_pending.empty()) {
+			update();
+			std::this_thread::yield();
+		}
+	}
+
+	bool TextureLoader::startCopy(PendingLoad &load)
+	{
+		for (int i = 0; i < load.decodes.size(); i++) {
+			if (!isReady(load.decodes[i])) {
+				return false;
+			}
+		}
+
+		std::vector<DecodedImage> images;
+		std::string error;
+		for (int i = 0; i < load.decodes.size(); i++) {
+			images.push_back(load.decodes[i].get());
+			if (!images[i].error.empty()) {
+				error = images[i].error;
+			}
+			else if (images[i].width != images[0].width || images[i].height != images[0].height || images[i].channels != images[0].channels) {
+				error = "All faces in a cubemap must have the same size and internal format: " + load.fileNames[i];
+			}
+		}
+
+		std::shared_ptr<Texture> texture = load.texture.lock();
+		if (texture.get() == nullptr || !error.empty()) {
+			if (!error.empty()) {
+				std::cerr << error << std::endl;
+			}
+			for (int i = 0; i < images.size(); i++) {
+				SOIL_free_image_data(images[i].bytes);
+			}
+			return true;
+		}
+
+		load.width = images[0].width;
+		load.height = images[0].height;
+		load.channels = images[0].channels;
+		load.internalFormat = Texture::getInternalFormat(images[0].channels, load.fileNames[0]);
+		load.alphaMode = Texture::ALPHA_OPAQUE;
+		for (int i = 0; i < images.size(); i++) {
+			load.alphaMode = std::max(load.alphaMode, images[i].alphaMode);
+		}
+
+		// Mipmaps are built on the workers along with the copy instead of with glGenerateMipmap on this thread
+		if (texture->_autoGenMipMaps) {
+			const int fullChain = MipMapGenerator::getNumLevels(load.width, load.height);
+			load.numLevels = (texture->_numMipMapLevels > 1) ? std::min(texture->_numMipMapLevels, fullChain) : fullChain;
+		}
+		const size_t totalBytes = getLevelOffset(load, load.numLevels);
+
+		glGenBuffers(1, &load.pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, totalBytes, NULL, GL_STREAM_DRAW);
+		unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (mapped == nullptr) {
+			std::cerr << "Unable to map a pixel buffer for: " << load.fileNames[0] << std::endl;
+			for (int i = 0; i < images.size(); i++) {
+				SOIL_free_image_data(images[i].bytes);
+			}
+			release(load);
+			return true;
+		}
+
+		std::vector<size_t> levelOffsets;
+		for (int level = 0; level < load.numLevels; level++) {
+			levelOffsets.push_back(getLevelOffset(load, level));
+		}
+		const int numLevels = load.numLevels;
+		const int width = load.width;
+		const int height = load.height;
+		const MipMapGenerator::Filter filter = MipMapGenerator::getDefaultFilter();
+
+		// The buffer stays mapped until the copy is done, GL doesn't look at it in the meantime.
+		// Within a level the faces follow each other, see getLevelOffset.
+		load.copy = ThreadPool::getShared().enqueue([images, mapped, levelOffsets, numLevels, width, height, filter]() {
+			const int channels = images[0].channels;
+			const size_t imageBytes = (size_t)width * height * channels;
+			for (int i = 0; i < images.size(); i++) {
+				if (numLevels == 1) {
+					memcpy(mapped + i * imageBytes, images[i].bytes, imageBytes);
+				}
+				else {
+					std::vector<std::vector<unsigned char>> levels;
+					MipMapGenerator::generate(images[i].bytes, width, height, channels, levels, filter, channels >= 3, numLevels);
+					for (int level = 0; level < numLevels; level++) {
+						memcpy(mapped + levelOffsets[level] + i * levels[level].size(), &levels[level][0], levels[level].size());
+					}
+				}
+				SOIL_free_image_data(images[i].bytes);
+			}
+		});
+		load.stage = COPYING;
+		return false;
+	}
+
+	bool TextureLoader::startTransfer(PendingLoad &load)
+	{
+		if (!isReady(load.copy)) {
+			return false;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, load.pbo);
+		bool mapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+
+		std::shared_ptr<Texture> texture = load.texture.lock();
+		if (texture.get() == nullptr || !mapped) {
+			if (!mapped) {
+				// The data store was lost (e.g. a mode switch), decode again
+				std::cerr << "Texture upload buffer was corrupted, reloading: " << load.fileNames[0] << std::endl;
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			release(load);
+			if (texture.get() != nullptr) {
+				this->load(texture, load.fileNames);
+			}
+			return true;
+		}
+
+		GLenum externalFormat = Texture::getExternalFormat(load.internalFormat);
+		GLenum dataFormat = Texture::determineDataType(load.internalFormat);
+		// Upload into a new texture object, the placeholder stays bound and usable until the transfer has finished
+		glGenTextures(1, &load.texID);
+		glBindTexture(load.target, load.texID);
+
+		// SOIL rows are tightly packed
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		const int numFaces = (load.target == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+		for (int level = 0; level < load.numLevels; level++) {
+			const int levelWidth = MipMapGenerator::getLevelWidth(load.width, level);
+			const int levelHeight = MipMapGenerator::getLevelHeight(load.height, level);
+			const size_t levelBytes = (size_t)levelWidth * levelHeight * load.channels;
+			for (int face = 0; face < numFaces; face++) {
+				GLenum faceTarget = (load.target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : load.target;
+				glTexImage2D(faceTarget, level, load.internalFormat, levelWidth, levelHeight, 0, externalFormat, dataFormat, (const void*)(getLevelOffset(load, level) + face * levelBytes));
+			}
+		}
+		glTexParameteri(load.target, GL_TEXTURE_MAX_LEVEL, load.numLevels - 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+		Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, getLevelOffset(load, load.numLevels));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		load.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		load.stage = TRANSFERRING;
+		return false;
+	}
+
+	bool TextureLoader::checkTransfer(PendingLoad &load)
+	{
+		GLenum status = glClientWaitSync(load.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return false;
+		}
+
+		std::shared_ptr<Texture> texture = load.texture.lock();
+		if (texture.get() != nullptr && status != GL_WAIT_FAILED) {
+			texture->makeResident(load.texID, load.width, load.height, load.internalFormat, load.alphaMode);
+			load.texID = 0; // owned by the texture now
+		}
+		release(load);
+		return true;
+	}
+
+	void TextureLoader::release(PendingLoad &load)
+	{
+		if (load.fence != 0) {
+			glDeleteSync(load.fence);
+			load.fence = 0;
+		}
+		if (load.pbo != 0) {
+			glDeleteBuffers(1, &load.pbo);
+			load.pbo = 0;
+		}
+		if (load.texID != 0) {
+			glDeleteTextures(1, &load.texID);
+			load.texID = 0;
+		}
+	}
+
+	size_t TextureLoader::getLevelOffset(const PendingLoad &load, int level)
+	{
+		const size_t numFaces = load.fileNames.size();
+		size_t offset = 0;
+		for (int i = 0; i < level; i++) {
+			offset += (size_t)MipMapGenerator::getLevelWidth(load.width, i) * MipMapGenerator::getLevelHeight(load.height, i) * load.channels * numFaces;
+		}
+		return offset;
+	}
+
+	TextureLoader::DecodedImage TextureLoader::decode(const std::string &fileName)
+	{
+		TRACE_SCOPE_DETAIL("texture", "Decode", fileName.c_str());
+		DecodedImage image;
+		image.bytes = SOIL_load_image(fileName.c_str(), &image.width, &image.height, &image.channels, SOIL_LOAD_AUTO);
+		if (image.bytes == NULL) {
+			// Note: SOIL keeps its last result in a global, with several decodes in flight the reason may belong to another file
+			image.error = "Unable to load texture: " + fileName + "\n" + SOIL_last_result();
+			image.width = 0;
+			image.height = 0;
+			image.channels = 0;
+		}
+		else if (image.channels < 1 || image.channels > 4) {
+			image.error = "Loaded image data in unsupported format: " + fileName;
+		}
+		image.alphaMode = image.error.empty() ? Texture::classifyAlpha(image.bytes, image.width, image.height, image.channels) : Texture::ALPHA_OPAQUE;
+		return image;
+	}
+
+}
@@ -0,0 +1,104 @@
+/*!
+ *  TextureLoader.h
+ *
+ * Backs Texture::create2DTextureFromFileAsync and Texture::createCubeMapFromFilesAsync.
+ */
+
+#ifndef TextureLoader_h
+#define TextureLoader_h
+
+#include <glad/glad.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** TextureLoader moves asynchronous texture loads through three stages:
+	1. Decoding: each image (cube face) is decoded with SOIL on the shared ThreadPool.
+	2. Copying: a pixel buffer object is mapped on the GL thread and a worker copies the decoded pixels into it.
+   If the texture wants mipmaps the worker builds them with MipMapGenerator and copies every level.
+	3. Transferring: the PBO is unmapped and glTexImage* sources from it, so the driver can DMA the pixels
+	   without stalling. A fence marks the end of the transfer and the texture becomes resident once it signals.
+	Only update() touches GL and it never waits, so loading textures does not stall the render loop.
+	*/
+	class TextureLoader
+	{
+	public:
+
+		static TextureLoader& getInstance();
+
+		// Starts loading fileNames (1 for a 2D texture, 6 for a cube map) into the placeholder texture
+		void load(std::shared_ptr<Texture> texture, const std::vector<std::string> &fileNames);
+
+		/*!
+		 * Advances all pending loads. Call once per frame on the GL thread.
+		 */
+		void update();
+
+		// Number of loads that have not become resident yet
+		int getNumPending() const;
+
+		/*!
+		 * Calls update() until every pending load is resident. Useful before taking screenshots or in batch jobs.
+		 */
+		void finish();
+
+	private:
+		TextureLoader() {};
+		TextureLoader(const TextureLoader&) {}; // prevent copying
+
+		struct DecodedImage {
+			unsigned char* bytes;
+			int width;
+			int height;
+			int channels;
+			Texture::AlphaMode alphaMode;
+			std::string error;
+		};
+
+		enum Stage {
+			DECODING,
+			COPYING,
+			TRANSFERRING
+		};
+
+		struct PendingLoad {
+			std::weak_ptr<Texture> texture;
+			GLenum target;
+			std::vector<std::string> fileNames;
+			Stage stage;
+			std::vector<std::shared_future<DecodedImage>> decodes;
+			std::future<void> copy;
+			GLuint pbo;
+			GLuint texID;
+			GLsync fence;
+			int width;
+			int height;
+			int channels;
+			GLenum internalFormat;
+			Texture::AlphaMode alphaMode;
+			int numLevels;
+		};
+
+		std::vector<std::unique_ptr<PendingLoad>> _pending;
+
+		// Each returns true when the load has finished (successfully or not) and can be removed
+		bool startCopy(PendingLoad &load);
+		bool startTransfer(PendingLoad &load);
+		bool checkTransfer(PendingLoad &load);
+		void release(PendingLoad &load);
+
+		// Byte offset of a mip level in the PBO, all levels before it (with all of their faces) come first
+		static size_t getLevelOffset(const PendingLoad &load, int level);
+
+		static DecodedImage decode(const std::string &fileName);
+	};
+
+}
+
+#endif /* TextureLoader_h */
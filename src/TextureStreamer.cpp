@@ -0,0 +1,375 @@
+//
+//  TextureStreamer.cpp
+//
+//
+
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace basicgraphics {
+
+	TextureStreamer::TextureStreamer() : _memoryBudget(256 * 1024 * 1024), _uploadBytesPerFrame(4 * 1024 * 1024), _residentBytes(0), _frame(0)
+	{
+	}
+
+	TextureStreamer& TextureStreamer::getInstance()
+	{
+		static TextureStreamer streamer;
+		return streamer;
+	}
+
+	void TextureStreamer::load(std::shared_ptr<Texture> texture, const std::string &fileName, MipMapGenerator::Filter filter)
+	{
+		std::unique_ptr<StreamedTexture> streamed(new StreamedTexture());
+		streamed->texture = texture;
+		streamed->fileName = fileName;
+		streamed->chain = ThreadPool::getShared().enqueue([fileName, filter]() { return buildChain(fileName, filter); }).share();
+		streamed->uploaded = false;
+		streamed->numLevels = 0;
+		streamed->tailLevel = 0;
+		streamed->baseLevel = 0;
+		streamed->requestedSize = 0.0f;
+		streamed->lastRequestFrame = _frame;
+		streamed->internalFormat = 0;
+		streamed->cache.setTag(fileName);
+
+		// The entry can belong to a destroyed texture that update() hasn't removed yet, or to this one being
+		// loaded again. Either way its levels stop counting against the budget.
+		std::unique_ptr<StreamedTexture> &entry = _textures[texture.get()];
+		if (entry.get() != nullptr) {
+			_residentBytes -= getUploadedBytes(*entry);
+		}
+		entry = std::move(streamed);
+	}
+
+	void TextureStreamer::requestScreenSize(const Texture* texture, float pixels)
+	{
+		std::map<const Texture*, std::unique_ptr<StreamedTexture>>::iterator it = _textures.find(texture);
+		if (it == _textures.end()) {
+			return;
+		}
+
+		StreamedTexture &streamed = *it->second;
+		if (streamed.lastRequestFrame != _frame) {
+			streamed.requestedSize = pixels;
+			streamed.lastRequestFrame = _frame;
+		}
+		else {
+			streamed.requestedSize = std::max(streamed.requestedSize, pixels);
+		}
+	}
+
+	void TextureStreamer::update()
+	{
+		_frame++;
+
+		std::vector<StreamedTexture*> &wanting = _wanting;
+		wanting.clear();
+		std::map<const Texture*, std::unique_ptr<StreamedTexture>>::iterator it = _textures.begin();
+		while (it != _textures.end()) {
+			StreamedTexture &streamed = *it->second;
+			std::shared_ptr<Texture> texture = streamed.texture.lock();
+
+			// The Texture destructor already deleted the GL texture, just forget about its levels
+			if (texture.get() == nullptr) {
+				_residentBytes -= getUploadedBytes(streamed);
+				it = _textures.erase(it);
+				continue;
+			}
+
+			if (!streamed.uploaded) {
+				if (streamed.chain.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+					++it;
+					continue;
+				}
+				if (!uploadTail(streamed, *texture)) {
+					it = _textures.erase(it);
+					continue;
+				}
+			}
+
+			if (getDesiredLevel(streamed) < streamed.baseLevel) {
+				wanting.push_back(&streamed);
+			}
+			++it;
+		}
+
+		// The textures that are furthest from the detail they need go first
+		std::sort(wanting.begin(), wanting.end(), [this](const StreamedTexture* a, const StreamedTexture* b) {
+			return (a->baseLevel - getDesiredLevel(*a)) > (b->baseLevel - getDesiredLevel(*b));
+		});
+
+		size_t uploadedBytes = 0;
+		for (int i = 0; i < wanting.size() && uploadedBytes < _uploadBytesPerFrame; i++) {
+			StreamedTexture &streamed = *wanting[i];
+			const GLuint texID = streamed.texture.lock()->getID();
+			const int desired = getDesiredLevel(streamed);
+
+			while (streamed.baseLevel > desired && uploadedBytes < _uploadBytesPerFrame) {
+				const size_t bytes = getLevelBytes(streamed, streamed.baseLevel - 1);
+				// How much more detail than needed the new level would be, <= 0 since it is wanted
+				const int excess = desired - (streamed.baseLevel - 1);
+
+				// Make room by evicting levels that are needed less than this one
+				while (_residentBytes + bytes > _memoryBudget) {
+					StreamedTexture* victim = nullptr;
+					int victimExcess = excess;
+					for (it = _textures.begin(); it != _textures.end(); ++it) {
+						StreamedTexture &other = *it->second;
+						if (&other == &streamed || !other.uploaded || other.baseLevel >= other.tailLevel) {
+							continue;
+						}
+						int otherExcess = getDesiredLevel(other) - other.baseLevel;
+						if (otherExcess > victimExcess) {
+							victim = &other;
+							victimExcess = otherExcess;
+						}
+					}
+					if (victim == nullptr) {
+						break;
+					}
+					std::shared_ptr<Texture> victimTexture = victim->texture.lock();
+					if (victimTexture.get() == nullptr) {
+						break; // removed next frame
+					}
+					evictLevel(*victim, victimTexture->getID());
+				}
+
+				if (_residentBytes + bytes > _memoryBudget) {
+					return; // over budget, everything left wants detail at least as much as this
+				}
+
+				uploadLevel(streamed, texID);
+				uploadedBytes += bytes;
+			}
+		}
+	}
+
+	void TextureStreamer::setMemoryBudget(size_t bytes)
+	{
+		_memoryBudget = bytes;
+	}
+
+	size_t TextureStreamer::getMemoryBudget() const
+	{
+		return _memoryBudget;
+	}
+
+	size_t TextureStreamer::getResidentBytes() const
+	{
+		return _residentBytes;
+	}
+
+	void TextureStreamer::setUploadBytesPerFrame(size_t bytes)
+	{
+		_uploadBytesPerFrame = bytes;
+	}
+
+	int TextureStreamer::getNumStreaming() const
+	{
+		return _textures.size();
+	}
+
+	float TextureStreamer::estimateScreenSize(const glm::mat4 &modelViewProjection, const glm::vec3 &center, float radius, int viewportHeight)
+	{
+		glm::vec4 clipCenter = modelViewProjection * glm::vec4(center, 1.0);
+		if (clipCenter.w <= radius) {
+			// The camera is inside or right in front of the object
+			return (float)viewportHeight;
+		}
+		glm::vec2 ndcCenter = glm::vec2(clipCenter) / clipCenter.w;
+
+		// Project the radius along each axis and keep the longest, offsets along the view direction shrink to nothing
+		float ndcRadius = 0.0f;
+		for (int axis = 0; axis < 3; axis++) {
+			glm::vec3 offset(0.0f);
+			offset[axis] = radius;
+			glm::vec4 clip = modelViewProjection * glm::vec4(center + offset, 1.0);
+			if (clip.w > 0.0f) {
+				ndcRadius = std::max(ndcRadius, glm::length(glm::vec2(clip) / clip.w - ndcCenter));
+			}
+		}
+
+		// NDC spans 2 units over the viewport, so the diameter 2 * ndcRadius covers ndcRadius * viewportHeight pixels
+		return ndcRadius * viewportHeight;
+	}
+
+	bool TextureStreamer::uploadTail(StreamedTexture &streamed, Texture &texture)
+	{
+		const MipChain &chain = streamed.chain.get();
+		if (!chain.error.empty()) {
+			std::cerr << chain.error << std::endl;
+			return false;
+		}
+
+		streamed.numLevels = chain.levels.size();
+		streamed.internalFormat = Texture::getInternalFormat(chain.channels, streamed.fileName);
+		streamed.tailLevel = 0;
+		while (streamed.tailLevel < streamed.numLevels - 1 && std::max(MipMapGenerator::getLevelWidth(chain.width, streamed.tailLevel), MipMapGenerator::getLevelHeight(chain.height, streamed.tailLevel)) > TAIL_SIZE) {
+			streamed.tailLevel++;
+		}
+
+		GLuint texID;
+		glGenTextures(1, &texID);
+		glBindTexture(GL_TEXTURE_2D, texID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (int level = streamed.tailLevel; level < streamed.numLevels; level++) {
+			glTexImage2D(GL_TEXTURE_2D, level, streamed.internalFormat, MipMapGenerator::getLevelWidth(chain.width, level), MipMapGenerator::getLevelHeight(chain.height, level), 0,
+				Texture::getExternalFormat(streamed.internalFormat), Texture::determineDataType(streamed.internalFormat), &chain.levels[level][0]);
+			_residentBytes += getLevelBytes(streamed, level);
+			Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, getLevelBytes(streamed, level));
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+
+		// Levels below the base level are never sampled, so they don't have to exist
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, streamed.tailLevel);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, streamed.numLevels - 1);
+		streamed.baseLevel = streamed.tailLevel;
+		streamed.uploaded = true;
+
+		texture.makeResident(texID, chain.width, chain.height, streamed.internalFormat, chain.alphaMode);
+
+		size_t chainBytes = 0;
+		for (int level = 0; level < chain.levels.size(); level++) {
+			chainBytes += chain.levels[level].size();
+		}
+		streamed.cache.setBytes(chainBytes);
+		updateMemory(streamed);
+		return true;
+	}
+
+	void TextureStreamer::uploadLevel(StreamedTexture &streamed, GLuint texID)
+	{
+		const MipChain &chain = streamed.chain.get();
+		const int level = streamed.baseLevel - 1;
+
+		glBindTexture(GL_TEXTURE_2D, texID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, level, streamed.internalFormat, MipMapGenerator::getLevelWidth(chain.width, level), MipMapGenerator::getLevelHeight(chain.height, level), 0,
+			Texture::getExternalFormat(streamed.internalFormat), Texture::determineDataType(streamed.internalFormat), &chain.levels[level][0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+		streamed.baseLevel = level;
+		_residentBytes += getLevelBytes(streamed, level);
+		updateMemory(streamed);
+		Metrics::add(Metrics::TEXTURE_UPLOADS);
+		Metrics::add(Metrics::TEXTURE_UPLOAD_BYTES, getLevelBytes(streamed, level));
+	}
+
+	void TextureStreamer::evictLevel(StreamedTexture &streamed, GLuint texID)
+	{
+		const int level = streamed.baseLevel;
+
+		// Move the base level first so the texture stays complete, then release the level's storage
+		glBindTexture(GL_TEXTURE_2D, texID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+		glTexImage2D(GL_TEXTURE_2D, level, streamed.internalFormat, 0, 0, 0, Texture::getExternalFormat(streamed.internalFormat), Texture::determineDataType(streamed.internalFormat), NULL);
+
+		streamed.baseLevel = level + 1;
+		_residentBytes -= getLevelBytes(streamed, level);
+		updateMemory(streamed);
+	}
+
+	int TextureStreamer::getDesiredLevel(const StreamedTexture &streamed) const
+	{
+		if (_frame - streamed.lastRequestFrame > IDLE_FRAMES || streamed.requestedSize <= 0.0f) {
+			return streamed.tailLevel;
+		}
+
+		// The finest level needed is the one with about one texel per pixel
+		const MipChain &chain = streamed.chain.get();
+		const float texels = (float)std::max(chain.width, chain.height);
+		int level = (int)std::floor(std::log2(texels / streamed.requestedSize));
+		return std::min(std::max(level, 0), streamed.tailLevel);
+	}
+
+	size_t TextureStreamer::getLevelBytes(const StreamedTexture &streamed, int level) const
+	{
+		const MipChain &chain = streamed.chain.get();
+		// Drivers pad RGB8 to four bytes per texel
+		const int bytesPerTexel = (chain.channels == 3) ? 4 : chain.channels;
+		return (size_t)MipMapGenerator::getLevelWidth(chain.width, level) * MipMapGenerator::getLevelHeight(chain.height, level) * bytesPerTexel;
+	}
+
+	size_t TextureStreamer::getUploadedBytes(const StreamedTexture &streamed) const
+	{
+		size_t bytes = 0;
+		for (int level = streamed.baseLevel; streamed.uploaded && level < streamed.numLevels; level++) {
+			bytes += getLevelBytes(streamed, level);
+		}
+		return bytes;
+	}
+
+	void TextureStreamer::updateMemory(const StreamedTexture &streamed) const
+	{
+		std::shared_ptr<Texture> texture = streamed.texture.lock();
+		if (texture.get() == nullptr) {
+			return;
+		}
+		texture->_memory.setBytes(getUploadedBytes(streamed));
+	}
+
+	bool TextureStreamer::getImage(const Texture* texture, std::vector<unsigned char> &rgba, int &width, int &height, Texture::AlphaMode &alphaMode)
+	{
+		std::map<const Texture*, std::unique_ptr<StreamedTexture>>::iterator it = _textures.find(texture);
+		if (it == _textures.end()) {
+			return false;
+		}
+		const MipChain &chain = it->second->chain.get();
+		if (!chain.error.empty() || chain.levels.empty()) {
+			return false;
+		}
+
+		// Expanded the way SOIL_LOAD_RGBA would: grey goes into every color channel, missing alpha is opaque
+		const unsigned char* src = &chain.levels[0][0];
+		const size_t numTexels = (size_t)chain.width * chain.height;
+		rgba.resize(numTexels * 4);
+		for (size_t i = 0; i < numTexels; i++) {
+			const unsigned char* texel = src + i * chain.channels;
+			unsigned char* dst = &rgba[i * 4];
+			if (chain.channels >= 3) {
+				dst[0] = texel[0];
+				dst[1] = texel[1];
+				dst[2] = texel[2];
+			}
+			else {
+				dst[0] = dst[1] = dst[2] = texel[0];
+			}
+			dst[3] = (chain.channels == 2 || chain.channels == 4) ? texel[chain.channels - 1] : 255;
+		}
+		width = chain.width;
+		height = chain.height;
+		alphaMode = chain.alphaMode;
+		return true;
+	}
+
+	TextureStreamer::MipChain TextureStreamer::buildChain(const std::string &fileName, MipMapGenerator::Filter filter)
+	{
+		TRACE_SCOPE_DETAIL("texture", "Build mip chain", fileName.c_str());
+		MipChain chain;
+		unsigned char* bytes = SOIL_load_image(fileName.c_str(), &chain.width, &chain.height, &chain.channels, SOIL_LOAD_AUTO);
+		if (bytes == NULL) {
+			chain.error = "Unable to load texture: " + fileName + "\n" + SOIL_last_result();
+			return chain;
+		}
+		if (chain.channels < 1 || chain.channels > 4) {
+			chain.error = "Loaded image data in unsupported format: " + fileName;
+			SOIL_free_image_data(bytes);
+			return chain;
+		}
+
+		chain.alphaMode = Texture::classifyAlpha(bytes, chain.width, chain.height, chain.channels);
+		MipMapGenerator::generate(bytes, chain.width, chain.height, chain.channels, chain.levels, filter, chain.channels >= 3);
+		SOIL_free_image_data(bytes);
+		return chain;
+	}
+
+}
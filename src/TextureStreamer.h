@@ -0,0 +1,139 @@
+/*!
+ *  TextureStreamer.h
+ *
+ * Backs Texture::create2DTextureFromFileStreaming.
+ */
+
+#ifndef TextureStreamer_h
+#define TextureStreamer_h
+
+#include <glad/glad.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "MipMapGenerator.h"
+#include "MemoryAccounting.h"
+#include "Texture.h"
+
+namespace basicgraphics {
+
+	/** TextureStreamer keeps only the mip levels of a texture that are actually needed on the GPU.
+	The image is decoded and its whole mip chain is built on worker threads. Then the coarse levels (the
+	mip tail, up to TAIL_SIZE texels on a side) are uploaded right away and the finer levels follow one
+	at a time as the texture covers more of the screen. GL_TEXTURE_BASE_LEVEL is clamped to the finest
+	level that has arrived, so sampling never touches a level that isn't there yet.
+
+	All streamed textures share one memory budget. When a finer level doesn't fit, levels are evicted
+	from the textures that have more detail than their screen size calls for (or haven't been drawn in a
+	while) first. The CPU copy of the mip chain stays in memory so evicted levels can come back quickly.
+
+	Screen coverage is reported with requestScreenSize, e.g. through Model::requestTextureResolution.
+	update() must be called once per frame on the GL thread (BaseApp::run does this).
+	*/
+	class TextureStreamer
+	{
+	public:
+
+		static TextureStreamer& getInstance();
+
+		// Starts streaming fileName into the placeholder texture
+		void load(std::shared_ptr<Texture> texture, const std::string &fileName, MipMapGenerator::Filter filter);
+
+		/*!
+		 * Reports that texture is drawn this frame covering about pixels pixels along its larger side.
+		 * Several calls in the same frame keep the largest size.
+		 */
+		void requestScreenSize(const Texture* texture, float pixels);
+
+		/*!
+		 * Uploads and evicts levels. Call once per frame on the GL thread.
+		 */
+		void update();
+
+		// Total size of the GPU levels of all streamed textures
+		void setMemoryBudget(size_t bytes);
+		size_t getMemoryBudget() const;
+		size_t getResidentBytes() const;
+
+		// Caps how much is uploaded in one frame so streaming doesn't cause hitches
+		void setUploadBytesPerFrame(size_t bytes);
+
+		int getNumStreaming() const;
+
+		/*!
+		 * Copies level 0 of a streamed texture's decoded image out as RGBA, waiting for the decode if it hasn't
+		 * finished. Returns false if the texture isn't streamed or its file failed to load. This is how
+		 * MaterialBuffer packs a Model's textures without decoding the files a second time.
+		 */
+		bool getImage(const Texture* texture, std::vector<unsigned char> &rgba, int &width, int &height, Texture::AlphaMode &alphaMode);
+
+		/*!
+		 * Approximate diameter in pixels of a bounding sphere after projection, for requestScreenSize.
+		 */
+		static float estimateScreenSize(const glm::mat4 &modelViewProjection, const glm::vec3 &center, float radius, int viewportHeight);
+
+		// Levels at or below this size are always resident
+		static const int TAIL_SIZE = 64;
+
+		// Frames without a request before a texture falls back to its mip tail
+		static const int IDLE_FRAMES = 60;
+
+	private:
+		TextureStreamer();
+		TextureStreamer(const TextureStreamer&) {}; // prevent copying
+
+		struct MipChain {
+			std::vector<std::vector<unsigned char>> levels;
+			int width;
+			int height;
+			int channels;
+			Texture::AlphaMode alphaMode;
+			std::string error;
+		};
+
+		struct StreamedTexture {
+			StreamedTexture() : cache(MemoryAccounting::TEXTURE_CACHE) {}
+
+			std::weak_ptr<Texture> texture;
+			std::string fileName;
+			std::shared_future<MipChain> chain;
+			bool uploaded; // the mip tail is on the GPU
+			int numLevels;
+			int tailLevel; // coarsest level that may be evicted is tailLevel - 1
+			int baseLevel; // finest level on the GPU
+			float requestedSize; // largest size requested since the last update
+			int lastRequestFrame;
+			GLenum internalFormat;
+			MemoryRecord cache; // the whole mip chain, kept in system memory to upload finer levels from
+		};
+
+		// Keyed by address, a texture allocated where a destroyed one was replaces its entry in load
+		std::map<const Texture*, std::unique_ptr<StreamedTexture>> _textures;
+		size_t _memoryBudget;
+		size_t _uploadBytesPerFrame;
+		size_t _residentBytes;
+		int _frame;
+		std::vector<StreamedTexture*> _wanting; // scratch for update, kept so it doesn't allocate every frame
+
+		bool uploadTail(StreamedTexture &streamed, Texture &texture);
+		void uploadLevel(StreamedTexture &streamed, GLuint texID);
+		void evictLevel(StreamedTexture &streamed, GLuint texID);
+		int getDesiredLevel(const StreamedTexture &streamed) const;
+		size_t getLevelBytes(const StreamedTexture &streamed, int level) const;
+		// Sum of the levels on the GPU, what the texture adds to _residentBytes
+		size_t getUploadedBytes(const StreamedTexture &streamed) const;
+		// Counts only the resident levels of the texture in MemoryAccounting
+		void updateMemory(const StreamedTexture &streamed) const;
+
+		static MipChain buildChain(const std::string &fileName, MipMapGenerator::Filter filter);
+	};
+
+}
+
+#endif /* TextureStreamer_h */
@@ -0,0 +1,123 @@
+//
+//  ThreadPool.cpp
+//
+//
+
+#include "ThreadPool.h"
+#include "Tracer.h"
+
+#include <algorithm>
+
+namespace basicgraphics {
+
+	ThreadPool::ThreadPool(int numThreads /*=0*/) : _stop(false)
+	{
+		if (numThreads <= 0) {
+			numThreads = std::thread::hardware_concurrency();
+			if (numThreads <= 0) {
+				numThreads = 2;
+			}
+		}
+
+		for (int i = 0; i < numThreads; i++) {
+			_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_condition.notify_all();
+
+		for (int i = 0; i < _workers.size(); i++) {
+			_workers[i].join();
+		}
+	}
+
+	void ThreadPool::push(const std::function<void()> &task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.push_back(task);
+		}
+		_condition.notify_one();
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		TRACE_THREAD_NAME("ThreadPool worker");
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_condition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+				if (_tasks.empty()) {
+					return; // stopped and drained
+				}
+				task = _tasks.front();
+				_tasks.pop_front();
+			}
+			TRACE_SCOPE("threadpool", "Task");
+			task();
+		}
+	}
+
+	void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)> &f)
+	{
+		if (end <= begin) {
+			return;
+		}
+
+		// Indices are handed out one at a time from a shared counter, so uneven work balances itself.
+		// Every helper holds a reference to the shared state in case it only starts after we returned.
+		struct State {
+			std::atomic<int> next;
+			std::atomic<int> done;
+			int end;
+			std::function<void(int)> f;
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		std::shared_ptr<State> state(new State());
+		state->next = begin;
+		state->done = 0;
+		state->end = end;
+		state->f = f;
+		const int total = end - begin;
+
+		std::function<void()> work = [state, total]() {
+			int i;
+			while ((i = state->next++) < state->end) {
+				state->f(i);
+				if (++state->done == total) {
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->finished.notify_all();
+				}
+			}
+		};
+
+		int helpers = std::min((int)_workers.size(), total - 1);
+		for (int i = 0; i < helpers; i++) {
+			push(work);
+		}
+		work();
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->finished.wait(lock, [state, total]() { return state->done == total; });
+	}
+
+	int ThreadPool::getNumThreads() const
+	{
+		return _workers.size();
+	}
+
+	ThreadPool& ThreadPool::getShared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+}
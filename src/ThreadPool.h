@@ -0,0 +1,81 @@
+/*!
+ *  ThreadPool.h
+ *
+ * A fixed set of worker threads that run queued tasks. Used to move work like image decoding off the render thread.
+ */
+
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** ThreadPool runs tasks on a fixed number of worker threads. enqueue returns a std::future for
+	the result of the task, so the render thread can poll it with wait_for(0) instead of blocking.
+	------------------------------------------------------------------------
+	std::future<int> result = ThreadPool::getShared().enqueue([]() { return expensiveWork(); });
+	...
+	if (result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		int value = result.get();
+	}
+	------------------------------------------------------------------------
+	*/
+	class ThreadPool
+	{
+	public:
+
+		// numThreads = 0 uses one thread per hardware core
+		ThreadPool(int numThreads = 0);
+
+		// Finishes the tasks that are already queued and joins the workers
+		virtual ~ThreadPool();
+
+		/*!
+		 * Queues f to run on a worker thread.
+		 */
+		template<class F>
+		std::future<typename std::result_of<F()>::type> enqueue(F f)
+		{
+			typedef typename std::result_of<F()>::type Result;
+			std::shared_ptr<std::packaged_task<Result()>> task(new std::packaged_task<Result()>(f));
+			std::future<Result> result = task->get_future();
+			push([task]() { (*task)(); });
+			return result;
+		}
+
+		/*!
+		 * Runs f(i) for every i in [begin, end) on the workers and returns when all calls are done.
+		 * The calling thread works on the range too, so this is safe to call from inside a task.
+		 */
+		void parallelFor(int begin, int end, const std::function<void(int)> &f);
+
+		int getNumThreads() const;
+
+		// Process wide pool sized to the number of cores
+		static ThreadPool& getShared();
+
+	private:
+		ThreadPool(const ThreadPool&) {}; // prevent copying
+
+		std::vector<std::thread> _workers;
+		std::deque<std::function<void()>> _tasks;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		bool _stop;
+
+		void push(const std::function<void()> &task);
+		void workerLoop();
+	};
+
+}
+
+#endif /* ThreadPool_h */
@@ -0,0 +1,211 @@
+//
+//  Tracer.cpp
+//
+//
+
+#include "Tracer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace basicgraphics {
+
+	// The calling thread's buffer, and its name until the buffer exists
+	static thread_local void* threadBuffer = nullptr;
+	static thread_local char threadName[Tracer::MAX_THREAD_NAME] = { 0 };
+
+	static void copyString(char* destination, const char* source, int size)
+	{
+		strncpy(destination, source, size - 1);
+		destination[size - 1] = '\0';
+	}
+
+	// As a JSON string
+	static void writeString(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				fputc('\\', file);
+				fputc(*c, file);
+			}
+			else if ((unsigned char)*c < 0x20) {
+				fprintf(file, "\\u%04x", (unsigned char)*c);
+			}
+			else {
+				fputc(*c, file);
+			}
+		}
+		fputc('"', file);
+	}
+
+	Tracer& Tracer::getInstance()
+	{
+		static Tracer tracer;
+		return tracer;
+	}
+
+	Tracer::Tracer() : _enabled(false), _started(false), _maxFrames(0), _numFrames(0), _origin(Clock::now())
+	{
+		const char* fileName = getenv("BASICGRAPHICS_TRACE");
+		if (fileName != nullptr && fileName[0] != '\0') {
+			start(fileName);
+		}
+	}
+
+	Tracer::~Tracer()
+	{
+		stop();
+	}
+
+	bool Tracer::start(const std::string &fileName, int maxFrames /*=0*/)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_started) {
+			std::cerr << "Tracer: already traced to " << _fileName << ", not tracing to " << fileName << std::endl;
+			return false;
+		}
+		_started = true;
+		_fileName = fileName;
+		_maxFrames = maxFrames;
+		if (_maxFrames == 0) {
+			const char* frames = getenv("BASICGRAPHICS_TRACE_FRAMES");
+			_maxFrames = frames != nullptr ? std::max(atoi(frames), 0) : 0;
+		}
+		_numFrames = 0;
+		if (threadName[0] == '\0') {
+			copyString(threadName, "Main", MAX_THREAD_NAME);
+		}
+		_enabled.store(true);
+		return true;
+	}
+
+	bool Tracer::stop()
+	{
+		if (!_enabled.exchange(false)) {
+			return true;
+		}
+		return write();
+	}
+
+	void Tracer::setThreadName(const char* name)
+	{
+		copyString(threadName, name, MAX_THREAD_NAME);
+		if (threadBuffer != nullptr) {
+			std::lock_guard<std::mutex> lock(_mutex);
+			copyString(static_cast<ThreadBuffer*>(threadBuffer)->name, name, MAX_THREAD_NAME);
+		}
+	}
+
+	Tracer::ThreadBuffer* Tracer::getThreadBuffer()
+	{
+		if (threadBuffer == nullptr) {
+			ThreadBuffer* buffer = new ThreadBuffer();
+			copyString(buffer->name, threadName[0] != '\0' ? threadName : "Thread", MAX_THREAD_NAME);
+			buffer->head = new Chunk();
+			buffer->head->count = 0;
+			buffer->head->next = nullptr;
+			buffer->tail = buffer->head;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			buffer->id = (int)_buffers.size() + 1;
+			_buffers.push_back(buffer);
+			threadBuffer = buffer;
+		}
+		return static_cast<ThreadBuffer*>(threadBuffer);
+	}
+
+	void Tracer::addEvent(const char* category, const char* name, const char* detail, Clock::time_point start, Clock::time_point end)
+	{
+		if (!isEnabled()) {
+			return;
+		}
+
+		ThreadBuffer* buffer = getThreadBuffer();
+		Chunk* chunk = buffer->tail;
+		int index = chunk->count.load(std::memory_order_relaxed);
+		if (index == CHUNK_SIZE) {
+			Chunk* next = new Chunk();
+			next->count = 0;
+			next->next = nullptr;
+			chunk->next.store(next, std::memory_order_release);
+			buffer->tail = next;
+			chunk = next;
+			index = 0;
+		}
+
+		Event &event = chunk->events[index];
+		event.category = category;
+		event.name = name;
+		if (detail != nullptr) {
+			copyString(event.detail, detail, MAX_DETAIL);
+		}
+		else {
+			event.detail[0] = '\0';
+		}
+		event.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _origin).count();
+		event.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		chunk->count.store(index + 1, std::memory_order_release);
+	}
+
+	void Tracer::endFrame()
+	{
+		if (isEnabled() && _maxFrames > 0 && ++_numFrames >= _maxFrames) {
+			stop();
+		}
+	}
+
+	bool Tracer::write()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		FILE* file = fopen(_fileName.c_str(), "w");
+		if (file == NULL) {
+			std::cerr << "Tracer: could not open " << _fileName << std::endl;
+			return false;
+		}
+
+		int numEvents = 0;
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ShadyBunny\"}}");
+		for (int i = 0; i < _buffers.size(); i++) {
+			const ThreadBuffer &buffer = *_buffers[i];
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", buffer.id);
+			writeString(file, buffer.name);
+			fprintf(file, "}}");
+
+			// Events a thread records while this runs are simply left out
+			for (const Chunk* chunk = buffer.head; chunk != nullptr; chunk = chunk->next.load(std::memory_order_acquire)) {
+				const int count = chunk->count.load(std::memory_order_acquire);
+				for (int e = 0; e < count; e++) {
+					const Event &event = chunk->events[e];
+					fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"cat\":", buffer.id, event.start / 1000.0, event.duration / 1000.0);
+					writeString(file, event.category);
+					fprintf(file, ",\"name\":");
+					writeString(file, event.name);
+					if (event.detail[0] != '\0') {
+						fprintf(file, ",\"args\":{\"detail\":");
+						writeString(file, event.detail);
+						fprintf(file, "}");
+					}
+					fprintf(file, "}");
+					numEvents++;
+				}
+			}
+		}
+		fprintf(file, "\n]}\n");
+		const bool success = ferror(file) == 0;
+		fclose(file);
+
+		if (success) {
+			std::cout << "Wrote " << numEvents << " trace events from " << _buffers.size() << " threads to " << _fileName << std::endl;
+		}
+		else {
+			std::cerr << "Tracer: could not write " << _fileName << std::endl;
+		}
+		return success;
+	}
+
+}
@@ -0,0 +1,156 @@
+/*!
+ *  Tracer.h
+ *
+ * Records what every thread does over time and writes it as a Chrome trace, which opens in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ */
+
+#ifndef Tracer_h
+#define Tracer_h
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace basicgraphics {
+
+	/** Tracer collects timed events into one buffer per thread. A thread only ever appends to its own
+	buffer and publishes each event with an atomic count, so recording takes no lock; only a thread's
+	first event registers its buffer. When tracing is off an event costs one relaxed atomic load.
+	Tracing starts when the program starts if the BASICGRAPHICS_TRACE environment variable names the
+	output file, or with BaseApp's --trace FILE. The trace is written when stop() is called, after
+	BASICGRAPHICS_TRACE_FRAMES frames if that is set, or when the program exits.
+	Code is instrumented with the macros below, which compile to nothing unless BASICGRAPHICS_TRACING
+	is defined (the CMake option of the same name, on by default). Names and categories must be string
+	literals, a detail (e.g. a file name) is copied when the scope ends. Profiler scopes are recorded
+	as well, in the "frame" category.
+	------------------------------------------------------------------------
+	void Model::importMesh(const std::string &filename, ...) {
+		TRACE_SCOPE_DETAIL("model", "Assimp import", filename.c_str());
+		...
+	}
+	------------------------------------------------------------------------
+	BASICGRAPHICS_TRACE=startup.json BASICGRAPHICS_TRACE_FRAMES=10 ./ShadyBunny
+	*/
+	class Tracer
+	{
+	public:
+
+		typedef std::chrono::steady_clock Clock;
+
+		static const int CHUNK_SIZE = 4096;  // events per allocation of a thread's buffer
+		static const int MAX_DETAIL = 64;    // longer details are cut off
+		static const int MAX_THREAD_NAME = 32;
+
+		static Tracer& getInstance();
+
+		/*!
+		 * Starts recording, the trace is written to fileName by stop(). With maxFrames the trace stops by
+		 * itself after that many calls to endFrame(). Returns false if tracing already ran.
+		 */
+		bool start(const std::string &fileName, int maxFrames = 0);
+
+		// Stops recording and writes the trace, returns false if it could not be written
+		bool stop();
+
+		bool isEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+		// Records a finished scope on the calling thread, detail may be null
+		void addEvent(const char* category, const char* name, const char* detail, Clock::time_point start, Clock::time_point end);
+
+		// Shown for the calling thread in the trace viewer
+		void setThreadName(const char* name);
+
+		// Called by BaseApp::run after each frame, for BASICGRAPHICS_TRACE_FRAMES
+		void endFrame();
+
+	private:
+		Tracer();
+		~Tracer();
+		Tracer(const Tracer&) {}; // prevent copying
+
+		struct Event {
+			const char* category;
+			const char* name;
+			char detail[MAX_DETAIL];
+			long long start;    // nanoseconds since _origin
+			long long duration; // nanoseconds
+		};
+
+		// Filled by the owning thread, count is published after the event is written
+		struct Chunk {
+			Event events[CHUNK_SIZE];
+			std::atomic<int> count;
+			std::atomic<Chunk*> next;
+		};
+
+		struct ThreadBuffer {
+			int id;
+			char name[MAX_THREAD_NAME];
+			Chunk* head;
+			Chunk* tail; // only used by the owning thread
+		};
+
+		// Buffers are never freed, a thread pool worker may still record while the program exits
+		std::mutex _mutex; // guards _buffers and writing the trace
+		std::vector<ThreadBuffer*> _buffers;
+		std::atomic<bool> _enabled;
+		bool _started;
+		std::string _fileName;
+		int _maxFrames;
+		int _numFrames;
+		Clock::time_point _origin;
+
+		ThreadBuffer* getThreadBuffer();
+		bool write();
+	};
+
+	// Records the time from its construction to its destruction, use through TRACE_SCOPE
+	class TraceScope
+	{
+	public:
+		TraceScope(const char* category, const char* name, const char* detail = nullptr) :
+			_category(category), _name(name), _detail(detail), _enabled(Tracer::getInstance().isEnabled())
+		{
+			if (_enabled) {
+				_start = Tracer::Clock::now();
+			}
+		}
+
+		~TraceScope()
+		{
+			if (_enabled) {
+				Tracer::getInstance().addEvent(_category, _name, _detail, _start, Tracer::Clock::now());
+			}
+		}
+
+	private:
+		TraceScope(const TraceScope&) {}; // prevent copying
+
+		const char* _category;
+		const char* _name;
+		const char* _detail;
+		bool _enabled;
+		Tracer::Clock::time_point _start;
+	};
+
+}
+
+#ifdef BASICGRAPHICS_TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces the rest of the enclosing block
+#define TRACE_SCOPE(category, name) basicgraphics::TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#define TRACE_SCOPE_DETAIL(category, name, detail) basicgraphics::TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, name, detail)
+#define TRACE_THREAD_NAME(name) basicgraphics::Tracer::getInstance().setThreadName(name)
+#define TRACE_END_FRAME() basicgraphics::Tracer::getInstance().endFrame()
+#else
+#define TRACE_SCOPE(category, name)
+#define TRACE_SCOPE_DETAIL(category, name, detail)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_END_FRAME()
+#endif
+
+#endif /* Tracer_h */
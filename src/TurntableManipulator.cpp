@@ -23,7 +23,7 @@ void TurntableManipulator::bump(double ar, double u) {
 
 void TurntableManipulator::onEvent(shared_ptr<Event> event) {
     
-    string name = event->getName();
+    const string &name = event->getName();
     
     if (name == "kbd_UP_down" || name == "kbd_UP_repeat") {
         distance -= 0.01;
@@ -66,4 +66,32 @@ glm::mat4 TurntableManipulator::frame() const {
 void TurntableManipulator::setCenterPosition(glm::vec3 position) {
 	center = position;
 }
+
+void TurntableManipulator::setAround(double a) {
+	around = a;
+}
+
+void TurntableManipulator::setUp(double u) {
+	up = u;
+}
+
+void TurntableManipulator::setDistance(double d) {
+	distance = d;
+}
+
+double TurntableManipulator::getAround() const {
+	return around;
+}
+
+double TurntableManipulator::getUp() const {
+	return up;
+}
+
+double TurntableManipulator::getDistance() const {
+	return distance;
+}
+
+glm::vec3 TurntableManipulator::getCenterPosition() const {
+	return center;
+}
 }//namespace
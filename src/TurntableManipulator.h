@@ -17,6 +17,15 @@ public:
 	void bump(double ar, double u);
     glm::vec3 getPos() const;
 
+    // Direct control of the orbit, e.g. for rendering a turntable animation. Angles are in radians.
+    void setAround(double a);
+    void setUp(double u);
+    void setDistance(double d);
+    double getAround() const;
+    double getUp() const;
+    double getDistance() const;
+    glm::vec3 getCenterPosition() const;
+
 protected:
 	double around;
 	double up;
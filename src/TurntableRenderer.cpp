@@ -0,0 +1,137 @@
+//
+//  TurntableRenderer.cpp
+//
+//
+
+#include "TurntableRenderer.h"
+
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+
+#include "PixelReadback.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
+
+namespace basicgraphics {
+
+	TurntableRenderer::Settings::Settings() : numFrames(120), width(1920), height(1080), samples(4), elevation(0.5), distance(3.0),
+		startAngle(0.0), center(0.0f), fieldOfView(45.0f), nearPlane(0.1f), farPlane(100.0f), directory("turntable"), prefix("frame"),
+		format(FrameCapture::FORMAT_PNG), maxFramesInFlight(16)
+	{
+	}
+
+	void TurntableRenderer::Report::print(std::ostream &out) const
+	{
+		// Per frame averages, the stages overlap so they don't add up to the frame time
+		const double frames = std::max(numFrames, 1);
+		out << std::fixed << std::setprecision(2);
+		out << "Turntable: " << numFrames << " frames in " << totalSeconds << " s, " << framesPerSecond << " fps" << std::endl;
+		out << "  draw     " << 1000.0 * drawSeconds / frames << " ms/frame" << std::endl;
+		out << "  readback " << 1000.0 * readbackSeconds / frames << " ms/frame" << std::endl;
+		out << "  encode   " << 1000.0 * encodeSeconds / frames << " ms/frame" << std::endl;
+		out << "  stall    " << 1000.0 * stallSeconds / frames << " ms/frame" << std::endl;
+		out << std::defaultfloat;
+	}
+
+	TurntableRenderer::TurntableRenderer(const Settings &settings) : _settings(settings)
+	{
+		_settings.numFrames = std::max(_settings.numFrames, 1);
+	}
+
+	TurntableRenderer::~TurntableRenderer()
+	{
+	}
+
+	TurntableRenderer::Report TurntableRenderer::render(DrawFunction draw)
+	{
+		return render(draw, 0, _settings.numFrames);
+	}
+
+	TurntableRenderer::Report TurntableRenderer::render(DrawFunction draw, int firstFrame, int count)
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		firstFrame = std::max(std::min(firstFrame, _settings.numFrames), 0);
+		const int endFrame = std::min(firstFrame + std::max(count, 0), _settings.numFrames);
+
+		waitForTextures();
+
+		Framebuffer target(_settings.width, _settings.height, _settings.samples);
+		FrameCapture capture(_settings.directory, _settings.prefix, _settings.format, _settings.maxFramesInFlight);
+		capture.setFirstFrame(firstFrame);
+		const glm::mat4 projection = getProjection();
+
+		Report report;
+		report.numFrames = endFrame - firstFrame;
+		report.drawSeconds = 0.0;
+
+		const Clock::time_point start = Clock::now();
+		for (int frame = firstFrame; frame < endFrame; frame++) {
+			const Clock::time_point drawStart = Clock::now();
+
+			TextureLoader::getInstance().update();
+			TextureStreamer::getInstance().update();
+
+			target.bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			draw(getView(frame), projection, getEyePosition(frame));
+			target.resolve();
+
+			report.drawSeconds += std::chrono::duration<double>(Clock::now() - drawStart).count();
+
+			// Starts the asynchronous copy, the pixels are picked up a few frames later by PixelReadback::update
+			target.bindForReading();
+			capture.capture(target.getWidth(), target.getHeight());
+			PixelReadback::getInstance().update();
+		}
+		capture.finish();
+		Framebuffer::unbind();
+
+		report.totalSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		report.framesPerSecond = (report.totalSeconds > 0.0) ? report.numFrames / report.totalSeconds : 0.0;
+
+		const FrameCapture::Stats stats = capture.getStats();
+		report.readbackSeconds = stats.readbackSeconds;
+		report.encodeSeconds = stats.encodeSeconds;
+		report.stallSeconds = stats.stallSeconds;
+		return report;
+	}
+
+	glm::mat4 TurntableRenderer::getView(int frame) const
+	{
+		return getCamera(frame).frame();
+	}
+
+	glm::vec3 TurntableRenderer::getEyePosition(int frame) const
+	{
+		return getCamera(frame).getPos();
+	}
+
+	glm::mat4 TurntableRenderer::getProjection() const
+	{
+		return glm::perspective(glm::radians(_settings.fieldOfView), (float)_settings.width / (float)_settings.height, _settings.nearPlane, _settings.farPlane);
+	}
+
+	TurntableManipulator TurntableRenderer::getCamera(int frame) const
+	{
+		// Equal steps that end one step short of the start, so the sequence loops without a repeated frame
+		const double around = _settings.startAngle + glm::two_pi<double>() * frame / _settings.numFrames;
+		TurntableManipulator camera(_settings.distance, around, _settings.elevation);
+		camera.setCenterPosition(_settings.center);
+		return camera;
+	}
+
+	void TurntableRenderer::waitForTextures()
+	{
+		TextureLoader &loader = TextureLoader::getInstance();
+		while (loader.getNumPending() > 0) {
+			loader.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+}
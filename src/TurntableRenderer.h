@@ -0,0 +1,112 @@
+/*!
+ *  TurntableRenderer.h
+ *
+ * Renders a 360 degree orbit around a model to an image sequence, offscreen and as fast as the pipeline allows.
+ */
+
+#ifndef TurntableRenderer_h
+#define TurntableRenderer_h
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm/glm.hpp>
+
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "FrameCapture.h"
+#include "Framebuffer.h"
+#include "TurntableManipulator.h"
+
+namespace basicgraphics {
+
+	/** TurntableRenderer steps a TurntableManipulator's around angle through a full turn in numFrames equal steps
+	and renders every step into a Framebuffer. The frames go through a FrameCapture, so while the GPU draws
+	frame n the pixels of the earlier frames are read back through pixel buffers and several frames are
+	encoded at once on the ThreadPool. The camera path doesn't depend on time, rendering the same settings
+	twice gives the same images.
+
+	Before the first frame it waits for asynchronously loading textures so they are in every frame.
+	------------------------------------------------------------------------
+	TurntableRenderer::Settings settings;
+	settings.numFrames = 360;
+	settings.width = 2048;
+	settings.height = 2048;
+	settings.center = glm::vec3(-0.3, 0.8, 0);
+	TurntableRenderer renderer(settings);
+	TurntableRenderer::Report report = renderer.render([&](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye) {
+		drawScene(view, projection, eye);
+	});
+	report.print(std::cout);
+	------------------------------------------------------------------------
+	*/
+	class TurntableRenderer
+	{
+	public:
+
+		struct Settings {
+			int numFrames;
+			int width;
+			int height;
+			int samples;        /// multisampling of the framebuffer
+			double elevation;   /// the manipulator's up angle, in radians
+			double distance;
+			double startAngle;  /// around angle of the first frame, in radians
+			glm::vec3 center;
+			float fieldOfView;  /// vertical, in degrees
+			float nearPlane;
+			float farPlane;
+			std::string directory;
+			std::string prefix;
+			FrameCapture::Format format;
+			int maxFramesInFlight;
+
+			Settings();
+		};
+
+		struct Report {
+			int numFrames;
+			double totalSeconds;
+			double framesPerSecond;
+			double drawSeconds;     /// issuing the draw calls, on this thread
+			double readbackSeconds; /// see FrameCapture::Stats, these three are summed over all frames
+			double encodeSeconds;
+			double stallSeconds;
+
+			void print(std::ostream &out) const;
+		};
+
+		// view, projection and eye position (world space) of the frame to draw, the framebuffer is bound and cleared
+		typedef std::function<void(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eyePosition)> DrawFunction;
+
+		TurntableRenderer(const Settings &settings);
+		virtual ~TurntableRenderer();
+
+		/*!
+		 * Renders all frames and returns once the last one has been written. Needs a current GL context.
+		 */
+		Report render(DrawFunction draw);
+
+		/*!
+		 * Renders only the frames [firstFrame, firstFrame + count) of the orbit, for splitting a turntable across
+		 * processes. The files keep their numbers in the whole sequence.
+		 */
+		Report render(DrawFunction draw, int firstFrame, int count);
+
+		// Camera of a frame, for previewing the path
+		glm::mat4 getView(int frame) const;
+		glm::vec3 getEyePosition(int frame) const;
+		glm::mat4 getProjection() const;
+
+	private:
+		TurntableRenderer(const TurntableRenderer&) {}; // prevent copying
+
+		Settings _settings;
+
+		TurntableManipulator getCamera(int frame) const;
+		static void waitForTextures();
+	};
+
+}
+
+#endif /* TurntableRenderer_h */
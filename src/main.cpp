@@ -7,18 +7,235 @@
 //
 
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <vector>
+#include <iostream>
+#include <string>
 
 #include "App.h"
+#include "HttpSocket.h"
+#include "ThreadPool.h"
 
 using namespace basicgraphics;
 
+// Stand-in for a client of --serve: sends numRequests copies of GET path at once, writes the last response
+// body to outputFile and prints the latencies the client saw
+static int runClient(const std::string &address, const std::string &path, const std::string &outputFile, int numRequests, int timeoutMilliseconds)
+{
+	typedef std::chrono::steady_clock Clock;
+	std::vector<std::future<double>> latencies;
+	std::vector<unsigned char> body;
+	std::mutex bodyMutex;
+	std::atomic<int> numFailed(0);
+
+	const Clock::time_point start = Clock::now();
+	for (int i = 0; i < numRequests; i++) {
+		latencies.push_back(ThreadPool::getShared().enqueue([&]() {
+			const Clock::time_point sent = Clock::now();
+			int status = 0;
+			std::vector<unsigned char> response;
+			std::string error;
+			if (!HttpSocket::get(address, path, status, response, error, timeoutMilliseconds) || status != 200) {
+				if (error.empty()) {
+					error = std::string(response.begin(), response.end());
+				}
+				std::cerr << "Request failed (" << status << "): " << error << std::endl;
+				numFailed++;
+			}
+			else {
+				std::lock_guard<std::mutex> lock(bodyMutex);
+				body.swap(response);
+			}
+			return std::chrono::duration<double, std::milli>(Clock::now() - sent).count();
+		}));
+	}
+
+	std::vector<double> milliseconds;
+	for (size_t i = 0; i < latencies.size(); i++) {
+		milliseconds.push_back(latencies[i].get());
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::sort(milliseconds.begin(), milliseconds.end());
+
+	std::cout << numRequests << " requests, " << numFailed << " failed, " << numRequests / seconds << " requests/s, latency p50 "
+		<< milliseconds[milliseconds.size() / 2] << " ms, max " << milliseconds.back() << " ms" << std::endl;
+
+	if (!body.empty() && !outputFile.empty()) {
+		FILE* file = fopen(outputFile.c_str(), "wb");
+		if (file != NULL) {
+			fwrite(&body[0], 1, body.size(), file);
+			fclose(file);
+		}
+	}
+	return numFailed > 0 ? 1 : 0;
+}
+
 int main(int argc, char** argv)
 {
+	// --turntable N renders N frames around the bunny to --output instead of running interactively,
+	// usually together with --headless and --size
+	int turntableFrames = 0;
+	TurntableRenderer::Settings turntable;
+	// --poster FILE renders one --poster-size WxH image in tiles of --tile pixels
+	std::string posterFile;
+	PosterRenderer::Settings poster;
+	// --serve ADDRESS answers render requests, --client ADDRESS PATH sends --client-requests N of them and saves one to --output,
+	// giving up on a request that stalls for --client-timeout SECONDS
+	std::string serveAddress;
+	std::string clientAddress;
+	std::string clientPath;
+	std::string clientOutput;
+	int clientRequests = 1;
+	int clientTimeoutMilliseconds = HttpSocket::DEFAULT_TIMEOUT_MILLISECONDS;
+	// --farm N renders the --turntable frames with N worker processes, which are started with --farm-worker
+	int farmWorkers = 0;
+	int farmCommandFd = -1;
+	int farmResultFd = -1;
+	std::vector<std::string> workerArguments;
+	// --software FILE renders --frames N frames at --size WxH on the CPU and saves the last one, without a GL context.
+	// --compare-gl then times the same frames through the GL path on a headless context
+	std::string softwareFile;
+	int softwareWidth = 1024;
+	int softwareHeight = 768;
+	int softwareFrames = 10;
+	// --path-trace SAMPLES renders a reference image at --size on the CPU, saving it to --output as it converges
+	int pathTraceSamples = 0;
+	std::string pathTraceDirectory = "pathtrace";
+	for (int i = 1; i < argc - 1; i++) {
+		std::string arg = argv[i];
+		if (arg == "--turntable") {
+			turntableFrames = atoi(argv[++i]);
+		}
+		else if (arg == "--output") {
+			turntable.directory = argv[++i];
+			clientOutput = argv[i];
+			pathTraceDirectory = argv[i];
+		}
+		else if (arg == "--elevation") {
+			turntable.elevation = atof(argv[++i]);
+		}
+		else if (arg == "--distance") {
+			turntable.distance = atof(argv[++i]);
+		}
+		else if (arg == "--poster") {
+			posterFile = argv[++i];
+		}
+		else if (arg == "--poster-size") {
+			int width, height;
+			if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+				poster.width = width;
+				poster.height = height;
+			}
+			else {
+				std::cerr << "Ignoring --poster-size " << argv[i] << ", expected WIDTHxHEIGHT" << std::endl;
+			}
+		}
+		else if (arg == "--tile") {
+			poster.tileSize = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--serve") {
+			serveAddress = argv[++i];
+		}
+		else if (arg == "--client" && i + 2 < argc) {
+			clientAddress = argv[++i];
+			clientPath = argv[++i];
+		}
+		else if (arg == "--client-requests") {
+			clientRequests = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--client-timeout") {
+			clientTimeoutMilliseconds = std::max((int)(atof(argv[++i]) * 1000.0), 1);
+		}
+		else if (arg == "--farm") {
+			farmWorkers = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--software") {
+			softwareFile = argv[++i];
+		}
+		else if (arg == "--path-trace") {
+			pathTraceSamples = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--size") {
+			// Also read by BaseApp for the GL paths
+			sscanf(argv[++i], "%dx%d", &softwareWidth, &softwareHeight);
+		}
+		else if (arg == "--frames") {
+			softwareFrames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--farm-worker" && i + 2 < argc) {
+			farmCommandFd = atoi(argv[++i]);
+			farmResultFd = atoi(argv[++i]);
+		}
+	}
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--farm") {
+			i++;
+		}
+		else {
+			workerArguments.push_back(argv[i]);
+		}
+	}
+
+	const bool softwareCompare = std::find(argv + 1, argv + argc, std::string("--compare-gl")) != argv + argc;
+
+	// The client doesn't need a GL context
+	if (!clientAddress.empty()) {
+		return runClient(clientAddress, clientPath, clientOutput, clientRequests, clientTimeoutMilliseconds);
+	}
+
+	if (!softwareFile.empty()) {
+		return App::renderSoftware(softwareFile, std::max(softwareWidth, 1), std::max(softwareHeight, 1), softwareFrames, softwareCompare);
+	}
+	if (pathTraceSamples > 0) {
+		return App::renderPathTraced(pathTraceDirectory, std::max(softwareWidth, 1), std::max(softwareHeight, 1), pathTraceSamples);
+	}
+
+	// The coordinator only launches the workers, they render
+	if (farmWorkers > 0) {
+		RenderFarm::Settings farm;
+		farm.executable = argv[0];
+		farm.arguments = workerArguments;
+		farm.arguments.push_back("--headless");
+		farm.numWorkers = farmWorkers;
+		farm.numFrames = std::max(turntableFrames, 1);
+		farm.directory = turntable.directory;
+		farm.prefix = turntable.prefix;
+		farm.format = turntable.format;
+		RenderFarm::Report report = RenderFarm(farm).run();
+		report.print(std::cout);
+		return report.numMissing == 0 ? 0 : 1;
+	}
 
 	App *app = new App(argc, argv, "Physically Based Shaders", 1024, 768);
-	app->run();
+	int result = 0;
+	if (farmCommandFd >= 0) {
+		turntable.numFrames = std::max(turntableFrames, 1);
+		result = app->serveFarmWorker(farmCommandFd, farmResultFd, turntable);
+	}
+	else if (!serveAddress.empty()) {
+		result = app->serve(serveAddress) ? 0 : 1;
+	}
+	else if (!posterFile.empty()) {
+		result = app->renderPoster(posterFile, poster) ? 0 : 1;
+	}
+	else if (turntableFrames > 0) {
+		turntable.numFrames = turntableFrames;
+		app->renderTurntable(turntable).print(std::cout);
+	}
+	else {
+		app->run();
+		// With --track-allocations a steady state frame that allocated fails the run
+		if (AllocationTracker::getInstance().getNumAllocatingFrames() > 0) {
+			result = 1;
+		}
+	}
 	delete app;
 
-	return 0;
+	return result;
 
 }